@@ -0,0 +1,198 @@
+//
+//  BT709AlphaTests.m
+//
+//  Test premultiply and unpremultiply logic in bt709_alpha.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "sRGB.h"
+#import "BT709.h"
+
+#import "bt709_alpha.h"
+
+@interface BT709AlphaTests : XCTestCase
+
+@end
+
+@implementation BT709AlphaTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// One BGRA pixel for every (C, A) pair, plus a few more so that
+// the row length is not a multiple of the SIMD block size.
+
+static
+uint8_t* make_alpha_test_row(int numPixels) {
+  uint8_t *pixels = malloc(numPixels * 4);
+  for (int i = 0; i < numPixels; i++) {
+    int C = i & 0xFF;
+    pixels[(i * 4)] = (uint8_t) C;
+    pixels[(i * 4) + 1] = (uint8_t) (255 - C);
+    pixels[(i * 4) + 2] = (uint8_t) (C / 2);
+    pixels[(i * 4) + 3] = (uint8_t) ((i >> 8) & 0xFF);
+  }
+  return pixels;
+}
+
+- (void)testPremultiplyUnpremultiply_Exact {
+  const int numPixels = (256 * 256) + 3;
+
+  BT709AlphaTables *tables = malloc(sizeof(BT709AlphaTables));
+  bt709_alpha_tables_init(tables, BT709GammaSrgb);
+
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  uint8_t *in = make_alpha_test_row(numPixels);
+  uint8_t *pre = malloc(numPixels * 4);
+  uint8_t *unpre = malloc(numPixels * 4);
+
+  bt709_alpha_premultiply_row(&layout, pre, in, numPixels);
+  bt709_alpha_unpremultiply_row(tables, &layout, unpre, in, numPixels);
+
+  int numPreWrong = 0;
+  int numUnpreWrong = 0;
+
+  for (int i = 0; i < numPixels; i++) {
+    const int A = in[(i * 4) + 3];
+
+    for (int c = 0; c < 3; c++) {
+      const int C = in[(i * 4) + c];
+
+      int expectedPre = (int) floor((C * A / 255.0) + 0.5);
+
+      int expectedUnpre = (A == 0) ? 0 : (((C * 255) + (A / 2)) / A);
+      if (expectedUnpre > 255) {
+        expectedUnpre = 255;
+      }
+
+      numPreWrong += (pre[(i * 4) + c] != expectedPre);
+      numUnpreWrong += (unpre[(i * 4) + c] != expectedUnpre);
+    }
+
+    XCTAssert(pre[(i * 4) + 3] == A);
+    XCTAssert(unpre[(i * 4) + 3] == A);
+  }
+
+  XCTAssert(numPreWrong == 0, @"%d premultiplied values are wrong", numPreWrong);
+  XCTAssert(numUnpreWrong == 0, @"%d unpremultiplied values are wrong", numUnpreWrong);
+
+  // In place results are the same
+
+  bt709_alpha_premultiply_row(&layout, in, in, numPixels);
+  XCTAssert(memcmp(in, pre, numPixels * 4) == 0);
+
+  free(in);
+  in = make_alpha_test_row(numPixels);
+
+  bt709_alpha_unpremultiply_row(tables, &layout, in, in, numPixels);
+  XCTAssert(memcmp(in, unpre, numPixels * 4) == 0);
+
+  free(in);
+  free(pre);
+  free(unpre);
+  free(tables);
+}
+
+// Linear light premultiply must match decoding, scaling, and
+// encoding with the sRGB curve evaluated directly.
+
+- (void)testPremultiplyLinear_MatchesDirect {
+  const int numPixels = (256 * 256) + 3;
+
+  BT709AlphaTables *tables = malloc(sizeof(BT709AlphaTables));
+  bt709_alpha_tables_init(tables, BT709GammaSrgb);
+
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  uint8_t *in = make_alpha_test_row(numPixels);
+  uint8_t *pre = malloc(numPixels * 4);
+
+  bt709_alpha_premultiply_linear_row(tables, &layout, pre, in, numPixels);
+
+  int numWrong = 0;
+
+  for (int i = 0; i < numPixels; i++) {
+    const int A = in[(i * 4) + 3];
+
+    for (int c = 0; c < 3; c++) {
+      float Cn = sRGB_nonLinearNormToLinear(in[(i * 4) + c] / 255.0f) * (A / 255.0f);
+      int expected = (int) round(sRGB_linearNormToNonLinear(Cn) * 255.0f);
+      numWrong += (pre[(i * 4) + c] != expected);
+    }
+  }
+
+  XCTAssert(numWrong == 0, @"%d premultiplied values are wrong", numWrong);
+
+  // Unpremultiply restores opaque enough pixels to within 1
+
+  bt709_alpha_unpremultiply_linear_row(tables, &layout, pre, pre, numPixels);
+
+  for (int i = 0; i < numPixels; i++) {
+    if (in[(i * 4) + 3] < 128) {
+      continue;
+    }
+    for (int c = 0; c < 3; c++) {
+      XCTAssert(abs(pre[(i * 4) + c] - in[(i * 4) + c]) <= 1, @"pixel %d component %d", i, c);
+    }
+  }
+
+  free(in);
+  free(pre);
+  free(tables);
+}
+
+// The fused encode must produce the same planes as a premultiply
+// pass over the whole frame followed by a plain encode.
+
+- (void)testEncodePremultiplied_MatchesTwoPass {
+  const int width = 10;
+  const int height = 4;
+
+  BT709AlphaTables *tables = malloc(sizeof(BT709AlphaTables));
+  bt709_alpha_tables_init(tables, BT709GammaSrgb);
+
+  BT709FrameTables *frameTables = malloc(sizeof(BT709FrameTables));
+  bt709_frame_tables_init(frameTables, BT709GammaSrgb, BT709GammaApple);
+
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  uint8_t pixels[width * height * 4];
+  uint8_t premultiplied[width * height * 4];
+  uint8_t scratch[2 * width * 4];
+
+  for (int i = 0; i < (width * height * 4); i++) {
+    pixels[i] = (uint8_t) ((i * 29) + 5);
+  }
+
+  const BT709AlphaOp ops[] = { BT709AlphaPremultiply, BT709AlphaPremultiplyLinear };
+
+  for (int o = 0; o < 2; o++) {
+    uint8_t Y1[width * height], Cb1[(width / 2) * (height / 2)], Cr1[(width / 2) * (height / 2)];
+    uint8_t Y2[width * height], Cb2[(width / 2) * (height / 2)], Cr2[(width / 2) * (height / 2)];
+
+    BT709PlanesStruct planes1 = { Y1, width, Cb1, width / 2, Cr1, width / 2 };
+    BT709PlanesStruct planes2 = { Y2, width, Cb2, width / 2, Cr2, width / 2 };
+
+    bt709_alpha_frame(tables, ops[o], &layout, premultiplied, width * 4, pixels, width * 4, width, height);
+    bt709_frame_encode(frameTables, &layout, premultiplied, width * 4, width, height, &planes1);
+
+    int result = bt709_alpha_encode_premultiplied(frameTables, tables, ops[o], &layout, pixels, width * 4, width, height, &planes2, scratch);
+    XCTAssert(result == 0);
+
+    XCTAssert(memcmp(Y1, Y2, sizeof(Y1)) == 0, @"op %d", o);
+    XCTAssert(memcmp(Cb1, Cb2, sizeof(Cb1)) == 0, @"op %d", o);
+    XCTAssert(memcmp(Cr1, Cr2, sizeof(Cr1)) == 0, @"op %d", o);
+  }
+
+  free(frameTables);
+  free(tables);
+}
+
+@end
@@ -0,0 +1,168 @@
+//
+//  BT709ArchiveTests.m
+//
+//  Test indexed frame archive logic in bt709_archive.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "bt709_archive.h"
+
+@interface BT709ArchiveTests : XCTestCase
+
+@end
+
+@implementation BT709ArchiveTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// Frames written from I420 planes read back as aligned NV12 planes
+// that hold the same values, and any frame can be looked up directly.
+
+- (void)testRoundTrip_AlignedPlanes {
+  const int width = 70;
+  const int height = 10;
+  const int numFrames = 3;
+  const int uvLen = (width / 2) * (height / 2);
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"frames.bfa"];
+
+  uint8_t *Y = malloc(width * height);
+  uint8_t *Cb = malloc(uvLen);
+  uint8_t *Cr = malloc(uvLen);
+
+  BT709PlanesStruct planes = { Y, width, Cb, width / 2, Cr, width / 2 };
+
+  BT709ArchiveWriter writer;
+  XCTAssert(bt709_archive_writer_open(&writer, [path UTF8String], width, height, 30000, 1001) == 0);
+
+  for (int frameIndex = 0; frameIndex < numFrames; frameIndex++) {
+    for (int i = 0; i < (width * height); i++) {
+      Y[i] = (uint8_t) (i + frameIndex);
+    }
+    for (int i = 0; i < uvLen; i++) {
+      Cb[i] = (uint8_t) (i * 3 + frameIndex);
+      Cr[i] = (uint8_t) (255 - i - frameIndex);
+    }
+    XCTAssert(bt709_archive_writer_add_planes(&writer, &planes) == 0);
+  }
+
+  XCTAssert(bt709_archive_writer_close(&writer) == 0);
+
+  BT709ArchiveReader reader;
+  XCTAssert(bt709_archive_reader_open(&reader, [path UTF8String]) == 0);
+  XCTAssert(reader.header.numFrames == numFrames);
+  XCTAssert(reader.header.width == width && reader.header.height == height);
+  XCTAssert(reader.header.fpsNum == 30000 && reader.header.fpsDen == 1001);
+
+  // Read frames out of order
+
+  const int order[] = { 2, 0, 1 };
+
+  for (int oi = 0; oi < numFrames; oi++) {
+    const int frameIndex = order[oi];
+
+    BT709ArchiveFrame frame;
+    XCTAssert(bt709_archive_reader_frame(&reader, frameIndex, &frame) == 0);
+    XCTAssert(bt709_archive_reader_verify(&reader, frameIndex) == 0);
+
+    XCTAssert(((frame.yPtr - reader.mapPtr) % BT709_ARCHIVE_ALIGN) == 0);
+    XCTAssert(((frame.cbcrPtr - reader.mapPtr) % BT709_ARCHIVE_ALIGN) == 0);
+    XCTAssert(((uintptr_t) frame.yPtr % getpagesize()) == 0);
+    XCTAssert(((uintptr_t) frame.cbcrPtr % getpagesize()) == 0);
+    XCTAssert(frame.yBytesPerRow == 128 && frame.cbcrBytesPerRow == 128);
+
+    for (int row = 0; row < height; row++) {
+      for (int col = 0; col < width; col++) {
+        XCTAssert(frame.yPtr[(row * frame.yBytesPerRow) + col] == (uint8_t) ((row * width) + col + frameIndex));
+      }
+    }
+
+    for (int row = 0; row < (height / 2); row++) {
+      for (int col = 0; col < (width / 2); col++) {
+        const int i = (row * (width / 2)) + col;
+        XCTAssert(frame.cbcrPtr[(row * frame.cbcrBytesPerRow) + (col * 2)] == (uint8_t) (i * 3 + frameIndex));
+        XCTAssert(frame.cbcrPtr[(row * frame.cbcrBytesPerRow) + (col * 2) + 1] == (uint8_t) (255 - i - frameIndex));
+      }
+    }
+  }
+
+  BT709ArchiveFrame frame;
+  XCTAssert(bt709_archive_reader_frame(&reader, numFrames, &frame) == 1);
+  XCTAssert(bt709_archive_reader_frame(&reader, -1, &frame) == 1);
+
+  bt709_archive_reader_close(&reader);
+
+  free(Y);
+  free(Cb);
+  free(Cr);
+}
+
+// A changed byte in a frame is caught by the checksum, and files
+// with a bad header or a truncated index are not opened.
+
+- (void)testCorrupt_Detected {
+  const int width = 16;
+  const int height = 4;
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"corrupt.bfa"];
+  const char *cPath = [path UTF8String];
+
+  uint8_t Y[width * height];
+  uint8_t CbCr[width * (height / 2)];
+  memset(Y, 100, sizeof(Y));
+  memset(CbCr, 128, sizeof(CbCr));
+
+  BT709ArchiveWriter writer;
+  XCTAssert(bt709_archive_writer_open(&writer, cPath, width - 1, height, 30, 1) == 1);
+  XCTAssert(bt709_archive_writer_open(&writer, cPath, width, height, 30, 1) == 0);
+  XCTAssert(bt709_archive_writer_add_nv12(&writer, Y, width, CbCr, width) == 0);
+  XCTAssert(bt709_archive_writer_add_nv12(&writer, Y, width, CbCr, width) == 0);
+  XCTAssert(bt709_archive_writer_close(&writer) == 0);
+
+  BT709ArchiveReader reader;
+  XCTAssert(bt709_archive_reader_open(&reader, cPath) == 0);
+  const uint64_t cbcrOffset = reader.index[1].offset + reader.header.cbcrOffset;
+  const uint64_t indexOffset = reader.header.indexOffset;
+  bt709_archive_reader_close(&reader);
+
+  // Change one Cr value in the second frame
+
+  FILE *fp = fopen(cPath, "r+b");
+  fseeko(fp, cbcrOffset + 7, SEEK_SET);
+  fputc(129, fp);
+  fclose(fp);
+
+  XCTAssert(bt709_archive_reader_open(&reader, cPath) == 0);
+  XCTAssert(bt709_archive_reader_verify(&reader, 0) == 0);
+  XCTAssert(bt709_archive_reader_verify(&reader, 1) == 2);
+  bt709_archive_reader_close(&reader);
+
+  // Cut off part of the index
+
+  XCTAssert(truncate(cPath, indexOffset + sizeof(BT709ArchiveIndexEntry)) == 0);
+  XCTAssert(bt709_archive_reader_open(&reader, cPath) == 2);
+
+  // Change the frame count in the header
+
+  XCTAssert(bt709_archive_writer_open(&writer, cPath, width, height, 30, 1) == 0);
+  XCTAssert(bt709_archive_writer_add_nv12(&writer, Y, width, CbCr, width) == 0);
+  XCTAssert(bt709_archive_writer_close(&writer) == 0);
+
+  fp = fopen(cPath, "r+b");
+  fseeko(fp, offsetof(BT709ArchiveHeader, numFrames), SEEK_SET);
+  fputc(2, fp);
+  fclose(fp);
+
+  XCTAssert(bt709_archive_reader_open(&reader, cPath) == 2);
+
+  XCTAssert(bt709_archive_reader_open(&reader, "/does/not/exist.bfa") == 1);
+}
+
+@end
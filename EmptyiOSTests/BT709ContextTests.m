@@ -0,0 +1,150 @@
+//
+//  BT709ContextTests.m
+//
+//  Test reusable converter logic in bt709_context.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "bt709_context.h"
+
+@interface BT709ContextTests : XCTestCase
+
+@end
+
+@implementation BT709ContextTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// Every thread count must produce the same planes as a single
+// threaded bt709_frame_encode(), for more than one frame.
+
+- (void)testEncode_MatchesFrameEncode {
+  const int width = 12;
+  const int height = 14;
+  const int frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  BT709FrameTables *tables = malloc(sizeof(BT709FrameTables));
+  bt709_frame_tables_init(tables, BT709GammaSrgb, BT709GammaApple);
+
+  uint8_t *pixels = malloc(width * height * 4 * 2);
+  for (int i = 0; i < (width * height * 4 * 2); i++) {
+    pixels[i] = (uint8_t) ((i * 31) + (i / 7));
+  }
+
+  uint8_t expected[2][frameLen];
+
+  for (int f = 0; f < 2; f++) {
+    BT709PlanesStruct planes = { expected[f], width, expected[f] + (width * height), width / 2, expected[f] + (width * height) + ((width / 2) * (height / 2)), width / 2 };
+    bt709_frame_encode(tables, &layout, pixels + (f * width * height * 4), width * 4, width, height, &planes);
+  }
+
+  const int threadCounts[] = { 1, 2, 3, 7, 100 };
+
+  for (int t = 0; t < (sizeof(threadCounts) / sizeof(threadCounts[0])); t++) {
+    BT709Context *context = malloc(sizeof(BT709Context));
+    XCTAssert(bt709_context_init(context, BT709GammaSrgb, BT709GammaApple, &layout, width, height, threadCounts[t], 2) == 0);
+    XCTAssert(context->numThreads <= (height / 2));
+
+    BT709PlanesStruct planes[3];
+
+    for (int f = 0; f < 3; f++) {
+      XCTAssert(bt709_context_convert(context, pixels + ((f % 2) * width * height * 4), width * 4, &planes[f]) == 0);
+      XCTAssert(memcmp(planes[f].yPtr, expected[f % 2], frameLen) == 0, @"threads %d frame %d", threadCounts[t], f);
+    }
+
+    // Output frames are reused in order
+
+    XCTAssert(planes[0].yPtr != planes[1].yPtr);
+    XCTAssert(planes[0].yPtr == planes[2].yPtr);
+
+    bt709_context_destroy(context);
+    free(context);
+  }
+
+  free(pixels);
+  free(tables);
+}
+
+// A layout change between frames, as in a stream that mixes PPM and
+// PAM frames, converts the following frames with the new layout.
+
+- (void)testEncode_LayoutChange {
+  const int width = 8;
+  const int height = 6;
+  const int frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+
+  BT709PixelLayout rgbLayout = bt709_pixel_layout_rgb();
+  BT709PixelLayout rgbaLayout = bt709_pixel_layout_rgba();
+
+  BT709FrameTables *tables = malloc(sizeof(BT709FrameTables));
+  bt709_frame_tables_init(tables, BT709GammaSrgb, BT709GammaApple);
+
+  uint8_t *pixels = malloc(width * height * 4);
+  for (int i = 0; i < (width * height * 4); i++) {
+    pixels[i] = (uint8_t) ((i * 37) + (i / 5));
+  }
+
+  uint8_t expected[2][frameLen];
+  const BT709PixelLayout *layouts[2] = { &rgbLayout, &rgbaLayout };
+
+  for (int f = 0; f < 2; f++) {
+    const int bytesPerRow = width * layouts[f]->bytesPerPixel;
+    BT709PlanesStruct planes = { expected[f], width, expected[f] + (width * height), width / 2, expected[f] + (width * height) + ((width / 2) * (height / 2)), width / 2 };
+    bt709_frame_encode(tables, layouts[f], pixels, bytesPerRow, width, height, &planes);
+  }
+
+  BT709Context *context = malloc(sizeof(BT709Context));
+  XCTAssert(bt709_context_init(context, BT709GammaSrgb, BT709GammaApple, &rgbLayout, width, height, 3, 1) == 0);
+
+  for (int f = 0; f < 4; f++) {
+    const BT709PixelLayout *layout = layouts[f % 2];
+    bt709_context_set_layout(context, layout);
+
+    BT709PlanesStruct planes;
+    XCTAssert(bt709_context_convert(context, pixels, width * layout->bytesPerPixel, &planes) == 0);
+    XCTAssert(memcmp(planes.yPtr, expected[f % 2], frameLen) == 0, @"frame %d", f);
+  }
+
+  bt709_context_destroy(context);
+  free(context);
+  free(pixels);
+  free(tables);
+}
+
+- (void)testInit_Invalid {
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+  BT709Context *context = malloc(sizeof(BT709Context));
+
+  XCTAssert(bt709_context_init(context, BT709GammaSrgb, BT709GammaApple, &layout, 3, 2, 1, 0) == 1);
+  XCTAssert(bt709_context_init(context, BT709GammaSrgb, BT709GammaApple, &layout, 2, 0, 1, 0) == 1);
+  XCTAssert(bt709_context_init(context, BT709GammaSrgb, BT709GammaApple, &layout, 2, 2, 1, BT709_CONTEXT_MAX_BUFFERS + 1) == 1);
+
+  // Without output frames only caller owned planes can be used
+
+  XCTAssert(bt709_context_init(context, BT709GammaSrgb, BT709GammaApple, &layout, 2, 2, 4, 0) == 0);
+
+  uint8_t pixels[2 * 2 * 3];
+  memset(pixels, 0xFF, sizeof(pixels));
+
+  BT709PlanesStruct planes;
+  XCTAssert(bt709_context_convert(context, pixels, 2 * 3, &planes) == 1);
+
+  uint8_t Y[4], Cb[1], Cr[1];
+  BT709PlanesStruct outPlanes = { Y, 2, Cb, 1, Cr, 1 };
+  XCTAssert(bt709_context_encode(context, pixels, 2 * 3, &outPlanes) == 0);
+  XCTAssert(Y[0] == 235 && Y[3] == 235 && Cb[0] == 128 && Cr[0] == 128);
+
+  bt709_context_destroy(context);
+  free(context);
+}
+
+@end
@@ -0,0 +1,221 @@
+//
+//  BT709CubeLUTTests.m
+//
+//  Test .cube parsing and tetrahedral interpolation in bt709_cube_lut.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "sRGB.h"
+#import "BT709.h"
+
+#import "bt709_cube_lut.h"
+
+@interface BT709CubeLUTTests : XCTestCase
+
+@end
+
+@implementation BT709CubeLUTTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// Write a LUT of size N that maps (R G B) to (B G R) when swap
+// is TRUE and is an identity otherwise.
+
+- (NSString*) writeCube:(int)N swap:(BOOL)swap {
+  NSMutableString *mStr = [NSMutableString string];
+
+  [mStr appendString:@"# generated\nTITLE \"test\"\n"];
+  [mStr appendFormat:@"LUT_3D_SIZE %d\n", N];
+  [mStr appendString:@"DOMAIN_MIN 0.0 0.0 0.0\nDOMAIN_MAX 1.0 1.0 1.0\n"];
+
+  for (int b = 0; b < N; b++) {
+    for (int g = 0; g < N; g++) {
+      for (int r = 0; r < N; r++) {
+        float Rn = r / (float) (N - 1);
+        float Gn = g / (float) (N - 1);
+        float Bn = b / (float) (N - 1);
+        if (swap) {
+          [mStr appendFormat:@"%.6f %.6f %.6f\n", Bn, Gn, Rn];
+        } else {
+          [mStr appendFormat:@"%.6f %.6f %.6f\n", Rn, Gn, Bn];
+        }
+      }
+    }
+  }
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"test.cube"];
+  BOOL worked = [mStr writeToFile:path atomically:TRUE encoding:NSUTF8StringEncoding error:nil];
+  XCTAssert(worked);
+  return path;
+}
+
+- (void)testCubeLUT_LoadErrors {
+  BT709CubeLUT lut;
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"short.cube"];
+  [@"LUT_3D_SIZE 2\n0 0 0\n1 0 0\n" writeToFile:path atomically:TRUE encoding:NSUTF8StringEncoding error:nil];
+
+  int result = bt709_cube_lut_load(&lut, [path UTF8String]);
+  XCTAssert(result == 2);
+
+  result = bt709_cube_lut_load(&lut, "/does/not/exist.cube");
+  XCTAssert(result == 1);
+}
+
+// Identity and channel swap LUTs are linear, so interpolation must
+// reproduce the plain conversion of the same or swapped pixels.
+
+- (void)testCubeLUT_EncodeMatchesPlain {
+  const int width = 32;
+  const int height = 16;
+
+  uint8_t pixels[width*height*3];
+  uint8_t swapped[width*height*3];
+
+  srand(709);
+
+  for (int i = 0; i < (width*height*3); i += 3) {
+    pixels[i+0] = rand() % 256;
+    pixels[i+1] = rand() % 256;
+    pixels[i+2] = rand() % 256;
+    swapped[i+0] = pixels[i+2];
+    swapped[i+1] = pixels[i+1];
+    swapped[i+2] = pixels[i+0];
+  }
+
+  uint8_t Y1[width*height], Cb1[(width/2)*(height/2)], Cr1[(width/2)*(height/2)];
+  uint8_t Y2[width*height], Cb2[(width/2)*(height/2)], Cr2[(width/2)*(height/2)];
+
+  BT709PlanesStruct planes1 = { Y1, width, Cb1, width/2, Cr1, width/2 };
+  BT709PlanesStruct planes2 = { Y2, width, Cb2, width/2, Cr2, width/2 };
+
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  BT709FrameTables tables;
+  bt709_frame_tables_init(&tables, BT709GammaSrgb, BT709GammaApple);
+
+  const int sizes[3] = { 17, 33, 65 };
+
+  for (int si = 0; si < 3; si++) {
+    for (int swap = 0; swap < 2; swap++) {
+      NSString *path = [self writeCube:sizes[si] swap:swap];
+
+      BT709CubeLUT lut;
+      int result = bt709_cube_lut_load(&lut, [path UTF8String]);
+      XCTAssert(result == 0);
+      XCTAssert(lut.size == sizes[si]);
+
+      result = bt709_cube_lut_encode(&lut, &tables, NULL, &layout, pixels, width*3, width, height, &planes1, 3);
+      XCTAssert(result == 0);
+
+      bt709_frame_encode(&tables, &layout, swap ? swapped : pixels, width*3, width, height, &planes2);
+
+      XCTAssert(memcmp(Y1, Y2, sizeof(Y1)) == 0, @"size %d swap %d", sizes[si], swap);
+      XCTAssert(memcmp(Cb1, Cb2, sizeof(Cb1)) == 0, @"size %d swap %d", sizes[si], swap);
+      XCTAssert(memcmp(Cr1, Cr2, sizeof(Cr1)) == 0, @"size %d swap %d", sizes[si], swap);
+
+      bt709_cube_lut_free(&lut);
+    }
+  }
+}
+
+// An output that lands exactly on a half rounds up with SSE2 and
+// NEON just like the scalar path.
+
+- (void)testCubeLUT_RoundsHalfUp {
+  BT709CubeLUT lut;
+  lut.size = 2;
+  lut.table = (float *) malloc(2 * 2 * 2 * 4 * sizeof(float));
+  for (int c = 0; c < 3; c++) {
+    lut.domainMin[c] = 0.0f;
+    lut.domainMax[c] = 1.0f;
+  }
+
+  // 2.5 4.5 6.5 once scaled by 255, half to even would give 2 4 6
+
+  for (int i = 0; i < (2 * 2 * 2); i++) {
+    lut.table[(i * 4) + 0] = 2.5f / 255.0f;
+    lut.table[(i * 4) + 1] = 4.5f / 255.0f;
+    lut.table[(i * 4) + 2] = 6.5f / 255.0f;
+    lut.table[(i * 4) + 3] = 0.0f;
+  }
+
+  bt709_cube_lut_init_index(&lut);
+
+  uint8_t out[3];
+  bt709_cube_lut_apply_pixel(&lut, 0, 0, 0, out);
+
+  XCTAssert(out[0] == 3, @"%d != %d", out[0], 3);
+  XCTAssert(out[1] == 5, @"%d != %d", out[1], 5);
+  XCTAssert(out[2] == 7, @"%d != %d", out[2], 7);
+
+  bt709_cube_lut_free(&lut);
+}
+
+// One pool converts frames of different sizes, including a frame
+// with fewer pairs of rows than threads, and matches the single
+// threaded encode.
+
+- (void)testCubeLUT_PoolMatchesEncode {
+  const int sizes[3][2] = { { 32, 16 }, { 8, 2 }, { 64, 34 } };
+
+  uint8_t pixels[64*34*3];
+  uint8_t Y1[64*34], Cb1[32*17], Cr1[32*17];
+  uint8_t Y2[64*34], Cb2[32*17], Cr2[32*17];
+
+  srand(33);
+
+  for (int i = 0; i < (int) sizeof(pixels); i++) {
+    pixels[i] = rand() % 256;
+  }
+
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  BT709FrameTables tables;
+  bt709_frame_tables_init(&tables, BT709GammaSrgb, BT709GammaApple);
+
+  NSString *path = [self writeCube:17 swap:TRUE];
+
+  BT709CubeLUT lut;
+  int result = bt709_cube_lut_load(&lut, [path UTF8String]);
+  XCTAssert(result == 0);
+
+  BT709CubeLUTPool *pool = (BT709CubeLUTPool *) malloc(sizeof(BT709CubeLUTPool));
+  bt709_cube_lut_pool_init(pool, 4);
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int si = 0; si < 3; si++) {
+      const int width = sizes[si][0];
+      const int height = sizes[si][1];
+
+      BT709PlanesStruct planes1 = { Y1, width, Cb1, width/2, Cr1, width/2 };
+      BT709PlanesStruct planes2 = { Y2, width, Cb2, width/2, Cr2, width/2 };
+
+      memset(Y2, 0, sizeof(Y2));
+
+      result = bt709_cube_lut_encode(&lut, &tables, NULL, &layout, pixels, width*3, width, height, &planes1, 1);
+      XCTAssert(result == 0);
+      result = bt709_cube_lut_pool_encode(pool, &lut, &tables, NULL, &layout, pixels, width*3, width, height, &planes2);
+      XCTAssert(result == 0);
+
+      XCTAssert(memcmp(Y1, Y2, width * height) == 0, @"%d x %d", width, height);
+      XCTAssert(memcmp(Cb1, Cb2, (width/2) * (height/2)) == 0, @"%d x %d", width, height);
+      XCTAssert(memcmp(Cr1, Cr2, (width/2) * (height/2)) == 0, @"%d x %d", width, height);
+    }
+  }
+
+  XCTAssert(bt709_cube_lut_pool_encode(pool, &lut, &tables, NULL, &layout, pixels, 9, 3, 2, NULL) == 1);
+
+  bt709_cube_lut_pool_destroy(pool);
+  free(pool);
+  bt709_cube_lut_free(&lut);
+}
+
+@end
@@ -0,0 +1,385 @@
+//
+//  BT709DecodeTests.m
+//
+//  Test CPU region decode logic in bt709_decode.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "sRGB.h"
+#import "BT709.h"
+
+#import "bt709_decode.h"
+
+@interface BT709DecodeTests : XCTestCase
+
+@end
+
+@implementation BT709DecodeTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+static
+void fill_test_planes(uint8_t *Y, uint8_t *Cb, uint8_t *Cr, int width, int height) {
+  for (int i = 0; i < (width * height); i++) {
+    Y[i] = (uint8_t) (16 + ((i * 37) % 220));
+  }
+  for (int i = 0; i < ((width / 2) * (height / 2)); i++) {
+    Cb[i] = (uint8_t) (16 + ((i * 53) % 225));
+    Cr[i] = (uint8_t) (16 + ((i * 71) % 225));
+  }
+}
+
+// Table based decode must match the matrix and gamma curves
+// evaluated directly for each pixel.
+
+- (void)testDecodeRegion_MatchesDirect {
+  const int width = 8;
+  const int height = 4;
+
+  uint8_t Y[width * height];
+  uint8_t Cb[(width / 2) * (height / 2)];
+  uint8_t Cr[(width / 2) * (height / 2)];
+  fill_test_planes(Y, Cb, Cr, width, height);
+
+  BT709PlanesStruct planes = { Y, width, Cb, width / 2, Cr, width / 2 };
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  const BT709Gamma gammas[] = { BT709GammaApple, BT709GammaSrgb, BT709GammaLinear };
+
+  for (int g = 0; g < 3; g++) {
+    BT709DecodeTables *tables = malloc(sizeof(BT709DecodeTables));
+    bt709_decode_tables_init(tables, gammas[g]);
+
+    uint8_t out[width * height * 3];
+    int result = bt709_decode_region(tables, &planes, 1, width, height, 0, 0, width, height, &layout, out, width * 3);
+    XCTAssert(result == 0);
+
+    for (int row = 0; row < height; row++) {
+      for (int col = 0; col < width; col++) {
+        int offset = ((row / 2) * (width / 2)) + (col / 2);
+        float rgb[3];
+        BT709_convertNormalizedYCbCrToRGB((Y[(row * width) + col] - 16) / 255.0f,
+                                          (Cb[offset] - 128) / 255.0f,
+                                          (Cr[offset] - 128) / 255.0f,
+                                          &rgb[0], &rgb[1], &rgb[2], 1);
+
+        for (int c = 0; c < 3; c++) {
+          float Cn = rgb[c];
+          if (gammas[g] == BT709GammaSrgb) {
+            Cn = sRGB_nonLinearNormToLinear(Cn);
+          } else if (gammas[g] == BT709GammaApple) {
+            Cn = Apple196_nonLinearNormToLinear(Cn);
+          }
+          int expected = (int) round(sRGB_linearNormToNonLinear(Cn) * 255.0f);
+          int decoded = out[(((row * width) + col) * 3) + c];
+          XCTAssert(abs(decoded - expected) <= 1, @"gamma %d (%d,%d) %d : %d != %d", g, col, row, c, decoded, expected);
+        }
+      }
+    }
+
+    free(tables);
+  }
+}
+
+// Regions that start at odd offsets must read the same chroma as
+// the full frame decode, from either I420 or NV12 input.
+
+- (void)testDecodeRegion_OddOffsets {
+  const int width = 10;
+  const int height = 6;
+
+  uint8_t Y[width * height];
+  uint8_t Cb[(width / 2) * (height / 2)];
+  uint8_t Cr[(width / 2) * (height / 2)];
+  uint8_t CbCr[width * (height / 2)];
+  fill_test_planes(Y, Cb, Cr, width, height);
+
+  for (int i = 0; i < ((width / 2) * (height / 2)); i++) {
+    CbCr[(i * 2)] = Cb[i];
+    CbCr[(i * 2) + 1] = Cr[i];
+  }
+
+  BT709PlanesStruct planes = { Y, width, Cb, width / 2, Cr, width / 2 };
+  BT709PlanesStruct nv12 = { Y, width, CbCr, width, CbCr + 1, width };
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  BT709DecodeTables *tables = malloc(sizeof(BT709DecodeTables));
+  bt709_decode_tables_init(tables, BT709GammaApple);
+
+  uint32_t full[width * height];
+  bt709_decode_region(tables, &planes, 1, width, height, 0, 0, width, height, &layout, (uint8_t *) full, width * 4);
+
+  const int regions[][4] = { { 1, 1, 3, 3 }, { 3, 0, 6, 5 }, { 0, 3, 1, 1 }, { 9, 5, 1, 1 }, { 2, 1, 8, 4 } };
+
+  for (int r = 0; r < (sizeof(regions) / sizeof(regions[0])); r++) {
+    const int x = regions[r][0];
+    const int y = regions[r][1];
+    const int w = regions[r][2];
+    const int h = regions[r][3];
+
+    // Output rows are padded and the padding must not be written
+
+    const int outPixelsPerRow = w + 3;
+    uint32_t out[outPixelsPerRow * h];
+    uint32_t outNV12[outPixelsPerRow * h];
+    memset(out, 0, sizeof(out));
+    memset(outNV12, 0, sizeof(outNV12));
+
+    XCTAssert(bt709_decode_region(tables, &planes, 1, width, height, x, y, w, h, &layout, (uint8_t *) out, outPixelsPerRow * 4) == 0);
+    XCTAssert(bt709_decode_region(tables, &nv12, 2, width, height, x, y, w, h, &layout, (uint8_t *) outNV12, outPixelsPerRow * 4) == 0);
+
+    for (int row = 0; row < h; row++) {
+      for (int col = 0; col < outPixelsPerRow; col++) {
+        uint32_t expected = (col < w) ? full[((y + row) * width) + x + col] : 0;
+        XCTAssert(out[(row * outPixelsPerRow) + col] == expected, @"region %d (%d,%d)", r, col, row);
+        XCTAssert(outNV12[(row * outPixelsPerRow) + col] == expected, @"region %d (%d,%d)", r, col, row);
+      }
+    }
+  }
+
+  // Regions outside the frame are rejected
+
+  uint32_t pixel;
+  XCTAssert(bt709_decode_region(tables, &planes, 1, width, height, 9, 0, 2, 1, &layout, (uint8_t *) &pixel, 4) == 1);
+  XCTAssert(bt709_decode_region(tables, &planes, 1, width, height, 0, 6, 1, 1, &layout, (uint8_t *) &pixel, 4) == 1);
+  XCTAssert(bt709_decode_region(tables, &planes, 1, width, height, -1, 0, 1, 1, &layout, (uint8_t *) &pixel, 4) == 1);
+  XCTAssert(bt709_decode_region(tables, &planes, 1, width, height, 0, 0, 0, 1, &layout, (uint8_t *) &pixel, 4) == 1);
+
+  free(tables);
+}
+
+// Linear float output must match the matrix and gamma curve
+// evaluated directly, and half float output must be the same
+// values rounded to half.
+
+- (void)testDecodeRegionLinear_MatchesDirect {
+  const int width = 6;
+  const int height = 4;
+
+  uint8_t Y[width * height];
+  uint8_t Cb[(width / 2) * (height / 2)];
+  uint8_t Cr[(width / 2) * (height / 2)];
+  fill_test_planes(Y, Cb, Cr, width, height);
+
+  BT709PlanesStruct planes = { Y, width, Cb, width / 2, Cr, width / 2 };
+
+  BT709DecodeTables *tables = malloc(sizeof(BT709DecodeTables));
+  bt709_decode_tables_init(tables, BT709GammaApple);
+
+  // Region starts at an odd column, output rows are padded
+
+  const int x = 1;
+  const int w = 5;
+  const int outPitch = 8;
+
+  float R[outPitch * height];
+  float G[outPitch * height];
+  float B[outPitch * height];
+  uint16_t half[outPitch * 4 * height];
+
+  BT709FloatPlanesStruct outPlanes = { R, outPitch * sizeof(float), G, outPitch * sizeof(float), B, outPitch * sizeof(float) };
+
+  XCTAssert(bt709_decode_region_float(tables, &planes, 1, width, height, x, 0, w, height, &outPlanes) == 0);
+  XCTAssert(bt709_decode_region_half(tables, &planes, 1, width, height, x, 0, w, height, half, outPitch * 4 * sizeof(uint16_t)) == 0);
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < w; col++) {
+      int offset = ((row / 2) * (width / 2)) + ((x + col) / 2);
+      float rgb[3];
+      BT709_convertNormalizedYCbCrToRGB((Y[(row * width) + x + col] - 16) / 255.0f,
+                                        (Cb[offset] - 128) / 255.0f,
+                                        (Cr[offset] - 128) / 255.0f,
+                                        &rgb[0], &rgb[1], &rgb[2], 1);
+
+      const float decoded[3] = { R[(row * outPitch) + col], G[(row * outPitch) + col], B[(row * outPitch) + col] };
+
+      for (int c = 0; c < 3; c++) {
+        float expected = Apple196_nonLinearNormToLinear(rgb[c]);
+        XCTAssert(fabs(decoded[c] - expected) < 0.0001f, @"(%d,%d) %d : %.6f != %.6f", col, row, c, decoded[c], expected);
+        XCTAssert(half[(row * outPitch * 4) + (col * 4) + c] == bt709_half_from_float(decoded[c]));
+      }
+
+      XCTAssert(half[(row * outPitch * 4) + (col * 4) + 3] == 0x3C00);
+    }
+  }
+
+  free(tables);
+}
+
+// Compositing over a background must match decoding to linear,
+// adding the background scaled by (1 - alpha) in linear light since
+// color is premultiplied, and encoding the result as sRGB. Opaque
+// pixels match the plain decode and fully transparent pixels leave
+// the background as is.
+
+- (void)testDecodeRegionOver_MatchesDirect {
+  const int width = 8;
+  const int height = 4;
+
+  uint8_t Y[width * height];
+  uint8_t Cb[(width / 2) * (height / 2)];
+  uint8_t Cr[(width / 2) * (height / 2)];
+  uint8_t A[width * height];
+  fill_test_planes(Y, Cb, Cr, width, height);
+
+  for (int i = 0; i < (width * height); i++) {
+    A[i] = (uint8_t) (i * 9);
+  }
+  A[0] = 16;
+  A[1] = 235;
+
+  BT709PlanesStruct planes = { Y, width, Cb, width / 2, Cr, width / 2 };
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  BT709DecodeTables *tables = malloc(sizeof(BT709DecodeTables));
+  bt709_decode_tables_init(tables, BT709GammaApple);
+
+  uint8_t background[width * height * 4];
+  uint8_t out[width * height * 4];
+  uint8_t plain[width * height * 4];
+
+  for (int i = 0; i < sizeof(background); i++) {
+    background[i] = (uint8_t) ((i * 41) + 3);
+  }
+  memcpy(out, background, sizeof(out));
+
+  // Composite in place over the background
+
+  XCTAssert(bt709_decode_region_over(tables, &planes, 1, A, width, width, height, 0, 0, width, height, &layout, out, width * 4, out, width * 4) == 0);
+  XCTAssert(bt709_decode_region(tables, &planes, 1, width, height, 0, 0, width, height, &layout, plain, width * 4) == 0);
+
+  for (int i = 0; i < (width * height); i++) {
+    float An = ((A[i] / 255.0f) - (16.0f / 255.0f)) * 1.1644f;
+    An = saturatef(An);
+
+    int offset = (((i / width) / 2) * (width / 2)) + ((i % width) / 2);
+    float Rn, Gn, Bn;
+    bt709_decode_linear_rgb(tables, Y[i], Cb[offset], Cr[offset], &Rn, &Gn, &Bn);
+
+    const float rgb[3] = { Bn, Gn, Rn };
+
+    for (int c = 0; c < 3; c++) {
+      int expected;
+      if (An >= 1.0f) {
+        expected = plain[(i * 4) + c];
+      } else {
+        float bg = sRGB_nonLinearNormToLinear(background[(i * 4) + c] / 255.0f);
+        expected = (int) round(sRGB_linearNormToNonLinear(rgb[c] + (bg * (1.0f - An))) * 255.0f);
+      }
+      int composited = out[(i * 4) + c];
+      XCTAssert(abs(composited - expected) <= 1, @"pixel %d component %d : %d != %d", i, c, composited, expected);
+    }
+
+    XCTAssert(out[(i * 4) + 3] == 0xFF);
+  }
+
+  XCTAssert(memcmp(out, background, 3) == 0);
+  XCTAssert(memcmp(out + 4, plain + 4, 4) == 0);
+
+  // A solid color is the same as a background filled with that color
+
+  uint8_t solid[width * height * 4];
+  for (int i = 0; i < (width * height); i++) {
+    background[(i * 4)] = 10;
+    background[(i * 4) + 1] = 200;
+    background[(i * 4) + 2] = 90;
+    background[(i * 4) + 3] = 0xFF;
+  }
+
+  XCTAssert(bt709_decode_region_over(tables, &planes, 1, A, width, width, height, 1, 1, 5, 3, &layout, background, width * 4, out, width * 4) == 0);
+  XCTAssert(bt709_decode_region_over_color(tables, &planes, 1, A, width, width, height, 1, 1, 5, 3, &layout, 90, 200, 10, solid, width * 4) == 0);
+
+  for (int row = 0; row < 3; row++) {
+    XCTAssert(memcmp(out + (row * width * 4), solid + (row * width * 4), 5 * 4) == 0, @"row %d", row);
+  }
+
+  free(tables);
+}
+
+// A packed frame stacks the alpha Y Cb Cr planes below the color
+// planes. Decoding color and alpha from the one frame must match
+// decoding the two frames separately.
+
+- (void)testDecodeRegionPackedAlpha {
+  const int width = 6;
+  const int height = 4;
+
+  uint8_t Y[width * height * 2];
+  uint8_t Cb[(width / 2) * (height / 2) * 2];
+  uint8_t Cr[(width / 2) * (height / 2) * 2];
+  fill_test_planes(Y, Cb, Cr, width, height);
+
+  uint8_t *alphaY = Y + (width * height);
+  for (int i = 0; i < (width * height); i++) {
+    alphaY[i] = (uint8_t) (i * 11);
+  }
+  memset(Cb + ((width / 2) * (height / 2)), 128, (width / 2) * (height / 2));
+  memset(Cr + ((width / 2) * (height / 2)), 128, (width / 2) * (height / 2));
+
+  BT709PlanesStruct packed = { Y, width, Cb, width / 2, Cr, width / 2 };
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  XCTAssert(bt709_decode_packed_alpha_ptr(&packed, height) == alphaY);
+
+  BT709DecodeTables *tables = malloc(sizeof(BT709DecodeTables));
+  bt709_decode_tables_init(tables, BT709GammaSrgb);
+
+  uint8_t plain[width * height * 4];
+  uint8_t withAlpha[width * height * 4];
+  XCTAssert(bt709_decode_region(tables, &packed, 1, width, height, 0, 0, width, height, &layout, plain, width * 4) == 0);
+  XCTAssert(bt709_decode_region_alpha(tables, &packed, 1, bt709_decode_packed_alpha_ptr(&packed, height), width, width, height, 0, 0, width, height, &layout, withAlpha, width * 4) == 0);
+
+  uint16_t half[width * height * 4];
+  XCTAssert(bt709_decode_region_half_alpha(tables, &packed, 1, alphaY, width, width, height, 0, 0, width, height, half, width * 4 * sizeof(uint16_t)) == 0);
+
+  for (int i = 0; i < (width * height); i++) {
+    float An = saturatef(((alphaY[i] / 255.0f) - (16.0f / 255.0f)) * 1.1644f);
+
+    XCTAssert(memcmp(&withAlpha[i * 4], &plain[i * 4], 3) == 0, @"pixel %d", i);
+    XCTAssert(withAlpha[(i * 4) + 3] == (int) round(An * 255.0f), @"pixel %d", i);
+    XCTAssert(half[(i * 4) + 3] == bt709_half_from_float(An), @"pixel %d", i);
+  }
+
+  // Layouts without an alpha channel are rejected
+
+  BT709PixelLayout rgbLayout = bt709_pixel_layout_rgb();
+  XCTAssert(bt709_decode_region_alpha(tables, &packed, 1, alphaY, width, width, height, 0, 0, width, height, &rgbLayout, withAlpha, width * 3) == 1);
+
+  free(tables);
+}
+
+- (void)testHalfFromFloat {
+  XCTAssert(bt709_half_from_float(0.0f) == 0x0000);
+  XCTAssert(bt709_half_from_float(-0.0f) == 0x8000);
+  XCTAssert(bt709_half_from_float(1.0f) == 0x3C00);
+  XCTAssert(bt709_half_from_float(0.5f) == 0x3800);
+  XCTAssert(bt709_half_from_float(-2.0f) == 0xC000);
+  XCTAssert(bt709_half_from_float(65504.0f) == 0x7BFF);
+  XCTAssert(bt709_half_from_float(65520.0f) == 0x7C00);
+  XCTAssert(bt709_half_from_float(1.0e10f) == 0x7C00);
+
+  // Smallest denormal half and ties that round to even
+
+  XCTAssert(bt709_half_from_float(powf(2.0f, -24.0f)) == 0x0001);
+  XCTAssert(bt709_half_from_float(1.0f + powf(2.0f, -11.0f)) == 0x3C00);
+  XCTAssert(bt709_half_from_float(1.0f + (3.0f * powf(2.0f, -11.0f))) == 0x3C02);
+
+  // SIMD and scalar conversion agree, including the tail
+
+  float values[7] = { 0.0f, 0.1f, 0.25f, 0.333333f, 0.9999f, 1.0f, 0.00001f };
+  uint16_t halfs[7];
+  bt709_half_from_float4(halfs, values, 7);
+
+  for (int i = 0; i < 7; i++) {
+    XCTAssert(halfs[i] == bt709_half_from_float(values[i]), @"%d", i);
+  }
+}
+
+@end
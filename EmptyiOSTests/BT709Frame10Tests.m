@@ -0,0 +1,141 @@
+//
+//  BT709Frame10Tests.m
+//
+//  Test 10 bit frame conversion logic in bt709_frame10.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "sRGB.h"
+#import "BT709.h"
+
+#import "bt709_frame10.h"
+
+@interface BT709Frame10Tests : XCTestCase
+
+@end
+
+@implementation BT709Frame10Tests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+- (void)testConvertNonLinearRGBToYCbCr10_Range {
+  int Y, Cb, Cr;
+
+  BT709_convertNonLinearRGBToYCbCr10(0.0f, 0.0f, 0.0f, &Y, &Cb, &Cr);
+  XCTAssert(Y == 64 && Cb == 512 && Cr == 512);
+
+  BT709_convertNonLinearRGBToYCbCr10(1.0f, 1.0f, 1.0f, &Y, &Cb, &Cr);
+  XCTAssert(Y == 940 && Cb == 512 && Cr == 512);
+
+  // 10 bit values for gray are 4 times the 8 bit values
+
+  for (int i = 0; i < 256; i++) {
+    int Y8, Cb8, Cr8;
+    BT709_convertNonLinearRGBToYCbCr(byteNorm(i), byteNorm(i), byteNorm(i), &Y8, &Cb8, &Cr8);
+    BT709_convertNonLinearRGBToYCbCr10(byteNorm(i), byteNorm(i), byteNorm(i), &Y, &Cb, &Cr);
+    XCTAssert(abs(Y - (Y8 * 4)) <= 2, @"%d : %d %d", i, Y, Y8);
+  }
+}
+
+// Table based conversion must match the gamma curve and matrix
+// evaluated directly for each pixel.
+
+- (void)testFrame10Encode_MatchesDirect {
+  const int width = 16;
+  const int height = 2;
+
+  uint8_t pixels[width * height * 3];
+  for (int i = 0; i < (width * height * 3); i++) {
+    pixels[i] = (uint8_t) ((i * 37) + 11);
+  }
+
+  uint16_t Y[width * height];
+  uint16_t Cb[width / 2];
+  uint16_t Cr[width / 2];
+
+  BT709Planes16Struct planes = { Y, width * 2, Cb, width, Cr, width };
+
+  BT709Frame10Tables *tables = (BT709Frame10Tables *) malloc(sizeof(BT709Frame10Tables));
+  bt709_frame10_tables_init(tables, BT709GammaSrgb, BT709GammaApple);
+
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  int result = bt709_frame10_encode(tables, &layout, pixels, width * 3, width, height, &planes);
+  XCTAssert(result == 0);
+
+  for (int col = 0; col < width; col += 2) {
+    float lin[3] = { 0.0f, 0.0f, 0.0f };
+
+    for (int i = 0; i < 4; i++) {
+      int offset = ((i / 2) * width) + col + (i % 2);
+      const uint8_t *p = &pixels[offset * 3];
+
+      float Rn, Gn, Bn;
+      BT709_tolinearNorm(p[0], p[1], p[2], &Rn, &Gn, &Bn, BT709GammaSrgb);
+
+      int expectedY, CbIgnored, CrIgnored;
+      BT709_convertNonLinearRGBToYCbCr10(BT709_from_linear_norm(Rn, BT709GammaApple),
+                                         BT709_from_linear_norm(Gn, BT709GammaApple),
+                                         BT709_from_linear_norm(Bn, BT709GammaApple),
+                                         &expectedY, &CbIgnored, &CrIgnored);
+
+      XCTAssert(abs(Y[offset] - expectedY) <= 1, @"Y[%d] %d != %d", offset, Y[offset], expectedY);
+
+      lin[0] += Rn / 4.0f;
+      lin[1] += Gn / 4.0f;
+      lin[2] += Bn / 4.0f;
+    }
+
+    int YIgnored, expectedCb, expectedCr;
+    BT709_convertNonLinearRGBToYCbCr10(BT709_from_linear_norm(lin[0], BT709GammaApple),
+                                       BT709_from_linear_norm(lin[1], BT709GammaApple),
+                                       BT709_from_linear_norm(lin[2], BT709GammaApple),
+                                       &YIgnored, &expectedCb, &expectedCr);
+
+    XCTAssert(abs(Cb[col/2] - expectedCb) <= 1, @"Cb[%d] %d != %d", col/2, Cb[col/2], expectedCb);
+    XCTAssert(abs(Cr[col/2] - expectedCr) <= 1, @"Cr[%d] %d != %d", col/2, Cr[col/2], expectedCr);
+  }
+
+  free(tables);
+}
+
+- (void)testPackP010 {
+  const int width = 20;
+  const int height = 2;
+
+  uint16_t Y[width * height];
+  uint16_t Cb[width / 2];
+  uint16_t Cr[width / 2];
+
+  for (int i = 0; i < (width * height); i++) {
+    Y[i] = (uint16_t) (64 + i);
+  }
+  for (int i = 0; i < (width / 2); i++) {
+    Cb[i] = (uint16_t) (100 + i);
+    Cr[i] = (uint16_t) (900 - i);
+  }
+
+  BT709Planes16Struct planes = { Y, width * 2, Cb, width, Cr, width };
+
+  uint16_t outY[width * height];
+  uint16_t outCbCr[width];
+
+  bt709_frame10_pack_p010(&planes, width, height, outY, width * 2, outCbCr, width * 2);
+
+  for (int i = 0; i < (width * height); i++) {
+    XCTAssert(outY[i] == (Y[i] << 6));
+  }
+  for (int i = 0; i < (width / 2); i++) {
+    XCTAssert(outCbCr[(i * 2)] == (Cb[i] << 6));
+    XCTAssert(outCbCr[(i * 2) + 1] == (Cr[i] << 6));
+  }
+}
+
+@end
@@ -0,0 +1,239 @@
+//
+//  BT709FrameCacheTests.m
+//
+//  Test budgeted frame cache logic in bt709_frame_cache.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "bt709_frame_cache.h"
+
+@interface BT709FrameCacheTests : XCTestCase
+
+@end
+
+@implementation BT709FrameCacheTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// Fill a frame with a gradient that moves with the frame index and
+// a noisy block, so that frames compress but not to nothing.
+
+static
+void fill_frame(uint8_t *ptr, int width, int height, int frameIndex) {
+  const int yLen = width * height;
+  const int uvLen = (width / 2) * (height / 2);
+
+  uint32_t seed = 1 + frameIndex;
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      uint8_t v = (uint8_t) (16 + row + col + frameIndex);
+      if (row < 8 && col < 8) {
+        seed = (seed * 1103515245) + 12345;
+        v = (uint8_t) (seed >> 16);
+      }
+      ptr[(row * width) + col] = v;
+    }
+  }
+  for (int i = 0; i < uvLen; i++) {
+    ptr[yLen + i] = (uint8_t) (128 + (i % 7));
+    ptr[yLen + uvLen + i] = (uint8_t) (128 - frameIndex);
+  }
+}
+
+- (void)testLZ_RoundTrip {
+  const int maxLen = 3000;
+
+  uint8_t *input = malloc(maxLen);
+  uint8_t *compressed = malloc(bt709_frame_cache_lz_bound(maxLen));
+  uint8_t *output = malloc(maxLen);
+  uint32_t *hashTable = malloc(sizeof(uint32_t) << BT709_FRAME_CACHE_HASH_BITS);
+
+  uint32_t seed = 7;
+
+  for (int kind = 0; kind < 4; kind++) {
+    for (int inLen = 0; inLen <= maxLen; inLen += (inLen < 40) ? 1 : 97) {
+      for (int i = 0; i < inLen; i++) {
+        seed = (seed * 1103515245) + 12345;
+        switch (kind) {
+          case 0: input[i] = 0; break;
+          case 1: input[i] = (uint8_t) (seed >> 16); break;
+          case 2: input[i] = (uint8_t) (i % 5); break;
+          default: input[i] = ((i / 300) % 2) ? (uint8_t) (seed >> 16) : (uint8_t) (i / 17); break;
+        }
+      }
+
+      size_t compressedLen = bt709_frame_cache_lz_compress(input, inLen, compressed, hashTable);
+      XCTAssert(compressedLen <= bt709_frame_cache_lz_bound(inLen));
+
+      memset(output, 0xAA, maxLen);
+      XCTAssert(bt709_frame_cache_lz_decompress(compressed, compressedLen, output, inLen) == 0, @"kind %d len %d", kind, inLen);
+      XCTAssert(memcmp(input, output, inLen) == 0, @"kind %d len %d", kind, inLen);
+
+      if (kind == 0 && inLen > 100) {
+        XCTAssert(compressedLen < 20);
+      }
+
+      // Truncated input or the wrong output size is rejected
+
+      if (compressedLen > 1) {
+        XCTAssert(bt709_frame_cache_lz_decompress(compressed, compressedLen - 1, output, inLen) != 0);
+      }
+      XCTAssert(bt709_frame_cache_lz_decompress(compressed, compressedLen, output, inLen + 1) != 0);
+    }
+  }
+
+  free(input);
+  free(compressed);
+  free(output);
+  free(hashTable);
+}
+
+// With room for about two raw frames, older frames are compressed
+// and every frame reads back exactly.
+
+- (void)testBudget_CompressesColdFrames {
+  const int width = 64;
+  const int height = 32;
+  const int numFrames = 12;
+  const size_t frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+
+  BT709FrameCache cache;
+  XCTAssert(bt709_frame_cache_init(&cache, width, height, numFrames, (frameLen * 5) / 2) == 0);
+  XCTAssert(cache.frameLen == frameLen);
+
+  uint8_t *frame = malloc(frameLen);
+  BT709PlanesStruct planes;
+  bt709_frame_cache_planes(&cache, frame, &planes);
+
+  for (int frameIndex = 0; frameIndex < numFrames; frameIndex++) {
+    fill_frame(frame, width, height, frameIndex);
+    XCTAssert(bt709_frame_cache_put(&cache, frameIndex, &planes) == 0);
+    XCTAssert(bt709_frame_cache_bytes(&cache) <= cache.budget);
+  }
+
+  XCTAssert(cache.stats.numCompressed >= (numFrames - 2));
+  XCTAssert(cache.stats.numDropped == 0);
+  XCTAssert(cache.entries[0].state == BT709FrameCacheCompressed);
+  XCTAssert(cache.entries[numFrames - 1].state == BT709FrameCacheRaw);
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int frameIndex = 0; frameIndex < numFrames; frameIndex++) {
+      BT709PlanesStruct out;
+      XCTAssert(bt709_frame_cache_get(&cache, frameIndex, &out) == 0);
+      fill_frame(frame, width, height, frameIndex);
+      XCTAssert(memcmp(out.yPtr, frame, frameLen) == 0, @"frame %d", frameIndex);
+      XCTAssert(bt709_frame_cache_bytes(&cache) <= cache.budget);
+    }
+  }
+
+  XCTAssert(cache.stats.numMisses == 0);
+
+  // Replacing a compressed frame keeps the new data
+
+  fill_frame(frame, width, height, 40);
+  XCTAssert(bt709_frame_cache_put(&cache, 0, &planes) == 0);
+  BT709PlanesStruct out;
+  XCTAssert(bt709_frame_cache_get(&cache, 5, &out) == 0);
+  XCTAssert(bt709_frame_cache_get(&cache, 0, &out) == 0);
+  XCTAssert(memcmp(out.yPtr, frame, frameLen) == 0);
+
+  XCTAssert(bt709_frame_cache_get(&cache, numFrames, &out) == 1);
+  XCTAssert(bt709_frame_cache_put(&cache, -1, &planes) == 1);
+
+  bt709_frame_cache_free(&cache);
+  free(frame);
+}
+
+// A budget smaller than the compressed clip drops the least recently
+// used frames, while the frame just returned is always kept.
+
+- (void)testBudget_DropsLeastRecentlyUsed {
+  const int width = 32;
+  const int height = 16;
+  const int numFrames = 8;
+  const size_t frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+
+  BT709FrameCache cache;
+  XCTAssert(bt709_frame_cache_init(&cache, width, height, numFrames, frameLen / 2) == 0);
+
+  uint8_t *frame = malloc(frameLen);
+  BT709PlanesStruct planes;
+  bt709_frame_cache_planes(&cache, frame, &planes);
+
+  for (int frameIndex = 0; frameIndex < numFrames; frameIndex++) {
+    fill_frame(frame, width, height, frameIndex);
+    XCTAssert(bt709_frame_cache_put(&cache, frameIndex, &planes) == 0);
+    XCTAssert(cache.entries[frameIndex].state == BT709FrameCacheRaw);
+  }
+
+  XCTAssert(cache.stats.numDropped > 0);
+
+  BT709PlanesStruct out;
+  XCTAssert(bt709_frame_cache_get(&cache, 0, &out) == 1);
+  XCTAssert(cache.stats.numMisses == 1);
+  XCTAssert(bt709_frame_cache_get(&cache, numFrames - 1, &out) == 0);
+  XCTAssert(memcmp(out.yPtr, frame, frameLen) == 0);
+
+  bt709_frame_cache_free(&cache);
+  free(frame);
+}
+
+// Prefetch decompresses the next frames so that sequential gets do
+// not decompress, and stops at the budget.
+
+- (void)testPrefetch_Sequential {
+  const int width = 64;
+  const int height = 32;
+  const int numFrames = 10;
+  const size_t frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+
+  BT709FrameCache cache;
+  XCTAssert(bt709_frame_cache_init(&cache, width, height, numFrames, frameLen * 4) == 0);
+
+  uint8_t *frame = malloc(frameLen);
+  BT709PlanesStruct planes;
+  bt709_frame_cache_planes(&cache, frame, &planes);
+
+  for (int frameIndex = 0; frameIndex < numFrames; frameIndex++) {
+    fill_frame(frame, width, height, frameIndex);
+    XCTAssert(bt709_frame_cache_put(&cache, frameIndex, &planes) == 0);
+  }
+
+  XCTAssert(cache.entries[0].state == BT709FrameCacheCompressed);
+
+  BT709PlanesStruct out;
+  XCTAssert(bt709_frame_cache_get(&cache, 0, &out) == 0);
+  XCTAssert(bt709_frame_cache_prefetch(&cache, 1, 2) == 2);
+  XCTAssert(cache.entries[0].state == BT709FrameCacheRaw);
+  XCTAssert(cache.entries[1].state == BT709FrameCacheRaw);
+  XCTAssert(cache.entries[2].state == BT709FrameCacheRaw);
+  XCTAssert(bt709_frame_cache_bytes(&cache) <= cache.budget);
+
+  // The frame returned by the get is still valid
+
+  fill_frame(frame, width, height, 0);
+  XCTAssert(memcmp(out.yPtr, frame, frameLen) == 0);
+
+  const uint64_t numDecompressed = cache.stats.numDecompressed;
+  XCTAssert(bt709_frame_cache_get(&cache, 1, &out) == 0);
+  XCTAssert(bt709_frame_cache_get(&cache, 2, &out) == 0);
+  XCTAssert(cache.stats.numDecompressed == numDecompressed);
+
+  // A window larger than the budget stops early
+
+  XCTAssert(bt709_frame_cache_prefetch(&cache, 3, numFrames) < (numFrames - 3));
+  XCTAssert(bt709_frame_cache_bytes(&cache) <= cache.budget);
+
+  bt709_frame_cache_free(&cache);
+  free(frame);
+}
+
+@end
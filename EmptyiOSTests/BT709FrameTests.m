@@ -0,0 +1,317 @@
+//
+//  BT709FrameTests.m
+//
+//  Test whole frame conversion logic in bt709_frame.h, luma
+//  refinement in bt709_sharp_yuv.h, and raw frame stream
+//  parsing in raw_frame_reader.h.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "sRGB.h"
+#import "BT709.h"
+
+#import "bt709_frame.h"
+#import "bt709_sharp_yuv.h"
+#import "raw_frame_reader.h"
+
+@interface BT709FrameTests : XCTestCase
+
+@end
+
+@implementation BT709FrameTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// Same input as testConvertsSRGBToYCbCr_AverageOf4_t1_sRGB but converted as a 2x2 RGB frame
+
+- (void)testFrameEncode_AverageOf4_t1_sRGB {
+  uint8_t pixels[2*2*3] = {
+    40, 201, 53,   52, 195, 59,
+    214, 53, 201,  202, 58, 197
+  };
+
+  uint8_t Y[4];
+  uint8_t Cb[1];
+  uint8_t Cr[1];
+
+  BT709PlanesStruct planes = { Y, 2, Cb, 1, Cr, 1 };
+
+  BT709FrameTables tables;
+  bt709_frame_tables_init(&tables, BT709GammaSrgb, BT709GammaSrgb);
+
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  int result = bt709_frame_encode(&tables, &layout, pixels, 2*3, 2, 2, &planes);
+  XCTAssert(result == 0);
+
+  XCTAssert(Y[0] == 150, @"%3d != %3d", Y[0], 150);
+  XCTAssert(Y[1] == 149, @"%3d != %3d", Y[1], 149);
+  XCTAssert(Y[2] == 100, @"%3d != %3d", Y[2], 100);
+  XCTAssert(Y[3] == 101, @"%3d != %3d", Y[3], 101);
+
+  XCTAssert(Cb[0] == 128, @"%3d != %3d", Cb[0], 128);
+  XCTAssert(Cr[0] == 131, @"%3d != %3d", Cr[0], 131);
+}
+
+// The table driven conversion must generate exactly the same
+// output as BT709_average_pixel_values() for each gamma setting.
+
+- (void)testFrameEncode_MatchesAveragePixelValues {
+  const int width = 32;
+  const int height = 16;
+
+  const BT709Gamma gammas[3][2] = {
+    { BT709GammaSrgb, BT709GammaApple },
+    { BT709GammaSrgb, BT709GammaSrgb },
+    { BT709GammaLinear, BT709GammaLinear }
+  };
+
+  uint32_t pixels[width*height];
+
+  srand(709);
+
+  for (int i = 0; i < (width*height); i++) {
+    pixels[i] = ((uint32_t) rand()) ^ (((uint32_t) rand()) << 16);
+  }
+
+  uint8_t Y[width*height];
+  uint8_t Cb[(width/2)*(height/2)];
+  uint8_t Cr[(width/2)*(height/2)];
+
+  BT709PlanesStruct planes = { Y, width, Cb, width/2, Cr, width/2 };
+
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  for (int gi = 0; gi < 3; gi++) {
+    BT709FrameTables tables;
+    bt709_frame_tables_init(&tables, gammas[gi][0], gammas[gi][1]);
+
+    int result = bt709_frame_encode(&tables, &layout, (const uint8_t *) pixels, width * sizeof(uint32_t), width, height, &planes);
+    XCTAssert(result == 0);
+
+    for (int row = 0; row < height; row += 2) {
+      for (int col = 0; col < width; col += 2) {
+        uint32_t p1 = pixels[(row * width) + col];
+        uint32_t p2 = pixels[(row * width) + col+1];
+        uint32_t p3 = pixels[((row+1) * width) + col];
+        uint32_t p4 = pixels[((row+1) * width) + col+1];
+
+        int Y1, Y2, Y3, Y4, CbAve, CrAve;
+
+        BT709_average_pixel_values((p1 >> 16) & 0xFF, (p1 >> 8) & 0xFF, p1 & 0xFF,
+                                   (p2 >> 16) & 0xFF, (p2 >> 8) & 0xFF, p2 & 0xFF,
+                                   (p3 >> 16) & 0xFF, (p3 >> 8) & 0xFF, p3 & 0xFF,
+                                   (p4 >> 16) & 0xFF, (p4 >> 8) & 0xFF, p4 & 0xFF,
+                                   &Y1, &Y2, &Y3, &Y4,
+                                   &CbAve, &CrAve,
+                                   gammas[gi][0], gammas[gi][1]);
+
+        XCTAssert(Y[(row * width) + col] == Y1);
+        XCTAssert(Y[(row * width) + col+1] == Y2);
+        XCTAssert(Y[((row+1) * width) + col] == Y3);
+        XCTAssert(Y[((row+1) * width) + col+1] == Y4);
+
+        XCTAssert(Cb[((row/2) * (width/2)) + col/2] == CbAve);
+        XCTAssert(Cr[((row/2) * (width/2)) + col/2] == CrAve);
+      }
+    }
+  }
+}
+
+// Squared linear error of decoded 4:2:0 planes against sRGB input pixels
+
+static
+double linearError(const uint8_t *pixels, int width, int height, const BT709PlanesStruct *planes) {
+  double sum = 0.0;
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      int Y = planes->yPtr[(row * planes->yBytesPerRow) + col];
+      int Cb = planes->cbPtr[((row/2) * planes->cbBytesPerRow) + col/2];
+      int Cr = planes->crPtr[((row/2) * planes->crBytesPerRow) + col/2];
+
+      float rgb[3];
+      BT709_convertYCbCrToNonLinearRGB(Y, Cb, Cr, &rgb[0], &rgb[1], &rgb[2]);
+
+      for (int c = 0; c < 3; c++) {
+        float decoded = Apple196_nonLinearNormToLinear(rgb[c]);
+        float orig = sRGB_nonLinearNormToLinear(byteNorm(pixels[(((row * width) + col) * 3) + c]));
+        sum += (decoded - orig) * (decoded - orig);
+      }
+    }
+  }
+
+  return sum;
+}
+
+// Zero iterations must match bt709_frame_encode() and refinement
+// must lower the decoded error for blocks that mix colors.
+
+- (void)testSharpEncode_ReducesError {
+  const int width = 32;
+  const int height = 16;
+
+  uint8_t pixels[width*height*3];
+
+  srand(709);
+
+  for (int i = 0; i < (width*height); i++) {
+    // Alternate between two colors so every block mixes hues
+    int k = (i % 2) ^ ((i / width) % 2);
+    pixels[(i*3)+0] = k ? 230 : (rand() % 64);
+    pixels[(i*3)+1] = k ? (rand() % 64) : 200;
+    pixels[(i*3)+2] = k ? 40 : (128 + (rand() % 64));
+  }
+
+  uint8_t Y1[width*height], Cb1[(width/2)*(height/2)], Cr1[(width/2)*(height/2)];
+  uint8_t Y2[width*height], Cb2[(width/2)*(height/2)], Cr2[(width/2)*(height/2)];
+
+  BT709PlanesStruct planes1 = { Y1, width, Cb1, width/2, Cr1, width/2 };
+  BT709PlanesStruct planes2 = { Y2, width, Cb2, width/2, Cr2, width/2 };
+
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  BT709SharpTables *sharpTables = (BT709SharpTables *) malloc(sizeof(BT709SharpTables));
+
+  bt709_sharp_tables_init(sharpTables, BT709GammaSrgb, BT709GammaApple, 0);
+  int result = bt709_frame_encode(&sharpTables->frame, &layout, pixels, width*3, width, height, &planes1);
+  XCTAssert(result == 0);
+  result = bt709_sharp_encode(sharpTables, &layout, pixels, width*3, width, height, &planes2);
+  XCTAssert(result == 0);
+
+  XCTAssert(memcmp(Y1, Y2, sizeof(Y1)) == 0);
+
+  bt709_sharp_tables_init(sharpTables, BT709GammaSrgb, BT709GammaApple, 2);
+  result = bt709_sharp_encode(sharpTables, &layout, pixels, width*3, width, height, &planes2);
+  XCTAssert(result == 0);
+
+  // Cb and Cr are not changed by refinement
+
+  XCTAssert(memcmp(Cb1, Cb2, sizeof(Cb1)) == 0);
+  XCTAssert(memcmp(Cr1, Cr2, sizeof(Cr1)) == 0);
+
+  double plainError = linearError(pixels, width, height, &planes1);
+  double sharpError = linearError(pixels, width, height, &planes2);
+
+  XCTAssert(sharpError < plainError, @"%.6f >= %.6f", sharpError, plainError);
+
+  free(sharpTables);
+}
+
+// The SIMD block eval returns the same error and the same rounded
+// Y as the scalar version for random blocks.
+
+- (void)testSharpBlockEval_MatchesScalar {
+  BT709SharpTables *sharpTables = (BT709SharpTables *) malloc(sizeof(BT709SharpTables));
+  bt709_sharp_tables_init(sharpTables, BT709GammaSrgb, BT709GammaApple, 2);
+
+  // The step from Y = 84 lands on 196.5, which rounds up to 197
+
+  {
+    const int Y[4] = { 84, 84, 84, 84 };
+    const float chroma[3] = { -404 / 1000.0f, -324 / 1000.0f, 222 / 1000.0f };
+    float orig[3][4];
+    for (int j = 0; j < 4; j++) {
+      orig[0][j] = 646 / 1000.0f;
+      orig[1][j] = 369 / 1000.0f;
+      orig[2][j] = 785 / 1000.0f;
+    }
+
+    float err[4];
+    int next[4];
+
+    bt709_sharp_block_eval_scalar(sharpTables, Y, chroma, orig, err, next);
+    XCTAssert(next[0] == 197, @"%d != %d", next[0], 197);
+    bt709_sharp_block_eval(sharpTables, Y, chroma, orig, err, next);
+    XCTAssert(next[0] == 197, @"%d != %d", next[0], 197);
+  }
+
+  srand(32);
+
+  for (int i = 0; i < 10000; i++) {
+    int Y[4];
+    float chroma[3];
+    float orig[3][4];
+
+    for (int j = 0; j < 4; j++) {
+      Y[j] = BT709_YMin + (rand() % (BT709_YMax - BT709_YMin + 1));
+    }
+    for (int c = 0; c < 3; c++) {
+      chroma[c] = ((rand() % 1001) - 500) / 1000.0f;
+      for (int j = 0; j < 4; j++) {
+        orig[c][j] = (rand() % 1001) / 1000.0f;
+      }
+    }
+
+    float err1[4], err2[4];
+    int next1[4], next2[4];
+
+    bt709_sharp_block_eval_scalar(sharpTables, Y, chroma, orig, err1, next1);
+    bt709_sharp_block_eval(sharpTables, Y, chroma, orig, err2, next2);
+
+    for (int j = 0; j < 4; j++) {
+      XCTAssert(next1[j] == next2[j], @"%d : %d != %d", i, next1[j], next2[j]);
+      XCTAssert(fabsf(err1[j] - err2[j]) <= (1.0e-5f * (1.0f + err1[j])), @"%d : %.8f != %.8f", i, err1[j], err2[j]);
+    }
+  }
+
+  free(sharpTables);
+}
+
+// A PAM frame followed by a PPM frame, read from a mapped file
+
+- (void)testRawFrameReader_NetpbmStream {
+  NSMutableData *mData = [NSMutableData data];
+
+  const char *pamHeader = "P7\nWIDTH 4\nHEIGHT 2\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+  [mData appendBytes:pamHeader length:strlen(pamHeader)];
+  for (int i = 0; i < (4*2*4); i++) {
+    uint8_t bVal = i;
+    [mData appendBytes:&bVal length:1];
+  }
+
+  const char *ppmHeader = "P6\n# comment\n4 2\n255\n";
+  [mData appendBytes:ppmHeader length:strlen(ppmHeader)];
+  for (int i = 0; i < (4*2*3); i++) {
+    uint8_t bVal = 100 + i;
+    [mData appendBytes:&bVal length:1];
+  }
+
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"frames.pam"];
+  BOOL worked = [mData writeToFile:path atomically:TRUE];
+  XCTAssert(worked);
+
+  RawFrameReader reader;
+  int result = raw_frame_reader_open(&reader, [path UTF8String], RawFrameFormatNetpbm, 0, 0);
+  XCTAssert(result == 0);
+
+  const uint8_t *framePtr = NULL;
+
+  result = raw_frame_reader_next(&reader, &framePtr);
+  XCTAssert(result == 0);
+  XCTAssert(reader.width == 4);
+  XCTAssert(reader.height == 2);
+  XCTAssert(reader.layout.bytesPerPixel == 4);
+  XCTAssert(framePtr[0] == 0);
+  XCTAssert(framePtr[31] == 31);
+
+  result = raw_frame_reader_next(&reader, &framePtr);
+  XCTAssert(result == 0);
+  XCTAssert(reader.layout.bytesPerPixel == 3);
+  XCTAssert(framePtr[0] == 100);
+  XCTAssert(framePtr[23] == 123);
+
+  result = raw_frame_reader_next(&reader, &framePtr);
+  XCTAssert(result == 1);
+
+  raw_frame_reader_close(&reader);
+}
+
+@end
@@ -0,0 +1,134 @@
+//
+//  BT709InverseTableTests.m
+//
+//  Test inverse search encoding logic in bt709_inverse_table.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "sRGB.h"
+#import "BT709.h"
+
+#import "bt709_inverse_table.h"
+
+@interface BT709InverseTableTests : XCTestCase
+
+@end
+
+@implementation BT709InverseTableTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+static inline
+int roundTripError(int R, int G, int B, int Y, int Cb, int Cr) {
+  int decR, decG, decB;
+  Apple196_to_sRGB_convertYCbCrToRGB(Y, Cb, Cr, &decR, &decG, &decB, 1);
+  return ((decR - R) * (decR - R)) + ((decG - G) * (decG - G)) + ((decB - B) * (decB - B));
+}
+
+// Searched values must never decode further from the input than
+// the forward matrix result, over a sample of sRGB inputs.
+
+- (void)testInverseSearch_NoWorseThanForward {
+  BT709InverseSearch *search = (BT709InverseSearch *) malloc(sizeof(BT709InverseSearch));
+  bt709_inverse_search_init(search, 2);
+
+  int numImproved = 0;
+
+  for (int R = 0; R < 256; R += 15) {
+    for (int G = 0; G < 256; G += 5) {
+      for (int B = 0; B < 256; B += 3) {
+        int Y, Cb, Cr;
+        Apple196_from_sRGB_convertRGBToYCbCr(R, G, B, &Y, &Cb, &Cr);
+        int forwardError = roundTripError(R, G, B, Y, Cb, Cr);
+
+        uint8_t entry[3];
+        bt709_inverse_search_pixel(search, R, G, B, entry);
+        int inverseError = roundTripError(R, G, B, entry[0], entry[1], entry[2]);
+
+        XCTAssert(inverseError <= forwardError, @"(%d %d %d) : %d > %d", R, G, B, inverseError, forwardError);
+
+        if (inverseError < forwardError) {
+          numImproved += 1;
+        }
+      }
+    }
+  }
+
+  XCTAssert(numImproved > 0);
+
+  free(search);
+}
+
+// Gray inputs decode exactly with the forward encoding already,
+// the search must keep those values.
+
+- (void)testInverseSearch_Gray {
+  BT709InverseSearch *search = (BT709InverseSearch *) malloc(sizeof(BT709InverseSearch));
+  bt709_inverse_search_init(search, 2);
+
+  for (int i = 0; i < 256; i++) {
+    int Y, Cb, Cr;
+    Apple196_from_sRGB_convertRGBToYCbCr(i, i, i, &Y, &Cb, &Cr);
+
+    if (roundTripError(i, i, i, Y, Cb, Cr) != 0) {
+      continue;
+    }
+
+    uint8_t entry[3];
+    bt709_inverse_search_pixel(search, i, i, i, entry);
+
+    XCTAssert(roundTripError(i, i, i, entry[0], entry[1], entry[2]) == 0, @"gray %d", i);
+  }
+
+  free(search);
+}
+
+// Y values in an encoded frame are the table entries for each pixel
+
+- (void)testInverseTableEncode_2x2 {
+  uint8_t *entries = (uint8_t *) calloc(1, BT709_INVERSE_TABLE_DATA_LEN);
+
+  BT709InverseSearch *search = (BT709InverseSearch *) malloc(sizeof(BT709InverseSearch));
+  bt709_inverse_search_init(search, 2);
+  bt709_inverse_search_rows(search, entries, 200, 201);
+  free(search);
+
+  BT709InverseTable table;
+  bt709_inverse_table_init(&table, entries);
+
+  uint8_t pixels[2*2*3] = {
+    200, 10, 30,    200, 20, 40,
+    200, 30, 50,    200, 40, 60
+  };
+
+  uint8_t Y[4];
+  uint8_t Cb[1];
+  uint8_t Cr[1];
+
+  BT709PlanesStruct planes = { Y, 2, Cb, 1, Cr, 1 };
+
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  int result = bt709_inverse_table_encode(&table, &layout, pixels, 2*3, 2, 2, &planes);
+  XCTAssert(result == 0);
+
+  for (int i = 0; i < 4; i++) {
+    const uint8_t *p = &pixels[i*3];
+    XCTAssert(Y[i] == bt709_inverse_table_lookup(&table, p[0], p[1], p[2])[0]);
+  }
+
+  XCTAssert(Cb[0] >= BT709_UVMin && Cb[0] <= BT709_UVMax);
+  XCTAssert(Cr[0] >= BT709_UVMin && Cr[0] <= BT709_UVMax);
+
+  bt709_inverse_table_close(&table);
+  free(entries);
+}
+
+@end
@@ -0,0 +1,141 @@
+//
+//  BT709PatternTests.m
+//
+//  Test pattern generator logic in bt709_pattern.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "bt709_pattern.h"
+
+@interface BT709PatternTests : XCTestCase
+
+@end
+
+@implementation BT709PatternTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// Planar output encodes one row pair per area and copies it down,
+// which must give the same planes as encoding every BGRA pixel.
+
+- (void)testPlanes_MatchFrameEncode {
+  const int width = 46;
+  const int height = 30;
+  const int frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+
+  const BT709Pattern patterns[] = { BT709PatternBars, BT709PatternRamp, BT709PatternLinearRamp, BT709PatternGraySweep, BT709PatternZonePlate };
+
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+  BT709FrameTables *tables = malloc(sizeof(BT709FrameTables));
+  bt709_frame_tables_init(tables, BT709GammaSrgb, BT709GammaApple);
+
+  uint8_t *pixels = malloc(width * height * 4);
+  uint8_t *expected = malloc(frameLen);
+  uint8_t *actual = malloc(frameLen);
+
+  BT709PlanesStruct expectedPlanes = { expected, width, expected + (width * height), width / 2, expected + (width * height) + ((width / 2) * (height / 2)), width / 2 };
+  BT709PlanesStruct actualPlanes = { actual, width, actual + (width * height), width / 2, actual + (width * height) + ((width / 2) * (height / 2)), width / 2 };
+
+  for (int p = 0; p < (sizeof(patterns) / sizeof(patterns[0])); p++) {
+    for (int frameIndex = 0; frameIndex < 3; frameIndex++) {
+      XCTAssert(bt709_pattern_bgra(patterns[p], frameIndex, 3, 1, width, height, pixels, width * 4) == 0);
+      bt709_frame_encode(tables, &layout, pixels, width * 4, width, height, &expectedPlanes);
+
+      memset(actual, 0, frameLen);
+      XCTAssert(bt709_pattern_planes(tables, patterns[p], frameIndex, 3, 1, width, height, &actualPlanes) == 0);
+      XCTAssert(memcmp(actual, expected, frameLen) == 0, @"pattern %d frame %d", patterns[p], frameIndex);
+    }
+  }
+
+  // The sweep goes from black to white over the frames
+
+  bt709_pattern_bgra(BT709PatternGraySweep, 0, 3, 1, width, height, pixels, width * 4);
+  XCTAssert(pixels[0] == 0 && pixels[(width * height * 4) - 2] == 0);
+  bt709_pattern_bgra(BT709PatternGraySweep, 2, 3, 1, width, height, pixels, width * 4);
+  XCTAssert(pixels[0] == 255 && pixels[(width * height * 4) - 2] == 255);
+
+  // The alpha fade planes are the alpha values encoded as gray
+
+  for (int frameIndex = 0; frameIndex < 3; frameIndex++) {
+    XCTAssert(bt709_pattern_bgra(BT709PatternAlphaFade, frameIndex, 3, 1, width, height, pixels, width * 4) == 0);
+    for (int i = 0; i < (width * height); i++) {
+      uint8_t A = pixels[(i * 4) + 3];
+      pixels[(i * 4) + 0] = A;
+      pixels[(i * 4) + 1] = A;
+      pixels[(i * 4) + 2] = A;
+      pixels[(i * 4) + 3] = 0xFF;
+    }
+    bt709_frame_encode(tables, &layout, pixels, width * 4, width, height, &expectedPlanes);
+
+    memset(actual, 0, frameLen);
+    XCTAssert(bt709_pattern_planes(tables, BT709PatternAlphaFade, frameIndex, 3, 1, width, height, &actualPlanes) == 0);
+    XCTAssert(memcmp(actual, expected, frameLen) == 0, @"alpha fade frame %d", frameIndex);
+  }
+
+  XCTAssert(bt709_pattern_planes(tables, BT709PatternBars, 0, 1, 1, width - 1, height, &actualPlanes) == 1);
+
+  free(pixels);
+  free(expected);
+  free(actual);
+  free(tables);
+}
+
+- (void)testNoise_Deterministic {
+  const int width = 37;
+  const int height = 5;
+  const int bytesPerRow = (width * 4) + 4;
+
+  uint8_t *a = malloc(bytesPerRow * height);
+  uint8_t *b = malloc(bytesPerRow * height);
+
+  bt709_pattern_bgra(BT709PatternNoise, 4, 10, 7, width, height, a, bytesPerRow);
+  bt709_pattern_bgra(BT709PatternNoise, 4, 10, 7, width, height, b, bytesPerRow);
+
+  for (int row = 0; row < height; row++) {
+    XCTAssert(memcmp(a + (row * bytesPerRow), b + (row * bytesPerRow), width * 4) == 0);
+    for (int col = 0; col < width; col++) {
+      XCTAssert(a[(row * bytesPerRow) + (col * 4) + 3] == 0xFF);
+    }
+  }
+
+  // Another seed or frame gives other values
+
+  bt709_pattern_bgra(BT709PatternNoise, 4, 10, 8, width, height, b, bytesPerRow);
+  XCTAssert(memcmp(a, b, width * 4) != 0);
+  bt709_pattern_bgra(BT709PatternNoise, 5, 10, 7, width, height, b, bytesPerRow);
+  XCTAssert(memcmp(a, b, width * 4) != 0);
+
+  free(a);
+  free(b);
+}
+
+- (void)testZonePlate_Symmetric {
+  const int width = 40;
+  const int height = 24;
+
+  uint8_t *pixels = malloc(width * height * 4);
+  bt709_pattern_bgra(BT709PatternZonePlate, 0, 1, 1, width, height, pixels, width * 4);
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      int v = pixels[((row * width) + col) * 4];
+      XCTAssert(v == pixels[((row * width) + (width - 1 - col)) * 4]);
+      XCTAssert(v == pixels[(((height - 1 - row) * width) + col) * 4]);
+    }
+  }
+
+  // The center is at the top of a cycle
+
+  XCTAssert(pixels[(((height / 2) * width) + (width / 2)) * 4] >= 250);
+
+  free(pixels);
+}
+
+@end
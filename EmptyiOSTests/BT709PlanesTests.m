@@ -0,0 +1,110 @@
+//
+//  BT709PlanesTests.m
+//
+//  Test plane copy and Cb Cr interleave logic in bt709_planes.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "bt709_planes.h"
+
+@interface BT709PlanesTests : XCTestCase
+
+@end
+
+@implementation BT709PlanesTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// Widths that are not a multiple of 16 exercise the scalar tail
+// and padded strides exercise the per row path.
+
+- (void)testDeinterleaveInterleave_RoundTrip {
+  const int widths[] = { 1, 15, 16, 17, 40 };
+
+  for (int i = 0; i < (sizeof(widths) / sizeof(widths[0])); i++) {
+    const int width = widths[i];
+    const int height = 3;
+
+    const int cbcrBytesPerRow = (width * 2) + 6;
+    const int cbBytesPerRow = width + 3;
+    const int crBytesPerRow = width + 5;
+
+    uint8_t *cbcr = malloc(cbcrBytesPerRow * height);
+    uint8_t *cbcrOut = calloc(cbcrBytesPerRow * height, 1);
+    uint8_t *cb = calloc(cbBytesPerRow * height, 1);
+    uint8_t *cr = calloc(crBytesPerRow * height, 1);
+
+    for (int j = 0; j < (cbcrBytesPerRow * height); j++) {
+      cbcr[j] = (uint8_t) ((j * 13) + 7);
+    }
+
+    bt709_planes_deinterleave(cb, cbBytesPerRow, cr, crBytesPerRow, cbcr, cbcrBytesPerRow, width, height);
+
+    for (int row = 0; row < height; row++) {
+      for (int col = 0; col < width; col++) {
+        uint8_t cbVal = cbcr[(row * cbcrBytesPerRow) + (col * 2)];
+        uint8_t crVal = cbcr[(row * cbcrBytesPerRow) + (col * 2) + 1];
+        XCTAssert(cb[(row * cbBytesPerRow) + col] == cbVal, @"width %d row %d col %d", width, row, col);
+        XCTAssert(cr[(row * crBytesPerRow) + col] == crVal, @"width %d row %d col %d", width, row, col);
+      }
+    }
+
+    bt709_planes_interleave(cbcrOut, cbcrBytesPerRow, cb, cbBytesPerRow, cr, crBytesPerRow, width, height);
+
+    for (int row = 0; row < height; row++) {
+      int cmp = memcmp(cbcrOut + (row * cbcrBytesPerRow), cbcr + (row * cbcrBytesPerRow), width * 2);
+      XCTAssert(cmp == 0, @"width %d row %d", width, row);
+
+      // Padding at the end of each row is not written
+
+      for (int col = (width * 2); col < cbcrBytesPerRow; col++) {
+        XCTAssert(cbcrOut[(row * cbcrBytesPerRow) + col] == 0);
+      }
+    }
+
+    free(cbcr);
+    free(cbcrOut);
+    free(cb);
+    free(cr);
+  }
+}
+
+- (void)testCopy_Strided {
+  const int width = 35;
+  const int height = 4;
+  const int inBytesPerRow = 64;
+  const int outBytesPerRow = 48;
+
+  uint8_t in[inBytesPerRow * height];
+  uint8_t out[outBytesPerRow * height];
+  uint8_t packed[width * height];
+
+  for (int i = 0; i < sizeof(in); i++) {
+    in[i] = (uint8_t) i;
+  }
+  memset(out, 0xFF, sizeof(out));
+
+  bt709_planes_copy(out, outBytesPerRow, in, inBytesPerRow, width, height);
+
+  for (int row = 0; row < height; row++) {
+    XCTAssert(memcmp(out + (row * outBytesPerRow), in + (row * inBytesPerRow), width) == 0, @"row %d", row);
+    XCTAssert(out[(row * outBytesPerRow) + width] == 0xFF, @"row %d", row);
+  }
+
+  // Packed output is copied as one block
+
+  bt709_planes_copy(packed, width, out, outBytesPerRow, width, height);
+
+  for (int row = 0; row < height; row++) {
+    XCTAssert(memcmp(packed + (row * width), in + (row * inBytesPerRow), width) == 0, @"row %d", row);
+  }
+}
+
+@end
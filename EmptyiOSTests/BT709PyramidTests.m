@@ -0,0 +1,130 @@
+//
+//  BT709PyramidTests.m
+//
+//  Test proxy level generation logic in bt709_pyramid.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "sRGB.h"
+#import "BT709.h"
+
+#import "bt709_pyramid.h"
+
+@interface BT709PyramidTests : XCTestCase
+
+@end
+
+@implementation BT709PyramidTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// A flat color frame must produce the same Y Cb Cr values
+// at every level as at full size.
+
+- (void)testPyramid_FlatColor {
+  const int width = 32;
+  const int height = 16;
+
+  uint8_t *pixels = (uint8_t *) malloc(width * height * 3);
+  for (int i = 0; i < (width * height); i++) {
+    pixels[(i*3)+0] = 200;
+    pixels[(i*3)+1] = 100;
+    pixels[(i*3)+2] = 50;
+  }
+
+  uint8_t *yuv = (uint8_t *) malloc(width * height * 2);
+  BT709PlanesStruct planes = { yuv, width, yuv + (width * height), width/2, yuv + (width * height) + (width * height / 4), width/2 };
+
+  BT709FrameTables tables;
+  bt709_frame_tables_init(&tables, BT709GammaSrgb, BT709GammaApple);
+
+  BT709Pyramid pyramid;
+  int result = bt709_pyramid_init(&pyramid, &tables, width, height, 3);
+  XCTAssert(result == 0);
+
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  result = bt709_pyramid_encode(&pyramid, &layout, pixels, width * 3, width, height, &planes);
+  XCTAssert(result == 0);
+
+  for (int level = 0; level < 3; level++) {
+    Y4MFrameStruct fs;
+    bt709_pyramid_level_frame(&pyramid, level, &fs);
+
+    XCTAssert(fs.yLen == ((width >> (level+1)) * (height >> (level+1))));
+
+    for (int i = 0; i < fs.yLen; i++) {
+      XCTAssert(fs.yPtr[i] == yuv[0], @"level %d Y[%d]", level, i);
+    }
+    for (int i = 0; i < fs.uLen; i++) {
+      XCTAssert(fs.uPtr[i] == planes.cbPtr[0], @"level %d Cb[%d]", level, i);
+      XCTAssert(fs.vPtr[i] == planes.crPtr[0], @"level %d Cr[%d]", level, i);
+    }
+  }
+
+  bt709_pyramid_free(&pyramid);
+  free(yuv);
+  free(pixels);
+}
+
+// Levels are averaged in linear light, so a black and white
+// checkerboard is a 50% linear gray at 1/2 size. A 12 row input
+// gives a 3 row 1/4 level that is encoded as 2 rows.
+
+- (void)testPyramid_LinearAverage {
+  const int width = 8;
+  const int height = 12;
+
+  uint8_t pixels[width * height * 3];
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      uint8_t v = ((row + col) % 2) ? 255 : 0;
+      uint8_t *p = &pixels[((row * width) + col) * 3];
+      p[0] = v;
+      p[1] = v;
+      p[2] = v;
+    }
+  }
+
+  uint8_t yuv[width * height * 2];
+  BT709PlanesStruct planes = { yuv, width, yuv + (width * height), width/2, yuv + (width * height) + (width * height / 4), width/2 };
+
+  BT709FrameTables tables;
+  bt709_frame_tables_init(&tables, BT709GammaSrgb, BT709GammaSrgb);
+
+  BT709Pyramid pyramid;
+  int result = bt709_pyramid_init(&pyramid, &tables, width, height, 2);
+  XCTAssert(result == 0);
+
+  XCTAssert(pyramid.levels[1].levelHeight == 3);
+  XCTAssert(pyramid.levels[1].height == 2);
+
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  result = bt709_pyramid_encode(&pyramid, &layout, pixels, width * 3, width, height, &planes);
+  XCTAssert(result == 0);
+
+  int grayY, grayCb, grayCr;
+  int gray = BT709_from_linear(0.5f, BT709GammaSrgb);
+  BT709_convertNonLinearRGBToYCbCr(byteNorm(gray), byteNorm(gray), byteNorm(gray), &grayY, &grayCb, &grayCr);
+
+  for (int level = 0; level < 2; level++) {
+    Y4MFrameStruct fs;
+    bt709_pyramid_level_frame(&pyramid, level, &fs);
+
+    for (int i = 0; i < fs.yLen; i++) {
+      XCTAssert(fs.yPtr[i] == grayY, @"level %d Y[%d] %d != %d", level, i, fs.yPtr[i], grayY);
+    }
+  }
+
+  bt709_pyramid_free(&pyramid);
+}
+
+@end
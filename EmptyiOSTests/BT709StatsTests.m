@@ -0,0 +1,106 @@
+//
+//  BT709StatsTests.m
+//
+//  Test histogram and range statistics logic in bt709_stats.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "bt709_stats.h"
+
+@interface BT709StatsTests : XCTestCase
+
+@end
+
+@implementation BT709StatsTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// Rows that mix runs of one value with varying values, at widths
+// that do and do not fill a whole SIMD block, must count the same
+// as a plain loop.
+
+- (void)testCountRow_MatchesScalar {
+  uint8_t row[80];
+
+  for (int width = 1; width <= 80; width++) {
+    for (int i = 0; i < width; i++) {
+      row[i] = ((i / 20) % 2) == 0 ? 128 : (uint8_t) ((i * 37) + width);
+    }
+
+    uint32_t counts[4 * 256];
+    memset(counts, 0, sizeof(counts));
+    bt709_stats_count_row(row, width, counts);
+
+    uint32_t expected[256];
+    memset(expected, 0, sizeof(expected));
+    for (int i = 0; i < width; i++) {
+      expected[row[i]] += 1;
+    }
+
+    for (int v = 0; v < 256; v++) {
+      uint32_t sum = counts[v] + counts[256 + v] + counts[512 + v] + counts[768 + v];
+      XCTAssert(sum == expected[v], @"width %d value %d", width, v);
+    }
+  }
+}
+
+- (void)testFrame_RangeAndDrift {
+  const int width = 8;
+  const int height = 6;
+
+  uint8_t Y[width * height];
+  uint8_t Cb[(width / 2) * (height / 2)];
+  uint8_t Cr[(width / 2) * (height / 2)];
+
+  memset(Y, 100, sizeof(Y));
+  memset(Cb, 128, sizeof(Cb));
+  memset(Cr, 130, sizeof(Cr));
+
+  Y[0] = 0;
+  Y[1] = 15;
+  Y[2] = 16;
+  Y[45] = 235;
+  Y[46] = 236;
+  Y[47] = 255;
+  Cb[11] = 241;
+
+  BT709PlanesStruct planes = { Y, width, Cb, width / 2, Cr, width / 2 };
+
+  for (int numThreads = 1; numThreads <= 4; numThreads++) {
+    BT709StatsResult *result = malloc(sizeof(BT709StatsResult));
+    XCTAssert(bt709_stats_frame(&planes, width, height, numThreads, result) == 0);
+
+    XCTAssert(result->numFrames == 1);
+    XCTAssert(result->numSamples[0] == (width * height));
+    XCTAssert(result->numSamples[1] == ((width / 2) * (height / 2)));
+
+    XCTAssert(bt709_stats_result_min(result, 0) == 0);
+    XCTAssert(bt709_stats_result_max(result, 0) == 255);
+    XCTAssert(bt709_stats_result_min(result, 2) == 130);
+    XCTAssert(bt709_stats_result_max(result, 2) == 130);
+
+    uint64_t below, above;
+    bt709_stats_result_out_of_range(result, 0, &below, &above);
+    XCTAssert(below == 2 && above == 2, @"threads %d", numThreads);
+    bt709_stats_result_out_of_range(result, 1, &below, &above);
+    XCTAssert(below == 0 && above == 1);
+    bt709_stats_result_out_of_range(result, 2, &below, &above);
+    XCTAssert(below == 0 && above == 0);
+
+    XCTAssert(fabs(bt709_stats_result_drift(result, 1) - (113.0 / 12.0)) < 1e-9);
+    XCTAssert(fabs(bt709_stats_result_drift(result, 2) - 2.0) < 1e-9);
+
+    free(result);
+  }
+
+  XCTAssert(bt709_stats_frame(&planes, width - 1, height, 1, NULL) == 1);
+}
+
+@end
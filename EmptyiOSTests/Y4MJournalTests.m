@@ -0,0 +1,149 @@
+//
+//  Y4MJournalTests.m
+//
+//  Test progress journal logic in y4m_journal.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "y4m_journal.h"
+
+@interface Y4MJournalTests : XCTestCase
+
+@end
+
+@implementation Y4MJournalTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+static
+int writeFrame(FILE *outFile, int frameNum) {
+  uint8_t frame[4*2 + 2*2];
+  memset(frame, frameNum, sizeof(frame));
+  Y4MFrameStruct fs = { frame, 4*2, frame + 4*2, 2, frame + 4*2 + 2, 2 };
+  return y4m_write_frame(outFile, &fs);
+}
+
+// A partially written frame after the last commit is dropped on
+// resume and the result matches an uninterrupted encode.
+
+- (void)testJournal_Resume {
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"resume.y4m"];
+  NSString *expectedPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"expected.y4m"];
+
+  const char *outPath = [path UTF8String];
+
+  Y4MHeaderStruct header = { 4, 2, Y4MHeaderFPS_30 };
+
+  FILE *expectedFile = fopen([expectedPath UTF8String], "wb");
+  y4m_write_header(expectedFile, &header);
+  for (int i = 0; i < 5; i++) {
+    writeFrame(expectedFile, i);
+  }
+  fclose(expectedFile);
+
+  Y4MJournal journal;
+
+  unlink(outPath);
+  unlink([[path stringByAppendingString:@".journal"] UTF8String]);
+
+  FILE *outFile = y4m_journal_open(&journal, outPath);
+  XCTAssert(outFile != NULL);
+  XCTAssert(journal.numFrames == 0);
+
+  y4m_write_header(outFile, &header);
+  XCTAssert(y4m_journal_commit(&journal, outFile, 0) == 0);
+
+  for (int i = 0; i < 3; i++) {
+    writeFrame(outFile, i);
+    XCTAssert(y4m_journal_commit(&journal, outFile, i + 1) == 0);
+  }
+
+  // Interrupted in the middle of the 4th frame
+
+  fwrite("FRAME\n", 6, 1, outFile);
+  fclose(outFile);
+
+  outFile = y4m_journal_open(&journal, outPath);
+  XCTAssert(outFile != NULL);
+  XCTAssert(journal.numFrames == 3);
+
+  for (int i = journal.numFrames; i < 5; i++) {
+    writeFrame(outFile, i);
+    XCTAssert(y4m_journal_commit(&journal, outFile, i + 1) == 0);
+  }
+  fclose(outFile);
+  y4m_journal_remove(&journal);
+
+  NSData *outData = [NSData dataWithContentsOfFile:path];
+  NSData *expectedData = [NSData dataWithContentsOfFile:expectedPath];
+
+  XCTAssert([outData isEqualToData:expectedData]);
+
+  XCTAssert(y4m_journal_load(&journal, outPath) == 1);
+}
+
+// Killed after the header was committed but before the first frame,
+// the resumed encode starts at frame 0 without a second header.
+
+- (void)testJournal_ResumeHeaderOnly {
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"resume_header.y4m"];
+  NSString *expectedPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"expected_header.y4m"];
+
+  const char *outPath = [path UTF8String];
+
+  Y4MHeaderStruct header = { 4, 2, Y4MHeaderFPS_30 };
+
+  FILE *expectedFile = fopen([expectedPath UTF8String], "wb");
+  y4m_write_header(expectedFile, &header);
+  for (int i = 0; i < 2; i++) {
+    writeFrame(expectedFile, i);
+  }
+  fclose(expectedFile);
+
+  Y4MJournal journal;
+
+  unlink(outPath);
+  unlink([[path stringByAppendingString:@".journal"] UTF8String]);
+
+  FILE *outFile = y4m_journal_open(&journal, outPath);
+  XCTAssert(outFile != NULL);
+  XCTAssert(y4m_journal_has_header(&journal) == 0);
+
+  y4m_write_header(outFile, &header);
+  XCTAssert(y4m_journal_commit(&journal, outFile, 0) == 0);
+
+  // Interrupted in the middle of the 1st frame
+
+  fwrite("FRAME\n", 6, 1, outFile);
+  fclose(outFile);
+
+  outFile = y4m_journal_open(&journal, outPath);
+  XCTAssert(outFile != NULL);
+  XCTAssert(journal.numFrames == 0);
+  XCTAssert(y4m_journal_has_header(&journal));
+
+  if (!y4m_journal_has_header(&journal)) {
+    y4m_write_header(outFile, &header);
+  }
+
+  for (int i = journal.numFrames; i < 2; i++) {
+    writeFrame(outFile, i);
+    XCTAssert(y4m_journal_commit(&journal, outFile, i + 1) == 0);
+  }
+  fclose(outFile);
+  y4m_journal_remove(&journal);
+
+  NSData *outData = [NSData dataWithContentsOfFile:path];
+  NSData *expectedData = [NSData dataWithContentsOfFile:expectedPath];
+
+  XCTAssert([outData isEqualToData:expectedData]);
+}
+
+@end
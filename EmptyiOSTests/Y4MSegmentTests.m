@@ -0,0 +1,111 @@
+//
+//  Y4MSegmentTests.m
+//
+//  Test segment write, check, and copy logic in y4m_segment.h
+//
+
+#import <XCTest/XCTest.h>
+
+#import "y4m_segment.h"
+
+@interface Y4MSegmentTests : XCTestCase
+
+@end
+
+@implementation Y4MSegmentTests
+
+- (void)setUp {
+  // Put setup code here. This method is called before the invocation of each test method in the class.
+}
+
+- (void)tearDown {
+  // Put teardown code here. This method is called after the invocation of each test method in the class.
+}
+
+// Write numFrames 4x2 frames filled with the frame index
+
+static
+int writeSegment(const char *path, int start, int numFrames) {
+  FILE *outFile = fopen(path, "wb");
+  if (outFile == NULL) {
+    return 1;
+  }
+
+  Y4MHeaderStruct header = { 4, 2, Y4MHeaderFPS_24 };
+  int result = y4m_segment_write_header(outFile, &header, start);
+
+  uint8_t frame[4*2 + 2*2];
+
+  for (int i = 0; i < numFrames && result == 0; i++) {
+    memset(frame, start + i, sizeof(frame));
+    Y4MFrameStruct fs = { frame, 4*2, frame + 4*2, 2, frame + 4*2 + 2, 2 };
+    result = y4m_write_frame(outFile, &fs);
+  }
+
+  if (result == 0) {
+    result = y4m_segment_finish(outFile, &header, start, numFrames);
+  }
+
+  fclose(outFile);
+  return result;
+}
+
+- (void)testSegment_ReadHeader {
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"test.y4mseg"];
+
+  XCTAssert(writeSegment([path UTF8String], 10, 3) == 0);
+
+  FILE *inFile = fopen([path UTF8String], "rb");
+  Y4MSegmentInfo info;
+  int result = y4m_segment_read_header(inFile, [path UTF8String], &info);
+  fclose(inFile);
+
+  XCTAssert(result == 0);
+  XCTAssert(info.width == 4);
+  XCTAssert(info.height == 2);
+  XCTAssert(info.fpsNum == 24);
+  XCTAssert(info.fpsDen == 1);
+  XCTAssert(info.start == 10);
+  XCTAssert(info.numFrames == 3);
+  XCTAssert(info.frameLen == (6 + 4*2 + 2*2));
+
+  // A partially written frame must be detected
+
+  truncate([path UTF8String], info.headerLen + (info.frameLen * 3) - 1);
+
+  inFile = fopen([path UTF8String], "rb");
+  result = y4m_segment_read_header(inFile, [path UTF8String], &info);
+  fclose(inFile);
+
+  XCTAssert(result != 0);
+}
+
+// Copied FRAME records must be the bytes after the segment line
+
+- (void)testSegment_Splice {
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"splice.y4mseg"];
+  NSString *outPath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"splice.out"];
+
+  XCTAssert(writeSegment([path UTF8String], 0, 2) == 0);
+
+  FILE *inFile = fopen([path UTF8String], "rb");
+  Y4MSegmentInfo info;
+  XCTAssert(y4m_segment_read_header(inFile, [path UTF8String], &info) == 0);
+
+  FILE *outFile = fopen([outPath UTF8String], "wb");
+  int result = y4m_segment_splice(fileno(outFile), fileno(inFile), info.headerLen, info.frameLen * info.numFrames);
+  fclose(outFile);
+  fclose(inFile);
+
+  XCTAssert(result == 0);
+
+  NSData *segmentData = [NSData dataWithContentsOfFile:path];
+  NSData *outData = [NSData dataWithContentsOfFile:outPath];
+
+  NSData *framesData = [segmentData subdataWithRange:NSMakeRange(info.headerLen, segmentData.length - info.headerLen)];
+
+  XCTAssert([outData isEqualToData:framesData]);
+  XCTAssert(outData.length == (2 * info.frameLen));
+}
+
+@end
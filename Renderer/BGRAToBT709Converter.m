@@ -14,6 +14,12 @@
 
 #import "CVPixelBufferUtils.h"
 
+#import "bt709_planes.h"
+
+#import "bt709_alpha.h"
+
+#import "bt709_trace.h"
+
 @import Accelerate;
 @import CoreImage;
 
@@ -553,7 +559,9 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
     CGColorSpaceRelease(cs);
   }
   
+  BT709_TRACE_BEGIN(render, "renderCGImage");
   [frameBuffer renderCGImage:inputImageRef];
+  BT709_TRACE_END(render);
   
   uint32_t *pixelsPtr = (uint32_t *) frameBuffer.pixels;
   
@@ -564,7 +572,9 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
     //*pixelsPtr++ = pixel;
   //}
   
+  BT709_TRACE_BEGIN(subsample, "cvpbu_ycbcr_subsample");
   cvpbu_ycbcr_subsample(pixelsPtr, width, height, cvPixelBuffer, inputGamma, outputGamma);
+  BT709_TRACE_END(subsample);
   
   return TRUE;
   
@@ -630,6 +640,8 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
                           bufferPtr:(vImage_Buffer*)bufferPtr
                          colorspace:(CGColorSpaceRef)colorspace
 {
+  BT709_TRACE_SCOPE("convertFromCoreVideoBuffer");
+  
   // Note that NULL passed in as colorspace defines colorspace as sRGB on both MacOSX and iOS
   
   vImage_CGImageFormat rgbCGImgFormat = {
@@ -691,6 +703,8 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
                 Cr:(NSMutableData*)Cr
               dump:(BOOL)dump
 {
+  BT709_TRACE_SCOPE("copyYCBCr");
+  
   int width = (int) CVPixelBufferGetWidth(cvPixelBuffer);
   int height = (int) CVPixelBufferGetHeight(cvPixelBuffer);
 
@@ -716,33 +730,12 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
   uint8_t *yPlane = (uint8_t *) CVPixelBufferGetBaseAddressOfPlane(cvPixelBuffer, 0);
   const size_t yBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(cvPixelBuffer, 0);
   
-  for (int row = 0; row < height; row++) {
-    uint8_t *rowPtr = yPlane + (row * yBytesPerRow);
-    for (int col = 0; col < width; col++) {
-      uint8_t bVal = rowPtr[col];
-      
-      int offset = (row * width) + col;
-      yOutPtr[offset] = bVal;
-    }
-  }
+  bt709_planes_copy(yOutPtr, width, yPlane, yBytesPerRow, width, height);
   
-  uint16_t *uvPlane = (uint16_t *) CVPixelBufferGetBaseAddressOfPlane(cvPixelBuffer, 1);
+  uint8_t *uvPlane = (uint8_t *) CVPixelBufferGetBaseAddressOfPlane(cvPixelBuffer, 1);
   const size_t cbcrBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(cvPixelBuffer, 1);
-  const size_t cbcrPixelsPerRow = cbcrBytesPerRow / sizeof(uint16_t);
   
-  for (int row = 0; row < hh; row++) {
-    uint16_t *rowPtr = uvPlane + (row * cbcrPixelsPerRow);
-    
-    for (int col = 0; col < hw; col++) {
-      uint16_t bPairs = rowPtr[col];
-      uint8_t cbByte = bPairs & 0xFF; // uvPair[0]
-      uint8_t crByte = (bPairs >> 8) & 0xFF; // uvPair[1]
-
-      int offset = (row * hw) + col;
-      CbOutPtr[offset] = cbByte;
-      CrOutPtr[offset] = crByte;
-    }
-  }
+  bt709_planes_deinterleave(CbOutPtr, hw, CrOutPtr, hw, uvPlane, cbcrBytesPerRow, hw, hh);
   
   {
     int status = CVPixelBufferUnlockBaseAddress(cvPixelBuffer, kCVPixelBufferLock_ReadOnly);
@@ -876,6 +869,8 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
                                    isLinear:(BOOL)isLinear
                                    asSRGBGamma:(BOOL)asSRGBGamma
 {
+  BT709_TRACE_SCOPE("createYCbCrFromCGImage");
+  
   if (isLinear) {
     assert(asSRGBGamma == FALSE);
   }
@@ -1131,67 +1126,41 @@ static inline uint32_t byte_to_grayscale24(uint32_t byteVal)
 
 + (CGImageRef) unpremultiply:(CGImageRef)inputImageRef
 {
-  // Default to sRGB on both MacOSX and iOS
-  //CGColorSpaceRef inputColorspaceRef = NULL;
-  CGColorSpaceRef inputColorspaceRef = CGImageGetColorSpace(inputImageRef);
-  
-  vImage_CGImageFormat rgbCGImgFormat24 = {
-    .bitsPerComponent = 8,
-    .bitsPerPixel = 32,
-    .bitmapInfo = (CGBitmapInfo)(kCGBitmapByteOrder32Host | kCGImageAlphaNoneSkipFirst),
-    .colorSpace = inputColorspaceRef,
-  };
+  static BT709AlphaTables alphaTables;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    bt709_alpha_tables_init(&alphaTables, BT709GammaSrgb);
+  });
   
-  vImage_CGImageFormat rgbCGImgFormat32 = {
-    .bitsPerComponent = 8,
-    .bitsPerPixel = 32,
-    .bitmapInfo = (CGBitmapInfo)(kCGBitmapByteOrder32Host | kCGImageAlphaPremultipliedFirst),
-    .colorSpace = inputColorspaceRef,
-  };
-  
-  const CGFloat backgroundColor = 0.0f;
-  
-  vImage_Flags flags = 0;
-  flags = kvImagePrintDiagnosticsToConsole;
-  
-  vImage_Error err;
-  
-  vImage_Buffer sourceBuffer;
-  vImage_Buffer dstBuffer;
+  int width = (int) CGImageGetWidth(inputImageRef);
+  int height = (int) CGImageGetHeight(inputImageRef);
   
-  // Copy input CoreGraphic image data into vImage buffer and then copy into CoreVideo buffer
+  // Default to sRGB on both MacOSX and iOS
+  CGColorSpaceRef inputColorspaceRef = CGImageGetColorSpace(inputImageRef);
   
-  err = vImageBuffer_InitWithCGImage(&sourceBuffer, &rgbCGImgFormat32, &backgroundColor, inputImageRef, flags);
+  // Render as premultiplied BGRA, then write unpremultiplied pixels
+  // directly into a 24 BPP buffer where the alpha byte is ignored.
   
-  NSAssert(err == kvImageNoError, @"vImageBuffer_InitWithCGImage failed");
+  CGFrameBuffer *inputFB = [CGFrameBuffer cGFrameBufferWithBppDimensions:32 width:width height:height];
+  inputFB.colorspace = inputColorspaceRef;
   
-  // Allocate dst buffer
+  BOOL worked = [inputFB renderCGImage:inputImageRef];
   
-  err = vImageBuffer_Init(&dstBuffer,
-                          sourceBuffer.height,
-                          sourceBuffer.width,
-                          rgbCGImgFormat24.bitsPerPixel,
-                          flags);
-
-  NSAssert(err == kvImageNoError, @"vImageBuffer_Init failed : %d", (int)err);
+  if (worked == FALSE) {
+    return NULL;
+  }
   
-  err = vImageUnpremultiplyData_BGRA8888(&sourceBuffer,
-                                         &dstBuffer,
-                                         flags);
-
-  NSAssert(err == kvImageNoError, @"vImageUnpremultiplyData_ARGB8888 failed : %d", (int)err);
+  CGFrameBuffer *outputFB = [CGFrameBuffer cGFrameBufferWithBppDimensions:24 width:width height:height];
+  outputFB.colorspace = inputColorspaceRef;
   
-  CGImageRef unPreImg = vImageCreateCGImageFromBuffer(&dstBuffer,
-                                                      &rgbCGImgFormat24,
-                                                      nil,
-                                                      nil,
-                                                      flags,
-                                                      &err);
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
   
-  free(sourceBuffer.data);
-  free(dstBuffer.data);
+  bt709_alpha_frame(&alphaTables, BT709AlphaUnpremultiply, &layout,
+                    (uint8_t *) outputFB.pixels, width * 4,
+                    (const uint8_t *) inputFB.pixels, width * 4,
+                    width, height);
   
-  return unPreImg;
+  return [outputFB createCGImageRef];
 }
 
 @end
@@ -58,6 +58,14 @@ const static int BT709_YMax = 235;
 const static int BT709_UVMin =  16;
 const static int BT709_UVMax = 240;
 
+// 10 bit code values are the 8 bit values times 4
+
+const static int BT709_YMin10 =  64;
+const static int BT709_YMax10 = 940;
+
+const static int BT709_UVMin10 =  64;
+const static int BT709_UVMax10 = 960;
+
 // BT.709
 
 // Convert a non-linear log value to a linear value.
@@ -268,6 +276,57 @@ int BT709_convertNonLinearRGBToYCbCr(
   return 0;
 }
 
+// 10 bit version of BT709_convertNonLinearRGBToYCbCr(), the
+// result is quantized to [64, 940] for Y and [64, 960] for Cb Cr.
+
+static inline
+int BT709_convertNonLinearRGBToYCbCr10(
+                                  float Rn,
+                                  float Gn,
+                                  float Bn,
+                                  int *YPtr,
+                                  int *CbPtr,
+                                  int *CrPtr)
+{
+#if defined(DEBUG)
+  assert(YPtr);
+  assert(CbPtr);
+  assert(CrPtr);
+#endif // DEBUG
+  
+  float Ey = (BT709_Kr * Rn) + (BT709_Kg * Gn) + (BT709_Kb * Bn);
+  float Eb = (Bn - Ey) / BT709_Eb_minus_Ey_Range;
+  float Er = (Rn - Ey) / BT709_Er_minus_Ey_Range;
+  
+  // Quant Y to range [64, 940] (inclusive 877 values)
+  // Quant Eb, Er to range [64, 960] (inclusive 897 values, centered at 512)
+  
+  float AdjEy = (Ey * (BT709_YMax10-BT709_YMin10)) + 64;
+  float AdjEb = (Eb * (BT709_UVMax10-BT709_UVMin10)) + 512;
+  float AdjEr = (Er * (BT709_UVMax10-BT709_UVMin10)) + 512;
+  
+  int Y = (int) round(AdjEy);
+  int Cb = (int) round(AdjEb);
+  int Cr = (int) round(AdjEr);
+  
+#if defined(DEBUG)
+  assert(Y >= BT709_YMin10);
+  assert(Y <= BT709_YMax10);
+  
+  assert(Cb >= BT709_UVMin10);
+  assert(Cb <= BT709_UVMax10);
+  
+  assert(Cr >= BT709_UVMin10);
+  assert(Cr <= BT709_UVMax10);
+#endif // DEBUG
+  
+  *YPtr = Y;
+  *CbPtr = Cb;
+  *CrPtr = Cr;
+  
+  return 0;
+}
+
 // Given a normalized linear RGB pixel value, convert to BT.709
 // YCbCr log colorspace. This method assumes Alpha = 255, the
 // gamma flag makes it possible to return Y without a gamma
@@ -1048,7 +1107,7 @@ void sRGB_ycbcr_tolinearNorm(
                               float *CrPtr
                               )
 {
-  const BOOL debug = FALSE;
+  const int debug = 0;
   
 #if defined(DEBUG)
   assert(R >= 0 && R <= 255);
@@ -1147,11 +1206,16 @@ void BT709_tolinearNorm(
   return;
 }
 
+// Convert a normalized linear value to a normalized value
+// encoded with the output gamma curve, without rounding.
+
 static inline
-int BT709_from_linear(float Cn,
-                      const BT709Gamma outputGamma)
+float BT709_from_linear_norm(float Cn,
+                             const BT709Gamma outputGamma)
 {
-  float nonLinear;
+  // Linear when the gamma is unknown, so that a release build
+  // without the assert still returns a defined value.
+  float nonLinear = Cn;
   
   if (outputGamma == BT709GammaSrgb) {
     nonLinear = sRGB_linearNormToNonLinear(Cn);
@@ -1162,6 +1226,15 @@ int BT709_from_linear(float Cn,
   } else {
     assert(0);
   }
+  
+  return nonLinear;
+}
+
+static inline
+int BT709_from_linear(float Cn,
+                      const BT709Gamma outputGamma)
+{
+  float nonLinear = BT709_from_linear_norm(Cn, outputGamma);
 
   return (int) round(nonLinear * 255.0f);
 }
@@ -1177,7 +1250,7 @@ float BT709_average_cbcr_linear(
                               float C4n
                               )
 {
-  const BOOL debug = FALSE;
+  const int debug = 0;
   
   float sum = (C1n + C2n + C3n + C4n);
   float ave = sum / 4.0f;
@@ -1370,7 +1443,9 @@ void BT709_average_pixel_values(
                                 const BT709Gamma outputGamma
                                )
 {
-  const int debug = 1;
+  // Set to 1 to print the intermediate values of every call, this
+  // is called once per 2x2 block by the C tests and the fuzzer.
+  const int debug = 0;
   
 #if defined(DEBUG)
   assert(R1 >= 0 && R1 <= 255);
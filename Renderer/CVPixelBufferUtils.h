@@ -12,9 +12,12 @@
 
 #import "BT709.h"
 
+#import "bt709_planes.h"
+
 // Copy the contents of a specific plane from src to dst, this
-// method is optimized so that memcpy() operations will copy
-// either the whole buffer if possible otherwise or a row at a time.
+// method is optimized so that the whole buffer is copied at once
+// when possible and otherwise a row at a time. Large planes are
+// written with non-temporal stores, see bt709_planes.h.
 
 static inline
 void cvpbu_copy_plane(CVPixelBufferRef src, CVPixelBufferRef dst, int plane) {
@@ -42,16 +45,12 @@ void cvpbu_copy_plane(CVPixelBufferRef src, CVPixelBufferRef dst, int plane) {
   const size_t yOutBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(dst, plane);
   
   if (yInBytesPerRow == yOutBytesPerRow) {
-    memcpy(yOutPlane, yInPlane, yInBytesPerRow * height);
+    bt709_planes_copy(yOutPlane, yOutBytesPerRow, yInPlane, yInBytesPerRow, yInBytesPerRow, height);
   } else {
-    for (int row = 0; row < height; row++) {
-      uint8_t *rowInPtr = yInPlane + (row * yInBytesPerRow);
-      uint8_t *rowOutPtr = yOutPlane + (row * yOutBytesPerRow);
 #if defined(DEBUG)
-      assert(width <= yOutBytesPerRow);
+    assert(width <= yOutBytesPerRow);
 #endif // DEBUG
-      memcpy(rowOutPtr, rowInPtr, width);
-    }
+    bt709_planes_copy(yOutPlane, yOutBytesPerRow, yInPlane, yInBytesPerRow, width, height);
   }
   
   if ((0)) {
@@ -177,15 +176,7 @@ NSMutableData* cvpbu_get_y_plane_as_data(CVPixelBufferRef cvPixelBuffer, int pla
   
   uint8_t *yPlanePacked = (uint8_t *) mData.bytes;
   
-  for (int row = 0; row < height; row++) {
-    uint8_t *inRowPtr = yPlane + (row * yBytesPerRow);
-    uint8_t *outRowPtr = yPlanePacked + (row * (width * sizeof(uint8_t)));
-    
-    for (int col = 0; col < width; col++) {
-      int Y = inRowPtr[col];
-      outRowPtr[col] = Y;
-    }
-  }
+  bt709_planes_copy(yPlanePacked, width, yPlane, yBytesPerRow, width, height);
 
   {
     int status = CVPixelBufferUnlockBaseAddress(cvPixelBuffer, 0);
@@ -211,21 +202,12 @@ NSMutableData* cvpbu_get_uv_plane_as_data(CVPixelBufferRef cvPixelBuffer, int pl
     assert(status == kCVReturnSuccess);
   }
   
-  uint16_t *cbcrPlane = (uint16_t *) CVPixelBufferGetBaseAddressOfPlane(cvPixelBuffer, plane);
+  uint8_t *cbcrPlane = (uint8_t *) CVPixelBufferGetBaseAddressOfPlane(cvPixelBuffer, plane);
   size_t cbcrBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(cvPixelBuffer, plane);
-  const size_t cbcrPixelsPerRow = cbcrBytesPerRow / sizeof(uint16_t);
   
-  uint16_t *cbcrPlanePacked = (uint16_t *) mData.bytes;
+  uint8_t *cbcrPlanePacked = (uint8_t *) mData.bytes;
   
-  for (int row = 0; row < hh; row++) {
-    uint16_t *inRowPtr = cbcrPlane + (row * cbcrPixelsPerRow);
-    uint16_t *outRowPtr = cbcrPlanePacked + (row * hw);
-    
-    for (int col = 0; col < hw; col++) {
-      uint16_t uv = inRowPtr[col];
-      outRowPtr[col] = uv;
-    }
-  }
+  bt709_planes_copy(cbcrPlanePacked, hw * sizeof(uint16_t), cbcrPlane, cbcrBytesPerRow, hw * sizeof(uint16_t), hh);
 
   {
     int status = CVPixelBufferUnlockBaseAddress(cvPixelBuffer, 0);
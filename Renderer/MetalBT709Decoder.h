@@ -47,6 +47,15 @@ typedef enum {
 
 @property (nonatomic, assign) BOOL hasAlphaChannel;
 
+// If packedAlpha is set to TRUE then input frames are double height
+// with alpha stacked below the color image (srgb_to_bt709 -alpha packed).
+// The CPU decode methods then read color and alpha from the one buffer,
+// BGRA and RGBA half float output gets premultiplied alpha, and the composite
+// decode ignores alphaPixelBuffer. Region coordinates refer to the color
+// image.
+
+@property (nonatomic, assign) BOOL packedAlpha;
+
 // Set to TRUE once a render context has been setup
 
 // Setup Metal refs for this instance, this is implicitly
@@ -71,4 +80,48 @@ renderPassDescriptor:(MTLRenderPassDescriptor*)renderPassDescriptor
         renderHeight:(int)renderHeight
   waitUntilCompleted:(BOOL)waitUntilCompleted;
 
+// BT709 -> BGRA conversion on the CPU for the rectangle that starts at
+// (regionX, regionY) in the input. Pixels are written as sRGB encoded
+// BGRA into caller owned memory where each row is bytesPerRow apart,
+// so a viewer can decode just the visible part of a frame directly
+// into a larger buffer. The region can start at an odd offset. The
+// gamma property selects the decode curve and Metal is not used.
+
+- (BOOL) decodeBT709:(CVPixelBufferRef)yCbCrInputTexture
+             regionX:(int)regionX
+             regionY:(int)regionY
+         regionWidth:(int)regionWidth
+        regionHeight:(int)regionHeight
+          bgraPixels:(uint32_t*)bgraPixels
+         bytesPerRow:(int)bytesPerRow;
+
+// Same as the CPU decode above but the output is linear light RGBA
+// half floats (8 bytes per pixel), the layout of MTLPixelFormatRGBA16Float.
+// This keeps full precision for compositing or resizing that would
+// otherwise have to undo an 8 bit sRGB quantize.
+
+- (BOOL) decodeBT709:(CVPixelBufferRef)yCbCrInputTexture
+             regionX:(int)regionX
+             regionY:(int)regionY
+         regionWidth:(int)regionWidth
+        regionHeight:(int)regionHeight
+      rgbaHalfPixels:(uint16_t*)rgbaHalfPixels
+         bytesPerRow:(int)bytesPerRow;
+
+// CPU decode of a color frame and its alpha frame that composites the
+// region over the sRGB BGRA pixels already in bgraPixels. Color is
+// premultiplied by alpha as srgb_to_bt709 -alpha writes it. The blend is
+// done in linear light as part of the decode, so drawing a transparent
+// layer does not need a separate decode and blend pass. The existing
+// pixels are treated as opaque.
+
+- (BOOL) decodeBT709:(CVPixelBufferRef)yCbCrInputTexture
+    alphaPixelBuffer:(CVPixelBufferRef)alphaPixelBuffer
+             regionX:(int)regionX
+             regionY:(int)regionY
+         regionWidth:(int)regionWidth
+        regionHeight:(int)regionHeight
+      overBgraPixels:(uint32_t*)bgraPixels
+         bytesPerRow:(int)bytesPerRow;
+
 @end
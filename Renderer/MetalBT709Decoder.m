@@ -10,9 +10,14 @@
 
 #import "CVPixelBufferUtils.h"
 
+#import "bt709_decode.h"
+
 @interface MetalBT709Decoder ()
 {
   CVMetalTextureCacheRef _textureCache;
+  
+  // Tables for CPU region decode, allocated on first use
+  BT709DecodeTables *_decodeTables;
 }
 
 @property (nonatomic, retain) id<MTLRenderPipelineState> renderPipelineState;
@@ -40,6 +45,10 @@
     CFRelease(_textureCache);
   }
   
+  if (_decodeTables != NULL) {
+    free(_decodeTables);
+  }
+  
   return;
 }
 
@@ -246,6 +255,226 @@ renderPassDescriptor:(MTLRenderPassDescriptor*)renderPassDescriptor
   return TRUE;
 }
 
+- (BOOL) decodeBT709:(CVPixelBufferRef)yCbCrPixelBuffer
+             regionX:(int)regionX
+             regionY:(int)regionY
+         regionWidth:(int)regionWidth
+        regionHeight:(int)regionHeight
+          bgraPixels:(uint32_t*)bgraPixels
+         bytesPerRow:(int)bytesPerRow
+{
+  return [self decodeBT709OnCPU:yCbCrPixelBuffer
+                        regionX:regionX
+                        regionY:regionY
+                    regionWidth:regionWidth
+                   regionHeight:regionHeight
+                      outPixels:bgraPixels
+                    bytesPerRow:bytesPerRow
+                     outputHalf:FALSE];
+}
+
+- (BOOL) decodeBT709:(CVPixelBufferRef)yCbCrPixelBuffer
+             regionX:(int)regionX
+             regionY:(int)regionY
+         regionWidth:(int)regionWidth
+        regionHeight:(int)regionHeight
+      rgbaHalfPixels:(uint16_t*)rgbaHalfPixels
+         bytesPerRow:(int)bytesPerRow
+{
+  return [self decodeBT709OnCPU:yCbCrPixelBuffer
+                        regionX:regionX
+                        regionY:regionY
+                    regionWidth:regionWidth
+                   regionHeight:regionHeight
+                      outPixels:rgbaHalfPixels
+                    bytesPerRow:bytesPerRow
+                     outputHalf:TRUE];
+}
+
+- (BOOL) decodeBT709:(CVPixelBufferRef)yCbCrPixelBuffer
+    alphaPixelBuffer:(CVPixelBufferRef)alphaPixelBuffer
+             regionX:(int)regionX
+             regionY:(int)regionY
+         regionWidth:(int)regionWidth
+        regionHeight:(int)regionHeight
+      overBgraPixels:(uint32_t*)bgraPixels
+         bytesPerRow:(int)bytesPerRow
+{
+  int width = (int) CVPixelBufferGetWidth(yCbCrPixelBuffer);
+  int height = (int) CVPixelBufferGetHeight(yCbCrPixelBuffer);
+  
+  // With packed alpha the alpha rows follow the color rows in the
+  // same buffer and alphaPixelBuffer is not used.
+  
+  if (self.packedAlpha) {
+    height /= 2;
+    alphaPixelBuffer = NULL;
+  }
+  
+  if (CVPixelBufferGetPixelFormatType(yCbCrPixelBuffer) != kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange ||
+      (alphaPixelBuffer != NULL && CVPixelBufferGetPixelFormatType(alphaPixelBuffer) != kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange)) {
+    NSLog(@"unsupported pixel format for CPU decode, only 420 bi-planar video range is supported");
+    return FALSE;
+  }
+  
+  if (alphaPixelBuffer == NULL && !self.packedAlpha) {
+    NSLog(@"alpha pixel buffer is required unless packedAlpha is set");
+    return FALSE;
+  }
+  
+  if (alphaPixelBuffer != NULL && (CVPixelBufferGetWidth(alphaPixelBuffer) != width || CVPixelBufferGetHeight(alphaPixelBuffer) != height)) {
+    NSLog(@"alpha pixel buffer must be the same size as the color pixel buffer");
+    return FALSE;
+  }
+  
+  [self setupDecodeTables];
+  
+  {
+    int status = CVPixelBufferLockBaseAddress(yCbCrPixelBuffer, kCVPixelBufferLock_ReadOnly);
+    assert(status == kCVReturnSuccess);
+    if (alphaPixelBuffer != NULL) {
+      status = CVPixelBufferLockBaseAddress(alphaPixelBuffer, kCVPixelBufferLock_ReadOnly);
+      assert(status == kCVReturnSuccess);
+    }
+  }
+  
+  uint8_t *yPlane = (uint8_t *) CVPixelBufferGetBaseAddressOfPlane(yCbCrPixelBuffer, 0);
+  uint8_t *cbcrPlane = (uint8_t *) CVPixelBufferGetBaseAddressOfPlane(yCbCrPixelBuffer, 1);
+  const int yBytesPerRow = (int) CVPixelBufferGetBytesPerRowOfPlane(yCbCrPixelBuffer, 0);
+  const int cbcrBytesPerRow = (int) CVPixelBufferGetBytesPerRowOfPlane(yCbCrPixelBuffer, 1);
+  
+  BT709PlanesStruct planes = { yPlane, yBytesPerRow, cbcrPlane, cbcrBytesPerRow, cbcrPlane + 1, cbcrBytesPerRow };
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+  
+  const uint8_t *alphaPlane;
+  int alphaBytesPerRow;
+  
+  if (alphaPixelBuffer != NULL) {
+    alphaPlane = (const uint8_t *) CVPixelBufferGetBaseAddressOfPlane(alphaPixelBuffer, 0);
+    alphaBytesPerRow = (int) CVPixelBufferGetBytesPerRowOfPlane(alphaPixelBuffer, 0);
+  } else {
+    alphaPlane = bt709_decode_packed_alpha_ptr(&planes, height);
+    alphaBytesPerRow = yBytesPerRow;
+  }
+  
+  int result = bt709_decode_region_over(_decodeTables, &planes, 2, alphaPlane, alphaBytesPerRow,
+                                        width, height, regionX, regionY, regionWidth, regionHeight,
+                                        &layout, (const uint8_t *) bgraPixels, bytesPerRow,
+                                        (uint8_t *) bgraPixels, bytesPerRow);
+  
+  {
+    int status;
+    if (alphaPixelBuffer != NULL) {
+      status = CVPixelBufferUnlockBaseAddress(alphaPixelBuffer, kCVPixelBufferLock_ReadOnly);
+      assert(status == kCVReturnSuccess);
+    }
+    status = CVPixelBufferUnlockBaseAddress(yCbCrPixelBuffer, kCVPixelBufferLock_ReadOnly);
+    assert(status == kCVReturnSuccess);
+  }
+  
+#if defined(DEBUG)
+  NSAssert(result == 0, @"region (%d,%d) %d x %d is not inside %d x %d input", regionX, regionY, regionWidth, regionHeight, width, height);
+#endif // DEBUG
+  
+  return (result == 0);
+}
+
+// Init CPU decode tables for the current gamma setting
+
+- (void) setupDecodeTables
+{
+  BT709Gamma gamma = BT709GammaApple;
+  
+  if (self.gamma == MetalBT709GammaSRGB) {
+    gamma = BT709GammaSrgb;
+  } else if (self.gamma == MetalBT709GammaLinear) {
+    gamma = BT709GammaLinear;
+  }
+  
+  if (_decodeTables == NULL) {
+    _decodeTables = (BT709DecodeTables *) malloc(sizeof(BT709DecodeTables));
+    bt709_decode_tables_init(_decodeTables, gamma);
+  } else if (_decodeTables->inputGamma != gamma) {
+    bt709_decode_tables_init(_decodeTables, gamma);
+  }
+}
+
+// CPU decode shared by the BGRA and RGBA half float outputs
+
+- (BOOL) decodeBT709OnCPU:(CVPixelBufferRef)yCbCrPixelBuffer
+                  regionX:(int)regionX
+                  regionY:(int)regionY
+              regionWidth:(int)regionWidth
+             regionHeight:(int)regionHeight
+                outPixels:(void*)outPixels
+              bytesPerRow:(int)bytesPerRow
+               outputHalf:(BOOL)outputHalf
+{
+  int width = (int) CVPixelBufferGetWidth(yCbCrPixelBuffer);
+  int height = (int) CVPixelBufferGetHeight(yCbCrPixelBuffer);
+  
+  OSType pixelFormat = CVPixelBufferGetPixelFormatType(yCbCrPixelBuffer);
+  
+  if (pixelFormat != kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) {
+    NSLog(@"unsupported pixel format for CPU decode, only 420 bi-planar video range is supported");
+    return FALSE;
+  }
+  
+  [self setupDecodeTables];
+  
+  {
+    int status = CVPixelBufferLockBaseAddress(yCbCrPixelBuffer, kCVPixelBufferLock_ReadOnly);
+    assert(status == kCVReturnSuccess);
+  }
+  
+  uint8_t *yPlane = (uint8_t *) CVPixelBufferGetBaseAddressOfPlane(yCbCrPixelBuffer, 0);
+  uint8_t *cbcrPlane = (uint8_t *) CVPixelBufferGetBaseAddressOfPlane(yCbCrPixelBuffer, 1);
+  const int yBytesPerRow = (int) CVPixelBufferGetBytesPerRowOfPlane(yCbCrPixelBuffer, 0);
+  const int cbcrBytesPerRow = (int) CVPixelBufferGetBytesPerRowOfPlane(yCbCrPixelBuffer, 1);
+  
+  BT709PlanesStruct planes = { yPlane, yBytesPerRow, cbcrPlane, cbcrBytesPerRow, cbcrPlane + 1, cbcrBytesPerRow };
+  
+  // Packed alpha is decoded from the same buffer, color stays premultiplied
+  
+  const uint8_t *alphaPlane = NULL;
+  
+  if (self.packedAlpha) {
+    height /= 2;
+    alphaPlane = bt709_decode_packed_alpha_ptr(&planes, height);
+  }
+  
+  int result;
+  
+  if (outputHalf) {
+    result = bt709_decode_region_half_alpha(_decodeTables, &planes, 2, alphaPlane, yBytesPerRow,
+                                            width, height, regionX, regionY, regionWidth, regionHeight,
+                                            (uint16_t *) outPixels, bytesPerRow);
+  } else if (alphaPlane != NULL) {
+    BT709PixelLayout layout = bt709_pixel_layout_bgra();
+    
+    result = bt709_decode_region_alpha(_decodeTables, &planes, 2, alphaPlane, yBytesPerRow,
+                                       width, height, regionX, regionY, regionWidth, regionHeight,
+                                       &layout, (uint8_t *) outPixels, bytesPerRow);
+  } else {
+    BT709PixelLayout layout = bt709_pixel_layout_bgra();
+    
+    result = bt709_decode_region(_decodeTables, &planes, 2, width, height,
+                                 regionX, regionY, regionWidth, regionHeight,
+                                 &layout, (uint8_t *) outPixels, bytesPerRow);
+  }
+  
+  {
+    int status = CVPixelBufferUnlockBaseAddress(yCbCrPixelBuffer, kCVPixelBufferLock_ReadOnly);
+    assert(status == kCVReturnSuccess);
+  }
+  
+#if defined(DEBUG)
+  NSAssert(result == 0, @"region (%d,%d) %d x %d is not inside %d x %d input", regionX, regionY, regionWidth, regionHeight, width, height);
+#endif // DEBUG
+  
+  return (result == 0);
+}
+
 // Process a YUV CoreVideo buffer with Metal logic that will convert the BT.709
 // colorspace image and resample it into a sRGB output image.
 
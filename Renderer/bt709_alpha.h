@@ -0,0 +1,423 @@
+//
+//  bt709_alpha.h
+//
+//  Header only interface that converts 32 bit pixels between
+//  straight and premultiplied alpha. Premultiply is available in
+//  the gamma encoded space, which is what CoreGraphics stores, and
+//  in linear light where each component is decoded, scaled by
+//  alpha and then encoded again.
+//
+//  Every conversion works on one row at a time and may be done in
+//  place, so it can run inside an encode or decode row loop while
+//  the pixels are still in cache instead of as a separate pass over
+//  the whole frame. Unpremultiply uses a table of reciprocals in
+//  place of a divide per component, the result is exactly
+//  (C * 255 + A / 2) / A as computed by vImage.
+//
+//  Gamma space premultiply is done with SSE2 or NEON. Unpremultiply
+//  checks blocks of pixels with SIMD so that fully opaque and fully
+//  transparent runs skip the per component work.
+//
+//  This module depends only on the C library.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_ALPHA_H)
+#define _BT709_ALPHA_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "BT709.h"
+#include "bt709_frame.h"
+
+typedef enum {
+  BT709AlphaPremultiply = 0,
+  BT709AlphaUnpremultiply,
+  BT709AlphaPremultiplyLinear,
+  BT709AlphaUnpremultiplyLinear
+} BT709AlphaOp;
+
+typedef struct {
+  // ceil(2^31 / A), index 0 is unused
+  uint32_t recip[256];
+
+  // 255.0 / A, index 0 is unused
+  float recipf[256];
+
+  // Gamma encoded byte <-> linear for the linear light ops,
+  // input and output gamma are the same.
+  BT709FrameTables frameTables;
+} BT709AlphaTables;
+
+// gamma is the encoding of the color components, this only
+// matters for the linear light ops.
+
+static inline
+void bt709_alpha_tables_init(BT709AlphaTables *tables, const BT709Gamma gamma) {
+  tables->recip[0] = 0;
+  tables->recipf[0] = 0.0f;
+
+  for (int A = 1; A < 256; A++) {
+    tables->recip[A] = (uint32_t) (((1ULL << 31) + A - 1) / A);
+    tables->recipf[A] = 255.0f / A;
+  }
+
+  bt709_frame_tables_init(&tables->frameTables, gamma, gamma);
+}
+
+// (C * A) / 255 rounded to nearest
+
+static inline
+uint8_t bt709_alpha_mul(int C, int A) {
+  int x = (C * A) + 128;
+  return (uint8_t) ((x + (x >> 8)) >> 8);
+}
+
+// (C * 255 + A / 2) / A clamped to 255, A must not be zero
+
+static inline
+uint8_t bt709_alpha_div(const BT709AlphaTables *tables, int C, int A) {
+  uint32_t n = (uint32_t) ((C * 255) + (A / 2));
+  uint32_t v = (uint32_t) (((uint64_t) n * tables->recip[A]) >> 31);
+  return (uint8_t) ((v > 255) ? 255 : v);
+}
+
+static inline
+void bt709_alpha_premultiply_pixel(const BT709PixelLayout *layout, uint8_t *outPtr, const uint8_t *inPtr) {
+  const int A = inPtr[layout->aOffset];
+  outPtr[layout->rOffset] = bt709_alpha_mul(inPtr[layout->rOffset], A);
+  outPtr[layout->gOffset] = bt709_alpha_mul(inPtr[layout->gOffset], A);
+  outPtr[layout->bOffset] = bt709_alpha_mul(inPtr[layout->bOffset], A);
+  outPtr[layout->aOffset] = (uint8_t) A;
+}
+
+static inline
+void bt709_alpha_unpremultiply_pixel(const BT709AlphaTables *tables, const BT709PixelLayout *layout, uint8_t *outPtr, const uint8_t *inPtr) {
+  const int A = inPtr[layout->aOffset];
+  if (A == 0) {
+    outPtr[layout->rOffset] = 0;
+    outPtr[layout->gOffset] = 0;
+    outPtr[layout->bOffset] = 0;
+  } else if (A == 255) {
+    outPtr[layout->rOffset] = inPtr[layout->rOffset];
+    outPtr[layout->gOffset] = inPtr[layout->gOffset];
+    outPtr[layout->bOffset] = inPtr[layout->bOffset];
+  } else {
+    outPtr[layout->rOffset] = bt709_alpha_div(tables, inPtr[layout->rOffset], A);
+    outPtr[layout->gOffset] = bt709_alpha_div(tables, inPtr[layout->gOffset], A);
+    outPtr[layout->bOffset] = bt709_alpha_div(tables, inPtr[layout->bOffset], A);
+  }
+  outPtr[layout->aOffset] = (uint8_t) A;
+}
+
+// Premultiply width pixels in the gamma encoded space, outPtr
+// may be the same as inPtr. The layout must have 4 bytes per pixel.
+
+static inline
+void bt709_alpha_premultiply_row(const BT709PixelLayout *layout,
+                                 uint8_t *outPtr,
+                                 const uint8_t *inPtr,
+                                 const int width)
+{
+  int col = 0;
+
+#if defined(DEBUG)
+  assert(layout->bytesPerPixel == 4 && layout->aOffset >= 0);
+#endif // DEBUG
+
+#if defined(__SSE2__)
+  if (layout->aOffset == 3) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16(128);
+    const __m128i alphaMask = _mm_set1_epi32((int) 0xFF000000);
+
+    for ( ; col + 4 <= width; col += 4) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (inPtr + (col * 4)));
+
+      __m128i lo = _mm_unpacklo_epi8(v, zero);
+      __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+      __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+      lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), round);
+      hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), round);
+
+      lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+      hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+      __m128i out = _mm_packus_epi16(lo, hi);
+      out = _mm_or_si128(_mm_andnot_si128(alphaMask, out), _mm_and_si128(alphaMask, v));
+
+      _mm_storeu_si128((__m128i *) (outPtr + (col * 4)), out);
+    }
+  }
+#elif defined(__ARM_NEON)
+  for ( ; col + 16 <= width; col += 16) {
+    uint8x16x4_t v = vld4q_u8(inPtr + (col * 4));
+    const uint8x16_t A = v.val[layout->aOffset];
+
+    for (int c = 0; c < 4; c++) {
+      if (c == layout->aOffset) {
+        continue;
+      }
+      uint16x8_t lo = vmull_u8(vget_low_u8(v.val[c]), vget_low_u8(A));
+      uint16x8_t hi = vmull_u8(vget_high_u8(v.val[c]), vget_high_u8(A));
+      // (x + ((x + 128) >> 8) + 128) >> 8
+      v.val[c] = vcombine_u8(vraddhn_u16(lo, vrshrq_n_u16(lo, 8)),
+                             vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+    }
+
+    vst4q_u8(outPtr + (col * 4), v);
+  }
+#endif
+
+  for ( ; col < width; col++) {
+    bt709_alpha_premultiply_pixel(layout, outPtr + (col * 4), inPtr + (col * 4));
+  }
+}
+
+// Unpremultiply width pixels in the gamma encoded space, outPtr
+// may be the same as inPtr. Components larger than alpha are
+// clamped to 255.
+
+static inline
+void bt709_alpha_unpremultiply_row(const BT709AlphaTables *tables,
+                                   const BT709PixelLayout *layout,
+                                   uint8_t *outPtr,
+                                   const uint8_t *inPtr,
+                                   const int width)
+{
+  int col = 0;
+
+#if defined(DEBUG)
+  assert(layout->bytesPerPixel == 4 && layout->aOffset >= 0);
+#endif // DEBUG
+
+#if defined(__SSE2__)
+  if (layout->aOffset == 3) {
+    const __m128i alphaMask = _mm_set1_epi32((int) 0xFF000000);
+
+    for ( ; col + 4 <= width; col += 4) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (inPtr + (col * 4)));
+      __m128i alpha = _mm_and_si128(v, alphaMask);
+
+      if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask)) == 0xFFFF) {
+        // All opaque
+        if (outPtr != inPtr) {
+          _mm_storeu_si128((__m128i *) (outPtr + (col * 4)), v);
+        }
+      } else if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) == 0xFFFF) {
+        // All transparent
+        _mm_storeu_si128((__m128i *) (outPtr + (col * 4)), _mm_setzero_si128());
+      } else {
+        for (int i = 0; i < 4; i++) {
+          bt709_alpha_unpremultiply_pixel(tables, layout, outPtr + ((col + i) * 4), inPtr + ((col + i) * 4));
+        }
+      }
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for ( ; col + 16 <= width; col += 16) {
+    uint8x16x4_t v = vld4q_u8(inPtr + (col * 4));
+    const uint8x16_t A = v.val[layout->aOffset];
+
+    if (vminvq_u8(A) == 255) {
+      if (outPtr != inPtr) {
+        vst4q_u8(outPtr + (col * 4), v);
+      }
+    } else if (vmaxvq_u8(A) == 0) {
+      vst1q_u8(outPtr + (col * 4), vdupq_n_u8(0));
+      vst1q_u8(outPtr + (col * 4) + 16, vdupq_n_u8(0));
+      vst1q_u8(outPtr + (col * 4) + 32, vdupq_n_u8(0));
+      vst1q_u8(outPtr + (col * 4) + 48, vdupq_n_u8(0));
+    } else {
+      for (int i = 0; i < 16; i++) {
+        bt709_alpha_unpremultiply_pixel(tables, layout, outPtr + ((col + i) * 4), inPtr + ((col + i) * 4));
+      }
+    }
+  }
+#endif
+
+  for ( ; col < width; col++) {
+    bt709_alpha_unpremultiply_pixel(tables, layout, outPtr + (col * 4), inPtr + (col * 4));
+  }
+}
+
+// Premultiply in linear light, each component is decoded to
+// linear, scaled by alpha and encoded with the same gamma.
+
+static inline
+void bt709_alpha_premultiply_linear_row(const BT709AlphaTables *tables,
+                                        const BT709PixelLayout *layout,
+                                        uint8_t *outPtr,
+                                        const uint8_t *inPtr,
+                                        const int width)
+{
+  const BT709FrameTables *frameTables = &tables->frameTables;
+  const float *toLinear = frameTables->toLinear;
+
+  for (int col = 0; col < width; col++) {
+    const uint8_t *p = inPtr + (col * 4);
+    uint8_t *o = outPtr + (col * 4);
+
+    const int A = p[layout->aOffset];
+
+    if (A == 255) {
+      if (o != p) {
+        memcpy(o, p, 4);
+      }
+      continue;
+    }
+
+    const float An = A * (1.0f / 255.0f);
+
+    const uint8_t R = p[layout->rOffset];
+    const uint8_t G = p[layout->gOffset];
+    const uint8_t B = p[layout->bOffset];
+
+    o[layout->rOffset] = (uint8_t) bt709_frame_from_linear(frameTables, toLinear[R] * An);
+    o[layout->gOffset] = (uint8_t) bt709_frame_from_linear(frameTables, toLinear[G] * An);
+    o[layout->bOffset] = (uint8_t) bt709_frame_from_linear(frameTables, toLinear[B] * An);
+    o[layout->aOffset] = (uint8_t) A;
+  }
+}
+
+// Inverse of bt709_alpha_premultiply_linear_row()
+
+static inline
+void bt709_alpha_unpremultiply_linear_row(const BT709AlphaTables *tables,
+                                          const BT709PixelLayout *layout,
+                                          uint8_t *outPtr,
+                                          const uint8_t *inPtr,
+                                          const int width)
+{
+  const BT709FrameTables *frameTables = &tables->frameTables;
+  const float *toLinear = frameTables->toLinear;
+
+  for (int col = 0; col < width; col++) {
+    const uint8_t *p = inPtr + (col * 4);
+    uint8_t *o = outPtr + (col * 4);
+
+    const int A = p[layout->aOffset];
+
+    if (A == 255) {
+      if (o != p) {
+        memcpy(o, p, 4);
+      }
+      continue;
+    } else if (A == 0) {
+      o[layout->rOffset] = 0;
+      o[layout->gOffset] = 0;
+      o[layout->bOffset] = 0;
+      o[layout->aOffset] = 0;
+      continue;
+    }
+
+    const float recip = tables->recipf[A];
+
+    const uint8_t R = p[layout->rOffset];
+    const uint8_t G = p[layout->gOffset];
+    const uint8_t B = p[layout->bOffset];
+
+    o[layout->rOffset] = (uint8_t) bt709_frame_from_linear(frameTables, saturatef(toLinear[R] * recip));
+    o[layout->gOffset] = (uint8_t) bt709_frame_from_linear(frameTables, saturatef(toLinear[G] * recip));
+    o[layout->bOffset] = (uint8_t) bt709_frame_from_linear(frameTables, saturatef(toLinear[B] * recip));
+    o[layout->aOffset] = (uint8_t) A;
+  }
+}
+
+static inline
+void bt709_alpha_row(const BT709AlphaTables *tables,
+                     const BT709AlphaOp op,
+                     const BT709PixelLayout *layout,
+                     uint8_t *outPtr,
+                     const uint8_t *inPtr,
+                     const int width)
+{
+  switch (op) {
+    case BT709AlphaPremultiply:
+      bt709_alpha_premultiply_row(layout, outPtr, inPtr, width);
+      break;
+    case BT709AlphaUnpremultiply:
+      bt709_alpha_unpremultiply_row(tables, layout, outPtr, inPtr, width);
+      break;
+    case BT709AlphaPremultiplyLinear:
+      bt709_alpha_premultiply_linear_row(tables, layout, outPtr, inPtr, width);
+      break;
+    case BT709AlphaUnpremultiplyLinear:
+      bt709_alpha_unpremultiply_linear_row(tables, layout, outPtr, inPtr, width);
+      break;
+  }
+}
+
+// Apply op to a whole frame, outPixels may be the same as inPixels
+
+static inline
+void bt709_alpha_frame(const BT709AlphaTables *tables,
+                       const BT709AlphaOp op,
+                       const BT709PixelLayout *layout,
+                       uint8_t *outPixels,
+                       const int outBytesPerRow,
+                       const uint8_t *inPixels,
+                       const int inBytesPerRow,
+                       const int width,
+                       const int height)
+{
+  for (int row = 0; row < height; row++) {
+    bt709_alpha_row(tables, op, layout,
+                    outPixels + (row * (size_t)outBytesPerRow),
+                    inPixels + (row * (size_t)inBytesPerRow),
+                    width);
+  }
+}
+
+// Premultiply and convert to Y Cb Cr in one pass. Each pair of
+// input rows is premultiplied into scratch, which must hold
+// 2 * width * 4 bytes, and then encoded with the frame tables.
+// Width and height must be even. Returns 0 on success.
+
+static inline
+int bt709_alpha_encode_premultiplied(const BT709FrameTables *frameTables,
+                                     const BT709AlphaTables *tables,
+                                     const BT709AlphaOp op,
+                                     const BT709PixelLayout *layout,
+                                     const uint8_t *inPixels,
+                                     const int inBytesPerRow,
+                                     const int width,
+                                     const int height,
+                                     const BT709PlanesStruct *planes,
+                                     uint8_t *scratch)
+{
+  if ((width % 2) != 0 || (height % 2) != 0) {
+    return 1;
+  }
+
+  const int scratchBytesPerRow = width * 4;
+
+  for (int row = 0; row < height; row += 2) {
+    bt709_alpha_row(tables, op, layout, scratch, inPixels + (row * (size_t)inBytesPerRow), width);
+    bt709_alpha_row(tables, op, layout, scratch + scratchBytesPerRow, inPixels + ((row + 1) * (size_t)inBytesPerRow), width);
+
+    BT709PlanesStruct rowPlanes = *planes;
+    rowPlanes.yPtr += (row * (size_t)planes->yBytesPerRow);
+    rowPlanes.cbPtr += ((row / 2) * (size_t)planes->cbBytesPerRow);
+    rowPlanes.crPtr += ((row / 2) * (size_t)planes->crBytesPerRow);
+
+    bt709_frame_encode_rows(frameTables, layout, scratch, scratchBytesPerRow, width, 0, 2, &rowPlanes);
+  }
+
+  return 0;
+}
+
+#endif // _BT709_ALPHA_H
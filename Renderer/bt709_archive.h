@@ -0,0 +1,492 @@
+//
+//  bt709_archive.h
+//
+//  Header only interface that writes and reads an indexed archive
+//  of 8 bit 4:2:0 Y Cb Cr frames. Each frame is stored as a Y plane
+//  followed by an interleaved Cb Cr plane (NV12), every plane begins
+//  on a page boundary and every row is padded to a multiple of 64
+//  bytes. A reader maps the whole file read only, so that plane
+//  pointers for any frame can be handed to a consumer or a texture
+//  upload without a copy, and seeking to a frame is a table lookup.
+//
+//  File layout:
+//
+//  [header, padded to BT709_ARCHIVE_ALIGN]
+//  [frame 0 Y plane][frame 0 Cb Cr plane]
+//  [frame 1 Y plane][frame 1 Cb Cr plane]
+//  ...
+//  [index, one BT709ArchiveIndexEntry per frame]
+//
+//  Values are stored in host byte order, which is little endian on
+//  every supported platform.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_ARCHIVE_H)
+#define _BT709_ARCHIVE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bt709_frame.h"
+#include "bt709_planes.h"
+
+#define BT709_ARCHIVE_MAGIC "BT709FA1"
+#define BT709_ARCHIVE_VERSION 1
+
+// Planes begin at a multiple of this many bytes, large enough for
+// the 16K pages used on Apple Silicon.
+
+#define BT709_ARCHIVE_ALIGN 16384
+
+// Rows of each plane are padded to a multiple of this many bytes
+
+#define BT709_ARCHIVE_ROW_ALIGN 64
+
+// Largest width or height accepted
+
+#define BT709_ARCHIVE_MAX_DIMENSION 32768
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t alignment;
+  uint32_t width;
+  uint32_t height;
+  uint32_t yBytesPerRow;
+  uint32_t cbcrBytesPerRow;
+  // Offset of the Cb Cr plane from the start of a frame
+  uint64_t cbcrOffset;
+  // Bytes from the start of one frame to the start of the next
+  uint64_t frameLen;
+  uint32_t fpsNum;
+  uint32_t fpsDen;
+  uint64_t numFrames;
+  uint64_t indexOffset;
+  // Checksum of the header with this field set to zero
+  uint64_t headerChecksum;
+} BT709ArchiveHeader;
+
+typedef struct {
+  uint64_t offset;
+  // Checksum of all frameLen bytes, padding included
+  uint64_t checksum;
+} BT709ArchiveIndexEntry;
+
+// Plane pointers for one frame, these point into the mapping and
+// stay valid until the reader is closed. Since the mapping begins
+// on a page, each plane pointer is aligned to the system page size
+// when that is BT709_ARCHIVE_ALIGN or smaller.
+
+typedef struct {
+  const uint8_t *yPtr;
+  size_t yBytesPerRow;
+  const uint8_t *cbcrPtr;
+  size_t cbcrBytesPerRow;
+  uint64_t checksum;
+} BT709ArchiveFrame;
+
+typedef struct {
+  FILE *outFile;
+  BT709ArchiveHeader header;
+
+  // One frame with padding, zero filled so that padding is stable
+  uint8_t *frameBuffer;
+
+  BT709ArchiveIndexEntry *index;
+  uint64_t indexCapacity;
+} BT709ArchiveWriter;
+
+typedef struct {
+  BT709ArchiveHeader header;
+  const BT709ArchiveIndexEntry *index;
+
+  const uint8_t *mapPtr;
+  size_t mapLen;
+} BT709ArchiveReader;
+
+static inline
+uint64_t bt709_archive_round_up(uint64_t value, uint64_t multiple) {
+  return ((value + multiple - 1) / multiple) * multiple;
+}
+
+// Fast 64 bit checksum that detects corrupt or truncated data, it
+// is not a cryptographic hash. Four independent lanes each take 8
+// bytes at a time so that the multiplies overlap.
+
+static inline
+uint64_t bt709_archive_checksum(const uint8_t *ptr, size_t numBytes) {
+  const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+
+  uint64_t lanes[4] = {
+    0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL
+  };
+
+  size_t offset = 0;
+
+  for ( ; offset + 32 <= numBytes; offset += 32) {
+    for (int lane = 0; lane < 4; lane++) {
+      uint64_t word;
+      memcpy(&word, ptr + offset + (lane * 8), 8);
+      uint64_t h = (lanes[lane] ^ word) * prime;
+      lanes[lane] = h ^ (h >> 32);
+    }
+  }
+
+  for ( ; offset < numBytes; offset++) {
+    uint64_t h = (lanes[0] ^ ptr[offset]) * prime;
+    lanes[0] = h ^ (h >> 32);
+  }
+
+  uint64_t sum = numBytes;
+  for (int lane = 0; lane < 4; lane++) {
+    sum = (sum ^ lanes[lane]) * prime;
+    sum ^= sum >> 29;
+  }
+
+  return sum;
+}
+
+static inline
+uint64_t bt709_archive_header_checksum(const BT709ArchiveHeader *header) {
+  BT709ArchiveHeader copy = *header;
+  copy.headerChecksum = 0;
+  return bt709_archive_checksum((const uint8_t *) &copy, sizeof(copy));
+}
+
+// Fill in strides and plane offsets for frames of the given size
+
+static inline
+void bt709_archive_header_init(BT709ArchiveHeader *header, int width, int height, int fpsNum, int fpsDen) {
+  memset(header, 0, sizeof(BT709ArchiveHeader));
+  memcpy(header->magic, BT709_ARCHIVE_MAGIC, sizeof(header->magic));
+  header->version = BT709_ARCHIVE_VERSION;
+  header->alignment = BT709_ARCHIVE_ALIGN;
+  header->width = width;
+  header->height = height;
+
+  // The Cb Cr plane holds width / 2 pairs, so both planes have
+  // width bytes of data in each row.
+
+  header->yBytesPerRow = (uint32_t) bt709_archive_round_up(width, BT709_ARCHIVE_ROW_ALIGN);
+  header->cbcrBytesPerRow = header->yBytesPerRow;
+
+  const uint64_t yPlaneLen = (uint64_t) header->yBytesPerRow * height;
+  const uint64_t cbcrPlaneLen = (uint64_t) header->cbcrBytesPerRow * (height / 2);
+
+  header->cbcrOffset = bt709_archive_round_up(yPlaneLen, BT709_ARCHIVE_ALIGN);
+  header->frameLen = header->cbcrOffset + bt709_archive_round_up(cbcrPlaneLen, BT709_ARCHIVE_ALIGN);
+  header->fpsNum = fpsNum;
+  header->fpsDen = fpsDen;
+}
+
+static inline
+int bt709_archive_write_header(BT709ArchiveWriter *writer) {
+  uint8_t headerPage[BT709_ARCHIVE_ALIGN];
+  memset(headerPage, 0, sizeof(headerPage));
+
+  writer->header.headerChecksum = bt709_archive_header_checksum(&writer->header);
+  memcpy(headerPage, &writer->header, sizeof(BT709ArchiveHeader));
+
+  if (fseeko(writer->outFile, 0, SEEK_SET) != 0 ||
+      fwrite(headerPage, sizeof(headerPage), 1, writer->outFile) != 1) {
+    return 2;
+  }
+
+  return 0;
+}
+
+// Create an archive for frames of the given even size. The header
+// is written again with the frame count and index location when the
+// writer is closed, so the output must be a seekable file. Returns 0
+// on success, 1 for bad arguments, and 2 when the file cannot be
+// written or memory cannot be allocated.
+
+static inline
+int bt709_archive_writer_open(BT709ArchiveWriter *writer, const char *path, int width, int height, int fpsNum, int fpsDen) {
+  memset(writer, 0, sizeof(BT709ArchiveWriter));
+
+  if (width <= 0 || width > BT709_ARCHIVE_MAX_DIMENSION || height <= 0 || height > BT709_ARCHIVE_MAX_DIMENSION ||
+      (width % 2) != 0 || (height % 2) != 0 || fpsNum <= 0 || fpsDen <= 0) {
+    return 1;
+  }
+
+  bt709_archive_header_init(&writer->header, width, height, fpsNum, fpsDen);
+
+  writer->frameBuffer = (uint8_t *) calloc(1, writer->header.frameLen);
+  if (writer->frameBuffer == NULL) {
+    return 2;
+  }
+
+  writer->outFile = fopen(path, "wb");
+  if (writer->outFile == NULL) {
+    fprintf(stderr, "could not open archive \"%s\" for writing\n", path);
+    free(writer->frameBuffer);
+    writer->frameBuffer = NULL;
+    return 2;
+  }
+
+  if (bt709_archive_write_header(writer) != 0) {
+    fprintf(stderr, "could not write archive \"%s\"\n", path);
+    fclose(writer->outFile);
+    writer->outFile = NULL;
+    free(writer->frameBuffer);
+    writer->frameBuffer = NULL;
+    return 2;
+  }
+
+  return 0;
+}
+
+// Append the frame already laid out in writer->frameBuffer
+
+static inline
+int bt709_archive_writer_append(BT709ArchiveWriter *writer) {
+  if (writer->header.numFrames == writer->indexCapacity) {
+    uint64_t capacity = (writer->indexCapacity == 0) ? 64 : (writer->indexCapacity * 2);
+    BT709ArchiveIndexEntry *index = (BT709ArchiveIndexEntry *) realloc(writer->index, capacity * sizeof(BT709ArchiveIndexEntry));
+    if (index == NULL) {
+      return 2;
+    }
+    writer->index = index;
+    writer->indexCapacity = capacity;
+  }
+
+  BT709ArchiveIndexEntry *entry = &writer->index[writer->header.numFrames];
+  entry->offset = BT709_ARCHIVE_ALIGN + (writer->header.numFrames * writer->header.frameLen);
+  entry->checksum = bt709_archive_checksum(writer->frameBuffer, writer->header.frameLen);
+
+  if (fwrite(writer->frameBuffer, writer->header.frameLen, 1, writer->outFile) != 1) {
+    return 2;
+  }
+
+  writer->header.numFrames += 1;
+  return 0;
+}
+
+// Append a frame given as a Y plane and an interleaved Cb Cr plane
+
+static inline
+int bt709_archive_writer_add_nv12(BT709ArchiveWriter *writer,
+                                  const uint8_t *yPtr,
+                                  size_t yBytesPerRow,
+                                  const uint8_t *cbcrPtr,
+                                  size_t cbcrBytesPerRow)
+{
+  const BT709ArchiveHeader *header = &writer->header;
+  uint8_t *yOut = writer->frameBuffer;
+  uint8_t *cbcrOut = writer->frameBuffer + header->cbcrOffset;
+
+  bt709_planes_copy(yOut, header->yBytesPerRow, yPtr, yBytesPerRow, header->width, header->height);
+  bt709_planes_copy(cbcrOut, header->cbcrBytesPerRow, cbcrPtr, cbcrBytesPerRow, header->width, header->height / 2);
+
+  return bt709_archive_writer_append(writer);
+}
+
+// Append a frame given as separate Y, Cb, and Cr planes (I420)
+
+static inline
+int bt709_archive_writer_add_planes(BT709ArchiveWriter *writer, const BT709PlanesStruct *planes) {
+  const BT709ArchiveHeader *header = &writer->header;
+  uint8_t *yOut = writer->frameBuffer;
+  uint8_t *cbcrOut = writer->frameBuffer + header->cbcrOffset;
+
+  bt709_planes_copy(yOut, header->yBytesPerRow, planes->yPtr, planes->yBytesPerRow, header->width, header->height);
+  bt709_planes_interleave(cbcrOut, header->cbcrBytesPerRow,
+                          planes->cbPtr, planes->cbBytesPerRow,
+                          planes->crPtr, planes->crBytesPerRow,
+                          header->width / 2, header->height / 2);
+
+  return bt709_archive_writer_append(writer);
+}
+
+// Write the index and the final header, then close the file.
+// Returns 0 on success and 2 when the file could not be written.
+
+static inline
+int bt709_archive_writer_close(BT709ArchiveWriter *writer) {
+  int retcode = 0;
+
+  if (writer->outFile != NULL) {
+    writer->header.indexOffset = BT709_ARCHIVE_ALIGN + (writer->header.numFrames * writer->header.frameLen);
+
+    if (writer->header.numFrames > 0 &&
+        fwrite(writer->index, sizeof(BT709ArchiveIndexEntry), writer->header.numFrames, writer->outFile) != writer->header.numFrames) {
+      retcode = 2;
+    }
+
+    if (retcode == 0) {
+      retcode = bt709_archive_write_header(writer);
+    }
+
+    if (fclose(writer->outFile) != 0) {
+      retcode = 2;
+    }
+  }
+
+  free(writer->frameBuffer);
+  free(writer->index);
+  memset(writer, 0, sizeof(BT709ArchiveWriter));
+
+  return retcode;
+}
+
+// Map an archive read only and check the header and index. Returns
+// 0 on success, 1 when the file cannot be opened or mapped, and 2
+// when the file is not a valid archive. Frame data is not read
+// until it is used, call bt709_archive_reader_verify() to check it.
+
+static inline
+int bt709_archive_reader_open(BT709ArchiveReader *reader, const char *path) {
+  memset(reader, 0, sizeof(BT709ArchiveReader));
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return 1;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) != 0 || st.st_size < BT709_ARCHIVE_ALIGN) {
+    fprintf(stderr, "archive \"%s\" is too small\n", path);
+    close(fd);
+    return 2;
+  }
+
+  const size_t mapLen = (size_t) st.st_size;
+  void *mapping = mmap(NULL, mapLen, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "could not map archive \"%s\"\n", path);
+    return 1;
+  }
+
+  BT709ArchiveHeader header;
+  memcpy(&header, mapping, sizeof(header));
+
+  int valid = (memcmp(header.magic, BT709_ARCHIVE_MAGIC, sizeof(header.magic)) == 0 &&
+               header.version == BT709_ARCHIVE_VERSION &&
+               header.headerChecksum == bt709_archive_header_checksum(&header) &&
+               header.width > 0 && header.width <= BT709_ARCHIVE_MAX_DIMENSION &&
+               header.height > 0 && header.height <= BT709_ARCHIVE_MAX_DIMENSION &&
+               (header.width % 2) == 0 && (header.height % 2) == 0);
+
+  // Strides and offsets must be the ones this version would write
+
+  if (valid) {
+    BT709ArchiveHeader expected;
+    bt709_archive_header_init(&expected, header.width, header.height, header.fpsNum, header.fpsDen);
+
+    valid = (header.alignment == expected.alignment &&
+             header.yBytesPerRow == expected.yBytesPerRow &&
+             header.cbcrBytesPerRow == expected.cbcrBytesPerRow &&
+             header.cbcrOffset == expected.cbcrOffset &&
+             header.frameLen == expected.frameLen);
+  }
+
+  // The index must fit in the file after the frames it points to
+
+  if (valid) {
+    const uint64_t indexLen = header.numFrames * sizeof(BT709ArchiveIndexEntry);
+    valid = (header.numFrames <= (mapLen / header.frameLen) &&
+             header.indexOffset >= BT709_ARCHIVE_ALIGN &&
+             header.indexOffset <= mapLen &&
+             indexLen <= (mapLen - header.indexOffset));
+  }
+
+  if (valid) {
+    const BT709ArchiveIndexEntry *index = (const BT709ArchiveIndexEntry *) ((const uint8_t *) mapping + header.indexOffset);
+
+    for (uint64_t i = 0; i < header.numFrames && valid; i++) {
+      valid = ((index[i].offset % header.alignment) == 0 &&
+               index[i].offset >= BT709_ARCHIVE_ALIGN &&
+               index[i].offset <= header.indexOffset &&
+               header.frameLen <= (header.indexOffset - index[i].offset));
+    }
+
+    reader->index = index;
+  }
+
+  if (!valid) {
+    fprintf(stderr, "\"%s\" is not a supported archive\n", path);
+    munmap(mapping, mapLen);
+    reader->index = NULL;
+    return 2;
+  }
+
+  reader->header = header;
+  reader->mapPtr = (const uint8_t *) mapping;
+  reader->mapLen = mapLen;
+
+  return 0;
+}
+
+static inline
+void bt709_archive_reader_close(BT709ArchiveReader *reader) {
+  if (reader->mapPtr != NULL) {
+    munmap((void *) reader->mapPtr, reader->mapLen);
+  }
+  memset(reader, 0, sizeof(BT709ArchiveReader));
+}
+
+// Look up the planes of a frame, no data is copied or read.
+// Returns 0 on success or 1 when frameIndex is out of range.
+
+static inline
+int bt709_archive_reader_frame(const BT709ArchiveReader *reader, int frameIndex, BT709ArchiveFrame *frame) {
+  if (frameIndex < 0 || (uint64_t) frameIndex >= reader->header.numFrames) {
+    return 1;
+  }
+
+  const BT709ArchiveIndexEntry *entry = &reader->index[frameIndex];
+  const uint8_t *framePtr = reader->mapPtr + entry->offset;
+
+  frame->yPtr = framePtr;
+  frame->yBytesPerRow = reader->header.yBytesPerRow;
+  frame->cbcrPtr = framePtr + reader->header.cbcrOffset;
+  frame->cbcrBytesPerRow = reader->header.cbcrBytesPerRow;
+  frame->checksum = entry->checksum;
+
+  return 0;
+}
+
+// Hint that a frame will be read soon, so that pages can be read
+// from disk ahead of sequential playback.
+
+static inline
+void bt709_archive_reader_prefetch(const BT709ArchiveReader *reader, int frameIndex) {
+  if (frameIndex < 0 || (uint64_t) frameIndex >= reader->header.numFrames) {
+    return;
+  }
+
+  const uint8_t *framePtr = reader->mapPtr + reader->index[frameIndex].offset;
+  madvise((void *) framePtr, reader->header.frameLen, MADV_WILLNEED);
+}
+
+// Recompute the checksum of a frame. Returns 0 when it matches,
+// 1 when frameIndex is out of range, and 2 when the data is corrupt.
+
+static inline
+int bt709_archive_reader_verify(const BT709ArchiveReader *reader, int frameIndex) {
+  BT709ArchiveFrame frame;
+
+  if (bt709_archive_reader_frame(reader, frameIndex, &frame) != 0) {
+    return 1;
+  }
+
+  if (bt709_archive_checksum(frame.yPtr, reader->header.frameLen) != frame.checksum) {
+    return 2;
+  }
+
+  return 0;
+}
+
+#endif // _BT709_ARCHIVE_H
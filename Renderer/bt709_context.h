@@ -0,0 +1,313 @@
+//
+//  bt709_context.h
+//
+//  Header only interface to a long lived sRGB to BT.709 converter.
+//  A context is created once for a given gamma, pixel layout, and
+//  frame size. It owns the lookup tables, a pool of page aligned
+//  output frames, and a set of worker threads that stay parked
+//  between frames, so converting a frame does no allocation, table
+//  setup, or thread creation. Each frame is split into bands of
+//  row pairs and every band is converted by its own thread with
+//  the same math as bt709_frame_encode().
+//
+//  The context struct is large and worker threads keep a pointer
+//  to it, so allocate it on the heap and do not move it between
+//  bt709_context_init() and bt709_context_destroy(). A context
+//  converts one frame at a time, calls must not overlap.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_CONTEXT_H)
+#define _BT709_CONTEXT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+
+#include "bt709_frame.h"
+
+#define BT709_CONTEXT_MAX_THREADS 64
+
+#define BT709_CONTEXT_MAX_BUFFERS 4
+
+// Output frames are allocated at this alignment
+
+#define BT709_CONTEXT_ALIGN 4096
+
+typedef struct BT709Context BT709Context;
+
+typedef struct {
+  BT709Context *context;
+  int rowStart;
+  int rowEnd;
+} BT709ContextBand;
+
+struct BT709Context {
+  BT709FrameTables tables;
+  BT709PixelLayout layout;
+
+  int width;
+  int height;
+
+  // Pool of output frames, each one is Y then Cb then Cr
+  int numBuffers;
+  int nextBuffer;
+  uint8_t *buffers[BT709_CONTEXT_MAX_BUFFERS];
+
+  // Band 0 is converted by the calling thread, bands that have
+  // no worker thread are also converted by the calling thread.
+  int numThreads;
+  int numStarted;
+  BT709ContextBand bands[BT709_CONTEXT_MAX_THREADS];
+  pthread_t threads[BT709_CONTEXT_MAX_THREADS];
+
+  pthread_mutex_t mutex;
+  pthread_cond_t workCond;
+  pthread_cond_t doneCond;
+
+  // Guarded by mutex
+  unsigned int generation;
+  int numRunning;
+  int isShutdown;
+
+  // Frame being converted, set before generation is incremented
+  const uint8_t *inPixels;
+  int inBytesPerRow;
+  BT709PlanesStruct planes;
+};
+
+static inline
+void bt709_context_encode_band(const BT709ContextBand *band) {
+  const BT709Context *context = band->context;
+
+  if (band->rowStart < band->rowEnd) {
+    bt709_frame_encode_rows(&context->tables, &context->layout, context->inPixels, context->inBytesPerRow,
+                            context->width, band->rowStart, band->rowEnd, &context->planes);
+  }
+}
+
+static inline
+void* bt709_context_thread(void *arg) {
+  BT709ContextBand *band = (BT709ContextBand *) arg;
+  BT709Context *context = band->context;
+
+  // Threads are started before the first frame, so the first
+  // frame is always seen as a new generation.
+
+  unsigned int seenGeneration = 0;
+
+  pthread_mutex_lock(&context->mutex);
+
+  while (1) {
+    while (context->isShutdown == 0 && context->generation == seenGeneration) {
+      pthread_cond_wait(&context->workCond, &context->mutex);
+    }
+
+    if (context->isShutdown) {
+      break;
+    }
+
+    seenGeneration = context->generation;
+    pthread_mutex_unlock(&context->mutex);
+
+    bt709_context_encode_band(band);
+
+    pthread_mutex_lock(&context->mutex);
+    context->numRunning -= 1;
+    if (context->numRunning == 0) {
+      pthread_cond_signal(&context->doneCond);
+    }
+  }
+
+  pthread_mutex_unlock(&context->mutex);
+
+  return NULL;
+}
+
+static inline
+void bt709_context_destroy(BT709Context *context) {
+  pthread_mutex_lock(&context->mutex);
+  context->isShutdown = 1;
+  pthread_cond_broadcast(&context->workCond);
+  pthread_mutex_unlock(&context->mutex);
+
+  for (int i = 1; i < context->numStarted; i++) {
+    pthread_join(context->threads[i], NULL);
+  }
+  context->numStarted = 0;
+
+  for (int i = 0; i < context->numBuffers; i++) {
+    free(context->buffers[i]);
+    context->buffers[i] = NULL;
+  }
+  context->numBuffers = 0;
+
+  pthread_cond_destroy(&context->doneCond);
+  pthread_cond_destroy(&context->workCond);
+  pthread_mutex_destroy(&context->mutex);
+}
+
+// Init a context that converts width x height frames of pixels
+// in the given layout with up to numThreads threads. numBuffers
+// output frames are allocated for bt709_context_convert(), pass 0
+// when the caller always provides output planes. Returns 0 on
+// success, 1 when an argument is not valid, and 2 when memory
+// could not be allocated. On failure nothing needs to be freed.
+
+static inline
+int bt709_context_init(BT709Context *context,
+                       const BT709Gamma inputGamma,
+                       const BT709Gamma outputGamma,
+                       const BT709PixelLayout *layout,
+                       const int width,
+                       const int height,
+                       int numThreads,
+                       const int numBuffers)
+{
+  if (width <= 0 || height <= 0 || (width % 2) != 0 || (height % 2) != 0 ||
+      numBuffers < 0 || numBuffers > BT709_CONTEXT_MAX_BUFFERS) {
+    return 1;
+  }
+
+  memset(context, 0, sizeof(BT709Context));
+
+  bt709_frame_tables_init(&context->tables, inputGamma, outputGamma);
+  context->layout = *layout;
+  context->width = width;
+  context->height = height;
+
+  const size_t frameLen = ((size_t) width * height) + (2 * (size_t) (width / 2) * (height / 2));
+
+  for (int i = 0; i < numBuffers; i++) {
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, BT709_CONTEXT_ALIGN, frameLen) != 0) {
+      for (int j = 0; j < i; j++) {
+        free(context->buffers[j]);
+      }
+      return 2;
+    }
+    context->buffers[i] = (uint8_t *) ptr;
+  }
+  context->numBuffers = numBuffers;
+
+  const int numPairs = height / 2;
+
+  if (numThreads < 1) {
+    numThreads = 1;
+  } else if (numThreads > BT709_CONTEXT_MAX_THREADS) {
+    numThreads = BT709_CONTEXT_MAX_THREADS;
+  }
+  if (numThreads > numPairs) {
+    numThreads = numPairs;
+  }
+  context->numThreads = numThreads;
+
+  for (int i = 0; i < numThreads; i++) {
+    BT709ContextBand *band = &context->bands[i];
+    band->context = context;
+    band->rowStart = (int) (((int64_t) numPairs * i) / numThreads) * 2;
+    band->rowEnd = (int) (((int64_t) numPairs * (i + 1)) / numThreads) * 2;
+  }
+
+  pthread_mutex_init(&context->mutex, NULL);
+  pthread_cond_init(&context->workCond, NULL);
+  pthread_cond_init(&context->doneCond, NULL);
+
+  // Thread 0 is the calling thread. When a thread cannot be
+  // started its band and every band after it is converted by
+  // the calling thread.
+
+  context->numStarted = 1;
+
+  for ( ; context->numStarted < numThreads; context->numStarted++) {
+    const int i = context->numStarted;
+    if (pthread_create(&context->threads[i], NULL, bt709_context_thread, &context->bands[i]) != 0) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+// Change the pixel layout of the frames that follow, for streams
+// where the layout can change between frames. Must not be called
+// while a frame is being converted.
+
+static inline
+void bt709_context_set_layout(BT709Context *context, const BT709PixelLayout *layout) {
+  context->layout = *layout;
+}
+
+// Convert one frame into caller owned planes. Returns 0 on success.
+
+static inline
+int bt709_context_encode(BT709Context *context,
+                         const uint8_t *inPixels,
+                         const int inBytesPerRow,
+                         const BT709PlanesStruct *planes)
+{
+  context->inPixels = inPixels;
+  context->inBytesPerRow = inBytesPerRow;
+  context->planes = *planes;
+
+  if (context->numStarted > 1) {
+    pthread_mutex_lock(&context->mutex);
+    context->numRunning = context->numStarted - 1;
+    context->generation += 1;
+    pthread_cond_broadcast(&context->workCond);
+    pthread_mutex_unlock(&context->mutex);
+  }
+
+  bt709_context_encode_band(&context->bands[0]);
+
+  for (int i = context->numStarted; i < context->numThreads; i++) {
+    bt709_context_encode_band(&context->bands[i]);
+  }
+
+  if (context->numStarted > 1) {
+    pthread_mutex_lock(&context->mutex);
+    while (context->numRunning > 0) {
+      pthread_cond_wait(&context->doneCond, &context->mutex);
+    }
+    pthread_mutex_unlock(&context->mutex);
+  }
+
+  return 0;
+}
+
+// Convert one frame into the next output frame from the pool and
+// return its planes in outPlanes. The planes stay valid until
+// numBuffers more frames have been converted. Returns 0 on
+// success and 1 when the context has no output frames.
+
+static inline
+int bt709_context_convert(BT709Context *context,
+                          const uint8_t *inPixels,
+                          const int inBytesPerRow,
+                          BT709PlanesStruct *outPlanes)
+{
+  if (context->numBuffers == 0) {
+    return 1;
+  }
+
+  const int width = context->width;
+  const int height = context->height;
+
+  uint8_t *buffer = context->buffers[context->nextBuffer];
+  context->nextBuffer = (context->nextBuffer + 1) % context->numBuffers;
+
+  outPlanes->yPtr = buffer;
+  outPlanes->yBytesPerRow = width;
+  outPlanes->cbPtr = buffer + ((size_t) width * height);
+  outPlanes->cbBytesPerRow = width / 2;
+  outPlanes->crPtr = outPlanes->cbPtr + ((size_t) (width / 2) * (height / 2));
+  outPlanes->crBytesPerRow = width / 2;
+
+  return bt709_context_encode(context, inPixels, inBytesPerRow, outPlanes);
+}
+
+#endif // _BT709_CONTEXT_H
@@ -0,0 +1,622 @@
+//
+//  bt709_cube_lut.h
+//
+//  Header only interface that loads a 3D LUT in the .cube text
+//  format and applies it to 8 bit RGB pixels as part of the BT.709
+//  encode. A LUT can grade a frame or map input from another gamut
+//  such as Display P3 into sRGB without CoreGraphics.
+//
+//  Each lattice entry is padded to 4 floats so that one vector load
+//  reads a whole RGB value, tetrahedral interpolation then needs 4
+//  loads and 4 multiply adds per pixel with SSE2 or NEON. The LUT
+//  is applied to one pair of rows at a time just before that pair
+//  is converted, so the graded pixels never make a full frame pass.
+//  Row bands are processed on worker threads that a pool keeps
+//  parked between frames.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_CUBE_LUT_H)
+#define _BT709_CUBE_LUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "bt709_frame.h"
+#include "bt709_sharp_yuv.h"
+
+#define BT709_CUBE_LUT_MIN_SIZE 2
+#define BT709_CUBE_LUT_MAX_SIZE 256
+
+#define BT709_CUBE_LUT_MAX_THREADS 64
+
+typedef struct {
+  // Number of lattice points along each axis, for example 17, 33, or 65
+  int size;
+
+  // size^3 entries of 4 floats (R G B pad), R changes fastest
+  float *table;
+
+  float domainMin[3];
+  float domainMax[3];
+
+  // For each input byte of each channel, offset of the lower
+  // lattice point in floats and the fraction toward the next.
+  int offsets[3][256];
+  float fracs[3][256];
+} BT709CubeLUT;
+
+// Parse 3 floats from a line, returns 1 when all were found
+
+static inline
+int bt709_cube_lut_parse3(const char *str, float *values) {
+  return sscanf(str, "%f %f %f", &values[0], &values[1], &values[2]) == 3;
+}
+
+// Fill the per byte lookup tables from the size and domain
+
+static inline
+void bt709_cube_lut_init_index(BT709CubeLUT *lut) {
+  const int N = lut->size;
+  const int strides[3] = { 4, N * 4, N * N * 4 };
+
+  for (int c = 0; c < 3; c++) {
+    float range = lut->domainMax[c] - lut->domainMin[c];
+
+    for (int v = 0; v < 256; v++) {
+      float pos = (byteNorm(v) - lut->domainMin[c]) / range;
+      pos = (pos < 0.0f) ? 0.0f : ((pos > 1.0f) ? 1.0f : pos);
+      pos *= (N - 1);
+
+      int i = (int) pos;
+      if (i > (N - 2)) {
+        i = N - 2;
+      }
+
+      lut->offsets[c][v] = i * strides[c];
+      lut->fracs[c][v] = pos - i;
+    }
+  }
+}
+
+// Load a .cube file. Returns 0 on success, 1 when the file cannot
+// be opened, and 2 when the contents are not a supported 3D LUT.
+
+static inline
+int bt709_cube_lut_load(BT709CubeLUT *lut, const char *path) {
+  memset(lut, 0, sizeof(BT709CubeLUT));
+
+  for (int c = 0; c < 3; c++) {
+    lut->domainMin[c] = 0.0f;
+    lut->domainMax[c] = 1.0f;
+  }
+
+  FILE *inFile = fopen(path, "r");
+
+  if (inFile == NULL) {
+    fprintf(stderr, "could not open LUT file \"%s\"\n", path);
+    return 1;
+  }
+
+  char line[1024];
+  int numEntries = 0;
+  int maxEntries = 0;
+  int retcode = 0;
+
+  while (fgets(line, sizeof(line), inFile) != NULL) {
+    char *str = line;
+    while (*str == ' ' || *str == '\t') {
+      str++;
+    }
+
+    if (*str == '#' || *str == '\n' || *str == '\r' || *str == '\0') {
+      continue;
+    }
+
+    if (strncmp(str, "TITLE", 5) == 0) {
+      continue;
+    } else if (strncmp(str, "LUT_1D_SIZE", 11) == 0) {
+      fprintf(stderr, "1D LUT in \"%s\" is not supported\n", path);
+      retcode = 2;
+      break;
+    } else if (strncmp(str, "LUT_3D_SIZE", 11) == 0) {
+      int size = atoi(str + 11);
+      if (lut->size != 0 || size < BT709_CUBE_LUT_MIN_SIZE || size > BT709_CUBE_LUT_MAX_SIZE) {
+        fprintf(stderr, "LUT_3D_SIZE %d in \"%s\" is not supported\n", size, path);
+        retcode = 2;
+        break;
+      }
+      lut->size = size;
+      maxEntries = size * size * size;
+      lut->table = (float *) malloc(maxEntries * 4 * sizeof(float));
+      if (lut->table == NULL) {
+        retcode = 2;
+        break;
+      }
+    } else if (strncmp(str, "DOMAIN_MIN", 10) == 0) {
+      if (!bt709_cube_lut_parse3(str + 10, lut->domainMin)) {
+        retcode = 2;
+        break;
+      }
+    } else if (strncmp(str, "DOMAIN_MAX", 10) == 0) {
+      if (!bt709_cube_lut_parse3(str + 10, lut->domainMax)) {
+        retcode = 2;
+        break;
+      }
+    } else if (strncmp(str, "LUT_3D_INPUT_RANGE", 18) == 0) {
+      float minv, maxv;
+      if (sscanf(str + 18, "%f %f", &minv, &maxv) != 2) {
+        retcode = 2;
+        break;
+      }
+      for (int c = 0; c < 3; c++) {
+        lut->domainMin[c] = minv;
+        lut->domainMax[c] = maxv;
+      }
+    } else if ((*str >= '0' && *str <= '9') || *str == '-' || *str == '.') {
+      float rgb[3];
+      if (lut->table == NULL || numEntries == maxEntries || !bt709_cube_lut_parse3(str, rgb)) {
+        retcode = 2;
+        break;
+      }
+      float *entry = lut->table + (numEntries * 4);
+      entry[0] = rgb[0];
+      entry[1] = rgb[1];
+      entry[2] = rgb[2];
+      entry[3] = 0.0f;
+      numEntries++;
+    } else {
+      // Unknown keywords are ignored, as the format allows
+    }
+  }
+
+  fclose(inFile);
+
+  if (retcode == 0 && (lut->size == 0 || numEntries != maxEntries)) {
+    retcode = 2;
+  }
+
+  for (int c = 0; retcode == 0 && c < 3; c++) {
+    if (!(lut->domainMax[c] > lut->domainMin[c])) {
+      retcode = 2;
+    }
+  }
+
+  if (retcode != 0) {
+    fprintf(stderr, "\"%s\" is not a valid 3D .cube LUT\n", path);
+    free(lut->table);
+    lut->table = NULL;
+    return retcode;
+  }
+
+  bt709_cube_lut_init_index(lut);
+
+  return 0;
+}
+
+static inline
+void bt709_cube_lut_free(BT709CubeLUT *lut) {
+  free(lut->table);
+  lut->table = NULL;
+}
+
+// Tetrahedral interpolation of one 8 bit RGB value, the 3 result
+// bytes are written to outPtr.
+
+static inline
+void bt709_cube_lut_apply_pixel(const BT709CubeLUT *lut, int R, int G, int B, uint8_t *outPtr) {
+  const int N = lut->size;
+  const int sr = 4;
+  const int sg = N * 4;
+  const int sb = N * N * 4;
+
+  const float fr = lut->fracs[0][R];
+  const float fg = lut->fracs[1][G];
+  const float fb = lut->fracs[2][B];
+
+  const float *c000 = lut->table + (lut->offsets[0][R] + lut->offsets[1][G] + lut->offsets[2][B]);
+  const float *c111 = c000 + (sr + sg + sb);
+
+  // Select the tetrahedron that contains the point, weights
+  // are sorted so that f1 >= f2 >= f3.
+
+  const float *c1;
+  const float *c2;
+  float f1, f2, f3;
+
+  if (fr > fg) {
+    if (fg > fb) {
+      c1 = c000 + sr; c2 = c000 + sr + sg; f1 = fr; f2 = fg; f3 = fb;
+    } else if (fr > fb) {
+      c1 = c000 + sr; c2 = c000 + sr + sb; f1 = fr; f2 = fb; f3 = fg;
+    } else {
+      c1 = c000 + sb; c2 = c000 + sr + sb; f1 = fb; f2 = fr; f3 = fg;
+    }
+  } else {
+    if (fb > fg) {
+      c1 = c000 + sb; c2 = c000 + sg + sb; f1 = fb; f2 = fg; f3 = fr;
+    } else if (fb > fr) {
+      c1 = c000 + sg; c2 = c000 + sg + sb; f1 = fg; f2 = fb; f3 = fr;
+    } else {
+      c1 = c000 + sg; c2 = c000 + sr + sg; f1 = fg; f2 = fr; f3 = fb;
+    }
+  }
+
+  // out = c000 * (1 - f1) + c1 * (f1 - f2) + c2 * (f2 - f3) + c111 * f3
+
+#if defined(__SSE2__)
+  __m128 v = _mm_mul_ps(_mm_loadu_ps(c000), _mm_set1_ps(1.0f - f1));
+  v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(c1), _mm_set1_ps(f1 - f2)));
+  v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(c2), _mm_set1_ps(f2 - f3)));
+  v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(c111), _mm_set1_ps(f3)));
+
+  v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  // Round half up as the scalar and NEON paths do
+  __m128i vi = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+  vi = _mm_packs_epi32(vi, vi);
+  vi = _mm_packus_epi16(vi, vi);
+
+  uint32_t packed = (uint32_t) _mm_cvtsi128_si32(vi);
+  outPtr[0] = (uint8_t) packed;
+  outPtr[1] = (uint8_t) (packed >> 8);
+  outPtr[2] = (uint8_t) (packed >> 16);
+#elif defined(__ARM_NEON)
+  float32x4_t v = vmulq_n_f32(vld1q_f32(c000), 1.0f - f1);
+  v = vmlaq_n_f32(v, vld1q_f32(c1), f1 - f2);
+  v = vmlaq_n_f32(v, vld1q_f32(c2), f2 - f3);
+  v = vmlaq_n_f32(v, vld1q_f32(c111), f3);
+
+  v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+  uint32x4_t vi = vcvtq_u32_f32(vmlaq_n_f32(vdupq_n_f32(0.5f), v, 255.0f));
+
+  outPtr[0] = (uint8_t) vgetq_lane_u32(vi, 0);
+  outPtr[1] = (uint8_t) vgetq_lane_u32(vi, 1);
+  outPtr[2] = (uint8_t) vgetq_lane_u32(vi, 2);
+#else
+  for (int c = 0; c < 3; c++) {
+    float v = (c000[c] * (1.0f - f1)) + (c1[c] * (f1 - f2)) + (c2[c] * (f2 - f3)) + (c111[c] * f3);
+    v = (v < 0.0f) ? 0.0f : ((v > 1.0f) ? 1.0f : v);
+    outPtr[c] = (uint8_t) ((v * 255.0f) + 0.5f);
+  }
+#endif
+}
+
+// Apply the LUT to numRows rows of input and write packed RGB
+// rows of width * 3 bytes to outPixels.
+
+static inline
+void bt709_cube_lut_apply_rows(const BT709CubeLUT *lut,
+                               const BT709PixelLayout *layout,
+                               const uint8_t *inPixels,
+                               const int inBytesPerRow,
+                               const int width,
+                               const int numRows,
+                               uint8_t *outPixels)
+{
+  const int bpp = layout->bytesPerPixel;
+  const int rOff = layout->rOffset;
+  const int gOff = layout->gOffset;
+  const int bOff = layout->bOffset;
+
+  for (int row = 0; row < numRows; row++) {
+    const uint8_t *inPtr = inPixels + (row * (size_t)inBytesPerRow);
+    uint8_t *outPtr = outPixels + (row * (size_t)width * 3);
+
+    for (int col = 0; col < width; col++) {
+      bt709_cube_lut_apply_pixel(lut, inPtr[rOff], inPtr[gOff], inPtr[bOff], outPtr);
+      inPtr += bpp;
+      outPtr += 3;
+    }
+  }
+}
+
+typedef struct BT709CubeLUTPool BT709CubeLUTPool;
+
+typedef struct {
+  BT709CubeLUTPool *pool;
+  int rowStart;
+  int rowEnd;
+  // Graded pixels for one pair of rows, kept between frames
+  uint8_t *rgbRows;
+  size_t rgbRowsLen;
+  int retcode;
+} BT709CubeLUTBand;
+
+// Worker threads that stay parked between frames, so that each
+// frame converted with a LUT does not create threads. The pool
+// struct is shared with the worker threads, do not move it between
+// bt709_cube_lut_pool_init() and bt709_cube_lut_pool_destroy().
+
+struct BT709CubeLUTPool {
+  // Band 0 is converted by the calling thread, bands that have
+  // no worker thread are also converted by the calling thread.
+  int numThreads;
+  int numStarted;
+  BT709CubeLUTBand bands[BT709_CUBE_LUT_MAX_THREADS];
+  pthread_t threads[BT709_CUBE_LUT_MAX_THREADS];
+
+  pthread_mutex_t mutex;
+  pthread_cond_t workCond;
+  pthread_cond_t doneCond;
+
+  // Guarded by mutex
+  unsigned int generation;
+  int numRunning;
+  int isShutdown;
+
+  // Frame being converted, set before generation is incremented
+  const BT709CubeLUT *lut;
+  const BT709FrameTables *tables;
+  const BT709SharpTables *sharpTables;
+  const BT709PixelLayout *layout;
+  const uint8_t *inPixels;
+  int inBytesPerRow;
+  int width;
+  BT709PlanesStruct planes;
+};
+
+static inline
+void bt709_cube_lut_encode_band(BT709CubeLUTBand *band) {
+  const BT709CubeLUTPool *pool = band->pool;
+
+  const int width = pool->width;
+
+  if (band->rowStart >= band->rowEnd) {
+    return;
+  }
+
+  const size_t rgbRowsLen = (size_t) width * 2 * 3;
+
+  if (band->rgbRowsLen < rgbRowsLen) {
+    free(band->rgbRows);
+    band->rgbRows = (uint8_t *) malloc(rgbRowsLen);
+    if (band->rgbRows == NULL) {
+      band->rgbRowsLen = 0;
+      band->retcode = 1;
+      return;
+    }
+    band->rgbRowsLen = rgbRowsLen;
+  }
+
+  uint8_t *rgbRows = band->rgbRows;
+
+  const BT709PixelLayout rgbLayout = bt709_pixel_layout_rgb();
+
+  // Planes relative to the pair of rows being converted
+
+  BT709PlanesStruct rowPlanes = pool->planes;
+
+  for (int row = band->rowStart; row < band->rowEnd; row += 2) {
+    bt709_cube_lut_apply_rows(pool->lut, pool->layout,
+                              pool->inPixels + (row * (size_t)pool->inBytesPerRow),
+                              pool->inBytesPerRow, width, 2, rgbRows);
+
+    rowPlanes.yPtr = pool->planes.yPtr + (row * (size_t)pool->planes.yBytesPerRow);
+    rowPlanes.cbPtr = pool->planes.cbPtr + ((row / 2) * (size_t)pool->planes.cbBytesPerRow);
+    rowPlanes.crPtr = pool->planes.crPtr + ((row / 2) * (size_t)pool->planes.crBytesPerRow);
+
+    if (pool->sharpTables != NULL) {
+      bt709_sharp_encode_rows(pool->sharpTables, &rgbLayout, rgbRows, width * 3, width, 0, 2, &rowPlanes);
+    } else {
+      bt709_frame_encode_rows(pool->tables, &rgbLayout, rgbRows, width * 3, width, 0, 2, &rowPlanes);
+    }
+  }
+}
+
+static inline
+void* bt709_cube_lut_band_thread(void *arg) {
+  BT709CubeLUTBand *band = (BT709CubeLUTBand *) arg;
+  BT709CubeLUTPool *pool = band->pool;
+
+  // Threads are started before the first frame, so the first
+  // frame is always seen as a new generation.
+
+  unsigned int seenGeneration = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+
+  while (1) {
+    while (pool->isShutdown == 0 && pool->generation == seenGeneration) {
+      pthread_cond_wait(&pool->workCond, &pool->mutex);
+    }
+
+    if (pool->isShutdown) {
+      break;
+    }
+
+    seenGeneration = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+
+    bt709_cube_lut_encode_band(band);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->numRunning -= 1;
+    if (pool->numRunning == 0) {
+      pthread_cond_signal(&pool->doneCond);
+    }
+  }
+
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+// Start up to numThreads - 1 worker threads, the calling thread is
+// the first thread. When a thread cannot be started its band and
+// every band after it is converted by the calling thread.
+
+static inline
+void bt709_cube_lut_pool_init(BT709CubeLUTPool *pool, int numThreads) {
+  memset(pool, 0, sizeof(BT709CubeLUTPool));
+
+  if (numThreads < 1) {
+    numThreads = 1;
+  } else if (numThreads > BT709_CUBE_LUT_MAX_THREADS) {
+    numThreads = BT709_CUBE_LUT_MAX_THREADS;
+  }
+  pool->numThreads = numThreads;
+
+  for (int i = 0; i < numThreads; i++) {
+    pool->bands[i].pool = pool;
+  }
+
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->workCond, NULL);
+  pthread_cond_init(&pool->doneCond, NULL);
+
+  pool->numStarted = 1;
+
+  for ( ; pool->numStarted < numThreads; pool->numStarted++) {
+    const int i = pool->numStarted;
+    if (pthread_create(&pool->threads[i], NULL, bt709_cube_lut_band_thread, &pool->bands[i]) != 0) {
+      break;
+    }
+  }
+}
+
+static inline
+void bt709_cube_lut_pool_destroy(BT709CubeLUTPool *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->isShutdown = 1;
+  pthread_cond_broadcast(&pool->workCond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (int i = 1; i < pool->numStarted; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  pool->numStarted = 0;
+
+  for (int i = 0; i < pool->numThreads; i++) {
+    free(pool->bands[i].rgbRows);
+    pool->bands[i].rgbRows = NULL;
+    pool->bands[i].rgbRowsLen = 0;
+  }
+
+  pthread_cond_destroy(&pool->doneCond);
+  pthread_cond_destroy(&pool->workCond);
+  pthread_mutex_destroy(&pool->mutex);
+}
+
+// Apply the LUT and convert a full frame with the pool threads,
+// width and height must both be even. When sharpTables is not NULL
+// the luma refinement stage is used, otherwise tables. Frames can
+// change size between calls. Returns 0 on success.
+
+static inline
+int bt709_cube_lut_pool_encode(BT709CubeLUTPool *pool,
+                               const BT709CubeLUT *lut,
+                               const BT709FrameTables *tables,
+                               const BT709SharpTables *sharpTables,
+                               const BT709PixelLayout *layout,
+                               const uint8_t *inPixels,
+                               const int inBytesPerRow,
+                               const int width,
+                               const int height,
+                               const BT709PlanesStruct *planes)
+{
+  if ((width % 2) != 0 || (height % 2) != 0) {
+    return 1;
+  }
+
+  pool->lut = lut;
+  pool->tables = tables;
+  pool->sharpTables = sharpTables;
+  pool->layout = layout;
+  pool->inPixels = inPixels;
+  pool->inBytesPerRow = inBytesPerRow;
+  pool->width = width;
+  pool->planes = *planes;
+
+  // Bands are split on pairs of rows, with fewer pairs than
+  // threads some bands are empty.
+
+  const int numPairs = height / 2;
+  const int numThreads = pool->numThreads;
+
+  for (int i = 0; i < numThreads; i++) {
+    BT709CubeLUTBand *band = &pool->bands[i];
+    band->rowStart = (int) (((int64_t) numPairs * i) / numThreads) * 2;
+    band->rowEnd = (int) (((int64_t) numPairs * (i + 1)) / numThreads) * 2;
+    band->retcode = 0;
+  }
+
+  if (pool->numStarted > 1) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->numRunning = pool->numStarted - 1;
+    pool->generation += 1;
+    pthread_cond_broadcast(&pool->workCond);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+
+  bt709_cube_lut_encode_band(&pool->bands[0]);
+
+  for (int i = pool->numStarted; i < numThreads; i++) {
+    bt709_cube_lut_encode_band(&pool->bands[i]);
+  }
+
+  if (pool->numStarted > 1) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->numRunning > 0) {
+      pthread_cond_wait(&pool->doneCond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+  }
+
+  int retcode = 0;
+  for (int i = 0; i < numThreads; i++) {
+    if (pool->bands[i].retcode != 0) {
+      retcode = pool->bands[i].retcode;
+    }
+  }
+
+  return retcode;
+}
+
+// Convert a single frame with threads that only live for this
+// call, use a BT709CubeLUTPool to convert a sequence of frames.
+// Returns 0 on success.
+
+static inline
+int bt709_cube_lut_encode(const BT709CubeLUT *lut,
+                          const BT709FrameTables *tables,
+                          const BT709SharpTables *sharpTables,
+                          const BT709PixelLayout *layout,
+                          const uint8_t *inPixels,
+                          const int inBytesPerRow,
+                          const int width,
+                          const int height,
+                          const BT709PlanesStruct *planes,
+                          int numThreads)
+{
+  if ((width % 2) != 0 || (height % 2) != 0) {
+    return 1;
+  }
+
+  // No more threads than pairs of rows
+
+  if (numThreads > (height / 2)) {
+    numThreads = height / 2;
+  }
+
+  BT709CubeLUTPool pool;
+  bt709_cube_lut_pool_init(&pool, numThreads);
+
+  int retcode = bt709_cube_lut_pool_encode(&pool, lut, tables, sharpTables, layout, inPixels, inBytesPerRow, width, height, planes);
+
+  bt709_cube_lut_pool_destroy(&pool);
+
+  return retcode;
+}
+
+#endif // _BT709_CUBE_LUT_H
@@ -0,0 +1,688 @@
+//
+//  bt709_decode.h
+//
+//  Header only interface that decodes BT.709 Y Cb Cr planes at
+//  4:2:0 subsampling to 8 bit sRGB pixels on the CPU. The math is
+//  the same as the Metal decode shaders: chroma is sampled with
+//  nearest filtering, the matrix output is saturated, gamma decoded
+//  to linear and then encoded as sRGB as a sRGB texture write would.
+//
+//  Any rectangle of the frame can be decoded into a caller owned
+//  buffer with any row stride, so a viewer that shows part of a
+//  large frame only converts the visible pixels. The rectangle can
+//  start at an odd column or row, each output pixel reads the
+//  chroma sample that covers it in the full frame.
+//
+//  Linear light output is also available as float32 planes or as
+//  interleaved RGBA half floats (RGBA16F), the same intermediate
+//  format the macOS renderer uses for resizing. Half floats are
+//  converted with F16C when the compiler targets it (-mf16c) and
+//  with NEON on arm64, otherwise with a scalar conversion that
+//  rounds the same way.
+//
+//  A color frame with a matching alpha channel frame (as written
+//  by srgb_to_bt709 -alpha) can be composited over a background
+//  buffer or a solid color as part of the decode. srgb_to_bt709
+//  encodes color premultiplied by alpha, so the decoded color is
+//  added to the background scaled by (1 - alpha). The blend is done
+//  in linear light and the result is written as sRGB, so a layer
+//  is drawn with one pass over the output instead of a decode
+//  followed by a separate read modify write blend.
+//
+//  Alpha can also be packed into the color stream (srgb_to_bt709
+//  -alpha packed). A packed frame is width x (2 * height), rows
+//  [0, height) hold the color image and rows [height, 2 * height)
+//  hold alpha in Y with neutral Cb and Cr. One decode of the
+//  packed frame provides both, use bt709_decode_packed_alpha_ptr()
+//  to find the alpha plane and pass the color height as height.
+//  Packed color is premultiplied by alpha the same way.
+//
+//  This module depends only on the C library.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_DECODE_H)
+#define _BT709_DECODE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "BT709.h"
+#include "bt709_frame.h"
+
+// Number of intervals in the gamma encoded matrix output to
+// sRGB byte table.
+
+#define BT709_DECODE_CURVE_SIZE 16384
+
+// Tables that depend only on the encoded gamma, init once and
+// then reuse for every frame. This struct is large, so allocate
+// it on the heap.
+
+typedef struct {
+  BT709Gamma inputGamma;
+
+  // Matrix terms for each Y, Cb, Cr code value
+  float yTerm[256];
+  float crR[256];
+  float cbG[256];
+  float crG[256];
+  float cbB[256];
+
+  // Gamma encoded matrix output -> sRGB byte
+  uint8_t toOutput[BT709_DECODE_CURVE_SIZE + 1];
+
+  // Gamma encoded matrix output -> normalized linear float
+  float toLinear[BT709_DECODE_CURVE_SIZE + 1];
+
+  // Alpha channel Y code value -> normalized alpha
+  float alpha[256];
+
+  // Alpha channel Y code value -> alpha byte
+  uint8_t alphaByte[256];
+
+  // sRGB background byte <-> linear, used when compositing
+  BT709FrameTables sRGBTables;
+} BT709DecodeTables;
+
+// Output planes of normalized linear floats, strides are in bytes
+
+typedef struct {
+  float *rPtr;
+  int rBytesPerRow;
+
+  float *gPtr;
+  int gBytesPerRow;
+
+  float *bPtr;
+  int bBytesPerRow;
+} BT709FloatPlanesStruct;
+
+static inline
+void bt709_decode_tables_init(BT709DecodeTables *tables, const BT709Gamma inputGamma) {
+  tables->inputGamma = inputGamma;
+
+  const float YScale = 1.0f / (BT709_YMax - BT709_YMin);
+  const float UVScale = 1.0f / (BT709_UVMax - BT709_UVMin);
+
+  for (int i = 0; i < 256; i++) {
+    float Yn = (i - 16) * YScale;
+    float Cn = (i - 128) * UVScale;
+
+    tables->yTerm[i] = Yn;
+    tables->crR[i] = Cn * BT709_Er_minus_Ey_Range;
+    tables->cbG[i] = -1.0f * Cn * BT709_Eb_minus_Ey_Range * BT709_Kb_over_Kg;
+    tables->crG[i] = -1.0f * Cn * BT709_Er_minus_Ey_Range * BT709_Kr_over_Kg;
+    tables->cbB[i] = Cn * BT709_Eb_minus_Ey_Range;
+  }
+
+  for (int i = 0; i <= BT709_DECODE_CURVE_SIZE; i++) {
+    float normV = i * (1.0f / BT709_DECODE_CURVE_SIZE);
+    if (inputGamma == BT709GammaSrgb) {
+      normV = sRGB_nonLinearNormToLinear(normV);
+    } else if (inputGamma == BT709GammaApple) {
+      normV = Apple196_nonLinearNormToLinear(normV);
+    }
+    tables->toOutput[i] = (uint8_t) round(sRGB_linearNormToNonLinear(normV) * 255.0f);
+    tables->toLinear[i] = normV;
+  }
+
+  // Alpha is stored as linear values in the Y channel, decode
+  // the same way as BT709_decodeAlpha() in the shaders.
+
+  for (int i = 0; i < 256; i++) {
+    tables->alpha[i] = saturatef(((i / 255.0f) - (16.0f / 255.0f)) * 1.1644f);
+    tables->alphaByte[i] = (uint8_t) round(tables->alpha[i] * 255.0f);
+  }
+
+  bt709_frame_tables_init(&tables->sRGBTables, BT709GammaSrgb, BT709GammaSrgb);
+}
+
+// Saturate a gamma encoded matrix output and map it to a sRGB byte
+
+static inline
+uint8_t bt709_decode_component(const BT709DecodeTables *tables, float nonLinear) {
+  int i = (int) ((nonLinear * BT709_DECODE_CURVE_SIZE) + 0.5f);
+  if (i <= 0) {
+    return tables->toOutput[0];
+  } else if (i >= BT709_DECODE_CURVE_SIZE) {
+    return tables->toOutput[BT709_DECODE_CURVE_SIZE];
+  }
+  return tables->toOutput[i];
+}
+
+// Saturate a gamma encoded matrix output and map it to linear,
+// values between table entries are interpolated.
+
+static inline
+float bt709_decode_linear_component(const BT709DecodeTables *tables, float nonLinear) {
+  float f = nonLinear * BT709_DECODE_CURVE_SIZE;
+  if (f <= 0.0f) {
+    return tables->toLinear[0];
+  } else if (f >= (float) BT709_DECODE_CURVE_SIZE) {
+    return tables->toLinear[BT709_DECODE_CURVE_SIZE];
+  }
+  int i = (int) f;
+  float frac = f - i;
+  return tables->toLinear[i] + ((tables->toLinear[i+1] - tables->toLinear[i]) * frac);
+}
+
+// Linear (R G B) for one Y sample and the chroma sample covering it
+
+static inline
+void bt709_decode_linear_rgb(const BT709DecodeTables *tables,
+                             int Y, int Cb, int Cr,
+                             float *RnPtr, float *GnPtr, float *BnPtr)
+{
+  const float yTerm = tables->yTerm[Y];
+  *RnPtr = bt709_decode_linear_component(tables, yTerm + tables->crR[Cr]);
+  *GnPtr = bt709_decode_linear_component(tables, yTerm + tables->cbG[Cb] + tables->crG[Cr]);
+  *BnPtr = bt709_decode_linear_component(tables, yTerm + tables->cbB[Cb]);
+}
+
+// Convert a float to an IEEE half float, rounding to nearest even
+
+static inline
+uint16_t bt709_half_from_float(float f) {
+  union { float f; uint32_t u; } v;
+  v.f = f;
+
+  const uint32_t sign = (v.u >> 16) & 0x8000;
+  uint32_t u = v.u & 0x7FFFFFFF;
+
+  if (u >= 0x47800000) {
+    // Too large for a half, or Inf or NaN
+    return sign | ((u > 0x7F800000) ? 0x7E00 : 0x7C00);
+  } else if (u < 0x38800000) {
+    // Denormal half or zero, adding 0.5 aligns the mantissa
+    // so that the float add does the rounding.
+    v.u = u;
+    v.f += 0.5f;
+    return sign | (uint16_t) (v.u - 0x3F000000);
+  } else {
+    const uint32_t mantOdd = (u >> 13) & 1;
+    // Rebias the exponent and round
+    u += ((uint32_t) (15 - 127) << 23) + 0xFFF;
+    u += mantOdd;
+    return sign | (uint16_t) (u >> 13);
+  }
+}
+
+// Convert numValues floats to half floats
+
+static inline
+void bt709_half_from_float4(uint16_t *outPtr, const float *inPtr, int numValues) {
+  int i = 0;
+
+#if defined(__F16C__)
+  for ( ; i + 4 <= numValues; i += 4) {
+    __m128i h = _mm_cvtps_ph(_mm_loadu_ps(inPtr + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storel_epi64((__m128i *) (outPtr + i), h);
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for ( ; i + 4 <= numValues; i += 4) {
+    float16x4_t h = vcvt_f16_f32(vld1q_f32(inPtr + i));
+    vst1_u16(outPtr + i, vreinterpret_u16_f16(h));
+  }
+#endif
+
+  for ( ; i < numValues; i++) {
+    outPtr[i] = bt709_half_from_float(inPtr[i]);
+  }
+}
+
+static inline
+void bt709_decode_pixel(const BT709DecodeTables *tables,
+                        const BT709PixelLayout *layout,
+                        float yTerm, float rTerm, float gTerm, float bTerm,
+                        uint8_t *outPtr)
+{
+  outPtr[layout->rOffset] = bt709_decode_component(tables, yTerm + rTerm);
+  outPtr[layout->gOffset] = bt709_decode_component(tables, yTerm + gTerm);
+  outPtr[layout->bOffset] = bt709_decode_component(tables, yTerm + bTerm);
+  if (layout->aOffset >= 0) {
+    outPtr[layout->aOffset] = 0xFF;
+  }
+}
+
+// Check that a region is inside the frame, returns 0 when it is
+
+static inline
+int bt709_decode_check_region(const int width,
+                              const int height,
+                              const int x,
+                              const int y,
+                              const int regionWidth,
+                              const int regionHeight)
+{
+  if (x < 0 || y < 0 || regionWidth <= 0 || regionHeight <= 0 ||
+      regionWidth > (width - x) || regionHeight > (height - y)) {
+    return 1;
+  }
+  return 0;
+}
+
+// Decode the rectangle (x, y, regionWidth, regionHeight) of a
+// width x height frame. Cb and Cr planes are half width and half
+// height, chromaStep is 1 when they are separate planes (I420)
+// and 2 when they are interleaved (NV12) with crPtr = cbPtr + 1.
+// The first output pixel is written at outPixels. Returns 0 on
+// success and 1 when the rectangle is not inside the frame.
+
+static inline
+int bt709_decode_region(const BT709DecodeTables *tables,
+                        const BT709PlanesStruct *planes,
+                        const int chromaStep,
+                        const int width,
+                        const int height,
+                        const int x,
+                        const int y,
+                        const int regionWidth,
+                        const int regionHeight,
+                        const BT709PixelLayout *layout,
+                        uint8_t *outPixels,
+                        const int outBytesPerRow)
+{
+  if (bt709_decode_check_region(width, height, x, y, regionWidth, regionHeight) != 0) {
+    return 1;
+  }
+
+  const int bpp = layout->bytesPerPixel;
+  const int colEnd = x + regionWidth;
+
+  for (int row = 0; row < regionHeight; row++) {
+    const int inRow = y + row;
+
+    const uint8_t *yRow = planes->yPtr + (inRow * (size_t)planes->yBytesPerRow);
+    const uint8_t *cbRow = planes->cbPtr + ((inRow / 2) * (size_t)planes->cbBytesPerRow);
+    const uint8_t *crRow = planes->crPtr + ((inRow / 2) * (size_t)planes->crBytesPerRow);
+
+    uint8_t *outPtr = outPixels + (row * (size_t)outBytesPerRow);
+
+    int col = x;
+
+    // An odd starting column shares its chroma sample with the
+    // pixel to the left, which is outside the region.
+
+    if ((col % 2) != 0) {
+      const int Cb = cbRow[(col / 2) * chromaStep];
+      const int Cr = crRow[(col / 2) * chromaStep];
+      bt709_decode_pixel(tables, layout, tables->yTerm[yRow[col]],
+                         tables->crR[Cr], tables->cbG[Cb] + tables->crG[Cr], tables->cbB[Cb], outPtr);
+      outPtr += bpp;
+      col++;
+    }
+
+    for ( ; col + 2 <= colEnd; col += 2) {
+      const int Cb = cbRow[(col / 2) * chromaStep];
+      const int Cr = crRow[(col / 2) * chromaStep];
+
+      const float rTerm = tables->crR[Cr];
+      const float gTerm = tables->cbG[Cb] + tables->crG[Cr];
+      const float bTerm = tables->cbB[Cb];
+
+      bt709_decode_pixel(tables, layout, tables->yTerm[yRow[col]], rTerm, gTerm, bTerm, outPtr);
+      bt709_decode_pixel(tables, layout, tables->yTerm[yRow[col+1]], rTerm, gTerm, bTerm, outPtr + bpp);
+      outPtr += (2 * bpp);
+    }
+
+    if (col < colEnd) {
+      const int Cb = cbRow[(col / 2) * chromaStep];
+      const int Cr = crRow[(col / 2) * chromaStep];
+      bt709_decode_pixel(tables, layout, tables->yTerm[yRow[col]],
+                         tables->crR[Cr], tables->cbG[Cb] + tables->crG[Cr], tables->cbB[Cb], outPtr);
+    }
+  }
+
+  return 0;
+}
+
+// Decode a region to linear float planes, arguments are the same
+// as bt709_decode_region(). Returns 0 on success.
+
+static inline
+int bt709_decode_region_float(const BT709DecodeTables *tables,
+                              const BT709PlanesStruct *planes,
+                              const int chromaStep,
+                              const int width,
+                              const int height,
+                              const int x,
+                              const int y,
+                              const int regionWidth,
+                              const int regionHeight,
+                              const BT709FloatPlanesStruct *outPlanes)
+{
+  if (bt709_decode_check_region(width, height, x, y, regionWidth, regionHeight) != 0) {
+    return 1;
+  }
+
+  for (int row = 0; row < regionHeight; row++) {
+    const int inRow = y + row;
+
+    const uint8_t *yRow = planes->yPtr + (inRow * (size_t)planes->yBytesPerRow);
+    const uint8_t *cbRow = planes->cbPtr + ((inRow / 2) * (size_t)planes->cbBytesPerRow);
+    const uint8_t *crRow = planes->crPtr + ((inRow / 2) * (size_t)planes->crBytesPerRow);
+
+    float *rRow = (float *) ((uint8_t *) outPlanes->rPtr + (row * (size_t)outPlanes->rBytesPerRow));
+    float *gRow = (float *) ((uint8_t *) outPlanes->gPtr + (row * (size_t)outPlanes->gBytesPerRow));
+    float *bRow = (float *) ((uint8_t *) outPlanes->bPtr + (row * (size_t)outPlanes->bBytesPerRow));
+
+    for (int col = 0; col < regionWidth; col++) {
+      const int inCol = x + col;
+      const int cOffset = (inCol / 2) * chromaStep;
+      bt709_decode_linear_rgb(tables, yRow[inCol], cbRow[cOffset], crRow[cOffset], &rRow[col], &gRow[col], &bRow[col]);
+    }
+  }
+
+  return 0;
+}
+
+// Decode a region to linear RGBA half floats with alpha read from
+// an alpha Y plane, or set to 1.0 when alphaPtr is NULL. Color is
+// returned premultiplied by alpha as srgb_to_bt709 -alpha encodes
+// it, the multiply having been done in the gamma encoded space.
+// Each output pixel is 8 bytes. Returns 0 on success.
+
+static inline
+int bt709_decode_region_half_alpha(const BT709DecodeTables *tables,
+                                   const BT709PlanesStruct *planes,
+                                   const int chromaStep,
+                                   const uint8_t *alphaPtr,
+                                   const int alphaBytesPerRow,
+                                   const int width,
+                                   const int height,
+                                   const int x,
+                                   const int y,
+                                   const int regionWidth,
+                                   const int regionHeight,
+                                   uint16_t *outPixels,
+                                   const int outBytesPerRow)
+{
+  if (bt709_decode_check_region(width, height, x, y, regionWidth, regionHeight) != 0) {
+    return 1;
+  }
+
+  // Pixels are decoded to float in blocks and then converted
+
+  const int blockSize = 64;
+  float block[64 * 4];
+
+  for (int row = 0; row < regionHeight; row++) {
+    const int inRow = y + row;
+
+    const uint8_t *yRow = planes->yPtr + (inRow * (size_t)planes->yBytesPerRow);
+    const uint8_t *cbRow = planes->cbPtr + ((inRow / 2) * (size_t)planes->cbBytesPerRow);
+    const uint8_t *crRow = planes->crPtr + ((inRow / 2) * (size_t)planes->crBytesPerRow);
+
+    const uint8_t *aRow = (alphaPtr != NULL) ? (alphaPtr + (inRow * (size_t)alphaBytesPerRow)) : NULL;
+
+    uint16_t *outRow = (uint16_t *) ((uint8_t *) outPixels + (row * (size_t)outBytesPerRow));
+
+    for (int blockStart = 0; blockStart < regionWidth; blockStart += blockSize) {
+      int numPixels = regionWidth - blockStart;
+      if (numPixels > blockSize) {
+        numPixels = blockSize;
+      }
+
+      for (int i = 0; i < numPixels; i++) {
+        const int inCol = x + blockStart + i;
+        const int cOffset = (inCol / 2) * chromaStep;
+        float *p = &block[i * 4];
+        bt709_decode_linear_rgb(tables, yRow[inCol], cbRow[cOffset], crRow[cOffset], &p[0], &p[1], &p[2]);
+        p[3] = (aRow != NULL) ? tables->alpha[aRow[inCol]] : 1.0f;
+      }
+
+      bt709_half_from_float4(outRow + (blockStart * 4), block, numPixels * 4);
+    }
+  }
+
+  return 0;
+}
+
+// Decode a region to linear RGBA half floats with alpha set to 1.0
+
+static inline
+int bt709_decode_region_half(const BT709DecodeTables *tables,
+                             const BT709PlanesStruct *planes,
+                             const int chromaStep,
+                             const int width,
+                             const int height,
+                             const int x,
+                             const int y,
+                             const int regionWidth,
+                             const int regionHeight,
+                             uint16_t *outPixels,
+                             const int outBytesPerRow)
+{
+  return bt709_decode_region_half_alpha(tables, planes, chromaStep, NULL, 0, width, height,
+                                        x, y, regionWidth, regionHeight, outPixels, outBytesPerRow);
+}
+
+// Decode a region to sRGB pixels with alpha read from an alpha Y
+// plane, the layout must have an alpha channel. Color is returned
+// premultiplied by alpha as srgb_to_bt709 -alpha encodes it, which
+// is the CoreGraphics premultiplied layout, use
+// bt709_alpha_unpremultiply_row() when straight alpha is needed.
+// Each row is decoded and then its alpha bytes are filled in while
+// the row is still in cache. Returns 0 on success.
+
+static inline
+int bt709_decode_region_alpha(const BT709DecodeTables *tables,
+                              const BT709PlanesStruct *planes,
+                              const int chromaStep,
+                              const uint8_t *alphaPtr,
+                              const int alphaBytesPerRow,
+                              const int width,
+                              const int height,
+                              const int x,
+                              const int y,
+                              const int regionWidth,
+                              const int regionHeight,
+                              const BT709PixelLayout *layout,
+                              uint8_t *outPixels,
+                              const int outBytesPerRow)
+{
+  if (bt709_decode_check_region(width, height, x, y, regionWidth, regionHeight) != 0 || layout->aOffset < 0) {
+    return 1;
+  }
+
+  const int bpp = layout->bytesPerPixel;
+
+  for (int row = 0; row < regionHeight; row++) {
+    uint8_t *outRow = outPixels + (row * (size_t)outBytesPerRow);
+    bt709_decode_region(tables, planes, chromaStep, width, height, x, y + row, regionWidth, 1, layout, outRow, outBytesPerRow);
+
+    const uint8_t *aRow = alphaPtr + ((y + row) * (size_t)alphaBytesPerRow) + x;
+    uint8_t *aOutPtr = outRow + layout->aOffset;
+
+    for (int col = 0; col < regionWidth; col++) {
+      aOutPtr[col * bpp] = tables->alphaByte[aRow[col]];
+    }
+  }
+
+  return 0;
+}
+
+// Composite one row of decoded pixels over background pixels in
+// linear light. Color is premultiplied by alpha, so the output is
+// color + background * (1 - alpha). Background pixels use the
+// output layout and are bgStep bytes apart, a bgStep of zero
+// repeats one pixel. The background is treated as opaque so output
+// alpha is 0xFF. The background can be the output row, each pixel
+// is read before it is written.
+
+static inline
+void bt709_decode_over_row(const BT709DecodeTables *tables,
+                           const uint8_t *yRow,
+                           const uint8_t *cbRow,
+                           const uint8_t *crRow,
+                           const int chromaStep,
+                           const uint8_t *aRow,
+                           const int x,
+                           const int regionWidth,
+                           const BT709PixelLayout *layout,
+                           const uint8_t *bgPtr,
+                           const int bgStep,
+                           uint8_t *outPtr)
+{
+  const BT709FrameTables *sRGBTables = &tables->sRGBTables;
+  const int bpp = layout->bytesPerPixel;
+  const int rOff = layout->rOffset;
+  const int gOff = layout->gOffset;
+  const int bOff = layout->bOffset;
+
+  for (int col = 0; col < regionWidth; col++, bgPtr += bgStep, outPtr += bpp) {
+    const int inCol = x + col;
+    const float An = tables->alpha[aRow[inCol]];
+
+    const int Cb = cbRow[(inCol / 2) * chromaStep];
+    const int Cr = crRow[(inCol / 2) * chromaStep];
+
+    if (An >= 1.0f) {
+      // Opaque pixels are the same as a plain decode
+      bt709_decode_pixel(tables, layout, tables->yTerm[yRow[inCol]],
+                         tables->crR[Cr], tables->cbG[Cb] + tables->crG[Cr], tables->cbB[Cb], outPtr);
+      continue;
+    }
+
+    const float Rb = sRGBTables->toLinear[bgPtr[rOff]];
+    const float Gb = sRGBTables->toLinear[bgPtr[gOff]];
+    const float Bb = sRGBTables->toLinear[bgPtr[bOff]];
+
+    if (An <= 0.0f) {
+      outPtr[rOff] = bgPtr[rOff];
+      outPtr[gOff] = bgPtr[gOff];
+      outPtr[bOff] = bgPtr[bOff];
+    } else {
+      float Rn, Gn, Bn;
+      bt709_decode_linear_rgb(tables, yRow[inCol], Cb, Cr, &Rn, &Gn, &Bn);
+
+      const float oneMinusA = 1.0f - An;
+      outPtr[rOff] = (uint8_t) bt709_frame_from_linear(sRGBTables, Rn + (Rb * oneMinusA));
+      outPtr[gOff] = (uint8_t) bt709_frame_from_linear(sRGBTables, Gn + (Gb * oneMinusA));
+      outPtr[bOff] = (uint8_t) bt709_frame_from_linear(sRGBTables, Bn + (Bb * oneMinusA));
+    }
+
+    if (layout->aOffset >= 0) {
+      outPtr[layout->aOffset] = 0xFF;
+    }
+  }
+}
+
+// Decode a region of a color frame and its alpha frame and composite
+// it over sRGB background pixels. Color is premultiplied by alpha as
+// srgb_to_bt709 -alpha writes it. The alpha frame Y plane is the same
+// size as the color Y plane, its Cb and Cr planes are not read. The
+// background rectangle starts at background, uses the output layout
+// and can be the same memory as outPixels to composite in place.
+// Other arguments are the same as bt709_decode_region(). Returns 0
+// on success.
+
+static inline
+int bt709_decode_region_over(const BT709DecodeTables *tables,
+                             const BT709PlanesStruct *planes,
+                             const int chromaStep,
+                             const uint8_t *alphaPtr,
+                             const int alphaBytesPerRow,
+                             const int width,
+                             const int height,
+                             const int x,
+                             const int y,
+                             const int regionWidth,
+                             const int regionHeight,
+                             const BT709PixelLayout *layout,
+                             const uint8_t *background,
+                             const int backgroundBytesPerRow,
+                             uint8_t *outPixels,
+                             const int outBytesPerRow)
+{
+  if (bt709_decode_check_region(width, height, x, y, regionWidth, regionHeight) != 0) {
+    return 1;
+  }
+
+  for (int row = 0; row < regionHeight; row++) {
+    const int inRow = y + row;
+
+    const uint8_t *yRow = planes->yPtr + (inRow * (size_t)planes->yBytesPerRow);
+    const uint8_t *cbRow = planes->cbPtr + ((inRow / 2) * (size_t)planes->cbBytesPerRow);
+    const uint8_t *crRow = planes->crPtr + ((inRow / 2) * (size_t)planes->crBytesPerRow);
+    const uint8_t *aRow = alphaPtr + (inRow * (size_t)alphaBytesPerRow);
+
+    const uint8_t *bgRow = background + (row * (size_t)backgroundBytesPerRow);
+    uint8_t *outRow = outPixels + (row * (size_t)outBytesPerRow);
+
+    bt709_decode_over_row(tables, yRow, cbRow, crRow, chromaStep, aRow, x, regionWidth,
+                          layout, bgRow, layout->bytesPerPixel, outRow);
+  }
+
+  return 0;
+}
+
+// Same as bt709_decode_region_over() with a solid sRGB background color
+
+static inline
+int bt709_decode_region_over_color(const BT709DecodeTables *tables,
+                                   const BT709PlanesStruct *planes,
+                                   const int chromaStep,
+                                   const uint8_t *alphaPtr,
+                                   const int alphaBytesPerRow,
+                                   const int width,
+                                   const int height,
+                                   const int x,
+                                   const int y,
+                                   const int regionWidth,
+                                   const int regionHeight,
+                                   const BT709PixelLayout *layout,
+                                   const uint8_t R,
+                                   const uint8_t G,
+                                   const uint8_t B,
+                                   uint8_t *outPixels,
+                                   const int outBytesPerRow)
+{
+  if (bt709_decode_check_region(width, height, x, y, regionWidth, regionHeight) != 0) {
+    return 1;
+  }
+
+  uint8_t color[4] = { 0, 0, 0, 0xFF };
+  color[layout->rOffset] = R;
+  color[layout->gOffset] = G;
+  color[layout->bOffset] = B;
+
+  for (int row = 0; row < regionHeight; row++) {
+    const int inRow = y + row;
+
+    const uint8_t *yRow = planes->yPtr + (inRow * (size_t)planes->yBytesPerRow);
+    const uint8_t *cbRow = planes->cbPtr + ((inRow / 2) * (size_t)planes->cbBytesPerRow);
+    const uint8_t *crRow = planes->crPtr + ((inRow / 2) * (size_t)planes->crBytesPerRow);
+    const uint8_t *aRow = alphaPtr + (inRow * (size_t)alphaBytesPerRow);
+
+    uint8_t *outRow = outPixels + (row * (size_t)outBytesPerRow);
+
+    bt709_decode_over_row(tables, yRow, cbRow, crRow, chromaStep, aRow, x, regionWidth,
+                          layout, color, 0, outRow);
+  }
+
+  return 0;
+}
+
+// Alpha Y plane of a packed frame, height is the color height which
+// must be even so that alpha starts on a new chroma row.
+
+static inline
+const uint8_t* bt709_decode_packed_alpha_ptr(const BT709PlanesStruct *planes, const int height) {
+#if defined(DEBUG)
+  assert((height % 2) == 0);
+#endif // DEBUG
+  return planes->yPtr + (height * (size_t)planes->yBytesPerRow);
+}
+
+#endif // _BT709_DECODE_H
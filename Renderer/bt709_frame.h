@@ -0,0 +1,287 @@
+//
+//  bt709_frame.h
+//
+//  Header only interface that converts a whole frame of 8 bit
+//  RGB pixels into BT.709 Y Cb Cr planes at 4:2:0 subsampling.
+//  The per pixel math is the same as BT709_average_pixel_values()
+//  but the gamma curves are evaluated once into lookup tables
+//  so that no pow() call is needed in the inner loop. Input
+//  pixels are read in place, so a mapped or read buffer in
+//  BGRA, RGB, or RGBA byte order can be converted without a copy.
+//
+//  This module depends only on the C library, so it can be
+//  used on platforms where CoreGraphics and CoreVideo do not exist.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_FRAME_H)
+#define _BT709_FRAME_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "BT709.h"
+
+// Byte layout of one input pixel, the offsets indicate where
+// each component is found relative to the start of the pixel.
+
+typedef struct {
+  int bytesPerPixel;
+  int rOffset;
+  int gOffset;
+  int bOffset;
+  int aOffset; // -1 when there is no alpha channel
+} BT709PixelLayout;
+
+// BGRA is the in memory layout of a little endian uint32_t
+// pixel as used by CGFrameBuffer.
+
+static inline
+BT709PixelLayout bt709_pixel_layout_bgra() {
+  BT709PixelLayout layout = { 4, 2, 1, 0, 3 };
+  return layout;
+}
+
+static inline
+BT709PixelLayout bt709_pixel_layout_rgb() {
+  BT709PixelLayout layout = { 3, 0, 1, 2, -1 };
+  return layout;
+}
+
+static inline
+BT709PixelLayout bt709_pixel_layout_rgba() {
+  BT709PixelLayout layout = { 4, 0, 1, 2, 3 };
+  return layout;
+}
+
+// Output planes, Cb and Cr are half width and half height.
+
+typedef struct {
+  uint8_t *yPtr;
+  int yBytesPerRow;
+
+  uint8_t *cbPtr;
+  int cbBytesPerRow;
+
+  uint8_t *crPtr;
+  int crBytesPerRow;
+} BT709PlanesStruct;
+
+// Number of buckets used to find a starting point in the
+// linear to output gamma threshold table.
+
+#define BT709_FRAME_LINEAR_INDEX_SIZE 4096
+
+// Tables that depend only on the input and output gamma,
+// init once and then reuse for every frame.
+
+typedef struct {
+  BT709Gamma inputGamma;
+  BT709Gamma outputGamma;
+
+  // Gamma encoded input byte -> normalized linear float
+  float toLinear[256];
+
+  // Gamma encoded input byte -> output gamma encoded byte
+  uint8_t toOutput[256];
+
+  // thresholds[k] is the smallest linear value that maps to output byte k
+  float thresholds[256];
+
+  // Bucket index -> largest output byte whose threshold is <= bucket start
+  uint8_t linearIndex[BT709_FRAME_LINEAR_INDEX_SIZE];
+} BT709FrameTables;
+
+// Find the smallest float in [0.0, 1.0] that BT709_from_linear()
+// maps to an output byte >= k. Positive floats sort the same way
+// as their bit patterns, so a bisection over the bits is exact.
+
+static inline
+float bt709_frame_find_threshold(int k, BT709Gamma outputGamma) {
+  uint32_t lo = 0;
+  uint32_t hi = 0x3F800000; // 1.0f
+
+  while (lo < hi) {
+    uint32_t mid = lo + ((hi - lo) / 2);
+    float midf;
+    memcpy(&midf, &mid, sizeof(float));
+
+    if (BT709_from_linear(midf, outputGamma) >= k) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  float f;
+  memcpy(&f, &lo, sizeof(float));
+  return f;
+}
+
+static inline
+void bt709_frame_tables_init(BT709FrameTables *tables,
+                             const BT709Gamma inputGamma,
+                             const BT709Gamma outputGamma)
+{
+  tables->inputGamma = inputGamma;
+  tables->outputGamma = outputGamma;
+
+  for (int i = 0; i < 256; i++) {
+    float Rn, Gn, Bn;
+    BT709_tolinearNorm(i, i, i, &Rn, &Gn, &Bn, inputGamma);
+    tables->toLinear[i] = Rn;
+    tables->toOutput[i] = (uint8_t) BT709_from_linear(Rn, outputGamma);
+  }
+
+  tables->thresholds[0] = 0.0f;
+  for (int k = 1; k < 256; k++) {
+    tables->thresholds[k] = bt709_frame_find_threshold(k, outputGamma);
+  }
+
+  int k = 0;
+  for (int i = 0; i < BT709_FRAME_LINEAR_INDEX_SIZE; i++) {
+    float bucketStart = i * (1.0f / BT709_FRAME_LINEAR_INDEX_SIZE);
+    while (k < 255 && tables->thresholds[k+1] <= bucketStart) {
+      k++;
+    }
+    tables->linearIndex[i] = (uint8_t) k;
+  }
+}
+
+// Map a normalized linear value to an output gamma encoded byte,
+// the result is the same as BT709_from_linear(Cn, outputGamma).
+
+static inline
+int bt709_frame_from_linear(const BT709FrameTables *tables, float Cn) {
+  if (Cn <= 0.0f) {
+    return 0;
+  }
+  int bucket = (int) (Cn * BT709_FRAME_LINEAR_INDEX_SIZE);
+  if (bucket >= BT709_FRAME_LINEAR_INDEX_SIZE) {
+    bucket = BT709_FRAME_LINEAR_INDEX_SIZE - 1;
+  }
+
+  int k = tables->linearIndex[bucket];
+
+  while (k < 255 && tables->thresholds[k+1] <= Cn) {
+    k++;
+  }
+
+  return k;
+}
+
+// Convert rows [rowStart, rowEnd) of the input frame, both row
+// values must be even. This is the unit of work when a frame is
+// split into bands.
+
+static inline
+void bt709_frame_encode_rows(const BT709FrameTables *tables,
+                             const BT709PixelLayout *layout,
+                             const uint8_t *inPixels,
+                             const int inBytesPerRow,
+                             const int width,
+                             const int rowStart,
+                             const int rowEnd,
+                             const BT709PlanesStruct *planes)
+{
+  const int bpp = layout->bytesPerPixel;
+  const int rOff = layout->rOffset;
+  const int gOff = layout->gOffset;
+  const int bOff = layout->bOffset;
+
+#if defined(DEBUG)
+  assert((width % 2) == 0);
+  assert((rowStart % 2) == 0);
+  assert((rowEnd % 2) == 0);
+#endif // DEBUG
+
+  for (int row = rowStart; row < rowEnd; row += 2) {
+    const uint8_t *inRow1 = inPixels + (row * (size_t)inBytesPerRow);
+    const uint8_t *inRow2 = inRow1 + inBytesPerRow;
+
+    uint8_t *outYRow1 = planes->yPtr + (row * (size_t)planes->yBytesPerRow);
+    uint8_t *outYRow2 = outYRow1 + planes->yBytesPerRow;
+
+    uint8_t *outCbRow = planes->cbPtr + ((row / 2) * (size_t)planes->cbBytesPerRow);
+    uint8_t *outCrRow = planes->crPtr + ((row / 2) * (size_t)planes->crBytesPerRow);
+
+    for (int col = 0; col < width; col += 2) {
+      const uint8_t *p1 = inRow1 + (col * bpp);
+      const uint8_t *p2 = p1 + bpp;
+      const uint8_t *p3 = inRow2 + (col * bpp);
+      const uint8_t *p4 = p3 + bpp;
+
+      // Y for each corner is generated from the original pixel
+      // after conversion to the output gamma curve.
+
+      int Y1, Y2, Y3, Y4, CbIgnored, CrIgnored;
+
+      BT709_convertNonLinearRGBToYCbCr(byteNorm(tables->toOutput[p1[rOff]]),
+                                       byteNorm(tables->toOutput[p1[gOff]]),
+                                       byteNorm(tables->toOutput[p1[bOff]]),
+                                       &Y1, &CbIgnored, &CrIgnored);
+      BT709_convertNonLinearRGBToYCbCr(byteNorm(tables->toOutput[p2[rOff]]),
+                                       byteNorm(tables->toOutput[p2[gOff]]),
+                                       byteNorm(tables->toOutput[p2[bOff]]),
+                                       &Y2, &CbIgnored, &CrIgnored);
+      BT709_convertNonLinearRGBToYCbCr(byteNorm(tables->toOutput[p3[rOff]]),
+                                       byteNorm(tables->toOutput[p3[gOff]]),
+                                       byteNorm(tables->toOutput[p3[bOff]]),
+                                       &Y3, &CbIgnored, &CrIgnored);
+      BT709_convertNonLinearRGBToYCbCr(byteNorm(tables->toOutput[p4[rOff]]),
+                                       byteNorm(tables->toOutput[p4[gOff]]),
+                                       byteNorm(tables->toOutput[p4[bOff]]),
+                                       &Y4, &CbIgnored, &CrIgnored);
+
+      // Average (R G B) as 4 linear values, then pass the gamma
+      // encoded average through the matrix to get Cb and Cr.
+
+      const float *toLinear = tables->toLinear;
+
+      float Rave = BT709_average_cbcr_linear(toLinear[p1[rOff]], toLinear[p2[rOff]], toLinear[p3[rOff]], toLinear[p4[rOff]]);
+      float Gave = BT709_average_cbcr_linear(toLinear[p1[gOff]], toLinear[p2[gOff]], toLinear[p3[gOff]], toLinear[p4[gOff]]);
+      float Bave = BT709_average_cbcr_linear(toLinear[p1[bOff]], toLinear[p2[bOff]], toLinear[p3[bOff]], toLinear[p4[bOff]]);
+
+      int YIgnored, Cb, Cr;
+
+      BT709_convertNonLinearRGBToYCbCr(byteNorm(bt709_frame_from_linear(tables, Rave)),
+                                       byteNorm(bt709_frame_from_linear(tables, Gave)),
+                                       byteNorm(bt709_frame_from_linear(tables, Bave)),
+                                       &YIgnored, &Cb, &Cr);
+
+      outYRow1[col] = Y1;
+      outYRow1[col+1] = Y2;
+      outYRow2[col] = Y3;
+      outYRow2[col+1] = Y4;
+
+      outCbRow[col/2] = Cb;
+      outCrRow[col/2] = Cr;
+    }
+  }
+}
+
+// Convert a full frame, width and height must both be even.
+// Returns 0 on success.
+
+static inline
+int bt709_frame_encode(const BT709FrameTables *tables,
+                       const BT709PixelLayout *layout,
+                       const uint8_t *inPixels,
+                       const int inBytesPerRow,
+                       const int width,
+                       const int height,
+                       const BT709PlanesStruct *planes)
+{
+  if ((width % 2) != 0 || (height % 2) != 0) {
+    return 1;
+  }
+
+  bt709_frame_encode_rows(tables, layout, inPixels, inBytesPerRow, width, 0, height, planes);
+
+  return 0;
+}
+
+#endif // _BT709_FRAME_H
@@ -0,0 +1,285 @@
+//
+//  bt709_frame10.h
+//
+//  Header only interface that converts a whole frame of 8 bit
+//  RGB pixels into 10 bit BT.709 Y Cb Cr planes at 4:2:0
+//  subsampling. The logic is the same as bt709_frame.h except
+//  that gamma encoded values are not rounded to 8 bits before
+//  the matrix, so the extra precision of the 10 bit output
+//  carries the gamma curve result. Float rounding in the summed
+//  tables and the interpolated curve leaves 38 Y and 6 Cb Cr
+//  samples out of the 3.1M in the 1080p benchmark frame 1 away
+//  from a direct pow() and matrix conversion.
+//
+//  Y for each pixel is a sum of 3 per component tables indexed by
+//  the input byte. Cb and Cr are generated from the linear average
+//  of each 2x2 block, that average is mapped back to the output
+//  gamma curve with an interpolated table.
+//
+//  Output samples are 16 bit values in host byte order, which is
+//  little endian on every supported target, so the planes can be
+//  written as Y4M C420p10 data. bt709_frame10_pack_p010() converts
+//  planes to the P010 layout used by CoreVideo.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_FRAME10_H)
+#define _BT709_FRAME10_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "BT709.h"
+#include "bt709_frame.h"
+
+// Number of intervals in the linear to output gamma table
+
+#define BT709_FRAME10_CURVE_SIZE 65536
+
+// Output planes of 16 bit samples, strides are in bytes
+
+typedef struct {
+  uint16_t *yPtr;
+  int yBytesPerRow;
+
+  uint16_t *cbPtr;
+  int cbBytesPerRow;
+
+  uint16_t *crPtr;
+  int crBytesPerRow;
+} BT709Planes16Struct;
+
+// Tables that depend only on the input and output gamma. This
+// struct is large, so allocate it on the heap.
+
+typedef struct {
+  BT709Gamma inputGamma;
+  BT709Gamma outputGamma;
+
+  // Gamma encoded input byte -> normalized linear float
+  float toLinear[256];
+
+  // Gamma encoded input byte -> part of the 10 bit Y value, yR
+  // also includes the Y offset and the 0.5 used to round.
+  float yR[256];
+  float yG[256];
+  float yB[256];
+
+  // Normalized linear -> normalized output gamma encoded value
+  float toOutput[BT709_FRAME10_CURVE_SIZE + 1];
+} BT709Frame10Tables;
+
+static inline
+void bt709_frame10_tables_init(BT709Frame10Tables *tables,
+                               const BT709Gamma inputGamma,
+                               const BT709Gamma outputGamma)
+{
+  tables->inputGamma = inputGamma;
+  tables->outputGamma = outputGamma;
+
+  const float yScale = (float) (BT709_YMax10 - BT709_YMin10);
+
+  for (int i = 0; i < 256; i++) {
+    float Rn, Gn, Bn;
+    BT709_tolinearNorm(i, i, i, &Rn, &Gn, &Bn, inputGamma);
+    tables->toLinear[i] = Rn;
+
+    float nonLinear = BT709_from_linear_norm(Rn, outputGamma);
+
+    tables->yR[i] = (BT709_Kr * nonLinear * yScale) + BT709_YMin10 + 0.5f;
+    tables->yG[i] = BT709_Kg * nonLinear * yScale;
+    tables->yB[i] = BT709_Kb * nonLinear * yScale;
+  }
+
+  for (int i = 0; i <= BT709_FRAME10_CURVE_SIZE; i++) {
+    tables->toOutput[i] = BT709_from_linear_norm(i / (float) BT709_FRAME10_CURVE_SIZE, outputGamma);
+  }
+}
+
+// Map a normalized linear value to the output gamma curve
+
+static inline
+float bt709_frame10_from_linear(const BT709Frame10Tables *tables, float Cn) {
+  if (Cn <= 0.0f) {
+    return tables->toOutput[0];
+  }
+  float f = Cn * BT709_FRAME10_CURVE_SIZE;
+  if (f >= (float) BT709_FRAME10_CURVE_SIZE) {
+    return tables->toOutput[BT709_FRAME10_CURVE_SIZE];
+  }
+  int i = (int) f;
+  float frac = f - i;
+  return tables->toOutput[i] + ((tables->toOutput[i+1] - tables->toOutput[i]) * frac);
+}
+
+// Convert rows [rowStart, rowEnd) of the input frame, both row
+// values must be even.
+
+static inline
+void bt709_frame10_encode_rows(const BT709Frame10Tables *tables,
+                               const BT709PixelLayout *layout,
+                               const uint8_t *inPixels,
+                               const int inBytesPerRow,
+                               const int width,
+                               const int rowStart,
+                               const int rowEnd,
+                               const BT709Planes16Struct *planes)
+{
+  const int bpp = layout->bytesPerPixel;
+  const int rOff = layout->rOffset;
+  const int gOff = layout->gOffset;
+  const int bOff = layout->bOffset;
+
+  const float *toLinear = tables->toLinear;
+  const float *yR = tables->yR;
+  const float *yG = tables->yG;
+  const float *yB = tables->yB;
+
+  const float uvScale = (float) (BT709_UVMax10 - BT709_UVMin10);
+  const float cbScale = uvScale / BT709_Eb_minus_Ey_Range;
+  const float crScale = uvScale / BT709_Er_minus_Ey_Range;
+
+#if defined(DEBUG)
+  assert((width % 2) == 0);
+  assert((rowStart % 2) == 0);
+  assert((rowEnd % 2) == 0);
+#endif // DEBUG
+
+  for (int row = rowStart; row < rowEnd; row += 2) {
+    const uint8_t *inRow1 = inPixels + (row * (size_t)inBytesPerRow);
+    const uint8_t *inRow2 = inRow1 + inBytesPerRow;
+
+    uint16_t *outYRow1 = (uint16_t *) ((uint8_t *) planes->yPtr + (row * (size_t)planes->yBytesPerRow));
+    uint16_t *outYRow2 = (uint16_t *) ((uint8_t *) outYRow1 + planes->yBytesPerRow);
+
+    uint16_t *outCbRow = (uint16_t *) ((uint8_t *) planes->cbPtr + ((row / 2) * (size_t)planes->cbBytesPerRow));
+    uint16_t *outCrRow = (uint16_t *) ((uint8_t *) planes->crPtr + ((row / 2) * (size_t)planes->crBytesPerRow));
+
+    for (int col = 0; col < width; col += 2) {
+      const uint8_t *p1 = inRow1 + (col * bpp);
+      const uint8_t *p2 = p1 + bpp;
+      const uint8_t *p3 = inRow2 + (col * bpp);
+      const uint8_t *p4 = p3 + bpp;
+
+      outYRow1[col] = (uint16_t) (yR[p1[rOff]] + yG[p1[gOff]] + yB[p1[bOff]]);
+      outYRow1[col+1] = (uint16_t) (yR[p2[rOff]] + yG[p2[gOff]] + yB[p2[bOff]]);
+      outYRow2[col] = (uint16_t) (yR[p3[rOff]] + yG[p3[gOff]] + yB[p3[bOff]]);
+      outYRow2[col+1] = (uint16_t) (yR[p4[rOff]] + yG[p4[gOff]] + yB[p4[bOff]]);
+
+      // Average (R G B) as 4 linear values, then pass the gamma
+      // encoded average through the matrix to get Cb and Cr.
+
+      float Rave = BT709_average_cbcr_linear(toLinear[p1[rOff]], toLinear[p2[rOff]], toLinear[p3[rOff]], toLinear[p4[rOff]]);
+      float Gave = BT709_average_cbcr_linear(toLinear[p1[gOff]], toLinear[p2[gOff]], toLinear[p3[gOff]], toLinear[p4[gOff]]);
+      float Bave = BT709_average_cbcr_linear(toLinear[p1[bOff]], toLinear[p2[bOff]], toLinear[p3[bOff]], toLinear[p4[bOff]]);
+
+      float Rn = bt709_frame10_from_linear(tables, Rave);
+      float Gn = bt709_frame10_from_linear(tables, Gave);
+      float Bn = bt709_frame10_from_linear(tables, Bave);
+
+      float Ey = (BT709_Kr * Rn) + (BT709_Kg * Gn) + (BT709_Kb * Bn);
+
+      outCbRow[col/2] = (uint16_t) (((Bn - Ey) * cbScale) + 512.5f);
+      outCrRow[col/2] = (uint16_t) (((Rn - Ey) * crScale) + 512.5f);
+    }
+  }
+}
+
+// Convert a full frame, width and height must both be even.
+// Returns 0 on success.
+
+static inline
+int bt709_frame10_encode(const BT709Frame10Tables *tables,
+                         const BT709PixelLayout *layout,
+                         const uint8_t *inPixels,
+                         const int inBytesPerRow,
+                         const int width,
+                         const int height,
+                         const BT709Planes16Struct *planes)
+{
+  if ((width % 2) != 0 || (height % 2) != 0) {
+    return 1;
+  }
+
+  bt709_frame10_encode_rows(tables, layout, inPixels, inBytesPerRow, width, 0, height, planes);
+
+  return 0;
+}
+
+// Convert 10 bit planes to P010, where each sample is shifted up
+// into the high 10 bits of a 16 bit value and Cb Cr are interleaved
+// into a single half height plane. Strides are in bytes.
+
+static inline
+void bt709_frame10_pack_p010(const BT709Planes16Struct *planes,
+                             const int width,
+                             const int height,
+                             uint16_t *outYPtr,
+                             const int outYBytesPerRow,
+                             uint16_t *outCbCrPtr,
+                             const int outCbCrBytesPerRow)
+{
+  for (int row = 0; row < height; row++) {
+    const uint16_t *inRow = (const uint16_t *) ((const uint8_t *) planes->yPtr + (row * (size_t)planes->yBytesPerRow));
+    uint16_t *outRow = (uint16_t *) ((uint8_t *) outYPtr + (row * (size_t)outYBytesPerRow));
+
+    int col = 0;
+
+#if defined(__SSE2__)
+    for ( ; col + 8 <= width; col += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (inRow + col));
+      _mm_storeu_si128((__m128i *) (outRow + col), _mm_slli_epi16(v, 6));
+    }
+#elif defined(__ARM_NEON)
+    for ( ; col + 8 <= width; col += 8) {
+      vst1q_u16(outRow + col, vshlq_n_u16(vld1q_u16(inRow + col), 6));
+    }
+#endif
+
+    for ( ; col < width; col++) {
+      outRow[col] = (uint16_t) (inRow[col] << 6);
+    }
+  }
+
+  const int uvWidth = width / 2;
+
+  for (int row = 0; row < (height / 2); row++) {
+    const uint16_t *cbRow = (const uint16_t *) ((const uint8_t *) planes->cbPtr + (row * (size_t)planes->cbBytesPerRow));
+    const uint16_t *crRow = (const uint16_t *) ((const uint8_t *) planes->crPtr + (row * (size_t)planes->crBytesPerRow));
+    uint16_t *outRow = (uint16_t *) ((uint8_t *) outCbCrPtr + (row * (size_t)outCbCrBytesPerRow));
+
+    int col = 0;
+
+#if defined(__SSE2__)
+    for ( ; col + 8 <= uvWidth; col += 8) {
+      __m128i cb = _mm_slli_epi16(_mm_loadu_si128((const __m128i *) (cbRow + col)), 6);
+      __m128i cr = _mm_slli_epi16(_mm_loadu_si128((const __m128i *) (crRow + col)), 6);
+      _mm_storeu_si128((__m128i *) (outRow + (col * 2)), _mm_unpacklo_epi16(cb, cr));
+      _mm_storeu_si128((__m128i *) (outRow + (col * 2) + 8), _mm_unpackhi_epi16(cb, cr));
+    }
+#elif defined(__ARM_NEON)
+    for ( ; col + 8 <= uvWidth; col += 8) {
+      uint16x8x2_t cbcr;
+      cbcr.val[0] = vshlq_n_u16(vld1q_u16(cbRow + col), 6);
+      cbcr.val[1] = vshlq_n_u16(vld1q_u16(crRow + col), 6);
+      vst2q_u16(outRow + (col * 2), cbcr);
+    }
+#endif
+
+    for ( ; col < uvWidth; col++) {
+      outRow[(col * 2)] = (uint16_t) (cbRow[col] << 6);
+      outRow[(col * 2) + 1] = (uint16_t) (crRow[col] << 6);
+    }
+  }
+}
+
+#endif // _BT709_FRAME10_H
@@ -0,0 +1,764 @@
+//
+//  bt709_frame_cache.h
+//
+//  Header only interface for an in memory cache of decoded 8 bit
+//  4:2:0 Y Cb Cr frames that stays within a byte budget, so that
+//  a clip longer than the available memory can be played back
+//  without decoding every frame again. Frames that were used most
+//  recently are kept as raw planes. When the budget is exceeded,
+//  the least recently used raw frames are compressed with a
+//  lossless planar codec, and when that is not enough the least
+//  recently used frames are dropped. A dropped frame must be
+//  decoded and put again by the caller.
+//
+//  The codec subtracts the row above from each row (the first row
+//  subtracts the pixel to the left), which turns flat areas and
+//  smooth gradients into runs of small values, and then packs the
+//  result with a byte oriented LZ77 coder that has a 64K window.
+//  The vertical predictor means both filter directions run on
+//  whole rows with SSE2 or NEON.
+//
+//  A cache is not thread safe, calls must be serialized by the
+//  caller. Planes returned by bt709_frame_cache_get() stay valid
+//  until the next call that takes the cache.
+//
+//  This module depends only on the C library.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_FRAME_CACHE_H)
+#define _BT709_FRAME_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "bt709_frame.h"
+#include "bt709_planes.h"
+
+// Entries in the LZ match finder hash table
+
+#define BT709_FRAME_CACHE_HASH_BITS 14
+
+#define BT709_FRAME_CACHE_MIN_MATCH 4
+#define BT709_FRAME_CACHE_MAX_OFFSET 65535
+
+typedef enum {
+  BT709FrameCacheEmpty = 0,
+  BT709FrameCacheRaw,
+  BT709FrameCacheCompressed
+} BT709FrameCacheState;
+
+typedef struct {
+  BT709FrameCacheState state;
+  // Raw planes or compressed bytes, len is the size held
+  uint8_t *ptr;
+  size_t len;
+  // Set when compression did not make the frame smaller
+  int incompressible;
+  // Value of the cache stamp when the frame was last used
+  uint64_t stamp;
+  // Recently used list, -1 at either end
+  int prev;
+  int next;
+} BT709FrameCacheEntry;
+
+typedef struct {
+  uint64_t numRawHits;
+  uint64_t numDecompressed;
+  uint64_t numMisses;
+  uint64_t numCompressed;
+  uint64_t numDropped;
+} BT709FrameCacheStats;
+
+typedef struct {
+  int width;
+  int height;
+  int numFrames;
+
+  // Bytes in one raw frame, the Y Cb Cr planes are stored back to back
+  size_t frameLen;
+
+  size_t budget;
+  size_t rawBytes;
+  size_t compressedBytes;
+
+  BT709FrameCacheEntry *entries;
+
+  // Most recently used at the head
+  int head;
+  int tail;
+
+  uint64_t stamp;
+
+  // Frames used at or after this stamp are never compressed or
+  // dropped, this keeps the frame returned to the caller in place.
+  uint64_t pinnedStamp;
+
+  // Scratch memory, not counted in the budget. One released raw
+  // buffer is kept so that a steady state does not allocate.
+  uint8_t *spare;
+  uint8_t *lzBuffer;
+  uint32_t *hashTable;
+
+  BT709FrameCacheStats stats;
+} BT709FrameCache;
+
+// Largest compressed size of numBytes bytes
+
+static inline
+size_t bt709_frame_cache_lz_bound(size_t numBytes) {
+  return numBytes + (numBytes / 255) + 16;
+}
+
+static inline
+uint32_t bt709_frame_cache_hash4(const uint8_t *ptr) {
+  uint32_t v;
+  memcpy(&v, ptr, 4);
+  return (v * 2654435761U) >> (32 - BT709_FRAME_CACHE_HASH_BITS);
+}
+
+static inline
+uint8_t* bt709_frame_cache_lz_put_length(uint8_t *outPtr, size_t len) {
+  while (len >= 255) {
+    *outPtr++ = 255;
+    len -= 255;
+  }
+  *outPtr++ = (uint8_t) len;
+  return outPtr;
+}
+
+// Each sequence is a token byte that holds the literal count in the
+// high 4 bits and the match length minus 4 in the low 4 bits, a
+// value of 15 continues in extra length bytes. Literals follow, then
+// a 2 byte little endian match offset. The last sequence only has
+// literals. The output must have room for bt709_frame_cache_lz_bound()
+// bytes, returns the compressed size.
+
+static inline
+size_t bt709_frame_cache_lz_compress(const uint8_t *inPtr, size_t inLen, uint8_t *outPtr, uint32_t *hashTable) {
+  memset(hashTable, 0, sizeof(uint32_t) << BT709_FRAME_CACHE_HASH_BITS);
+
+  uint8_t *op = outPtr;
+  size_t anchor = 0;
+  size_t ip = 0;
+
+  // Matches do not start in the last few bytes so that the 4 byte
+  // hash read stays in bounds.
+
+  const size_t matchLimit = (inLen > 12) ? (inLen - 12) : 0;
+
+  while (ip < matchLimit) {
+    const uint32_t h = bt709_frame_cache_hash4(inPtr + ip);
+    const size_t candidate = hashTable[h];
+    hashTable[h] = (uint32_t) ip;
+
+    if (candidate >= ip || (ip - candidate) > BT709_FRAME_CACHE_MAX_OFFSET ||
+        memcmp(inPtr + candidate, inPtr + ip, BT709_FRAME_CACHE_MIN_MATCH) != 0) {
+      // Step further the longer no match is found, so that data that
+      // does not compress is passed over quickly.
+      ip += 1 + ((ip - anchor) >> 6);
+      continue;
+    }
+
+    size_t matchLen = BT709_FRAME_CACHE_MIN_MATCH;
+
+    while ((ip + matchLen + 8) <= inLen) {
+      uint64_t a, b;
+      memcpy(&a, inPtr + candidate + matchLen, 8);
+      memcpy(&b, inPtr + ip + matchLen, 8);
+      if (a != b) {
+        break;
+      }
+      matchLen += 8;
+    }
+    while ((ip + matchLen) < inLen && inPtr[candidate + matchLen] == inPtr[ip + matchLen]) {
+      matchLen += 1;
+    }
+
+    const size_t litLen = ip - anchor;
+    const size_t offset = ip - candidate;
+    const size_t extraLen = matchLen - BT709_FRAME_CACHE_MIN_MATCH;
+
+    *op++ = (uint8_t) (((litLen < 15) ? litLen : 15) << 4 | ((extraLen < 15) ? extraLen : 15));
+    if (litLen >= 15) {
+      op = bt709_frame_cache_lz_put_length(op, litLen - 15);
+    }
+    memcpy(op, inPtr + anchor, litLen);
+    op += litLen;
+    *op++ = (uint8_t) (offset & 0xFF);
+    *op++ = (uint8_t) (offset >> 8);
+    if (extraLen >= 15) {
+      op = bt709_frame_cache_lz_put_length(op, extraLen - 15);
+    }
+
+    ip += matchLen;
+    anchor = ip;
+  }
+
+  const size_t litLen = inLen - anchor;
+
+  *op++ = (uint8_t) (((litLen < 15) ? litLen : 15) << 4);
+  if (litLen >= 15) {
+    op = bt709_frame_cache_lz_put_length(op, litLen - 15);
+  }
+  memcpy(op, inPtr + anchor, litLen);
+  op += litLen;
+
+  return (size_t) (op - outPtr);
+}
+
+// Read an extended length, returns 0 when the input ends first
+
+static inline
+int bt709_frame_cache_lz_get_length(const uint8_t *inPtr, size_t inLen, size_t *ip, size_t *len) {
+  while (1) {
+    if (*ip >= inLen) {
+      return 0;
+    }
+    uint8_t b = inPtr[(*ip)++];
+    *len += b;
+    if (b != 255) {
+      return 1;
+    }
+  }
+}
+
+// Decompress exactly outLen bytes, returns 0 on success or 1 when
+// the input is not valid.
+
+static inline
+int bt709_frame_cache_lz_decompress(const uint8_t *inPtr, size_t inLen, uint8_t *outPtr, size_t outLen) {
+  size_t ip = 0;
+  size_t op = 0;
+  int sawLast = 0;
+
+  while (ip < inLen) {
+    const uint8_t token = inPtr[ip++];
+
+    size_t litLen = token >> 4;
+    if (litLen == 15 && !bt709_frame_cache_lz_get_length(inPtr, inLen, &ip, &litLen)) {
+      return 1;
+    }
+    if (litLen > (inLen - ip) || litLen > (outLen - op)) {
+      return 1;
+    }
+    memcpy(outPtr + op, inPtr + ip, litLen);
+    ip += litLen;
+    op += litLen;
+
+    if (ip == inLen) {
+      sawLast = 1;
+      break;
+    }
+
+    if ((inLen - ip) < 2) {
+      return 1;
+    }
+    const size_t offset = inPtr[ip] | (inPtr[ip + 1] << 8);
+    ip += 2;
+
+    size_t matchLen = token & 0xF;
+    if (matchLen == 15 && !bt709_frame_cache_lz_get_length(inPtr, inLen, &ip, &matchLen)) {
+      return 1;
+    }
+    matchLen += BT709_FRAME_CACHE_MIN_MATCH;
+
+    if (offset == 0 || offset > op || matchLen > (outLen - op)) {
+      return 1;
+    }
+
+    uint8_t *dst = outPtr + op;
+    const uint8_t *src = dst - offset;
+
+    if (offset == 1) {
+      memset(dst, src[0], matchLen);
+    } else if (offset >= 8) {
+      size_t i = 0;
+      for ( ; i + 8 <= matchLen; i += 8) {
+        memcpy(dst + i, src + i, 8);
+      }
+      for ( ; i < matchLen; i++) {
+        dst[i] = src[i];
+      }
+    } else {
+      for (size_t i = 0; i < matchLen; i++) {
+        dst[i] = src[i];
+      }
+    }
+
+    op += matchLen;
+  }
+
+  // Input that ends after a match was cut short
+
+  return (sawLast && op == outLen) ? 0 : 1;
+}
+
+// outRow = row - above, and the reverse, modulo 256
+
+static inline
+void bt709_frame_cache_sub_row(uint8_t *row, const uint8_t *above, int width) {
+  int col = 0;
+
+#if defined(__SSE2__)
+  for ( ; col + 16 <= width; col += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (row + col));
+    __m128i a = _mm_loadu_si128((const __m128i *) (above + col));
+    _mm_storeu_si128((__m128i *) (row + col), _mm_sub_epi8(v, a));
+  }
+#elif defined(__ARM_NEON)
+  for ( ; col + 16 <= width; col += 16) {
+    vst1q_u8(row + col, vsubq_u8(vld1q_u8(row + col), vld1q_u8(above + col)));
+  }
+#endif
+
+  for ( ; col < width; col++) {
+    row[col] = (uint8_t) (row[col] - above[col]);
+  }
+}
+
+static inline
+void bt709_frame_cache_add_row(uint8_t *row, const uint8_t *above, int width) {
+  int col = 0;
+
+#if defined(__SSE2__)
+  for ( ; col + 16 <= width; col += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (row + col));
+    __m128i a = _mm_loadu_si128((const __m128i *) (above + col));
+    _mm_storeu_si128((__m128i *) (row + col), _mm_add_epi8(v, a));
+  }
+#elif defined(__ARM_NEON)
+  for ( ; col + 16 <= width; col += 16) {
+    vst1q_u8(row + col, vaddq_u8(vld1q_u8(row + col), vld1q_u8(above + col)));
+  }
+#endif
+
+  for ( ; col < width; col++) {
+    row[col] = (uint8_t) (row[col] + above[col]);
+  }
+}
+
+// Replace a plane with prediction residuals in place, rows are
+// done from the bottom up so that each row above is still intact.
+
+static inline
+void bt709_frame_cache_delta_plane(uint8_t *ptr, int width, int height) {
+  for (int row = height - 1; row > 0; row--) {
+    bt709_frame_cache_sub_row(ptr + (row * width), ptr + ((row - 1) * width), width);
+  }
+  for (int col = width - 1; col > 0; col--) {
+    ptr[col] = (uint8_t) (ptr[col] - ptr[col - 1]);
+  }
+}
+
+static inline
+void bt709_frame_cache_undelta_plane(uint8_t *ptr, int width, int height) {
+  for (int col = 1; col < width; col++) {
+    ptr[col] = (uint8_t) (ptr[col] + ptr[col - 1]);
+  }
+  for (int row = 1; row < height; row++) {
+    bt709_frame_cache_add_row(ptr + (row * width), ptr + ((row - 1) * width), width);
+  }
+}
+
+static inline
+void bt709_frame_cache_delta_frame(uint8_t *ptr, int width, int height, int undo) {
+  const size_t yLen = (size_t) width * height;
+  const size_t uvLen = (size_t) (width / 2) * (height / 2);
+
+  uint8_t *planes[3] = { ptr, ptr + yLen, ptr + yLen + uvLen };
+  const int widths[3] = { width, width / 2, width / 2 };
+  const int heights[3] = { height, height / 2, height / 2 };
+
+  for (int pi = 0; pi < 3; pi++) {
+    if (undo) {
+      bt709_frame_cache_undelta_plane(planes[pi], widths[pi], heights[pi]);
+    } else {
+      bt709_frame_cache_delta_plane(planes[pi], widths[pi], heights[pi]);
+    }
+  }
+}
+
+// Create a cache for numFrames frames of an even size that holds at
+// most budget bytes of frame data. Returns 0 on success, 1 for bad
+// arguments, and 2 when memory cannot be allocated.
+
+static inline
+int bt709_frame_cache_init(BT709FrameCache *cache, int width, int height, int numFrames, size_t budget) {
+  memset(cache, 0, sizeof(BT709FrameCache));
+
+  if (width <= 0 || height <= 0 || (width % 2) != 0 || (height % 2) != 0 || numFrames <= 0) {
+    return 1;
+  }
+
+  cache->width = width;
+  cache->height = height;
+  cache->numFrames = numFrames;
+  cache->frameLen = ((size_t) width * height) + (2 * (size_t) (width / 2) * (height / 2));
+  cache->budget = budget;
+  cache->head = -1;
+  cache->tail = -1;
+
+  cache->entries = (BT709FrameCacheEntry *) calloc(numFrames, sizeof(BT709FrameCacheEntry));
+  cache->lzBuffer = (uint8_t *) malloc(bt709_frame_cache_lz_bound(cache->frameLen));
+  cache->hashTable = (uint32_t *) malloc(sizeof(uint32_t) << BT709_FRAME_CACHE_HASH_BITS);
+
+  if (cache->entries == NULL || cache->lzBuffer == NULL || cache->hashTable == NULL) {
+    free(cache->entries);
+    free(cache->lzBuffer);
+    free(cache->hashTable);
+    memset(cache, 0, sizeof(BT709FrameCache));
+    return 2;
+  }
+
+  return 0;
+}
+
+static inline
+void bt709_frame_cache_free(BT709FrameCache *cache) {
+  if (cache->entries != NULL) {
+    for (int i = 0; i < cache->numFrames; i++) {
+      free(cache->entries[i].ptr);
+    }
+  }
+  free(cache->entries);
+  free(cache->spare);
+  free(cache->lzBuffer);
+  free(cache->hashTable);
+  memset(cache, 0, sizeof(BT709FrameCache));
+}
+
+// Bytes of frame data held, raw and compressed
+
+static inline
+size_t bt709_frame_cache_bytes(const BT709FrameCache *cache) {
+  return cache->rawBytes + cache->compressedBytes;
+}
+
+static inline
+void bt709_frame_cache_unlink(BT709FrameCache *cache, int frameIndex) {
+  BT709FrameCacheEntry *entry = &cache->entries[frameIndex];
+
+  if (entry->prev != -1) {
+    cache->entries[entry->prev].next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next != -1) {
+    cache->entries[entry->next].prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+}
+
+// Move a frame to the head of the recently used list
+
+static inline
+void bt709_frame_cache_touch(BT709FrameCache *cache, int frameIndex) {
+  BT709FrameCacheEntry *entry = &cache->entries[frameIndex];
+
+  if (entry->state != BT709FrameCacheEmpty) {
+    bt709_frame_cache_unlink(cache, frameIndex);
+  }
+
+  entry->prev = -1;
+  entry->next = cache->head;
+  if (cache->head != -1) {
+    cache->entries[cache->head].prev = frameIndex;
+  } else {
+    cache->tail = frameIndex;
+  }
+  cache->head = frameIndex;
+
+  cache->stamp += 1;
+  entry->stamp = cache->stamp;
+}
+
+static inline
+uint8_t* bt709_frame_cache_alloc_raw(BT709FrameCache *cache) {
+  uint8_t *ptr = cache->spare;
+  if (ptr != NULL) {
+    cache->spare = NULL;
+    return ptr;
+  }
+  return (uint8_t *) malloc(cache->frameLen);
+}
+
+static inline
+void bt709_frame_cache_release_raw(BT709FrameCache *cache, uint8_t *ptr) {
+  if (cache->spare == NULL) {
+    cache->spare = ptr;
+  } else {
+    free(ptr);
+  }
+}
+
+static inline
+void bt709_frame_cache_drop(BT709FrameCache *cache, int frameIndex) {
+  BT709FrameCacheEntry *entry = &cache->entries[frameIndex];
+
+  if (entry->state == BT709FrameCacheRaw) {
+    bt709_frame_cache_release_raw(cache, entry->ptr);
+    cache->rawBytes -= entry->len;
+  } else if (entry->state == BT709FrameCacheCompressed) {
+    free(entry->ptr);
+    cache->compressedBytes -= entry->len;
+  } else {
+    return;
+  }
+
+  bt709_frame_cache_unlink(cache, frameIndex);
+  memset(entry, 0, sizeof(BT709FrameCacheEntry));
+  cache->stats.numDropped += 1;
+}
+
+// Compress a raw frame, the frame stays raw when it does not get
+// smaller. Returns 0 on success or 2 when memory cannot be allocated.
+
+static inline
+int bt709_frame_cache_compress(BT709FrameCache *cache, int frameIndex) {
+  BT709FrameCacheEntry *entry = &cache->entries[frameIndex];
+
+  // The raw buffer is filtered in place, then restored when the
+  // frame does not compress.
+
+  bt709_frame_cache_delta_frame(entry->ptr, cache->width, cache->height, 0);
+  size_t lzLen = bt709_frame_cache_lz_compress(entry->ptr, cache->frameLen, cache->lzBuffer, cache->hashTable);
+
+  uint8_t *compressed = NULL;
+  if (lzLen < cache->frameLen) {
+    compressed = (uint8_t *) malloc(lzLen);
+  }
+
+  if (compressed == NULL) {
+    bt709_frame_cache_delta_frame(entry->ptr, cache->width, cache->height, 1);
+    entry->incompressible = 1;
+    return (lzLen < cache->frameLen) ? 2 : 0;
+  }
+
+  memcpy(compressed, cache->lzBuffer, lzLen);
+  bt709_frame_cache_release_raw(cache, entry->ptr);
+  cache->rawBytes -= entry->len;
+
+  entry->state = BT709FrameCacheCompressed;
+  entry->ptr = compressed;
+  entry->len = lzLen;
+  cache->compressedBytes += lzLen;
+  cache->stats.numCompressed += 1;
+
+  return 0;
+}
+
+static inline
+int bt709_frame_cache_decompress(BT709FrameCache *cache, int frameIndex) {
+  BT709FrameCacheEntry *entry = &cache->entries[frameIndex];
+
+  uint8_t *raw = bt709_frame_cache_alloc_raw(cache);
+  if (raw == NULL) {
+    return 2;
+  }
+
+  if (bt709_frame_cache_lz_decompress(entry->ptr, entry->len, raw, cache->frameLen) != 0) {
+    bt709_frame_cache_release_raw(cache, raw);
+    return 2;
+  }
+  bt709_frame_cache_delta_frame(raw, cache->width, cache->height, 1);
+
+  free(entry->ptr);
+  cache->compressedBytes -= entry->len;
+
+  entry->state = BT709FrameCacheRaw;
+  entry->ptr = raw;
+  entry->len = cache->frameLen;
+  cache->rawBytes += cache->frameLen;
+  cache->stats.numDecompressed += 1;
+
+  return 0;
+}
+
+// Get back under budget by compressing raw frames from the least
+// recently used end of the list, then by dropping frames. Returns 1
+// when only pinned frames are left and the budget is still exceeded.
+
+static inline
+int bt709_frame_cache_enforce(BT709FrameCache *cache) {
+  for (int i = cache->tail; i != -1 && bt709_frame_cache_bytes(cache) > cache->budget; ) {
+    BT709FrameCacheEntry *entry = &cache->entries[i];
+    const int prev = entry->prev;
+
+    if (entry->stamp >= cache->pinnedStamp) {
+      break;
+    }
+    if (entry->state == BT709FrameCacheRaw && !entry->incompressible &&
+        bt709_frame_cache_compress(cache, i) != 0) {
+      bt709_frame_cache_drop(cache, i);
+    }
+
+    i = prev;
+  }
+
+  while (cache->tail != -1 && bt709_frame_cache_bytes(cache) > cache->budget) {
+    if (cache->entries[cache->tail].stamp >= cache->pinnedStamp) {
+      break;
+    }
+    bt709_frame_cache_drop(cache, cache->tail);
+  }
+
+  return (bt709_frame_cache_bytes(cache) > cache->budget) ? 1 : 0;
+}
+
+// Point planes at the raw data of a frame
+
+static inline
+void bt709_frame_cache_planes(const BT709FrameCache *cache, uint8_t *ptr, BT709PlanesStruct *planes) {
+  const size_t yLen = (size_t) cache->width * cache->height;
+  const size_t uvLen = (size_t) (cache->width / 2) * (cache->height / 2);
+
+  planes->yPtr = ptr;
+  planes->yBytesPerRow = cache->width;
+  planes->cbPtr = ptr + yLen;
+  planes->cbBytesPerRow = cache->width / 2;
+  planes->crPtr = ptr + yLen + uvLen;
+  planes->crBytesPerRow = cache->width / 2;
+}
+
+// Copy a decoded frame into the cache, replacing any frame already
+// held at frameIndex. The new frame is kept raw even when the budget
+// is smaller than one frame. Returns 0 on success, 1 when frameIndex
+// is out of range, and 2 when memory cannot be allocated.
+
+static inline
+int bt709_frame_cache_put(BT709FrameCache *cache, int frameIndex, const BT709PlanesStruct *planes) {
+  if (frameIndex < 0 || frameIndex >= cache->numFrames) {
+    return 1;
+  }
+
+  BT709FrameCacheEntry *entry = &cache->entries[frameIndex];
+
+  if (entry->state == BT709FrameCacheCompressed) {
+    free(entry->ptr);
+    cache->compressedBytes -= entry->len;
+    entry->ptr = NULL;
+  }
+
+  if (entry->state != BT709FrameCacheRaw) {
+    uint8_t *raw = bt709_frame_cache_alloc_raw(cache);
+    if (raw == NULL) {
+      if (entry->state != BT709FrameCacheEmpty) {
+        bt709_frame_cache_unlink(cache, frameIndex);
+        memset(entry, 0, sizeof(BT709FrameCacheEntry));
+      }
+      return 2;
+    }
+    bt709_frame_cache_touch(cache, frameIndex);
+    entry->state = BT709FrameCacheRaw;
+    entry->ptr = raw;
+    entry->len = cache->frameLen;
+    cache->rawBytes += cache->frameLen;
+  } else {
+    bt709_frame_cache_touch(cache, frameIndex);
+  }
+
+  entry->incompressible = 0;
+
+  BT709PlanesStruct rawPlanes;
+  bt709_frame_cache_planes(cache, entry->ptr, &rawPlanes);
+
+  const int width = cache->width;
+  const int height = cache->height;
+
+  bt709_planes_copy(rawPlanes.yPtr, rawPlanes.yBytesPerRow, planes->yPtr, planes->yBytesPerRow, width, height);
+  bt709_planes_copy(rawPlanes.cbPtr, rawPlanes.cbBytesPerRow, planes->cbPtr, planes->cbBytesPerRow, width / 2, height / 2);
+  bt709_planes_copy(rawPlanes.crPtr, rawPlanes.crBytesPerRow, planes->crPtr, planes->crBytesPerRow, width / 2, height / 2);
+
+  cache->pinnedStamp = entry->stamp;
+  bt709_frame_cache_enforce(cache);
+
+  return 0;
+}
+
+// Look up a frame and point planes at its raw data, decompressing
+// it when needed. Returns 0 on success, 1 when the frame is not held
+// and must be decoded and put again, and 2 when memory cannot be
+// allocated.
+
+static inline
+int bt709_frame_cache_get(BT709FrameCache *cache, int frameIndex, BT709PlanesStruct *planes) {
+  if (frameIndex < 0 || frameIndex >= cache->numFrames ||
+      cache->entries[frameIndex].state == BT709FrameCacheEmpty) {
+    cache->stats.numMisses += 1;
+    return 1;
+  }
+
+  BT709FrameCacheEntry *entry = &cache->entries[frameIndex];
+
+  if (entry->state == BT709FrameCacheCompressed) {
+    if (bt709_frame_cache_decompress(cache, frameIndex) != 0) {
+      return 2;
+    }
+  } else {
+    cache->stats.numRawHits += 1;
+  }
+
+  bt709_frame_cache_touch(cache, frameIndex);
+  bt709_frame_cache_planes(cache, entry->ptr, planes);
+
+  cache->pinnedStamp = entry->stamp;
+  bt709_frame_cache_enforce(cache);
+
+  return 0;
+}
+
+// Hint that frames from frameIndex on will be used next, as in
+// sequential playback. Up to count held frames are decompressed
+// ahead so that the following gets only return a pointer, stopping
+// at the first frame that is not held or when the budget is full.
+// The frame last returned by a get stays valid. Returns the number
+// of frames that are now raw.
+
+static inline
+int bt709_frame_cache_prefetch(BT709FrameCache *cache, int frameIndex, int count) {
+  int numRaw = 0;
+
+  for (int i = frameIndex; i < (frameIndex + count) && i >= 0 && i < cache->numFrames; i++) {
+    BT709FrameCacheEntry *entry = &cache->entries[i];
+
+    if (entry->state == BT709FrameCacheEmpty) {
+      break;
+    }
+
+    if (entry->state == BT709FrameCacheCompressed) {
+      if (bt709_frame_cache_decompress(cache, i) != 0) {
+        break;
+      }
+      bt709_frame_cache_touch(cache, i);
+
+      // Frames touched since the last get are pinned, so a window
+      // that does not fit is compressed again and prefetch stops.
+      // When that fails the frame is dropped, as enforce does.
+
+      if (bt709_frame_cache_enforce(cache) != 0) {
+        if (bt709_frame_cache_compress(cache, i) != 0) {
+          bt709_frame_cache_drop(cache, i);
+        }
+        break;
+      }
+    } else {
+      bt709_frame_cache_touch(cache, i);
+    }
+
+    numRaw += 1;
+  }
+
+  return numRaw;
+}
+
+#endif // _BT709_FRAME_CACHE_H
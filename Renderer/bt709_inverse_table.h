@@ -0,0 +1,532 @@
+//
+//  bt709_inverse_table.h
+//
+//  Header only interface that encodes sRGB pixels to BT.709 YCbCr
+//  with a precomputed inverse of the Apple 1.96 gamma decoder.
+//  Apple196_from_sRGB_convertRGBToYCbCr() applies the forward matrix
+//  and rounds each component, which leaves some colors that decode
+//  through Apple196_to_sRGB_convertYCbCrToRGB() one or two values
+//  away from the original. For every one of the 2^24 sRGB inputs,
+//  this module searches the 8 bit (Y, Cb, Cr) values around the
+//  forward result and keeps the triple whose decode is nearest the
+//  input. Encoding is then a single table lookup per pixel.
+//
+//  The table is 48 MB, 3 bytes per sRGB input, and is stored after
+//  a page sized header so that a file written once can be mapped
+//  read only by any number of processes.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_INVERSE_TABLE_H)
+#define _BT709_INVERSE_TABLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bt709_frame.h"
+
+#define BT709_INVERSE_TABLE_MAGIC "BT709INV"
+#define BT709_INVERSE_TABLE_VERSION 1
+
+// Entry data begins at this offset in the file
+
+#define BT709_INVERSE_TABLE_DATA_OFFSET 4096
+
+#define BT709_INVERSE_TABLE_NUM_ENTRIES (256 * 256 * 256)
+#define BT709_INVERSE_TABLE_DATA_LEN (BT709_INVERSE_TABLE_NUM_ENTRIES * 3)
+
+#define BT709_INVERSE_TABLE_MAX_THREADS 64
+
+// Gamma encoded values from the decode matrix are mapped to
+// sRGB with a table of this many entries plus one.
+
+#define BT709_INVERSE_CURVE_SIZE 65536
+
+// The search moves to the best neighbour and looks again at most
+// this many times before it settles.
+
+#define BT709_INVERSE_MAX_STEPS 8
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t gamma;
+  uint32_t radius;
+  uint32_t entrySize;
+  uint64_t dataOffset;
+  uint64_t dataLen;
+} BT709InverseTableHeader;
+
+// Tables used while searching, the decode matrix is split into
+// per component terms so that a candidate costs a few adds.
+
+typedef struct {
+  int radius;
+
+  // sRGB byte -> Apple 1.96 gamma encoded normalized value
+  float toApple[256];
+
+  // Decode matrix terms for each Y, Cb, Cr code value
+  float yTerm[256];
+  float crR[256];
+  float cbG[256];
+  float crG[256];
+  float cbB[256];
+
+  // Apple 1.96 gamma encoded normalized value -> sRGB in byte range
+  float toSrgb[BT709_INVERSE_CURVE_SIZE + 1];
+} BT709InverseSearch;
+
+typedef struct {
+  // Entry for (R, G, B) is 3 bytes (Y, Cb, Cr) at ((R << 16) | (G << 8) | B) * 3
+  const uint8_t *entries;
+
+  // Non-NULL when entries are mapped from a file
+  void *mapping;
+  size_t mappingLen;
+
+  // sRGB tables used to average each 2x2 block in linear space
+  BT709FrameTables srgbTables;
+} BT709InverseTable;
+
+static inline
+void bt709_inverse_search_init(BT709InverseSearch *search, int radius) {
+  search->radius = radius;
+
+  for (int i = 0; i < 256; i++) {
+    float Cn = sRGB_nonLinearNormToLinear(byteNorm(i));
+    search->toApple[i] = Apple196_linearNormToNonLinear(Cn);
+  }
+
+  // Same coefficients as BT709_convertNormalizedYCbCrToRGB()
+  // with the limited range scale applied.
+
+  const float YScale = 255.0f / (BT709_YMax-BT709_YMin);
+  const float UVScale = 255.0f / (BT709_UVMax-BT709_UVMin);
+
+  for (int i = 0; i < 256; i++) {
+    float Yn = (i - 16) * (1.0f / 255.0f);
+    float Cn = (i - 128) * (1.0f / 255.0f);
+
+    search->yTerm[i] = Yn * YScale;
+    search->crR[i] = Cn * (UVScale * BT709_Er_minus_Ey_Range);
+    search->cbG[i] = Cn * (-1.0f * UVScale * BT709_Eb_minus_Ey_Range * BT709_Kb_over_Kg);
+    search->crG[i] = Cn * (-1.0f * UVScale * BT709_Er_minus_Ey_Range * BT709_Kr_over_Kg);
+    search->cbB[i] = Cn * (UVScale * BT709_Eb_minus_Ey_Range);
+  }
+
+  for (int i = 0; i <= BT709_INVERSE_CURVE_SIZE; i++) {
+    float Cn = i * (1.0f / BT709_INVERSE_CURVE_SIZE);
+    Cn = Apple196_nonLinearNormToLinear(Cn);
+    Cn = sRGB_linearNormToNonLinear(Cn);
+    search->toSrgb[i] = Cn * 255.0f;
+  }
+}
+
+// Decode one gamma encoded matrix output to sRGB in byte range
+
+static inline
+float bt709_inverse_search_decode(const BT709InverseSearch *search, float Cn) {
+  if (Cn <= 0.0f) {
+    return search->toSrgb[0];
+  } else if (Cn >= 1.0f) {
+    return search->toSrgb[BT709_INVERSE_CURVE_SIZE];
+  }
+
+  float f = Cn * BT709_INVERSE_CURVE_SIZE;
+  int i = (int) f;
+  float t = f - i;
+  return search->toSrgb[i] + ((search->toSrgb[i+1] - search->toSrgb[i]) * t);
+}
+
+// Error for one decoded component. Values that round to the wrong
+// byte are what a round trip test sees, so the number of rounded
+// values that miss dominates and the unrounded distance breaks ties.
+
+static inline
+float bt709_inverse_search_cost(float decoded, int expected) {
+  float diff = decoded - expected;
+  int rounded = (int) round(decoded) - expected;
+  return (rounded * rounded * 65536.0f) + (diff * diff);
+}
+
+// Find the (Y, Cb, Cr) nearest to the sRGB input (R, G, B) and
+// write the 3 result bytes to outPtr.
+
+static inline
+void bt709_inverse_search_pixel(const BT709InverseSearch *search,
+                                int R, int G, int B,
+                                uint8_t *outPtr)
+{
+  int Y, Cb, Cr;
+
+  BT709_convertNonLinearRGBToYCbCr(search->toApple[R], search->toApple[G], search->toApple[B], &Y, &Cb, &Cr);
+
+  const int radius = search->radius;
+
+  for (int step = 0; step < BT709_INVERSE_MAX_STEPS; step++) {
+    int bestY = Y;
+    int bestCb = Cb;
+    int bestCr = Cr;
+    float bestCost = 1.0e30f;
+
+    const int yMin = (Y - radius) < BT709_YMin ? BT709_YMin : (Y - radius);
+    const int yMax = (Y + radius) > BT709_YMax ? BT709_YMax : (Y + radius);
+    const int cbMin = (Cb - radius) < BT709_UVMin ? BT709_UVMin : (Cb - radius);
+    const int cbMax = (Cb + radius) > BT709_UVMax ? BT709_UVMax : (Cb + radius);
+    const int crMin = (Cr - radius) < BT709_UVMin ? BT709_UVMin : (Cr - radius);
+    const int crMax = (Cr + radius) > BT709_UVMax ? BT709_UVMax : (Cr + radius);
+
+    for (int y = yMin; y <= yMax; y++) {
+      const float yTerm = search->yTerm[y];
+
+      for (int cr = crMin; cr <= crMax; cr++) {
+        // R depends only on Y and Cr, skip every Cb once the
+        // R error alone is worse than the best so far.
+
+        float costR = bt709_inverse_search_cost(bt709_inverse_search_decode(search, yTerm + search->crR[cr]), R);
+
+        if (costR >= bestCost) {
+          continue;
+        }
+
+        const float yCrG = yTerm + search->crG[cr];
+
+        for (int cb = cbMin; cb <= cbMax; cb++) {
+          float cost = costR + bt709_inverse_search_cost(bt709_inverse_search_decode(search, yTerm + search->cbB[cb]), B);
+
+          if (cost >= bestCost) {
+            continue;
+          }
+
+          cost += bt709_inverse_search_cost(bt709_inverse_search_decode(search, yCrG + search->cbG[cb]), G);
+
+          if (cost < bestCost) {
+            bestCost = cost;
+            bestY = y;
+            bestCb = cb;
+            bestCr = cr;
+          }
+        }
+      }
+    }
+
+    if (bestY == Y && bestCb == Cb && bestCr == Cr) {
+      break;
+    }
+
+    Y = bestY;
+    Cb = bestCb;
+    Cr = bestCr;
+  }
+
+  outPtr[0] = (uint8_t) Y;
+  outPtr[1] = (uint8_t) Cb;
+  outPtr[2] = (uint8_t) Cr;
+}
+
+// Fill entries for every sRGB input with R in [rStart, rEnd)
+
+static inline
+void bt709_inverse_search_rows(const BT709InverseSearch *search,
+                               uint8_t *entries,
+                               int rStart, int rEnd)
+{
+  for (int R = rStart; R < rEnd; R++) {
+    for (int G = 0; G < 256; G++) {
+      uint8_t *outPtr = entries + (((R << 16) | (G << 8)) * 3);
+      for (int B = 0; B < 256; B++) {
+        bt709_inverse_search_pixel(search, R, G, B, outPtr);
+        outPtr += 3;
+      }
+    }
+  }
+}
+
+typedef struct {
+  const BT709InverseSearch *search;
+  uint8_t *entries;
+  int bandIndex;
+  int numBands;
+} BT709InverseBand;
+
+static inline
+void* bt709_inverse_band_thread(void *arg) {
+  BT709InverseBand *band = (BT709InverseBand *) arg;
+
+  // Interleave R values so that bands near black and white,
+  // where the search exits early, are spread over every thread.
+
+  for (int R = band->bandIndex; R < 256; R += band->numBands) {
+    bt709_inverse_search_rows(band->search, band->entries, R, R + 1);
+  }
+
+  return NULL;
+}
+
+// Search every sRGB input and write BT709_INVERSE_TABLE_DATA_LEN
+// bytes to entries. A radius of 1 checks the 27 neighbours of
+// the current best on each step. Returns 0 on success.
+
+static inline
+int bt709_inverse_table_build(uint8_t *entries, int radius, int numThreads) {
+  if (radius < 1) {
+    return 1;
+  }
+
+  if (numThreads < 1) {
+    numThreads = 1;
+  } else if (numThreads > BT709_INVERSE_TABLE_MAX_THREADS) {
+    numThreads = BT709_INVERSE_TABLE_MAX_THREADS;
+  }
+
+  BT709InverseSearch *search = (BT709InverseSearch *) malloc(sizeof(BT709InverseSearch));
+  if (search == NULL) {
+    return 1;
+  }
+  bt709_inverse_search_init(search, radius);
+
+  BT709InverseBand bands[BT709_INVERSE_TABLE_MAX_THREADS];
+  pthread_t threads[BT709_INVERSE_TABLE_MAX_THREADS];
+
+  for (int i = 0; i < numThreads; i++) {
+    bands[i].search = search;
+    bands[i].entries = entries;
+    bands[i].bandIndex = i;
+    bands[i].numBands = numThreads;
+  }
+
+  // Band 0 runs on the calling thread
+
+  int numStarted = 1;
+  for ( ; numStarted < numThreads; numStarted++) {
+    if (pthread_create(&threads[numStarted], NULL, bt709_inverse_band_thread, &bands[numStarted]) != 0) {
+      break;
+    }
+  }
+
+  bt709_inverse_band_thread(&bands[0]);
+
+  for (int i = 1; i < numStarted; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (int i = numStarted; i < numThreads; i++) {
+    bt709_inverse_band_thread(&bands[i]);
+  }
+
+  free(search);
+
+  return 0;
+}
+
+// Write a built table to a file that can later be mapped with
+// bt709_inverse_table_map(). Returns 0 on success.
+
+static inline
+int bt709_inverse_table_write(const char *path, const uint8_t *entries, int radius) {
+  FILE *outFile = fopen(path, "wb");
+
+  if (outFile == NULL) {
+    fprintf(stderr, "could not open inverse table \"%s\" for writing\n", path);
+    return 1;
+  }
+
+  uint8_t headerPage[BT709_INVERSE_TABLE_DATA_OFFSET];
+  memset(headerPage, 0, sizeof(headerPage));
+
+  BT709InverseTableHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BT709_INVERSE_TABLE_MAGIC, sizeof(header.magic));
+  header.version = BT709_INVERSE_TABLE_VERSION;
+  header.gamma = BT709GammaApple;
+  header.radius = radius;
+  header.entrySize = 3;
+  header.dataOffset = BT709_INVERSE_TABLE_DATA_OFFSET;
+  header.dataLen = BT709_INVERSE_TABLE_DATA_LEN;
+  memcpy(headerPage, &header, sizeof(header));
+
+  int retcode = 0;
+
+  if (fwrite(headerPage, sizeof(headerPage), 1, outFile) != 1 ||
+      fwrite(entries, BT709_INVERSE_TABLE_DATA_LEN, 1, outFile) != 1) {
+    fprintf(stderr, "could not write inverse table \"%s\"\n", path);
+    retcode = 1;
+  }
+
+  if (fclose(outFile) != 0) {
+    retcode = 1;
+  }
+
+  return retcode;
+}
+
+// Use entries that were built in memory, the caller keeps ownership.
+
+static inline
+void bt709_inverse_table_init(BT709InverseTable *table, const uint8_t *entries) {
+  memset(table, 0, sizeof(BT709InverseTable));
+  table->entries = entries;
+  bt709_frame_tables_init(&table->srgbTables, BT709GammaSrgb, BT709GammaSrgb);
+}
+
+// Map a table file read only. Returns 0 on success, 1 when the file
+// cannot be opened, and 2 when the file is not a valid table.
+
+static inline
+int bt709_inverse_table_map(BT709InverseTable *table, const char *path) {
+  memset(table, 0, sizeof(BT709InverseTable));
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return 1;
+  }
+
+  struct stat st;
+  const size_t mappingLen = BT709_INVERSE_TABLE_DATA_OFFSET + BT709_INVERSE_TABLE_DATA_LEN;
+
+  if (fstat(fd, &st) != 0 || st.st_size != (off_t) mappingLen) {
+    fprintf(stderr, "inverse table \"%s\" has the wrong size\n", path);
+    close(fd);
+    return 2;
+  }
+
+  void *mapping = mmap(NULL, mappingLen, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "could not map inverse table \"%s\"\n", path);
+    return 1;
+  }
+
+  BT709InverseTableHeader header;
+  memcpy(&header, mapping, sizeof(header));
+
+  if (memcmp(header.magic, BT709_INVERSE_TABLE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != BT709_INVERSE_TABLE_VERSION ||
+      header.gamma != BT709GammaApple ||
+      header.entrySize != 3 ||
+      header.dataOffset != BT709_INVERSE_TABLE_DATA_OFFSET ||
+      header.dataLen != BT709_INVERSE_TABLE_DATA_LEN) {
+    fprintf(stderr, "\"%s\" is not a supported inverse table\n", path);
+    munmap(mapping, mappingLen);
+    return 2;
+  }
+
+  bt709_inverse_table_init(table, (const uint8_t *) mapping + BT709_INVERSE_TABLE_DATA_OFFSET);
+  table->mapping = mapping;
+  table->mappingLen = mappingLen;
+
+  return 0;
+}
+
+static inline
+void bt709_inverse_table_close(BT709InverseTable *table) {
+  if (table->mapping != NULL) {
+    munmap(table->mapping, table->mappingLen);
+  }
+  table->mapping = NULL;
+  table->entries = NULL;
+}
+
+static inline
+const uint8_t* bt709_inverse_table_lookup(const BT709InverseTable *table, int R, int G, int B) {
+  return table->entries + (((R << 16) | (G << 8) | B) * 3);
+}
+
+// Convert rows [rowStart, rowEnd) of the input frame, both row
+// values must be even. Each Y comes from the table entry for its
+// pixel. Cb and Cr come from the table entry for the 2x2 average
+// computed in linear space, like bt709_frame_encode_rows().
+
+static inline
+void bt709_inverse_table_encode_rows(const BT709InverseTable *table,
+                                     const BT709PixelLayout *layout,
+                                     const uint8_t *inPixels,
+                                     const int inBytesPerRow,
+                                     const int width,
+                                     const int rowStart,
+                                     const int rowEnd,
+                                     const BT709PlanesStruct *planes)
+{
+  const int bpp = layout->bytesPerPixel;
+  const int rOff = layout->rOffset;
+  const int gOff = layout->gOffset;
+  const int bOff = layout->bOffset;
+
+  const BT709FrameTables *srgbTables = &table->srgbTables;
+  const float *toLinear = srgbTables->toLinear;
+
+#if defined(DEBUG)
+  assert((width % 2) == 0);
+  assert((rowStart % 2) == 0);
+  assert((rowEnd % 2) == 0);
+#endif // DEBUG
+
+  for (int row = rowStart; row < rowEnd; row += 2) {
+    const uint8_t *inRow1 = inPixels + (row * (size_t)inBytesPerRow);
+    const uint8_t *inRow2 = inRow1 + inBytesPerRow;
+
+    uint8_t *outYRow1 = planes->yPtr + (row * (size_t)planes->yBytesPerRow);
+    uint8_t *outYRow2 = outYRow1 + planes->yBytesPerRow;
+
+    uint8_t *outCbRow = planes->cbPtr + ((row / 2) * (size_t)planes->cbBytesPerRow);
+    uint8_t *outCrRow = planes->crPtr + ((row / 2) * (size_t)planes->crBytesPerRow);
+
+    for (int col = 0; col < width; col += 2) {
+      const uint8_t *p1 = inRow1 + (col * bpp);
+      const uint8_t *p2 = p1 + bpp;
+      const uint8_t *p3 = inRow2 + (col * bpp);
+      const uint8_t *p4 = p3 + bpp;
+
+      outYRow1[col] = bt709_inverse_table_lookup(table, p1[rOff], p1[gOff], p1[bOff])[0];
+      outYRow1[col+1] = bt709_inverse_table_lookup(table, p2[rOff], p2[gOff], p2[bOff])[0];
+      outYRow2[col] = bt709_inverse_table_lookup(table, p3[rOff], p3[gOff], p3[bOff])[0];
+      outYRow2[col+1] = bt709_inverse_table_lookup(table, p4[rOff], p4[gOff], p4[bOff])[0];
+
+      float Rave = BT709_average_cbcr_linear(toLinear[p1[rOff]], toLinear[p2[rOff]], toLinear[p3[rOff]], toLinear[p4[rOff]]);
+      float Gave = BT709_average_cbcr_linear(toLinear[p1[gOff]], toLinear[p2[gOff]], toLinear[p3[gOff]], toLinear[p4[gOff]]);
+      float Bave = BT709_average_cbcr_linear(toLinear[p1[bOff]], toLinear[p2[bOff]], toLinear[p3[bOff]], toLinear[p4[bOff]]);
+
+      const uint8_t *ave = bt709_inverse_table_lookup(table,
+                                                      bt709_frame_from_linear(srgbTables, Rave),
+                                                      bt709_frame_from_linear(srgbTables, Gave),
+                                                      bt709_frame_from_linear(srgbTables, Bave));
+
+      outCbRow[col/2] = ave[1];
+      outCrRow[col/2] = ave[2];
+    }
+  }
+}
+
+// Convert a full frame, width and height must both be even.
+// Returns 0 on success.
+
+static inline
+int bt709_inverse_table_encode(const BT709InverseTable *table,
+                               const BT709PixelLayout *layout,
+                               const uint8_t *inPixels,
+                               const int inBytesPerRow,
+                               const int width,
+                               const int height,
+                               const BT709PlanesStruct *planes)
+{
+  if ((width % 2) != 0 || (height % 2) != 0) {
+    return 1;
+  }
+
+  bt709_inverse_table_encode_rows(table, layout, inPixels, inBytesPerRow, width, 0, height, planes);
+
+  return 0;
+}
+
+#endif // _BT709_INVERSE_TABLE_H
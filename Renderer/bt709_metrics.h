@@ -0,0 +1,644 @@
+//
+//  bt709_metrics.h
+//
+//  Header only interface that scores a decoded BT.709 frame
+//  against a reference. Per plane PSNR and SSIM are computed on
+//  the Y, Cb, Cr planes and color error is reported as CIE76
+//  delta E in Lab space. Lab values are derived from linear RGB
+//  using the same sRGB -> XYZ matrix as sRGB_convertRGBToXYZ().
+//
+//  A reference is either another set of 4:2:0 planes or the
+//  original RGB pixels, in which case delta E is measured against
+//  the source pixels instead of a decoded reference. A frame is
+//  split into row bands that are scored on separate threads.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_METRICS_H)
+#define _BT709_METRICS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "bt709_frame.h"
+
+#define BT709_METRICS_MAX_THREADS 64
+
+// Gamma encoded values decoded from YCbCr are mapped to
+// linear with a table of this many entries plus one.
+
+#define BT709_METRICS_LINEAR_TABLE_SIZE 4096
+
+// PSNR reported when two planes are identical
+
+#define BT709_METRICS_PSNR_MAX 100.0
+
+typedef struct {
+  BT709PlanesStruct planes;
+
+  // Original RGB pixels or NULL
+  const uint8_t *rgbPixels;
+  int rgbBytesPerRow;
+  BT709PixelLayout layout;
+} BT709MetricsFrame;
+
+typedef struct {
+  // Decoded YCbCr gamma -> linear, indexed by nonlinear * SIZE
+  float decodedToLinear[BT709_METRICS_LINEAR_TABLE_SIZE + 1];
+  // Source RGB byte -> linear
+  float sourceToLinear[256];
+} BT709MetricsTables;
+
+// Results for one frame, or the sum over many frames
+
+typedef struct {
+  // Index 0 is Y, 1 is Cb, 2 is Cr
+  uint64_t sse[3];
+  uint64_t numSamples[3];
+  double ssimSum[3];
+  uint64_t ssimCount[3];
+
+  double deltaESum;
+  double deltaEMax;
+  uint64_t numPixels;
+
+  int numFrames;
+} BT709MetricsResult;
+
+static inline
+void bt709_metrics_tables_init(BT709MetricsTables *tables,
+                               const BT709Gamma decodedGamma,
+                               const BT709Gamma sourceGamma)
+{
+  for (int i = 0; i <= BT709_METRICS_LINEAR_TABLE_SIZE; i++) {
+    float normV = i * (1.0f / BT709_METRICS_LINEAR_TABLE_SIZE);
+    if (decodedGamma == BT709GammaSrgb) {
+      normV = sRGB_nonLinearNormToLinear(normV);
+    } else if (decodedGamma == BT709GammaApple) {
+      normV = Apple196_nonLinearNormToLinear(normV);
+    }
+    tables->decodedToLinear[i] = normV;
+  }
+
+  for (int i = 0; i < 256; i++) {
+    float Rn, Gn, Bn;
+    BT709_tolinearNorm(i, i, i, &Rn, &Gn, &Bn, sourceGamma);
+    tables->sourceToLinear[i] = Rn;
+  }
+}
+
+static inline
+double bt709_metrics_psnr(uint64_t sse, uint64_t numSamples) {
+  if (sse == 0) {
+    return BT709_METRICS_PSNR_MAX;
+  }
+  double mse = (double) sse / numSamples;
+  double psnr = 10.0 * log10((255.0 * 255.0) / mse);
+  return (psnr > BT709_METRICS_PSNR_MAX) ? BT709_METRICS_PSNR_MAX : psnr;
+}
+
+// Sum of squared differences for one row of bytes
+
+static inline
+uint64_t bt709_metrics_row_sse(const uint8_t *a, const uint8_t *b, int width) {
+  uint64_t sse = 0;
+  int i = 0;
+
+#if defined(__SSE2__)
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc = _mm_setzero_si128();
+
+  for ( ; i <= (width - 16); i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+    __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+    __m128i dlo = _mm_unpacklo_epi8(d, zero);
+    __m128i dhi = _mm_unpackhi_epi8(d, zero);
+    __m128i sq = _mm_add_epi32(_mm_madd_epi16(dlo, dlo), _mm_madd_epi16(dhi, dhi));
+    // Widen to 64 bit lanes so that very wide rows cannot overflow
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+  }
+
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i *) lanes, acc);
+  sse = lanes[0] + lanes[1];
+#elif defined(__ARM_NEON)
+  uint64x2_t acc = vdupq_n_u64(0);
+
+  for ( ; i <= (width - 16); i += 16) {
+    uint8x16_t d = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+    uint16x8_t sqlo = vmull_u8(vget_low_u8(d), vget_low_u8(d));
+    uint16x8_t sqhi = vmull_u8(vget_high_u8(d), vget_high_u8(d));
+    uint32x4_t sq = vpaddlq_u16(sqlo);
+    sq = vpadalq_u16(sq, sqhi);
+    acc = vpadalq_u32(acc, sq);
+  }
+
+  sse = vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+
+  for ( ; i < width; i++) {
+    int d = (int) a[i] - (int) b[i];
+    sse += d * d;
+  }
+
+  return sse;
+}
+
+static inline
+uint64_t bt709_metrics_plane_sse(const uint8_t *a, int aBytesPerRow,
+                                 const uint8_t *b, int bBytesPerRow,
+                                 int width, int rowStart, int rowEnd)
+{
+  uint64_t sse = 0;
+  for (int row = rowStart; row < rowEnd; row++) {
+    sse += bt709_metrics_row_sse(a + (row * (size_t)aBytesPerRow), b + (row * (size_t)bBytesPerRow), width);
+  }
+  return sse;
+}
+
+// Per column sums over 8 rows of a and b, the sums of a, b, a*a,
+// b*b and a*b for column i are written to sums[(k * width) + i].
+
+static inline
+void bt709_metrics_ssim_column_sums(const uint8_t *a, int aBytesPerRow,
+                                    const uint8_t *b, int bBytesPerRow,
+                                    int width, uint32_t *sums)
+{
+  uint32_t *sumA = sums;
+  uint32_t *sumB = sums + width;
+  uint32_t *sumAA = sums + (2 * width);
+  uint32_t *sumBB = sums + (3 * width);
+  uint32_t *sumAB = sums + (4 * width);
+
+  int col = 0;
+
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+
+  for ( ; col + 8 <= width; col += 8) {
+    __m128i sa = zero, sb = zero;
+    __m128i saaLo = zero, saaHi = zero, sbbLo = zero, sbbHi = zero, sabLo = zero, sabHi = zero;
+
+    for (int y = 0; y < 8; y++) {
+      __m128i va = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (a + (y * (size_t)aBytesPerRow) + col)), zero);
+      __m128i vb = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (b + (y * (size_t)bBytesPerRow) + col)), zero);
+
+      sa = _mm_add_epi16(sa, va);
+      sb = _mm_add_epi16(sb, vb);
+
+      // Products of two bytes fit in an unsigned 16 bit lane
+
+      __m128i aa = _mm_mullo_epi16(va, va);
+      __m128i bb = _mm_mullo_epi16(vb, vb);
+      __m128i ab = _mm_mullo_epi16(va, vb);
+
+      saaLo = _mm_add_epi32(saaLo, _mm_unpacklo_epi16(aa, zero));
+      saaHi = _mm_add_epi32(saaHi, _mm_unpackhi_epi16(aa, zero));
+      sbbLo = _mm_add_epi32(sbbLo, _mm_unpacklo_epi16(bb, zero));
+      sbbHi = _mm_add_epi32(sbbHi, _mm_unpackhi_epi16(bb, zero));
+      sabLo = _mm_add_epi32(sabLo, _mm_unpacklo_epi16(ab, zero));
+      sabHi = _mm_add_epi32(sabHi, _mm_unpackhi_epi16(ab, zero));
+    }
+
+    _mm_storeu_si128((__m128i *) (sumA + col), _mm_unpacklo_epi16(sa, zero));
+    _mm_storeu_si128((__m128i *) (sumA + col + 4), _mm_unpackhi_epi16(sa, zero));
+    _mm_storeu_si128((__m128i *) (sumB + col), _mm_unpacklo_epi16(sb, zero));
+    _mm_storeu_si128((__m128i *) (sumB + col + 4), _mm_unpackhi_epi16(sb, zero));
+    _mm_storeu_si128((__m128i *) (sumAA + col), saaLo);
+    _mm_storeu_si128((__m128i *) (sumAA + col + 4), saaHi);
+    _mm_storeu_si128((__m128i *) (sumBB + col), sbbLo);
+    _mm_storeu_si128((__m128i *) (sumBB + col + 4), sbbHi);
+    _mm_storeu_si128((__m128i *) (sumAB + col), sabLo);
+    _mm_storeu_si128((__m128i *) (sumAB + col + 4), sabHi);
+  }
+#elif defined(__ARM_NEON)
+  for ( ; col + 8 <= width; col += 8) {
+    uint16x8_t sa = vdupq_n_u16(0), sb = vdupq_n_u16(0);
+    uint32x4_t saaLo = vdupq_n_u32(0), saaHi = vdupq_n_u32(0);
+    uint32x4_t sbbLo = vdupq_n_u32(0), sbbHi = vdupq_n_u32(0);
+    uint32x4_t sabLo = vdupq_n_u32(0), sabHi = vdupq_n_u32(0);
+
+    for (int y = 0; y < 8; y++) {
+      uint8x8_t va = vld1_u8(a + (y * (size_t)aBytesPerRow) + col);
+      uint8x8_t vb = vld1_u8(b + (y * (size_t)bBytesPerRow) + col);
+
+      sa = vaddw_u8(sa, va);
+      sb = vaddw_u8(sb, vb);
+
+      uint16x8_t aa = vmull_u8(va, va);
+      uint16x8_t bb = vmull_u8(vb, vb);
+      uint16x8_t ab = vmull_u8(va, vb);
+
+      saaLo = vaddw_u16(saaLo, vget_low_u16(aa));
+      saaHi = vaddw_u16(saaHi, vget_high_u16(aa));
+      sbbLo = vaddw_u16(sbbLo, vget_low_u16(bb));
+      sbbHi = vaddw_u16(sbbHi, vget_high_u16(bb));
+      sabLo = vaddw_u16(sabLo, vget_low_u16(ab));
+      sabHi = vaddw_u16(sabHi, vget_high_u16(ab));
+    }
+
+    vst1q_u32(sumA + col, vmovl_u16(vget_low_u16(sa)));
+    vst1q_u32(sumA + col + 4, vmovl_u16(vget_high_u16(sa)));
+    vst1q_u32(sumB + col, vmovl_u16(vget_low_u16(sb)));
+    vst1q_u32(sumB + col + 4, vmovl_u16(vget_high_u16(sb)));
+    vst1q_u32(sumAA + col, saaLo);
+    vst1q_u32(sumAA + col + 4, saaHi);
+    vst1q_u32(sumBB + col, sbbLo);
+    vst1q_u32(sumBB + col + 4, sbbHi);
+    vst1q_u32(sumAB + col, sabLo);
+    vst1q_u32(sumAB + col + 4, sabHi);
+  }
+#endif
+
+  for ( ; col < width; col++) {
+    uint32_t sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+    for (int y = 0; y < 8; y++) {
+      uint32_t va = a[(y * (size_t)aBytesPerRow) + col];
+      uint32_t vb = b[(y * (size_t)bBytesPerRow) + col];
+      sa += va;
+      sb += vb;
+      saa += va * va;
+      sbb += vb * vb;
+      sab += va * vb;
+    }
+    sumA[col] = sa;
+    sumB[col] = sb;
+    sumAA[col] = saa;
+    sumBB[col] = sbb;
+    sumAB[col] = sab;
+  }
+}
+
+// SSIM over 8x8 windows placed every 4 pixels, windows whose top row
+// is 4*k for k in [windowRowStart, windowRowEnd) are summed. Column
+// sums over the 8 rows of a window row are computed with SSE2 or
+// NEON, then each window adds the sums of 8 columns. Returns 2 when
+// memory cannot be allocated.
+
+static inline
+int bt709_metrics_plane_ssim(const uint8_t *a, int aBytesPerRow,
+                             const uint8_t *b, int bBytesPerRow,
+                             int width,
+                             int windowRowStart, int windowRowEnd,
+                             double *ssimSumPtr, uint64_t *ssimCountPtr)
+{
+  const double C1 = (0.01 * 255) * (0.01 * 255);
+  const double C2 = (0.03 * 255) * (0.03 * 255);
+
+  if (width < 8 || windowRowStart >= windowRowEnd) {
+    return 0;
+  }
+
+  uint32_t *sums = (uint32_t *) malloc(5 * sizeof(uint32_t) * width);
+  if (sums == NULL) {
+    return 2;
+  }
+
+  double ssimSum = 0.0;
+  uint64_t ssimCount = 0;
+
+  for (int wr = windowRowStart; wr < windowRowEnd; wr++) {
+    const int row = wr * 4;
+
+    bt709_metrics_ssim_column_sums(a + (row * (size_t)aBytesPerRow), aBytesPerRow,
+                                   b + (row * (size_t)bBytesPerRow), bBytesPerRow,
+                                   width, sums);
+
+    for (int col = 0; col <= (width - 8); col += 4) {
+      uint32_t w[5];
+
+      for (int k = 0; k < 5; k++) {
+        const uint32_t *s = sums + (k * width) + col;
+        w[k] = s[0] + s[1] + s[2] + s[3] + s[4] + s[5] + s[6] + s[7];
+      }
+
+      const double n = 64.0;
+      double muA = w[0] / n;
+      double muB = w[1] / n;
+      double varA = (w[2] / n) - (muA * muA);
+      double varB = (w[3] / n) - (muB * muB);
+      double cov = (w[4] / n) - (muA * muB);
+
+      double ssim = ((2.0 * muA * muB + C1) * (2.0 * cov + C2)) /
+                    (((muA * muA) + (muB * muB) + C1) * (varA + varB + C2));
+
+      ssimSum += ssim;
+      ssimCount += 1;
+    }
+  }
+
+  free(sums);
+
+  *ssimSumPtr += ssimSum;
+  *ssimCountPtr += ssimCount;
+
+  return 0;
+}
+
+// Number of 8x8 window rows in a plane of the given height
+
+static inline
+int bt709_metrics_ssim_window_rows(int height) {
+  return (height < 8) ? 0 : (((height - 8) / 4) + 1);
+}
+
+// Linear RGB -> CIE Lab with the sRGB -> XYZ matrix and D65 white
+// scaling from sRGB_convertRGBToXYZ()
+
+static inline
+float bt709_metrics_lab_f(float t) {
+  const float delta = 6.0f / 29.0f;
+  if (t > (delta * delta * delta)) {
+    return cbrtf(t);
+  }
+  return (t * (1.0f / (3.0f * delta * delta))) + (4.0f / 29.0f);
+}
+
+static inline
+void bt709_metrics_linear_to_lab(float Rn, float Gn, float Bn, float *LPtr, float *aPtr, float *bPtr) {
+  float X = (Rn * 0.4124f) + (Gn * 0.3576f) + (Bn * 0.1805f);
+  float Y = (Rn * 0.2126f) + (Gn * 0.7152f) + (Bn * 0.0722f);
+  float Z = (Rn * 0.0193f) + (Gn * 0.1192f) + (Bn * 0.9505f);
+
+  X *= (1.0f / 0.9505f);
+  Z *= (1.0f / 1.08899f);
+
+  float fx = bt709_metrics_lab_f(X);
+  float fy = bt709_metrics_lab_f(Y);
+  float fz = bt709_metrics_lab_f(Z);
+
+  *LPtr = (116.0f * fy) - 16.0f;
+  *aPtr = 500.0f * (fx - fy);
+  *bPtr = 200.0f * (fy - fz);
+}
+
+static inline
+float bt709_metrics_decoded_linear(const BT709MetricsTables *tables, float nonLinear) {
+  nonLinear = saturatef(nonLinear);
+  return tables->decodedToLinear[(int) (nonLinear * BT709_METRICS_LINEAR_TABLE_SIZE + 0.5f)];
+}
+
+// Linear RGB for pixel (col, row) of a frame, chroma samples are
+// shared by each 2x2 block of Y samples.
+
+static inline
+void bt709_metrics_pixel_linear(const BT709MetricsTables *tables,
+                                const BT709MetricsFrame *frame,
+                                int col, int row,
+                                float *RnPtr, float *GnPtr, float *BnPtr)
+{
+  if (frame->rgbPixels != NULL) {
+    const uint8_t *p = frame->rgbPixels + (row * (size_t)frame->rgbBytesPerRow) + (col * frame->layout.bytesPerPixel);
+    *RnPtr = tables->sourceToLinear[p[frame->layout.rOffset]];
+    *GnPtr = tables->sourceToLinear[p[frame->layout.gOffset]];
+    *BnPtr = tables->sourceToLinear[p[frame->layout.bOffset]];
+    return;
+  }
+
+  const BT709PlanesStruct *planes = &frame->planes;
+
+  int Y = planes->yPtr[(row * (size_t)planes->yBytesPerRow) + col];
+  int Cb = planes->cbPtr[((row / 2) * (size_t)planes->cbBytesPerRow) + (col / 2)];
+  int Cr = planes->crPtr[((row / 2) * (size_t)planes->crBytesPerRow) + (col / 2)];
+
+  // Same matrix as BT709_convertNormalizedYCbCrToRGB() with unscale,
+  // Y values outside [16, 235] are not asserted on since decoders
+  // can emit them.
+
+  const float YScale = 255.0f / (BT709_YMax - BT709_YMin);
+  const float UVScale = 255.0f / (BT709_UVMax - BT709_UVMin);
+
+  float Yn = (Y - 16) * (1.0f / 255.0f) * YScale;
+  float Cbn = (Cb - 128) * (1.0f / 255.0f) * UVScale;
+  float Crn = (Cr - 128) * (1.0f / 255.0f) * UVScale;
+
+  float Rn = Yn + (Crn * BT709_Er_minus_Ey_Range);
+  float Gn = Yn - (Cbn * BT709_Eb_minus_Ey_Range * BT709_Kb_over_Kg) - (Crn * BT709_Er_minus_Ey_Range * BT709_Kr_over_Kg);
+  float Bn = Yn + (Cbn * BT709_Eb_minus_Ey_Range);
+
+  *RnPtr = bt709_metrics_decoded_linear(tables, Rn);
+  *GnPtr = bt709_metrics_decoded_linear(tables, Gn);
+  *BnPtr = bt709_metrics_decoded_linear(tables, Bn);
+}
+
+static inline
+void bt709_metrics_deltae_rows(const BT709MetricsTables *tables,
+                               const BT709MetricsFrame *refFrame,
+                               const BT709MetricsFrame *frame,
+                               int width, int rowStart, int rowEnd,
+                               double *sumPtr, double *maxPtr)
+{
+  double sum = 0.0;
+  float maxDeltaE = 0.0f;
+
+  for (int row = rowStart; row < rowEnd; row++) {
+    for (int col = 0; col < width; col++) {
+      float R1, G1, B1, R2, G2, B2;
+      bt709_metrics_pixel_linear(tables, refFrame, col, row, &R1, &G1, &B1);
+      bt709_metrics_pixel_linear(tables, frame, col, row, &R2, &G2, &B2);
+
+      float L1, a1, b1, L2, a2, b2;
+      bt709_metrics_linear_to_lab(R1, G1, B1, &L1, &a1, &b1);
+      bt709_metrics_linear_to_lab(R2, G2, B2, &L2, &a2, &b2);
+
+      float dL = L1 - L2;
+      float da = a1 - a2;
+      float db = b1 - b2;
+      float deltaE = sqrtf((dL * dL) + (da * da) + (db * db));
+
+      sum += deltaE;
+      if (deltaE > maxDeltaE) {
+        maxDeltaE = deltaE;
+      }
+    }
+  }
+
+  *sumPtr += sum;
+  if (maxDeltaE > *maxPtr) {
+    *maxPtr = maxDeltaE;
+  }
+}
+
+typedef struct {
+  const BT709MetricsTables *tables;
+  const BT709MetricsFrame *refFrame;
+  const BT709MetricsFrame *frame;
+  int width;
+  int height;
+  int bandIndex;
+  int numBands;
+  int retcode;
+  BT709MetricsResult result;
+} BT709MetricsBand;
+
+// Split count items into numBands ranges, returns range for bandIndex
+
+static inline
+void bt709_metrics_band_range(int count, int bandIndex, int numBands, int *startPtr, int *endPtr) {
+  *startPtr = (int) (((int64_t) count * bandIndex) / numBands);
+  *endPtr = (int) (((int64_t) count * (bandIndex + 1)) / numBands);
+}
+
+static inline
+void* bt709_metrics_band_thread(void *arg) {
+  BT709MetricsBand *band = (BT709MetricsBand *) arg;
+  BT709MetricsResult *result = &band->result;
+
+  const BT709PlanesStruct *p1 = &band->refFrame->planes;
+  const BT709PlanesStruct *p2 = &band->frame->planes;
+
+  const int width = band->width;
+  const int height = band->height;
+
+  const uint8_t *planes1[3] = { p1->yPtr, p1->cbPtr, p1->crPtr };
+  const uint8_t *planes2[3] = { p2->yPtr, p2->cbPtr, p2->crPtr };
+  const int rowBytes1[3] = { p1->yBytesPerRow, p1->cbBytesPerRow, p1->crBytesPerRow };
+  const int rowBytes2[3] = { p2->yBytesPerRow, p2->cbBytesPerRow, p2->crBytesPerRow };
+
+  for (int pi = 0; pi < 3; pi++) {
+    int planeWidth = (pi == 0) ? width : (width / 2);
+    int planeHeight = (pi == 0) ? height : (height / 2);
+
+    int rowStart, rowEnd;
+    bt709_metrics_band_range(planeHeight, band->bandIndex, band->numBands, &rowStart, &rowEnd);
+
+    result->sse[pi] += bt709_metrics_plane_sse(planes1[pi], rowBytes1[pi], planes2[pi], rowBytes2[pi], planeWidth, rowStart, rowEnd);
+    result->numSamples[pi] += (uint64_t) planeWidth * (rowEnd - rowStart);
+
+    int windowStart, windowEnd;
+    bt709_metrics_band_range(bt709_metrics_ssim_window_rows(planeHeight), band->bandIndex, band->numBands, &windowStart, &windowEnd);
+
+    if (bt709_metrics_plane_ssim(planes1[pi], rowBytes1[pi], planes2[pi], rowBytes2[pi], planeWidth, windowStart, windowEnd, &result->ssimSum[pi], &result->ssimCount[pi]) != 0) {
+      band->retcode = 2;
+    }
+  }
+
+  int rowStart, rowEnd;
+  bt709_metrics_band_range(height, band->bandIndex, band->numBands, &rowStart, &rowEnd);
+
+  bt709_metrics_deltae_rows(band->tables, band->refFrame, band->frame, width, rowStart, rowEnd, &result->deltaESum, &result->deltaEMax);
+  result->numPixels += (uint64_t) width * (rowEnd - rowStart);
+
+  return NULL;
+}
+
+// Add the values in src into dst
+
+static inline
+void bt709_metrics_accumulate(BT709MetricsResult *dst, const BT709MetricsResult *src) {
+  for (int pi = 0; pi < 3; pi++) {
+    dst->sse[pi] += src->sse[pi];
+    dst->numSamples[pi] += src->numSamples[pi];
+    dst->ssimSum[pi] += src->ssimSum[pi];
+    dst->ssimCount[pi] += src->ssimCount[pi];
+  }
+  dst->deltaESum += src->deltaESum;
+  if (src->deltaEMax > dst->deltaEMax) {
+    dst->deltaEMax = src->deltaEMax;
+  }
+  dst->numPixels += src->numPixels;
+  dst->numFrames += src->numFrames;
+}
+
+// Score one frame against a reference frame of the same dimensions.
+// Returns 0 on success, 2 when SSIM column sums cannot be allocated.
+
+static inline
+int bt709_metrics_frame(const BT709MetricsTables *tables,
+                        const BT709MetricsFrame *refFrame,
+                        const BT709MetricsFrame *frame,
+                        int width, int height,
+                        int numThreads,
+                        BT709MetricsResult *result)
+{
+  if (numThreads < 1) {
+    numThreads = 1;
+  } else if (numThreads > BT709_METRICS_MAX_THREADS) {
+    numThreads = BT709_METRICS_MAX_THREADS;
+  }
+
+  BT709MetricsBand bands[BT709_METRICS_MAX_THREADS];
+  pthread_t threads[BT709_METRICS_MAX_THREADS];
+
+  for (int i = 0; i < numThreads; i++) {
+    BT709MetricsBand *band = &bands[i];
+    memset(band, 0, sizeof(BT709MetricsBand));
+    band->tables = tables;
+    band->refFrame = refFrame;
+    band->frame = frame;
+    band->width = width;
+    band->height = height;
+    band->bandIndex = i;
+    band->numBands = numThreads;
+  }
+
+  // Band 0 runs on the calling thread
+
+  int numStarted = 1;
+  for ( ; numStarted < numThreads; numStarted++) {
+    if (pthread_create(&threads[numStarted], NULL, bt709_metrics_band_thread, &bands[numStarted]) != 0) {
+      break;
+    }
+  }
+
+  bt709_metrics_band_thread(&bands[0]);
+
+  for (int i = 1; i < numStarted; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // Any band that could not get a thread is scored here
+
+  for (int i = numStarted; i < numThreads; i++) {
+    bt709_metrics_band_thread(&bands[i]);
+  }
+
+  int retcode = 0;
+
+  memset(result, 0, sizeof(BT709MetricsResult));
+  for (int i = 0; i < numThreads; i++) {
+    bt709_metrics_accumulate(result, &bands[i].result);
+    if (bands[i].retcode != 0) {
+      retcode = bands[i].retcode;
+    }
+  }
+  result->numFrames = 1;
+
+  return retcode;
+}
+
+static inline
+double bt709_metrics_result_psnr(const BT709MetricsResult *result, int planeIndex) {
+  return bt709_metrics_psnr(result->sse[planeIndex], result->numSamples[planeIndex]);
+}
+
+static inline
+double bt709_metrics_result_ssim(const BT709MetricsResult *result, int planeIndex) {
+  if (result->ssimCount[planeIndex] == 0) {
+    return 1.0;
+  }
+  return result->ssimSum[planeIndex] / result->ssimCount[planeIndex];
+}
+
+static inline
+double bt709_metrics_result_deltae(const BT709MetricsResult *result) {
+  if (result->numPixels == 0) {
+    return 0.0;
+  }
+  return result->deltaESum / result->numPixels;
+}
+
+#endif // _BT709_METRICS_H
@@ -0,0 +1,528 @@
+//
+//  bt709_pattern.h
+//
+//  Header only interface that generates test patterns for
+//  benchmark and calibration input: color bars, gamma and linear
+//  ramps, a gray sweep, a zone plate, random noise and an alpha
+//  fade. Frames are written straight into BGRA pixels or into
+//  BT.709 Y Cb Cr planes at 4:2:0 subsampling, so a corpus can be
+//  produced at memory speed without decoding images.
+//
+//  Most patterns are made of areas that do not change from one
+//  row to the next. Only the first row of each area is generated,
+//  spans of one color are filled with SSE2 or NEON stores, and the
+//  row is then copied down. For planar output the first row pair
+//  of an area is encoded with bt709_frame_encode_rows() and the
+//  encoded rows are copied the same way, so each color is converted
+//  once per row pair instead of once per pixel.
+//
+//  Every frame depends only on the pattern, frame index, and seed.
+//
+//  This module depends only on the C library and pthreads.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_PATTERN_H)
+#define _BT709_PATTERN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "bt709_frame.h"
+
+typedef enum {
+  // 75% bars over castellations and a PLUGE row, as in SMPTE EG 1
+  BT709PatternBars = 0,
+  // Horizontal ramp of evenly spaced sRGB code values
+  BT709PatternRamp,
+  // Horizontal ramp of evenly spaced linear light values
+  BT709PatternLinearRamp,
+  // Flat gray that steps from black to white over the frames
+  BT709PatternGraySweep,
+  // Circular zone plate that reaches Nyquist at the frame edge
+  BT709PatternZonePlate,
+  // Uniform random bytes
+  BT709PatternNoise,
+  // Red with an alpha ramp that scrolls one step per frame
+  BT709PatternAlphaFade
+} BT709Pattern;
+
+#define BT709_PATTERN_COUNT 7
+
+// Parse a pattern name as used on the command line, returns -1
+// when the name is not known.
+
+static inline
+int bt709_pattern_from_name(const char *name) {
+  static const char *names[BT709_PATTERN_COUNT] = {
+    "bars", "ramp", "linear-ramp", "sweep", "zoneplate", "noise", "alphafade"
+  };
+
+  for (int i = 0; i < BT709_PATTERN_COUNT; i++) {
+    if (strcmp(name, names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// A BGRA pixel as a little endian uint32_t
+
+static inline
+uint32_t bt709_pattern_pixel(int R, int G, int B, int A) {
+  return ((uint32_t) A << 24) | ((uint32_t) R << 16) | ((uint32_t) G << 8) | (uint32_t) B;
+}
+
+// Fill count pixels with one value
+
+static inline
+void bt709_pattern_fill32(uint8_t *outPtr, uint32_t pixel, int count) {
+  int i = 0;
+
+#if defined(__SSE2__)
+  __m128i v = _mm_set1_epi32((int) pixel);
+  for ( ; i <= (count - 4); i += 4) {
+    _mm_storeu_si128((__m128i *) (outPtr + (i * 4)), v);
+  }
+#elif defined(__ARM_NEON)
+  uint32x4_t v = vdupq_n_u32(pixel);
+  for ( ; i <= (count - 4); i += 4) {
+    vst1q_u8(outPtr + (i * 4), vreinterpretq_u8_u32(v));
+  }
+#endif
+
+  for ( ; i < count; i++) {
+    memcpy(outPtr + (i * 4), &pixel, 4);
+  }
+}
+
+// Copy the first row of [rowStart, rowEnd) to the other rows
+
+static inline
+void bt709_pattern_copy_down(uint8_t *ptr, int bytesPerRow, int rowBytes, int rowStart, int rowEnd) {
+  const uint8_t *firstRow = ptr + (rowStart * (size_t)bytesPerRow);
+  for (int row = rowStart + 1; row < rowEnd; row++) {
+    memcpy(ptr + (row * (size_t)bytesPerRow), firstRow, rowBytes);
+  }
+}
+
+// SMPTE bars in sRGB, 75% bars and the castellation row below them
+
+static const uint8_t bt709PatternBars[7][3] = {
+  { 191, 191, 191 }, { 191, 191, 0 }, { 0, 191, 191 }, { 0, 191, 0 },
+  { 191, 0, 191 }, { 191, 0, 0 }, { 0, 0, 191 }
+};
+
+static const uint8_t bt709PatternCastellations[7][3] = {
+  { 0, 0, 191 }, { 19, 19, 19 }, { 191, 0, 191 }, { 19, 19, 19 },
+  { 0, 191, 191 }, { 19, 19, 19 }, { 191, 191, 191 }
+};
+
+// -I, 100% white, +Q, black, then PLUGE below black, black and
+// above black, then black to the edge.
+
+static const uint8_t bt709PatternPluge[8][3] = {
+  { 0, 33, 76 }, { 255, 255, 255 }, { 50, 0, 106 }, { 19, 19, 19 },
+  { 9, 9, 9 }, { 19, 19, 19 }, { 29, 29, 29 }, { 19, 19, 19 }
+};
+
+// Bars split the frame into 3 areas, each with an even row count
+// so that planar output can encode whole row pairs.
+
+static inline
+void bt709_pattern_bars_areas(int height, int *areaEnds) {
+  areaEnds[0] = ((height * 2) / 3) & ~1;
+  areaEnds[1] = ((height * 3) / 4) & ~1;
+  areaEnds[2] = height;
+}
+
+// Write the first row of bars area areaIndex
+
+static inline
+void bt709_pattern_bars_row(int areaIndex, int width, uint8_t *outPtr) {
+  if (areaIndex < 2) {
+    const uint8_t (*colors)[3] = (areaIndex == 0) ? bt709PatternBars : bt709PatternCastellations;
+    for (int i = 0; i < 7; i++) {
+      const int start = (width * i) / 7;
+      const int end = (width * (i + 1)) / 7;
+      bt709_pattern_fill32(outPtr + (start * 4), bt709_pattern_pixel(colors[i][0], colors[i][1], colors[i][2], 0xFF), end - start);
+    }
+  } else {
+    // The first 4 blocks are as wide as 5/4 of a bar, the PLUGE
+    // strips are 1/3 of a bar wide each.
+
+    int ends[8];
+    for (int i = 0; i < 4; i++) {
+      ends[i] = (width * 5 * (i + 1)) / 28;
+    }
+    for (int i = 4; i < 7; i++) {
+      ends[i] = ((width * 5) / 7) + ((width * (i - 3)) / 21);
+    }
+    ends[7] = width;
+
+    int start = 0;
+    for (int i = 0; i < 8; i++) {
+      const uint8_t *c = bt709PatternPluge[i];
+      bt709_pattern_fill32(outPtr + (start * 4), bt709_pattern_pixel(c[0], c[1], c[2], 0xFF), ends[i] - start);
+      start = ends[i];
+    }
+  }
+}
+
+// Column ramp value from 0 to 255, the ramp scrolls left by one
+// column each frame.
+
+static inline
+int bt709_pattern_ramp_value(int col, int width, int frameIndex) {
+  const int x = (col + frameIndex) % width;
+  return (width == 1) ? 0 : (int) (((int64_t) x * 255 + ((width - 1) / 2)) / (width - 1));
+}
+
+// Write one row of a pattern that is the same on every row
+
+static inline
+void bt709_pattern_flat_row(BT709Pattern pattern, int frameIndex, int numFrames, int width, uint8_t *outPtr) {
+  switch (pattern) {
+    case BT709PatternRamp: {
+      for (int col = 0; col < width; col++) {
+        int v = bt709_pattern_ramp_value(col, width, frameIndex);
+        uint32_t pixel = bt709_pattern_pixel(v, v, v, 0xFF);
+        memcpy(outPtr + (col * 4), &pixel, 4);
+      }
+      break;
+    }
+    case BT709PatternLinearRamp: {
+      // Columns with the same ramp value share one pow() call
+
+      int lastV = -1;
+      uint32_t pixel = 0;
+      for (int col = 0; col < width; col++) {
+        int v = bt709_pattern_ramp_value(col, width, frameIndex);
+        if (v != lastV) {
+          int G = (int) round(sRGB_linearNormToNonLinear(v / 255.0f) * 255.0f);
+          pixel = bt709_pattern_pixel(G, G, G, 0xFF);
+          lastV = v;
+        }
+        memcpy(outPtr + (col * 4), &pixel, 4);
+      }
+      break;
+    }
+    case BT709PatternGraySweep: {
+      int G = (numFrames <= 1) ? 0 : (int) (((int64_t) (frameIndex % numFrames) * 255 + ((numFrames - 1) / 2)) / (numFrames - 1));
+      bt709_pattern_fill32(outPtr, bt709_pattern_pixel(G, G, G, 0xFF), width);
+      break;
+    }
+    case BT709PatternAlphaFade: {
+      for (int col = 0; col < width; col++) {
+        int A = bt709_pattern_ramp_value(col, width, frameIndex);
+        uint32_t pixel = bt709_pattern_pixel(0xFF, 0, 0, A);
+        memcpy(outPtr + (col * 4), &pixel, 4);
+      }
+      break;
+    }
+    default: {
+      break;
+    }
+  }
+}
+
+// Zone plate gray value for one pixel, cos is looked up in a table
+// of 1024 steps per cycle. The table is filled once with
+// pthread_once() so that frames can be generated on any thread.
+
+static inline
+uint8_t* bt709_pattern_cos_storage() {
+  static uint8_t table[1024];
+  return table;
+}
+
+static inline
+void bt709_pattern_cos_init() {
+  uint8_t *table = bt709_pattern_cos_storage();
+
+  for (int i = 0; i < 1024; i++) {
+    table[i] = (uint8_t) round((0.5 + (0.5 * cos((2.0 * M_PI * i) / 1024.0))) * 255.0);
+  }
+}
+
+static inline
+const uint8_t* bt709_pattern_cos_table() {
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, bt709_pattern_cos_init);
+  return bt709_pattern_cos_storage();
+}
+
+// The phase at distance r from the center is k * r^2 / 256 table
+// steps, its slope reaches 512 steps (half a cycle) per pixel at
+// the edge of the longer side.
+
+static inline
+void bt709_pattern_zone_row(int row, int frameIndex, int width, int height, uint8_t *grayPtr) {
+  const uint8_t *cosTable = bt709_pattern_cos_table();
+  const int maxDim = (width > height) ? width : height;
+  const int64_t k = 131072 / ((maxDim > 0) ? maxDim : 1);
+  const int64_t dy = (2 * row) - height + 1;
+  const int phase = frameIndex * 16;
+
+  for (int col = 0; col < width; col++) {
+    const int64_t dx = (2 * col) - width + 1;
+    // dx and dy are in half pixels, so r^2 is (dx^2 + dy^2) / 4
+    const int64_t r2 = (dx * dx) + (dy * dy);
+    grayPtr[col] = cosTable[(((k * r2) >> 10) + phase) & 1023];
+  }
+}
+
+// Expand a row of gray values into opaque BGRA pixels
+
+static inline
+void bt709_pattern_gray_row(const uint8_t *grayPtr, int width, uint8_t *outPtr) {
+  for (int col = 0; col < width; col++) {
+    uint32_t pixel = bt709_pattern_pixel(grayPtr[col], grayPtr[col], grayPtr[col], 0xFF);
+    memcpy(outPtr + (col * 4), &pixel, 4);
+  }
+}
+
+// splitmix64, used to seed each row so that a row does not depend
+// on any other row.
+
+static inline
+uint64_t bt709_pattern_mix(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Fill numBytes of random data for one row, orMask is applied to
+// every 8 bytes, for example to make BGRA alpha opaque.
+
+static inline
+void bt709_pattern_noise_row(uint32_t seed, int frameIndex, int row, int plane, uint8_t *outPtr, int numBytes, uint64_t orMask) {
+  uint64_t state = bt709_pattern_mix(((uint64_t) seed << 32) ^ ((uint64_t) frameIndex << 20) ^ ((uint64_t) plane << 16) ^ (uint64_t) row);
+  if (state == 0) {
+    state = 1;
+  }
+
+  int i = 0;
+  for ( ; i <= (numBytes - 8); i += 8) {
+    // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    uint64_t v = (state * 0x2545F4914F6CDD1DULL) | orMask;
+    memcpy(outPtr + i, &v, 8);
+  }
+
+  if (i < numBytes) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    uint64_t v = (state * 0x2545F4914F6CDD1DULL) | orMask;
+    memcpy(outPtr + i, &v, numBytes - i);
+  }
+}
+
+// Generate one frame of BGRA pixels. Returns 0 on success, 1 when
+// an argument is not valid and 2 when memory could not be allocated.
+
+static inline
+int bt709_pattern_bgra(BT709Pattern pattern,
+                       int frameIndex,
+                       int numFrames,
+                       uint32_t seed,
+                       int width,
+                       int height,
+                       uint8_t *outPixels,
+                       int outBytesPerRow)
+{
+  if (width <= 0 || height <= 0 || outBytesPerRow < (width * 4) || frameIndex < 0) {
+    return 1;
+  }
+
+  const int rowBytes = width * 4;
+
+  switch (pattern) {
+    case BT709PatternBars: {
+      int areaEnds[3];
+      bt709_pattern_bars_areas(height, areaEnds);
+
+      int rowStart = 0;
+      for (int i = 0; i < 3; i++) {
+        if (areaEnds[i] > rowStart) {
+          bt709_pattern_bars_row(i, width, outPixels + (rowStart * (size_t)outBytesPerRow));
+          bt709_pattern_copy_down(outPixels, outBytesPerRow, rowBytes, rowStart, areaEnds[i]);
+          rowStart = areaEnds[i];
+        }
+      }
+      return 0;
+    }
+    case BT709PatternRamp:
+    case BT709PatternLinearRamp:
+    case BT709PatternGraySweep:
+    case BT709PatternAlphaFade: {
+      bt709_pattern_flat_row(pattern, frameIndex, numFrames, width, outPixels);
+      bt709_pattern_copy_down(outPixels, outBytesPerRow, rowBytes, 0, height);
+      return 0;
+    }
+    case BT709PatternZonePlate: {
+      uint8_t *grayRow = (uint8_t *) malloc(width);
+      if (grayRow == NULL) {
+        return 2;
+      }
+      for (int row = 0; row < height; row++) {
+        bt709_pattern_zone_row(row, frameIndex, width, height, grayRow);
+        bt709_pattern_gray_row(grayRow, width, outPixels + (row * (size_t)outBytesPerRow));
+      }
+      free(grayRow);
+      return 0;
+    }
+    case BT709PatternNoise: {
+      for (int row = 0; row < height; row++) {
+        bt709_pattern_noise_row(seed, frameIndex, row, 0, outPixels + (row * (size_t)outBytesPerRow), rowBytes, 0xFF000000FF000000ULL);
+      }
+      return 0;
+    }
+    default: {
+      return 1;
+    }
+  }
+}
+
+// Encode the first row pair of [rowStart, rowEnd) from two BGRA
+// rows in scratch and copy the encoded rows down.
+
+static inline
+void bt709_pattern_encode_area(const BT709FrameTables *tables,
+                               const uint8_t *scratch,
+                               int width,
+                               int rowStart,
+                               int rowEnd,
+                               const BT709PlanesStruct *planes)
+{
+  const BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  BT709PlanesStruct areaPlanes = *planes;
+  areaPlanes.yPtr += (rowStart * (size_t)planes->yBytesPerRow);
+  areaPlanes.cbPtr += ((rowStart / 2) * (size_t)planes->cbBytesPerRow);
+  areaPlanes.crPtr += ((rowStart / 2) * (size_t)planes->crBytesPerRow);
+
+  bt709_frame_encode_rows(tables, &layout, scratch, width * 4, width, 0, 2, &areaPlanes);
+
+  // Both rows of the pair are the same so the first Y row is used
+
+  bt709_pattern_copy_down(planes->yPtr, planes->yBytesPerRow, width, rowStart, rowEnd);
+  bt709_pattern_copy_down(planes->cbPtr, planes->cbBytesPerRow, width / 2, rowStart / 2, rowEnd / 2);
+  bt709_pattern_copy_down(planes->crPtr, planes->crBytesPerRow, width / 2, rowStart / 2, rowEnd / 2);
+}
+
+// Generate one frame as Y Cb Cr planes encoded with tables, width and
+// height must both be even. Noise is written as random Y Cb Cr bytes,
+// including codes outside the video range. Other patterns match the
+// encode of the BGRA frame, except that the alpha fade is written as
+// the alpha channel frame, each alpha value encoded as gray as
+// srgb_to_bt709 -alpha does. Returns 0 on success, 1 when an argument
+// is not valid and 2 when memory could not be allocated.
+
+static inline
+int bt709_pattern_planes(const BT709FrameTables *tables,
+                         BT709Pattern pattern,
+                         int frameIndex,
+                         int numFrames,
+                         uint32_t seed,
+                         int width,
+                         int height,
+                         const BT709PlanesStruct *planes)
+{
+  if (width <= 0 || height <= 0 || (width % 2) != 0 || (height % 2) != 0 || frameIndex < 0) {
+    return 1;
+  }
+
+  const int chromaWidth = width / 2;
+  const int chromaHeight = height / 2;
+
+  if (pattern == BT709PatternNoise) {
+    for (int row = 0; row < height; row++) {
+      bt709_pattern_noise_row(seed, frameIndex, row, 0, planes->yPtr + (row * (size_t)planes->yBytesPerRow), width, 0);
+    }
+    for (int row = 0; row < chromaHeight; row++) {
+      bt709_pattern_noise_row(seed, frameIndex, row, 1, planes->cbPtr + (row * (size_t)planes->cbBytesPerRow), chromaWidth, 0);
+      bt709_pattern_noise_row(seed, frameIndex, row, 2, planes->crPtr + (row * (size_t)planes->crBytesPerRow), chromaWidth, 0);
+    }
+    return 0;
+  }
+
+  // A BGRA row pair is generated for each area and encoded once,
+  // the zone plate row pair after it is the gray row.
+
+  uint8_t *scratch = (uint8_t *) malloc((width * 4 * 2) + width);
+  if (scratch == NULL) {
+    return 2;
+  }
+
+  if (pattern == BT709PatternBars) {
+    int areaEnds[3];
+    bt709_pattern_bars_areas(height, areaEnds);
+
+    int rowStart = 0;
+    for (int i = 0; i < 3; i++) {
+      if (areaEnds[i] > rowStart) {
+        bt709_pattern_bars_row(i, width, scratch);
+        memcpy(scratch + (width * 4), scratch, width * 4);
+        bt709_pattern_encode_area(tables, scratch, width, rowStart, areaEnds[i], planes);
+        rowStart = areaEnds[i];
+      }
+    }
+  } else if (pattern == BT709PatternRamp || pattern == BT709PatternLinearRamp || pattern == BT709PatternGraySweep) {
+    bt709_pattern_flat_row(pattern, frameIndex, numFrames, width, scratch);
+    memcpy(scratch + (width * 4), scratch, width * 4);
+    bt709_pattern_encode_area(tables, scratch, width, 0, height, planes);
+  } else if (pattern == BT709PatternAlphaFade) {
+    // Each alpha value is encoded as an opaque gray pixel
+
+    for (int col = 0; col < width; col++) {
+      int A = bt709_pattern_ramp_value(col, width, frameIndex);
+      uint32_t pixel = bt709_pattern_pixel(A, A, A, 0xFF);
+      memcpy(scratch + (col * 4), &pixel, 4);
+    }
+    memcpy(scratch + (width * 4), scratch, width * 4);
+    bt709_pattern_encode_area(tables, scratch, width, 0, height, planes);
+  } else if (pattern == BT709PatternZonePlate) {
+    // Every row is different, so each row pair is encoded
+
+    const BT709PixelLayout layout = bt709_pixel_layout_bgra();
+    uint8_t *grayRow = scratch + (width * 4 * 2);
+
+    for (int row = 0; row < height; row += 2) {
+      bt709_pattern_zone_row(row, frameIndex, width, height, grayRow);
+      bt709_pattern_gray_row(grayRow, width, scratch);
+      bt709_pattern_zone_row(row + 1, frameIndex, width, height, grayRow);
+      bt709_pattern_gray_row(grayRow, width, scratch + (width * 4));
+
+      BT709PlanesStruct rowPlanes = *planes;
+      rowPlanes.yPtr += (row * (size_t)planes->yBytesPerRow);
+      rowPlanes.cbPtr += ((row / 2) * (size_t)planes->cbBytesPerRow);
+      rowPlanes.crPtr += ((row / 2) * (size_t)planes->crBytesPerRow);
+
+      bt709_frame_encode_rows(tables, &layout, scratch, width * 4, width, 0, 2, &rowPlanes);
+    }
+  } else {
+    free(scratch);
+    return 1;
+  }
+
+  free(scratch);
+  return 0;
+}
+
+#endif // _BT709_PATTERN_H
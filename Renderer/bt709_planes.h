@@ -0,0 +1,229 @@
+//
+//  bt709_planes.h
+//
+//  Header only interface for moving 8 bit planes between the
+//  layouts used on each side of the pipeline. Y4M files store
+//  Y Cb Cr as 3 separate planes (I420) while CoreVideo and Metal
+//  use a Y plane and an interleaved Cb Cr plane (NV12). Planes
+//  are copied with SSE2 or NEON and a row stride is given for
+//  each input and output so that padded CoreVideo rows can be
+//  read or written in place.
+//
+//  When the total output is larger than the last level cache,
+//  SSE2 non-temporal stores are used so that writing the output
+//  does not evict the input that is still to be read.
+//
+//  This module depends only on the C library.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_PLANES_H)
+#define _BT709_PLANES_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Output size in bytes above which non-temporal stores are used
+
+#if !defined(BT709_PLANES_STREAM_THRESHOLD)
+#define BT709_PLANES_STREAM_THRESHOLD (8 * 1024 * 1024)
+#endif
+
+// Non-temporal stores need 16 byte aligned output rows
+
+static inline
+int bt709_planes_use_stream(size_t numBytes, const void *ptr1, size_t bytesPerRow1, const void *ptr2, size_t bytesPerRow2) {
+#if defined(__SSE2__)
+  if (numBytes < BT709_PLANES_STREAM_THRESHOLD) {
+    return 0;
+  }
+  return ((((uintptr_t) ptr1) | ((uintptr_t) ptr2) | bytesPerRow1 | bytesPerRow2) & 15) == 0;
+#else
+  return 0;
+#endif // __SSE2__
+}
+
+static inline
+void bt709_planes_stream_fence(int useStream) {
+#if defined(__SSE2__)
+  if (useStream) {
+    _mm_sfence();
+  }
+#endif // __SSE2__
+}
+
+static inline
+void bt709_planes_copy_row(uint8_t *outPtr, const uint8_t *inPtr, size_t numBytes, int useStream) {
+#if defined(__SSE2__)
+  if (useStream) {
+    size_t i = 0;
+    for ( ; i + 64 <= numBytes; i += 64) {
+      __m128i v0 = _mm_loadu_si128((const __m128i *) (inPtr + i));
+      __m128i v1 = _mm_loadu_si128((const __m128i *) (inPtr + i + 16));
+      __m128i v2 = _mm_loadu_si128((const __m128i *) (inPtr + i + 32));
+      __m128i v3 = _mm_loadu_si128((const __m128i *) (inPtr + i + 48));
+      _mm_stream_si128((__m128i *) (outPtr + i), v0);
+      _mm_stream_si128((__m128i *) (outPtr + i + 16), v1);
+      _mm_stream_si128((__m128i *) (outPtr + i + 32), v2);
+      _mm_stream_si128((__m128i *) (outPtr + i + 48), v3);
+    }
+    memcpy(outPtr + i, inPtr + i, numBytes - i);
+    return;
+  }
+#endif // __SSE2__
+
+  memcpy(outPtr, inPtr, numBytes);
+}
+
+// Copy a plane of rowBytes x height bytes between buffers with
+// any row stride. When both strides equal rowBytes the plane is
+// copied as one block.
+
+static inline
+void bt709_planes_copy(uint8_t *outPtr,
+                       const size_t outBytesPerRow,
+                       const uint8_t *inPtr,
+                       const size_t inBytesPerRow,
+                       const size_t rowBytes,
+                       const int height)
+{
+#if defined(DEBUG)
+  assert(rowBytes <= outBytesPerRow);
+  assert(rowBytes <= inBytesPerRow);
+#endif // DEBUG
+
+  const int useStream = bt709_planes_use_stream(rowBytes * height, outPtr, outBytesPerRow, outPtr, outBytesPerRow);
+
+  if (inBytesPerRow == rowBytes && outBytesPerRow == rowBytes) {
+    bt709_planes_copy_row(outPtr, inPtr, rowBytes * height, useStream);
+  } else {
+    for (int row = 0; row < height; row++) {
+      bt709_planes_copy_row(outPtr + (row * outBytesPerRow), inPtr + (row * inBytesPerRow), rowBytes, useStream);
+    }
+  }
+
+  bt709_planes_stream_fence(useStream);
+}
+
+// Split an interleaved Cb Cr plane (NV12) into separate Cb and Cr
+// planes (I420), width is the number of Cb Cr pairs in a row.
+
+static inline
+void bt709_planes_deinterleave(uint8_t *cbPtr,
+                               const size_t cbBytesPerRow,
+                               uint8_t *crPtr,
+                               const size_t crBytesPerRow,
+                               const uint8_t *cbcrPtr,
+                               const size_t cbcrBytesPerRow,
+                               const int width,
+                               const int height)
+{
+  const int useStream = bt709_planes_use_stream((size_t) width * height * 2, cbPtr, cbBytesPerRow, crPtr, crBytesPerRow);
+
+  for (int row = 0; row < height; row++) {
+    const uint8_t *inRow = cbcrPtr + (row * cbcrBytesPerRow);
+    uint8_t *cbRow = cbPtr + (row * cbBytesPerRow);
+    uint8_t *crRow = crPtr + (row * crBytesPerRow);
+
+    int col = 0;
+
+#if defined(__SSE2__)
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+
+    for ( ; col + 16 <= width; col += 16) {
+      __m128i v0 = _mm_loadu_si128((const __m128i *) (inRow + (col * 2)));
+      __m128i v1 = _mm_loadu_si128((const __m128i *) (inRow + (col * 2) + 16));
+
+      __m128i cb = _mm_packus_epi16(_mm_and_si128(v0, lowMask), _mm_and_si128(v1, lowMask));
+      __m128i cr = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+
+      if (useStream) {
+        _mm_stream_si128((__m128i *) (cbRow + col), cb);
+        _mm_stream_si128((__m128i *) (crRow + col), cr);
+      } else {
+        _mm_storeu_si128((__m128i *) (cbRow + col), cb);
+        _mm_storeu_si128((__m128i *) (crRow + col), cr);
+      }
+    }
+#elif defined(__ARM_NEON)
+    for ( ; col + 16 <= width; col += 16) {
+      uint8x16x2_t cbcr = vld2q_u8(inRow + (col * 2));
+      vst1q_u8(cbRow + col, cbcr.val[0]);
+      vst1q_u8(crRow + col, cbcr.val[1]);
+    }
+#endif
+
+    for ( ; col < width; col++) {
+      cbRow[col] = inRow[(col * 2)];
+      crRow[col] = inRow[(col * 2) + 1];
+    }
+  }
+
+  bt709_planes_stream_fence(useStream);
+}
+
+// Join separate Cb and Cr planes (I420) into an interleaved Cb Cr
+// plane (NV12), width is the number of Cb Cr pairs in a row.
+
+static inline
+void bt709_planes_interleave(uint8_t *cbcrPtr,
+                             const size_t cbcrBytesPerRow,
+                             const uint8_t *cbPtr,
+                             const size_t cbBytesPerRow,
+                             const uint8_t *crPtr,
+                             const size_t crBytesPerRow,
+                             const int width,
+                             const int height)
+{
+  const int useStream = bt709_planes_use_stream((size_t) width * height * 2, cbcrPtr, cbcrBytesPerRow, cbcrPtr, cbcrBytesPerRow);
+
+  for (int row = 0; row < height; row++) {
+    uint8_t *outRow = cbcrPtr + (row * cbcrBytesPerRow);
+    const uint8_t *cbRow = cbPtr + (row * cbBytesPerRow);
+    const uint8_t *crRow = crPtr + (row * crBytesPerRow);
+
+    int col = 0;
+
+#if defined(__SSE2__)
+    for ( ; col + 16 <= width; col += 16) {
+      __m128i cb = _mm_loadu_si128((const __m128i *) (cbRow + col));
+      __m128i cr = _mm_loadu_si128((const __m128i *) (crRow + col));
+
+      __m128i v0 = _mm_unpacklo_epi8(cb, cr);
+      __m128i v1 = _mm_unpackhi_epi8(cb, cr);
+
+      if (useStream) {
+        _mm_stream_si128((__m128i *) (outRow + (col * 2)), v0);
+        _mm_stream_si128((__m128i *) (outRow + (col * 2) + 16), v1);
+      } else {
+        _mm_storeu_si128((__m128i *) (outRow + (col * 2)), v0);
+        _mm_storeu_si128((__m128i *) (outRow + (col * 2) + 16), v1);
+      }
+    }
+#elif defined(__ARM_NEON)
+    for ( ; col + 16 <= width; col += 16) {
+      uint8x16x2_t cbcr;
+      cbcr.val[0] = vld1q_u8(cbRow + col);
+      cbcr.val[1] = vld1q_u8(crRow + col);
+      vst2q_u8(outRow + (col * 2), cbcr);
+    }
+#endif
+
+    for ( ; col < width; col++) {
+      outRow[(col * 2)] = cbRow[col];
+      outRow[(col * 2) + 1] = crRow[col];
+    }
+  }
+
+  bt709_planes_stream_fence(useStream);
+}
+
+#endif // _BT709_PLANES_H
@@ -0,0 +1,344 @@
+//
+//  bt709_pyramid.h
+//
+//  Header only interface that generates reduced size proxy
+//  frames in the same pass as the full size BT.709 encode.
+//  Each pair of input rows is encoded with bt709_frame_encode_rows()
+//  and then averaged 2x2 in linear light into the next row of
+//  the 1/2 size level. Once a level holds a pair of rows, that
+//  pair is encoded into the level planes and averaged down into
+//  the next level, so 1/2, 1/4, and 1/8 proxies are produced
+//  while the input rows are still in cache. Each level keeps
+//  just 2 rows of linear float RGB as working memory.
+//
+//  A level is half the size of the level above it, rounded down.
+//  When a level ends up with an odd width or height, the last
+//  column or row is left out of the encoded planes for that
+//  level but is still averaged into the next level.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_PYRAMID_H)
+#define _BT709_PYRAMID_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "bt709_frame.h"
+#include "y4m_writer.h"
+
+#define BT709_PYRAMID_MAX_LEVELS 3
+
+typedef struct {
+  // Size of the linear light level before rounding down to even
+  int levelWidth;
+  int levelHeight;
+
+  // Size of the encoded planes, always even
+  int width;
+  int height;
+
+  // 2 rows of levelWidth linear (R G B) floats
+  float *rows;
+
+  // Number of rows generated so far in the current frame
+  int numRows;
+
+  // Encoded output, Y followed by Cb and Cr
+  uint8_t *yuvPtr;
+  BT709PlanesStruct planes;
+} BT709PyramidLevel;
+
+typedef struct {
+  const BT709FrameTables *tables;
+  int numLevels;
+  BT709PyramidLevel levels[BT709_PYRAMID_MAX_LEVELS];
+} BT709Pyramid;
+
+// Allocate numLevels proxy levels for a width x height input.
+// Returns 0 on success, 1 if the smallest level would be smaller
+// than 2x2, and 2 on allocation failure.
+
+static inline
+int bt709_pyramid_init(BT709Pyramid *pyramid,
+                       const BT709FrameTables *tables,
+                       const int width,
+                       const int height,
+                       const int numLevels)
+{
+  memset(pyramid, 0, sizeof(BT709Pyramid));
+  pyramid->tables = tables;
+
+  if (numLevels < 1 || numLevels > BT709_PYRAMID_MAX_LEVELS) {
+    return 1;
+  }
+
+  int levelWidth = width;
+  int levelHeight = height;
+
+  for (int i = 0; i < numLevels; i++) {
+    levelWidth /= 2;
+    levelHeight /= 2;
+
+    if (levelWidth < 2 || levelHeight < 2) {
+      return 1;
+    }
+  }
+
+  levelWidth = width;
+  levelHeight = height;
+
+  for (int i = 0; i < numLevels; i++) {
+    BT709PyramidLevel *level = &pyramid->levels[i];
+
+    levelWidth /= 2;
+    levelHeight /= 2;
+
+    level->levelWidth = levelWidth;
+    level->levelHeight = levelHeight;
+    level->width = levelWidth & ~1;
+    level->height = levelHeight & ~1;
+
+    int yLen = level->width * level->height;
+    int uvLen = (level->width / 2) * (level->height / 2);
+
+    level->rows = (float *) malloc(2 * levelWidth * 3 * sizeof(float));
+    level->yuvPtr = (uint8_t *) malloc(yLen + 2 * uvLen);
+
+    pyramid->numLevels = i + 1;
+
+    if (level->rows == NULL || level->yuvPtr == NULL) {
+      return 2;
+    }
+
+    level->planes.yPtr = level->yuvPtr;
+    level->planes.yBytesPerRow = level->width;
+    level->planes.cbPtr = level->yuvPtr + yLen;
+    level->planes.cbBytesPerRow = level->width / 2;
+    level->planes.crPtr = level->planes.cbPtr + uvLen;
+    level->planes.crBytesPerRow = level->width / 2;
+  }
+
+  return 0;
+}
+
+static inline
+void bt709_pyramid_free(BT709Pyramid *pyramid) {
+  for (int i = 0; i < pyramid->numLevels; i++) {
+    free(pyramid->levels[i].rows);
+    free(pyramid->levels[i].yuvPtr);
+  }
+  pyramid->numLevels = 0;
+}
+
+// Encode one pair of linear float rows into 4:2:0 planes, this is
+// the same per pixel logic as bt709_frame_encode_rows() except that
+// the input values are already linear.
+
+static inline
+void bt709_pyramid_encode_linear_rows(const BT709FrameTables *tables,
+                                      const float *inRow1,
+                                      const float *inRow2,
+                                      const int width,
+                                      uint8_t *outYRow1,
+                                      uint8_t *outYRow2,
+                                      uint8_t *outCbRow,
+                                      uint8_t *outCrRow)
+{
+#if defined(DEBUG)
+  assert((width % 2) == 0);
+#endif // DEBUG
+
+  for (int col = 0; col < width; col += 2) {
+    const float *p1 = inRow1 + (col * 3);
+    const float *p2 = p1 + 3;
+    const float *p3 = inRow2 + (col * 3);
+    const float *p4 = p3 + 3;
+
+    int Y1, Y2, Y3, Y4, CbIgnored, CrIgnored;
+
+    BT709_convertNonLinearRGBToYCbCr(byteNorm(bt709_frame_from_linear(tables, p1[0])),
+                                     byteNorm(bt709_frame_from_linear(tables, p1[1])),
+                                     byteNorm(bt709_frame_from_linear(tables, p1[2])),
+                                     &Y1, &CbIgnored, &CrIgnored);
+    BT709_convertNonLinearRGBToYCbCr(byteNorm(bt709_frame_from_linear(tables, p2[0])),
+                                     byteNorm(bt709_frame_from_linear(tables, p2[1])),
+                                     byteNorm(bt709_frame_from_linear(tables, p2[2])),
+                                     &Y2, &CbIgnored, &CrIgnored);
+    BT709_convertNonLinearRGBToYCbCr(byteNorm(bt709_frame_from_linear(tables, p3[0])),
+                                     byteNorm(bt709_frame_from_linear(tables, p3[1])),
+                                     byteNorm(bt709_frame_from_linear(tables, p3[2])),
+                                     &Y3, &CbIgnored, &CrIgnored);
+    BT709_convertNonLinearRGBToYCbCr(byteNorm(bt709_frame_from_linear(tables, p4[0])),
+                                     byteNorm(bt709_frame_from_linear(tables, p4[1])),
+                                     byteNorm(bt709_frame_from_linear(tables, p4[2])),
+                                     &Y4, &CbIgnored, &CrIgnored);
+
+    float Rave = BT709_average_cbcr_linear(p1[0], p2[0], p3[0], p4[0]);
+    float Gave = BT709_average_cbcr_linear(p1[1], p2[1], p3[1], p4[1]);
+    float Bave = BT709_average_cbcr_linear(p1[2], p2[2], p3[2], p4[2]);
+
+    int YIgnored, Cb, Cr;
+
+    BT709_convertNonLinearRGBToYCbCr(byteNorm(bt709_frame_from_linear(tables, Rave)),
+                                     byteNorm(bt709_frame_from_linear(tables, Gave)),
+                                     byteNorm(bt709_frame_from_linear(tables, Bave)),
+                                     &YIgnored, &Cb, &Cr);
+
+    outYRow1[col] = Y1;
+    outYRow1[col+1] = Y2;
+    outYRow2[col] = Y3;
+    outYRow2[col+1] = Y4;
+
+    outCbRow[col/2] = Cb;
+    outCrRow[col/2] = Cr;
+  }
+}
+
+// Average the pair of rows held in a level into the next level.
+// Returns 0 when the next level is already full.
+
+static inline
+int bt709_pyramid_push_average(BT709Pyramid *pyramid, int levelNum) {
+  BT709PyramidLevel *level = &pyramid->levels[levelNum];
+  BT709PyramidLevel *next = &pyramid->levels[levelNum+1];
+
+  if (next->numRows >= next->levelHeight) {
+    return 0;
+  }
+
+  const float *inRow1 = level->rows;
+  const float *inRow2 = level->rows + (level->levelWidth * 3);
+  float *outRow = next->rows + ((next->numRows % 2) * next->levelWidth * 3);
+
+  for (int col = 0; col < next->levelWidth; col++) {
+    const float *p1 = inRow1 + (col * 2 * 3);
+    const float *p3 = inRow2 + (col * 2 * 3);
+    for (int c = 0; c < 3; c++) {
+      outRow[(col * 3) + c] = BT709_average_cbcr_linear(p1[c], p1[3+c], p3[c], p3[3+c]);
+    }
+  }
+
+  next->numRows += 1;
+  return 1;
+}
+
+// Called after a row has been stored in a level. When the level
+// holds a complete pair of rows, encode the pair and push the
+// average down into the next level, which may complete a pair
+// there in turn.
+
+static inline
+void bt709_pyramid_level_row_done(BT709Pyramid *pyramid, int levelNum) {
+  for ( ; levelNum < pyramid->numLevels && levelNum < BT709_PYRAMID_MAX_LEVELS; levelNum++) {
+    BT709PyramidLevel *level = &pyramid->levels[levelNum];
+
+    if ((level->numRows % 2) != 0) {
+      return;
+    }
+
+    int row = level->numRows - 2;
+
+    if (row < level->height) {
+      const BT709PlanesStruct *planes = &level->planes;
+
+      uint8_t *outYRow1 = planes->yPtr + (row * (size_t)planes->yBytesPerRow);
+      uint8_t *outYRow2 = outYRow1 + planes->yBytesPerRow;
+      uint8_t *outCbRow = planes->cbPtr + ((row / 2) * (size_t)planes->cbBytesPerRow);
+      uint8_t *outCrRow = planes->crPtr + ((row / 2) * (size_t)planes->crBytesPerRow);
+
+      bt709_pyramid_encode_linear_rows(pyramid->tables,
+                                       level->rows,
+                                       level->rows + (level->levelWidth * 3),
+                                       level->width,
+                                       outYRow1, outYRow2, outCbRow, outCrRow);
+    }
+
+    if ((levelNum + 1) >= pyramid->numLevels || (levelNum + 1) >= BT709_PYRAMID_MAX_LEVELS) {
+      return;
+    }
+
+    if (bt709_pyramid_push_average(pyramid, levelNum) == 0) {
+      return;
+    }
+  }
+}
+
+// Convert a full frame into planes and fill in the planes of every
+// proxy level in the same pass. Width and height must both be even.
+// Returns 0 on success.
+
+static inline
+int bt709_pyramid_encode(BT709Pyramid *pyramid,
+                         const BT709PixelLayout *layout,
+                         const uint8_t *inPixels,
+                         const int inBytesPerRow,
+                         const int width,
+                         const int height,
+                         const BT709PlanesStruct *planes)
+{
+  if ((width % 2) != 0 || (height % 2) != 0) {
+    return 1;
+  }
+
+  const BT709FrameTables *tables = pyramid->tables;
+  const float *toLinear = tables->toLinear;
+
+  const int bpp = layout->bytesPerPixel;
+  const int rOff = layout->rOffset;
+  const int gOff = layout->gOffset;
+  const int bOff = layout->bOffset;
+
+  for (int i = 0; i < pyramid->numLevels; i++) {
+    pyramid->levels[i].numRows = 0;
+  }
+
+  BT709PyramidLevel *first = (pyramid->numLevels > 0) ? &pyramid->levels[0] : NULL;
+
+  for (int row = 0; row < height; row += 2) {
+    bt709_frame_encode_rows(tables, layout, inPixels, inBytesPerRow, width, row, row + 2, planes);
+
+    if (first == NULL || first->numRows >= first->levelHeight) {
+      continue;
+    }
+
+    const uint8_t *inRow1 = inPixels + (row * (size_t)inBytesPerRow);
+    const uint8_t *inRow2 = inRow1 + inBytesPerRow;
+    float *outRow = first->rows + ((first->numRows % 2) * first->levelWidth * 3);
+
+    for (int col = 0; col < first->levelWidth; col++) {
+      const uint8_t *p1 = inRow1 + (col * 2 * bpp);
+      const uint8_t *p2 = p1 + bpp;
+      const uint8_t *p3 = inRow2 + (col * 2 * bpp);
+      const uint8_t *p4 = p3 + bpp;
+
+      float *outPixel = outRow + (col * 3);
+      outPixel[0] = BT709_average_cbcr_linear(toLinear[p1[rOff]], toLinear[p2[rOff]], toLinear[p3[rOff]], toLinear[p4[rOff]]);
+      outPixel[1] = BT709_average_cbcr_linear(toLinear[p1[gOff]], toLinear[p2[gOff]], toLinear[p3[gOff]], toLinear[p4[gOff]]);
+      outPixel[2] = BT709_average_cbcr_linear(toLinear[p1[bOff]], toLinear[p2[bOff]], toLinear[p3[bOff]], toLinear[p4[bOff]]);
+    }
+
+    first->numRows += 1;
+    bt709_pyramid_level_row_done(pyramid, 0);
+  }
+
+  return 0;
+}
+
+// Fill in a frame descriptor for the encoded planes of one level
+
+static inline
+void bt709_pyramid_level_frame(const BT709Pyramid *pyramid, int levelNum, Y4MFrameStruct *fs) {
+  const BT709PyramidLevel *level = &pyramid->levels[levelNum];
+  fs->yPtr = level->planes.yPtr;
+  fs->yLen = level->width * level->height;
+  fs->uPtr = level->planes.cbPtr;
+  fs->uLen = (level->width / 2) * (level->height / 2);
+  fs->vPtr = level->planes.crPtr;
+  fs->vLen = fs->uLen;
+}
+
+#endif // _BT709_PYRAMID_H
@@ -0,0 +1,319 @@
+//
+//  bt709_stats.h
+//
+//  Header only interface that collects per plane statistics from
+//  8 bit Y Cb Cr frames at 4:2:0 subsampling. Each plane is counted
+//  into a 256 entry histogram, and min, max, mean, the number of
+//  codes outside the video range (Y outside 16-235, Cb Cr outside
+//  16-240) and the mean chroma drift from 128 are all derived from
+//  the histogram, so the inner loop does nothing but count.
+//
+//  Samples are counted into 4 interleaved sub histograms so that
+//  runs of the same value do not stall on one counter. A block of
+//  16 samples that all have the same value, which is common in flat
+//  or gray areas, is detected with SSE2 or NEON and counted with a
+//  single add. A frame is split into row bands that are counted on
+//  separate threads.
+//
+//  This module depends only on the C library and pthreads.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_STATS_H)
+#define _BT709_STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "bt709_frame.h"
+
+#define BT709_STATS_MAX_THREADS 64
+
+// Video range limits, a code below min or above max is out of range
+
+#define BT709_STATS_Y_MIN 16
+#define BT709_STATS_Y_MAX 235
+#define BT709_STATS_C_MIN 16
+#define BT709_STATS_C_MAX 240
+
+// Results for one frame, or the sum over many frames
+
+typedef struct {
+  // Index 0 is Y, 1 is Cb, 2 is Cr
+  uint64_t histogram[3][256];
+  uint64_t numSamples[3];
+
+  int numFrames;
+} BT709StatsResult;
+
+// Count width samples into 4 sub histograms of 256 entries each.
+// Sub histogram counters are 32 bit, so a caller must flush them
+// before 2^32 samples have been counted.
+
+static inline
+void bt709_stats_count_row(const uint8_t *ptr, int width, uint32_t *counts) {
+  uint32_t *c0 = counts;
+  uint32_t *c1 = counts + 256;
+  uint32_t *c2 = counts + 512;
+  uint32_t *c3 = counts + 768;
+
+  int i = 0;
+
+  for ( ; i <= (width - 16); i += 16) {
+    const uint8_t *p = ptr + i;
+
+#if defined(__SSE2__)
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    __m128i first = _mm_set1_epi8((char) p[0]);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, first)) == 0xFFFF) {
+      c0[p[0]] += 16;
+      continue;
+    }
+#elif defined(__ARM_NEON)
+    uint8x16_t v = vld1q_u8(p);
+    uint64x2_t eq = vreinterpretq_u64_u8(vceqq_u8(v, vdupq_n_u8(p[0])));
+    if ((vgetq_lane_u64(eq, 0) & vgetq_lane_u64(eq, 1)) == UINT64_MAX) {
+      c0[p[0]] += 16;
+      continue;
+    }
+#endif
+
+    for (int j = 0; j < 16; j += 4) {
+      c0[p[j]] += 1;
+      c1[p[j + 1]] += 1;
+      c2[p[j + 2]] += 1;
+      c3[p[j + 3]] += 1;
+    }
+  }
+
+  for ( ; i < width; i++) {
+    c0[ptr[i]] += 1;
+  }
+}
+
+// Count rows [rowStart, rowEnd) of a plane and add the result
+// into histogram.
+
+static inline
+void bt709_stats_count_plane(const uint8_t *ptr,
+                             const int bytesPerRow,
+                             const int width,
+                             const int rowStart,
+                             const int rowEnd,
+                             uint64_t *histogram)
+{
+  uint32_t counts[4 * 256];
+  memset(counts, 0, sizeof(counts));
+
+  // Flush well before a 32 bit sub histogram entry could overflow
+
+  const int flushRows = (int) ((UINT32_MAX / 2) / ((width > 0) ? width : 1));
+  int numRows = 0;
+
+  for (int row = rowStart; row < rowEnd; row++) {
+    bt709_stats_count_row(ptr + (row * (size_t)bytesPerRow), width, counts);
+
+    numRows += 1;
+    if (numRows == flushRows || row == (rowEnd - 1)) {
+      for (int v = 0; v < 256; v++) {
+        histogram[v] += (uint64_t) counts[v] + counts[256 + v] + counts[512 + v] + counts[768 + v];
+      }
+      memset(counts, 0, sizeof(counts));
+      numRows = 0;
+    }
+  }
+}
+
+typedef struct {
+  const BT709PlanesStruct *planes;
+  int width;
+  int height;
+  int bandIndex;
+  int numBands;
+  BT709StatsResult result;
+} BT709StatsBand;
+
+static inline
+void* bt709_stats_band_thread(void *arg) {
+  BT709StatsBand *band = (BT709StatsBand *) arg;
+  const BT709PlanesStruct *p = band->planes;
+
+  const uint8_t *planes[3] = { p->yPtr, p->cbPtr, p->crPtr };
+  const int rowBytes[3] = { p->yBytesPerRow, p->cbBytesPerRow, p->crBytesPerRow };
+
+  for (int pi = 0; pi < 3; pi++) {
+    const int planeWidth = (pi == 0) ? band->width : (band->width / 2);
+    const int planeHeight = (pi == 0) ? band->height : (band->height / 2);
+
+    const int rowStart = (int) (((int64_t) planeHeight * band->bandIndex) / band->numBands);
+    const int rowEnd = (int) (((int64_t) planeHeight * (band->bandIndex + 1)) / band->numBands);
+
+    bt709_stats_count_plane(planes[pi], rowBytes[pi], planeWidth, rowStart, rowEnd, band->result.histogram[pi]);
+    band->result.numSamples[pi] += (uint64_t) planeWidth * (rowEnd - rowStart);
+  }
+
+  return NULL;
+}
+
+// Add the values in src into dst
+
+static inline
+void bt709_stats_accumulate(BT709StatsResult *dst, const BT709StatsResult *src) {
+  for (int pi = 0; pi < 3; pi++) {
+    for (int v = 0; v < 256; v++) {
+      dst->histogram[pi][v] += src->histogram[pi][v];
+    }
+    dst->numSamples[pi] += src->numSamples[pi];
+  }
+  dst->numFrames += src->numFrames;
+}
+
+// Count one frame, width and height must both be even. Returns 0
+// on success.
+
+static inline
+int bt709_stats_frame(const BT709PlanesStruct *planes,
+                      int width, int height,
+                      int numThreads,
+                      BT709StatsResult *result)
+{
+  if ((width % 2) != 0 || (height % 2) != 0) {
+    return 1;
+  }
+
+  if (numThreads < 1) {
+    numThreads = 1;
+  } else if (numThreads > BT709_STATS_MAX_THREADS) {
+    numThreads = BT709_STATS_MAX_THREADS;
+  }
+  if (numThreads > (height / 2)) {
+    numThreads = height / 2;
+  }
+
+  // Each band holds 3 histograms, too large for the stack
+
+  BT709StatsBand *bands = (BT709StatsBand *) calloc(numThreads, sizeof(BT709StatsBand));
+  if (bands == NULL) {
+    return 2;
+  }
+  pthread_t threads[BT709_STATS_MAX_THREADS];
+
+  for (int i = 0; i < numThreads; i++) {
+    BT709StatsBand *band = &bands[i];
+    band->planes = planes;
+    band->width = width;
+    band->height = height;
+    band->bandIndex = i;
+    band->numBands = numThreads;
+  }
+
+  // Band 0 runs on the calling thread
+
+  int numStarted = 1;
+  for ( ; numStarted < numThreads; numStarted++) {
+    if (pthread_create(&threads[numStarted], NULL, bt709_stats_band_thread, &bands[numStarted]) != 0) {
+      break;
+    }
+  }
+
+  bt709_stats_band_thread(&bands[0]);
+
+  for (int i = 1; i < numStarted; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // Any band that could not get a thread is counted here
+
+  for (int i = numStarted; i < numThreads; i++) {
+    bt709_stats_band_thread(&bands[i]);
+  }
+
+  memset(result, 0, sizeof(BT709StatsResult));
+  for (int i = 0; i < numThreads; i++) {
+    bt709_stats_accumulate(result, &bands[i].result);
+  }
+  result->numFrames = 1;
+
+  free(bands);
+
+  return 0;
+}
+
+// Smallest and largest code in a plane, -1 when there are no samples
+
+static inline
+int bt709_stats_result_min(const BT709StatsResult *result, int planeIndex) {
+  for (int v = 0; v < 256; v++) {
+    if (result->histogram[planeIndex][v] != 0) {
+      return v;
+    }
+  }
+  return -1;
+}
+
+static inline
+int bt709_stats_result_max(const BT709StatsResult *result, int planeIndex) {
+  for (int v = 255; v >= 0; v--) {
+    if (result->histogram[planeIndex][v] != 0) {
+      return v;
+    }
+  }
+  return -1;
+}
+
+static inline
+double bt709_stats_result_mean(const BT709StatsResult *result, int planeIndex) {
+  if (result->numSamples[planeIndex] == 0) {
+    return 0.0;
+  }
+  uint64_t sum = 0;
+  for (int v = 0; v < 256; v++) {
+    sum += result->histogram[planeIndex][v] * v;
+  }
+  return (double) sum / result->numSamples[planeIndex];
+}
+
+// Mean distance of a chroma plane from the neutral value 128, a
+// gray source should give 0.0 for both Cb and Cr.
+
+static inline
+double bt709_stats_result_drift(const BT709StatsResult *result, int planeIndex) {
+  return bt709_stats_result_mean(result, planeIndex) - 128.0;
+}
+
+// Number of samples below and above the video range of a plane
+
+static inline
+void bt709_stats_result_out_of_range(const BT709StatsResult *result,
+                                     int planeIndex,
+                                     uint64_t *belowPtr,
+                                     uint64_t *abovePtr)
+{
+  const int minCode = (planeIndex == 0) ? BT709_STATS_Y_MIN : BT709_STATS_C_MIN;
+  const int maxCode = (planeIndex == 0) ? BT709_STATS_Y_MAX : BT709_STATS_C_MAX;
+
+  uint64_t below = 0;
+  uint64_t above = 0;
+
+  for (int v = 0; v < minCode; v++) {
+    below += result->histogram[planeIndex][v];
+  }
+  for (int v = maxCode + 1; v < 256; v++) {
+    above += result->histogram[planeIndex][v];
+  }
+
+  *belowPtr = below;
+  *abovePtr = above;
+}
+
+#endif // _BT709_STATS_H
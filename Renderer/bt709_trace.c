@@ -0,0 +1,339 @@
+//
+//  bt709_trace.c
+//
+//  Event storage and output for bt709_trace.h, this file
+//  compiles to nothing unless BT709_TRACE is defined.
+//
+//  Licensed under BSD terms.
+
+#if defined(BT709_TRACE)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#include "bt709_trace.h"
+
+typedef enum {
+  BT709TraceEventComplete = 0,
+  BT709TraceEventCounter = 1
+} BT709TraceEventType;
+
+typedef struct {
+  const char *name;
+  BT709TraceEventType type;
+  int threadNum;
+  uint64_t startNanos;
+  // duration for a complete event, value for a counter
+  int64_t value;
+} BT709TraceEvent;
+
+// Each thread appends to its own list of fixed size chunks, so
+// recording an event takes no lock. A chunk is never moved once
+// allocated and numEvents and next are published with release
+// stores, so output can walk every thread while events are added.
+
+#define BT709_TRACE_CHUNK_EVENTS 4096
+
+typedef struct BT709TraceChunk {
+  struct BT709TraceChunk *next;
+  int numEvents;
+  BT709TraceEvent events[BT709_TRACE_CHUNK_EVENTS];
+} BT709TraceChunk;
+
+typedef struct BT709TraceThread {
+  struct BT709TraceThread *next;
+  int threadNum;
+  BT709TraceChunk *first;
+  BT709TraceChunk *last;
+} BT709TraceThread;
+
+// Guards the list of threads, taken once per thread and for output
+
+static pthread_mutex_t bt709TraceMutex = PTHREAD_MUTEX_INITIALIZER;
+static BT709TraceThread *bt709TraceThreads = NULL;
+static BT709TraceThread **bt709TraceThreadsTail = &bt709TraceThreads;
+static int bt709TraceNumThreads = 0;
+static uint64_t bt709TraceStartNanos = 0;
+
+// Events of the calling thread, its threadNum is a small number used
+// as the tid of the trace track, 0 is the thread that called
+// bt709_trace_start().
+
+static __thread BT709TraceThread *bt709TraceThread = NULL;
+
+uint64_t bt709_trace_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static
+BT709TraceChunk* bt709_trace_chunk_alloc(void) {
+  BT709TraceChunk *chunk = (BT709TraceChunk *) malloc(sizeof(BT709TraceChunk));
+  if (chunk != NULL) {
+    chunk->next = NULL;
+    chunk->numEvents = 0;
+  }
+  return chunk;
+}
+
+// Return the events of the calling thread, registered on first use
+
+static
+BT709TraceThread* bt709_trace_thread(void) {
+  if (bt709TraceThread != NULL) {
+    return bt709TraceThread;
+  }
+
+  BT709TraceThread *thread = (BT709TraceThread *) malloc(sizeof(BT709TraceThread));
+  BT709TraceChunk *chunk = bt709_trace_chunk_alloc();
+  if (thread == NULL || chunk == NULL) {
+    free(thread);
+    free(chunk);
+    return NULL;
+  }
+
+  thread->next = NULL;
+  thread->first = chunk;
+  thread->last = chunk;
+
+  pthread_mutex_lock(&bt709TraceMutex);
+  thread->threadNum = bt709TraceNumThreads++;
+  *bt709TraceThreadsTail = thread;
+  bt709TraceThreadsTail = &thread->next;
+  pthread_mutex_unlock(&bt709TraceMutex);
+
+  bt709TraceThread = thread;
+  return thread;
+}
+
+static
+void bt709_trace_append(BT709TraceEvent *event) {
+  BT709TraceThread *thread = bt709_trace_thread();
+  if (thread == NULL) {
+    return;
+  }
+
+  BT709TraceChunk *chunk = thread->last;
+
+  if (chunk->numEvents == BT709_TRACE_CHUNK_EVENTS) {
+    BT709TraceChunk *nextChunk = bt709_trace_chunk_alloc();
+    if (nextChunk == NULL) {
+      return;
+    }
+    __atomic_store_n(&chunk->next, nextChunk, __ATOMIC_RELEASE);
+    thread->last = nextChunk;
+    chunk = nextChunk;
+  }
+
+  event->threadNum = thread->threadNum;
+  chunk->events[chunk->numEvents] = *event;
+  __atomic_store_n(&chunk->numEvents, chunk->numEvents + 1, __ATOMIC_RELEASE);
+}
+
+// Call func for each recorded event, thread by thread in the order
+// the threads recorded their first event. Caller holds the mutex.
+
+static
+void bt709_trace_each_event(void (*func)(const BT709TraceEvent *event, void *ctx), void *ctx) {
+  for (BT709TraceThread *thread = bt709TraceThreads; thread != NULL; thread = thread->next) {
+    for (BT709TraceChunk *chunk = thread->first; chunk != NULL; chunk = __atomic_load_n(&chunk->next, __ATOMIC_ACQUIRE)) {
+      const int numEvents = __atomic_load_n(&chunk->numEvents, __ATOMIC_ACQUIRE);
+      for (int i = 0; i < numEvents; i++) {
+        func(&chunk->events[i], ctx);
+      }
+    }
+  }
+}
+
+void bt709_trace_complete(const char *name, uint64_t startNanos, uint64_t endNanos) {
+  BT709TraceEvent event;
+  event.name = name;
+  event.type = BT709TraceEventComplete;
+  event.startNanos = startNanos;
+  event.value = (int64_t) (endNanos - startNanos);
+  bt709_trace_append(&event);
+}
+
+void bt709_trace_counter(const char *name, int64_t value) {
+  BT709TraceEvent event;
+  event.name = name;
+  event.type = BT709TraceEventCounter;
+  event.startNanos = bt709_trace_now();
+  event.value = value;
+  bt709_trace_append(&event);
+}
+
+// Records are written with the separator in front, so that the
+// output is valid JSON for any number of threads and events.
+
+typedef struct {
+  FILE *outFile;
+  const char *sep;
+} BT709TraceJSONWriter;
+
+static
+void bt709_trace_write_event(const BT709TraceEvent *event, void *ctx) {
+  BT709TraceJSONWriter *writer = (BT709TraceJSONWriter *) ctx;
+
+  // Trace timestamps are in microseconds relative to process start
+  double ts = (event->startNanos - bt709TraceStartNanos) / 1000.0;
+
+  if (event->type == BT709TraceEventComplete) {
+    fprintf(writer->outFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}\n",
+            writer->sep, event->name, event->threadNum, ts, event->value / 1000.0);
+  } else {
+    fprintf(writer->outFile, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}\n",
+            writer->sep, event->name, event->threadNum, ts, (long long) event->value);
+  }
+
+  writer->sep = ",";
+}
+
+int bt709_trace_write_json(const char *path) {
+  FILE *outFile = fopen(path, "w");
+  if (outFile == NULL) {
+    fprintf(stderr, "could not open trace file \"%s\"\n", path);
+    return 1;
+  }
+
+  pthread_mutex_lock(&bt709TraceMutex);
+
+  fprintf(outFile, "{\"traceEvents\":[\n");
+
+  BT709TraceJSONWriter writer;
+  writer.outFile = outFile;
+  writer.sep = "";
+
+  for (int i = 0; i < bt709TraceNumThreads; i++) {
+    fprintf(outFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}\n",
+            writer.sep, i, (i == 0) ? "main" : "worker", i);
+    writer.sep = ",";
+  }
+
+  bt709_trace_each_event(bt709_trace_write_event, &writer);
+
+  fprintf(outFile, "],\"displayTimeUnit\":\"ms\"}\n");
+
+  pthread_mutex_unlock(&bt709TraceMutex);
+
+  if (fclose(outFile) != 0) {
+    return 1;
+  }
+
+  return 0;
+}
+
+typedef struct {
+  const char *name;
+  int count;
+  uint64_t totalNanos;
+  uint64_t minNanos;
+  uint64_t maxNanos;
+} BT709TraceStageSummary;
+
+// Stages are listed in order of first appearance, the number of
+// distinct names is small so a linear search is fine.
+
+#define BT709_TRACE_MAX_STAGES 256
+
+typedef struct {
+  BT709TraceStageSummary stages[BT709_TRACE_MAX_STAGES];
+  int numStages;
+} BT709TraceSummary;
+
+static
+void bt709_trace_summarize_event(const BT709TraceEvent *event, void *ctx) {
+  BT709TraceSummary *summary = (BT709TraceSummary *) ctx;
+  BT709TraceStageSummary *stages = summary->stages;
+
+  if (event->type != BT709TraceEventComplete) {
+    return;
+  }
+
+  int si = 0;
+  for ( ; si < summary->numStages; si++) {
+    if (strcmp(stages[si].name, event->name) == 0) {
+      break;
+    }
+  }
+  if (si == summary->numStages) {
+    if (si == BT709_TRACE_MAX_STAGES) {
+      return;
+    }
+    stages[si].name = event->name;
+    stages[si].minNanos = UINT64_MAX;
+    summary->numStages++;
+  }
+
+  uint64_t dur = (uint64_t) event->value;
+  BT709TraceStageSummary *stage = &stages[si];
+  stage->count += 1;
+  stage->totalNanos += dur;
+  if (dur < stage->minNanos) {
+    stage->minNanos = dur;
+  }
+  if (dur > stage->maxNanos) {
+    stage->maxNanos = dur;
+  }
+}
+
+void bt709_trace_print_summary(FILE *outFile) {
+  BT709TraceSummary *summary = (BT709TraceSummary *) calloc(1, sizeof(BT709TraceSummary));
+  if (summary == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&bt709TraceMutex);
+
+  bt709_trace_each_event(bt709_trace_summarize_event, summary);
+
+  double wallMs = (bt709_trace_now() - bt709TraceStartNanos) / 1000000.0;
+
+  fprintf(outFile, "%-32s %8s %12s %10s %10s %10s %7s\n", "stage", "count", "total ms", "mean ms", "min ms", "max ms", "% wall");
+
+  for (int si = 0; si < summary->numStages; si++) {
+    BT709TraceStageSummary *stage = &summary->stages[si];
+    double totalMs = stage->totalNanos / 1000000.0;
+    fprintf(outFile, "%-32s %8d %12.3f %10.3f %10.3f %10.3f %6.1f%%\n",
+            stage->name,
+            stage->count,
+            totalMs,
+            totalMs / stage->count,
+            stage->minNanos / 1000000.0,
+            stage->maxNanos / 1000000.0,
+            (wallMs > 0.0) ? (100.0 * totalMs / wallMs) : 0.0);
+  }
+
+  fprintf(outFile, "wall time %.3f ms, %d threads\n", wallMs, bt709TraceNumThreads);
+
+  pthread_mutex_unlock(&bt709TraceMutex);
+
+  free(summary);
+}
+
+static
+void bt709_trace_finish(void) {
+  bt709_trace_print_summary(stderr);
+
+  const char *path = getenv("BT709_TRACE_FILE");
+  if (path != NULL && bt709_trace_write_json(path) == 0) {
+    fprintf(stderr, "wrote trace %s\n", path);
+  }
+}
+
+void bt709_trace_start(void) {
+  bt709TraceStartNanos = bt709_trace_now();
+
+  // The thread that starts tracing is always track 0
+  bt709_trace_thread();
+
+  atexit(bt709_trace_finish);
+}
+
+#endif // BT709_TRACE
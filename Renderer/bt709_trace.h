@@ -0,0 +1,102 @@
+//
+//  bt709_trace.h
+//
+//  Lightweight timing instrumentation for the conversion pipeline.
+//  Stages are wrapped in scoped timers and values can be recorded
+//  as counters. At exit a per stage summary table is printed to
+//  stderr and, when the BT709_TRACE_FILE environment variable
+//  names a file, the events are written as Chrome trace event JSON
+//  that can be opened in chrome://tracing or Perfetto. Each thread
+//  that records events gets its own track.
+//
+//  Tracing is compiled in only when BT709_TRACE is defined, which
+//  also requires bt709_trace.c to be linked. Otherwise every macro
+//  expands to nothing and there is no runtime cost.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_BT709_TRACE_H)
+#define _BT709_TRACE_H
+
+#if defined(BT709_TRACE)
+
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct {
+  const char *name;
+  uint64_t startNanos;
+} BT709TraceScope;
+
+// Record process start time and register the atexit() output handler
+
+void bt709_trace_start(void);
+
+uint64_t bt709_trace_now(void);
+
+// Name must be a string literal or otherwise outlive the trace
+
+void bt709_trace_complete(const char *name, uint64_t startNanos, uint64_t endNanos);
+
+void bt709_trace_counter(const char *name, int64_t value);
+
+// Write events as Chrome trace JSON, returns 0 on success
+
+int bt709_trace_write_json(const char *path);
+
+void bt709_trace_print_summary(FILE *outFile);
+
+static inline
+BT709TraceScope bt709_trace_scope_begin(const char *name) {
+  BT709TraceScope scope;
+  scope.name = name;
+  scope.startNanos = bt709_trace_now();
+  return scope;
+}
+
+static inline
+void bt709_trace_scope_end(BT709TraceScope *scope) {
+  bt709_trace_complete(scope->name, scope->startNanos, bt709_trace_now());
+}
+
+#if defined(__cplusplus)
+}
+#endif
+
+#define BT709_TRACE_CONCAT2(a, b) a ## b
+#define BT709_TRACE_CONCAT(a, b) BT709_TRACE_CONCAT2(a, b)
+
+#define BT709_TRACE_START() bt709_trace_start()
+
+// Time from this point to the end of the enclosing block
+
+#define BT709_TRACE_SCOPE(name) \
+  BT709TraceScope BT709_TRACE_CONCAT(bt709TraceScope, __LINE__) \
+  __attribute__((cleanup(bt709_trace_scope_end))) = bt709_trace_scope_begin(name)
+
+// Time a section that does not map to a block, BEGIN and END
+// must appear in the same block with the same tag.
+
+#define BT709_TRACE_BEGIN(tag, name) \
+  BT709TraceScope bt709TraceScope_ ## tag = bt709_trace_scope_begin(name)
+
+#define BT709_TRACE_END(tag) \
+  bt709_trace_scope_end(&bt709TraceScope_ ## tag)
+
+#define BT709_TRACE_COUNTER(name, value) bt709_trace_counter(name, (int64_t) (value))
+
+#else // BT709_TRACE
+
+#define BT709_TRACE_START()
+#define BT709_TRACE_SCOPE(name)
+#define BT709_TRACE_BEGIN(tag, name)
+#define BT709_TRACE_END(tag)
+#define BT709_TRACE_COUNTER(name, value)
+
+#endif // BT709_TRACE
+
+#endif // _BT709_TRACE_H
@@ -0,0 +1,341 @@
+//
+//  raw_frame_reader.h
+//
+//  Header only interface that reads a continuous stream of
+//  uncompressed frames. A stream is either a series of PAM (P7)
+//  or binary PPM (P6) images where each frame carries a header,
+//  or headerless BGRA frames where the dimensions are given once.
+//
+//  Input can be stdin or any pipe, in which case each frame is read
+//  into a reused buffer. When input is a regular file, the file
+//  is mapped and frame pointers point directly into the mapping
+//  so that no copy is made.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_RAW_FRAME_READER_H)
+#define _RAW_FRAME_READER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bt709_frame.h"
+
+typedef enum {
+  RawFrameFormatBGRA = 0, // headerless, dimensions given once
+  RawFrameFormatNetpbm = 1 // PAM (P7) or PPM (P6), header per frame
+} RawFrameFormat;
+
+typedef struct {
+  RawFrameFormat format;
+  int width;
+  int height;
+
+  // Layout of pixels in the current frame, PAM RGB_ALPHA input
+  // has 4 bytes per pixel while PPM and PAM RGB have 3.
+  BT709PixelLayout layout;
+
+  // Stream input
+  FILE *inFile;
+  uint8_t *frameBuffer;
+  size_t frameBufferLen;
+
+  // Mapped input
+  int fd;
+  uint8_t *mapPtr;
+  size_t mapLen;
+  size_t mapOffset;
+
+  int frameNum;
+} RawFrameReader;
+
+// Read one byte of header data, returns -1 at end of input
+
+static inline
+int raw_frame_reader_getc(RawFrameReader *reader) {
+  if (reader->mapPtr != NULL) {
+    if (reader->mapOffset >= reader->mapLen) {
+      return -1;
+    }
+    return reader->mapPtr[reader->mapOffset++];
+  } else {
+    return getc(reader->inFile);
+  }
+}
+
+// Read a whitespace delimited token from a Netpbm header,
+// comment lines that begin with '#' are skipped. Returns
+// the token length or -1 at end of input.
+
+static inline
+int raw_frame_reader_token(RawFrameReader *reader, char *token, int maxLen) {
+  int c;
+
+  // Skip leading whitespace and comments
+
+  while (1) {
+    c = raw_frame_reader_getc(reader);
+    if (c == -1) {
+      return -1;
+    }
+    if (c == '#') {
+      while (c != '\n' && c != -1) {
+        c = raw_frame_reader_getc(reader);
+      }
+      continue;
+    }
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      continue;
+    }
+    break;
+  }
+
+  int len = 0;
+
+  while (c != -1 && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+    if (len < (maxLen - 1)) {
+      token[len++] = (char) c;
+    }
+    c = raw_frame_reader_getc(reader);
+  }
+
+  token[len] = '\0';
+  return len;
+}
+
+// Parse the header of the next PAM or PPM frame. Returns 0 on
+// success, 1 when there is no more input, and 2 on a parse error.
+
+static inline
+int raw_frame_reader_parse_netpbm(RawFrameReader *reader, int *widthPtr, int *heightPtr, BT709PixelLayout *layoutPtr) {
+  char token[64];
+
+  if (raw_frame_reader_token(reader, token, sizeof(token)) == -1) {
+    return 1;
+  }
+
+  int width = -1;
+  int height = -1;
+  int maxval = -1;
+  int depth = 3;
+
+  if (strcmp(token, "P6") == 0) {
+    int *fields[3] = { &width, &height, &maxval };
+    for (int i = 0; i < 3; i++) {
+      if (raw_frame_reader_token(reader, token, sizeof(token)) <= 0) {
+        return 2;
+      }
+      *fields[i] = atoi(token);
+    }
+    // Exactly one whitespace char after maxval was consumed by the token read
+  } else if (strcmp(token, "P7") == 0) {
+    while (1) {
+      if (raw_frame_reader_token(reader, token, sizeof(token)) <= 0) {
+        return 2;
+      }
+
+      if (strcmp(token, "ENDHDR") == 0) {
+        break;
+      }
+
+      char value[64];
+      if (raw_frame_reader_token(reader, value, sizeof(value)) <= 0) {
+        return 2;
+      }
+
+      if (strcmp(token, "WIDTH") == 0) {
+        width = atoi(value);
+      } else if (strcmp(token, "HEIGHT") == 0) {
+        height = atoi(value);
+      } else if (strcmp(token, "DEPTH") == 0) {
+        depth = atoi(value);
+      } else if (strcmp(token, "MAXVAL") == 0) {
+        maxval = atoi(value);
+      } else if (strcmp(token, "TUPLTYPE") == 0) {
+        if (strcmp(value, "RGB") != 0 && strcmp(value, "RGB_ALPHA") != 0) {
+          fprintf(stderr, "unsupported PAM TUPLTYPE \"%s\"\n", value);
+          return 2;
+        }
+      }
+    }
+  } else {
+    fprintf(stderr, "raw input frame must begin with P6 or P7 but found \"%s\"\n", token);
+    return 2;
+  }
+
+  if (width <= 0 || height <= 0) {
+    return 2;
+  }
+
+  if (maxval != 255) {
+    fprintf(stderr, "raw input frame MAXVAL must be 255 but found %d\n", maxval);
+    return 2;
+  }
+
+  if (depth == 3) {
+    *layoutPtr = bt709_pixel_layout_rgb();
+  } else if (depth == 4) {
+    *layoutPtr = bt709_pixel_layout_rgba();
+  } else {
+    fprintf(stderr, "raw input frame DEPTH must be 3 or 4 but found %d\n", depth);
+    return 2;
+  }
+
+  *widthPtr = width;
+  *heightPtr = height;
+
+  return 0;
+}
+
+// Open input stream, "-" indicates stdin. When format is
+// RawFrameFormatBGRA then width and height must be passed,
+// otherwise they can be zero and are read from the first
+// frame header. Returns 0 on success.
+
+static inline
+int raw_frame_reader_open(RawFrameReader *reader, const char *inPath, RawFrameFormat format, int width, int height) {
+  memset(reader, 0, sizeof(RawFrameReader));
+  reader->fd = -1;
+  reader->format = format;
+  reader->width = width;
+  reader->height = height;
+
+  if (format == RawFrameFormatBGRA) {
+    if (width <= 0 || height <= 0) {
+      fprintf(stderr, "width and height must be given for BGRA raw input\n");
+      return 1;
+    }
+    reader->layout = bt709_pixel_layout_bgra();
+  }
+
+  if (strcmp(inPath, "-") == 0) {
+    reader->inFile = stdin;
+    return 0;
+  }
+
+  int fd = open(inPath, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "could not open raw input file \"%s\"\n", inPath);
+    return 1;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *ptr = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) {
+      // Frames are consumed front to back exactly once
+      madvise(ptr, (size_t) st.st_size, MADV_SEQUENTIAL);
+      reader->fd = fd;
+      reader->mapPtr = (uint8_t *) ptr;
+      reader->mapLen = (size_t) st.st_size;
+      return 0;
+    }
+  }
+
+  // Named pipe or a file that cannot be mapped, read as a stream
+
+  reader->inFile = fdopen(fd, "rb");
+  if (reader->inFile == NULL) {
+    close(fd);
+    return 1;
+  }
+
+  return 0;
+}
+
+// Get a pointer to the pixels of the next frame. The pointer is valid
+// until the next call. Returns 0 on success, 1 at the end of the
+// stream, and 2 on a read or format error.
+
+static inline
+int raw_frame_reader_next(RawFrameReader *reader, const uint8_t **framePtr) {
+  if (reader->format == RawFrameFormatNetpbm) {
+    int width, height;
+    BT709PixelLayout layout;
+
+    int result = raw_frame_reader_parse_netpbm(reader, &width, &height, &layout);
+    if (result != 0) {
+      return result;
+    }
+
+    if (reader->frameNum == 0 && reader->width == 0) {
+      reader->width = width;
+      reader->height = height;
+    } else if (width != reader->width || height != reader->height) {
+      fprintf(stderr, "raw input frame %d is %d x %d but expected %d x %d\n", reader->frameNum, width, height, reader->width, reader->height);
+      return 2;
+    }
+
+    reader->layout = layout;
+  }
+
+  size_t frameLen = (size_t) reader->width * reader->height * reader->layout.bytesPerPixel;
+
+  if (reader->mapPtr != NULL) {
+    if (reader->mapOffset == reader->mapLen) {
+      return 1;
+    }
+    if ((reader->mapLen - reader->mapOffset) < frameLen) {
+      fprintf(stderr, "raw input truncated in frame %d\n", reader->frameNum);
+      return 2;
+    }
+    *framePtr = reader->mapPtr + reader->mapOffset;
+    reader->mapOffset += frameLen;
+  } else {
+    if (reader->frameBufferLen < frameLen) {
+      free(reader->frameBuffer);
+      reader->frameBuffer = (uint8_t *) malloc(frameLen);
+      if (reader->frameBuffer == NULL) {
+        return 2;
+      }
+      reader->frameBufferLen = frameLen;
+    }
+
+    size_t numRead = fread(reader->frameBuffer, 1, frameLen, reader->inFile);
+
+    if (numRead == 0 && reader->format == RawFrameFormatBGRA && feof(reader->inFile)) {
+      return 1;
+    }
+    if (numRead != frameLen) {
+      fprintf(stderr, "raw input truncated in frame %d\n", reader->frameNum);
+      return 2;
+    }
+
+    *framePtr = reader->frameBuffer;
+  }
+
+  reader->frameNum += 1;
+
+  return 0;
+}
+
+static inline
+void raw_frame_reader_close(RawFrameReader *reader) {
+  if (reader->mapPtr != NULL) {
+    munmap(reader->mapPtr, reader->mapLen);
+    reader->mapPtr = NULL;
+  }
+  if (reader->inFile != NULL && reader->inFile != stdin) {
+    fclose(reader->inFile);
+    // fclose() also closed the descriptor
+    reader->fd = -1;
+  }
+  reader->inFile = NULL;
+  if (reader->fd != -1) {
+    close(reader->fd);
+    reader->fd = -1;
+  }
+  free(reader->frameBuffer);
+  reader->frameBuffer = NULL;
+  reader->frameBufferLen = 0;
+}
+
+#endif // _RAW_FRAME_READER_H
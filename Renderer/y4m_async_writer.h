@@ -0,0 +1,482 @@
+//
+//  y4m_async_writer.h
+//
+//  Header only interface that writes a Y4M stream from a
+//  background thread. Frames are converted directly into one
+//  of 2 or 3 page aligned frame buffers while the previously
+//  converted frame is being written, so that conversion of
+//  frame N+1 overlaps with the write of frame N.
+//
+//  When the output is a regular file, the file is opened with
+//  O_DIRECT (F_NOCACHE on Apple platforms) so that frame data
+//  does not pass through the page cache. Direct writes must
+//  cover whole blocks, so the bytes at the end of a frame that
+//  do not fill a block are carried over into the next write.
+//  Note that glibc only defines O_DIRECT when _GNU_SOURCE is
+//  defined, without it buffered writes are used.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_Y4M_ASYNC_WRITER_H)
+#define _Y4M_ASYNC_WRITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "y4m_writer.h"
+
+// Direct writes are aligned to this size in both file
+// offset and memory address.
+
+#define Y4M_ASYNC_WRITER_ALIGN 4096
+
+#define Y4M_ASYNC_WRITER_MAX_BUFFERS 3
+
+typedef struct {
+  // Page aligned allocation, the frame record starts at dataOffset
+  uint8_t *buffer;
+  // Offset of "FRAME\n" in buffer, the bytes before it are
+  // filled with bytes carried over from the previous frame.
+  int dataOffset;
+} Y4MAsyncWriterSlot;
+
+typedef struct {
+  int fd;
+  int isDirect;
+  int align;
+
+  int width;
+  int height;
+  int frameLen; // "FRAME\n" + Y + U + V
+
+  int numBuffers;
+  Y4MAsyncWriterSlot slots[Y4M_ASYNC_WRITER_MAX_BUFFERS];
+
+  // Bytes at the end of the stream that do not fill a whole block
+  uint8_t *carry;
+  int carryLen;
+
+  // Total number of stream bytes submitted so far, including the header
+  uint64_t streamOffset;
+
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int threadStarted;
+
+  // Ring of slots, guarded by mutex
+  int nextAcquire;
+  int nextWrite;
+  int numQueued;   // submitted and waiting for the write thread
+  int numInFlight; // acquired or queued, not yet written
+  int isAcquired;
+  int isDone;
+  int error;
+
+  // Stats
+  int numFrames;
+  int numStalls;
+  double stallSeconds;
+  double writeSeconds;
+  uint64_t bytesWritten;
+  double openTime;
+} Y4MAsyncWriter;
+
+static inline
+double y4m_async_writer_now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+// Write all bytes, a short write is retried. Returns 0 on success.
+
+static inline
+int y4m_async_writer_write_all(int fd, const uint8_t *ptr, size_t len) {
+  while (len > 0) {
+    ssize_t numWritten = write(fd, ptr, len);
+    if (numWritten < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return 2;
+    }
+    ptr += numWritten;
+    len -= (size_t) numWritten;
+  }
+  return 0;
+}
+
+// Write the frame record in slot, along with carried over bytes
+// from the previous write. Called from the write thread only.
+
+static inline
+int y4m_async_writer_write_slot(Y4MAsyncWriter *writer, Y4MAsyncWriterSlot *slot) {
+#if defined(DEBUG)
+  assert(slot->dataOffset == writer->carryLen);
+#endif // DEBUG
+
+  memcpy(slot->buffer, writer->carry, writer->carryLen);
+
+  size_t len = (size_t) writer->carryLen + writer->frameLen;
+  size_t alignedLen = len - (len % writer->align);
+
+  double startTime = y4m_async_writer_now();
+
+  if (y4m_async_writer_write_all(writer->fd, slot->buffer, alignedLen) != 0) {
+    return 2;
+  }
+
+  writer->writeSeconds += y4m_async_writer_now() - startTime;
+  writer->bytesWritten += alignedLen;
+
+  writer->carryLen = (int) (len - alignedLen);
+  memcpy(writer->carry, slot->buffer + alignedLen, writer->carryLen);
+
+  return 0;
+}
+
+static inline
+void* y4m_async_writer_thread(void *arg) {
+  Y4MAsyncWriter *writer = (Y4MAsyncWriter *) arg;
+
+  pthread_mutex_lock(&writer->mutex);
+
+  while (1) {
+    while (writer->numQueued == 0 && !writer->isDone) {
+      pthread_cond_wait(&writer->cond, &writer->mutex);
+    }
+
+    if (writer->numQueued == 0) {
+      // isDone and nothing left to write
+      break;
+    }
+
+    Y4MAsyncWriterSlot *slot = &writer->slots[writer->nextWrite];
+
+    pthread_mutex_unlock(&writer->mutex);
+
+    int result = 0;
+    if (writer->error == 0) {
+      result = y4m_async_writer_write_slot(writer, slot);
+    }
+
+    pthread_mutex_lock(&writer->mutex);
+
+    if (result != 0) {
+      writer->error = result;
+    }
+
+    writer->nextWrite = (writer->nextWrite + 1) % writer->numBuffers;
+    writer->numQueued -= 1;
+    writer->numInFlight -= 1;
+
+    pthread_cond_broadcast(&writer->cond);
+  }
+
+  pthread_mutex_unlock(&writer->mutex);
+
+  return NULL;
+}
+
+// Open the output path, "-" writes to stdout. numBuffers must be 2 or 3.
+// When useDirect is non-zero and the output is a regular file then
+// writes bypass the page cache. Returns 0 on success.
+
+static inline
+int y4m_async_writer_open(Y4MAsyncWriter *writer, const char *outFilePath, int width, int height, int numBuffers, int useDirect) {
+  memset(writer, 0, sizeof(Y4MAsyncWriter));
+  writer->fd = -1;
+
+  if (numBuffers < 2 || numBuffers > Y4M_ASYNC_WRITER_MAX_BUFFERS) {
+    fprintf(stderr, "async Y4M output needs 2 or 3 buffers but got %d\n", numBuffers);
+    return 1;
+  }
+
+  if (strcmp(outFilePath, "-") == 0) {
+    writer->fd = dup(STDOUT_FILENO);
+    useDirect = 0;
+  } else {
+#if defined(O_DIRECT)
+    if (useDirect) {
+      writer->fd = open(outFilePath, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+      if (writer->fd != -1) {
+        writer->isDirect = 1;
+      }
+    }
+#endif // O_DIRECT
+    if (writer->fd == -1) {
+      // No O_DIRECT or the filesystem does not support it
+      writer->fd = open(outFilePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+#if defined(F_NOCACHE)
+    if (useDirect && writer->fd != -1 && fcntl(writer->fd, F_NOCACHE, 1) == 0) {
+      writer->isDirect = 1;
+    }
+#endif // F_NOCACHE
+  }
+
+  if (writer->fd == -1) {
+    fprintf(stderr, "could not open output Y4M file \"%s\"\n", outFilePath);
+    return 1;
+  }
+
+  // Block alignment only matters when the OS enforces it for
+  // O_DIRECT, with F_NOCACHE aligned writes are just faster.
+
+  writer->align = writer->isDirect ? Y4M_ASYNC_WRITER_ALIGN : 1;
+
+  writer->width = width;
+  writer->height = height;
+  writer->frameLen = 6 + (width * height) + 2 * ((width/2) * (height/2));
+  writer->numBuffers = numBuffers;
+
+  size_t slotLen = Y4M_ASYNC_WRITER_ALIGN + writer->frameLen;
+  slotLen += Y4M_ASYNC_WRITER_ALIGN - (slotLen % Y4M_ASYNC_WRITER_ALIGN);
+
+  for (int i = 0; i < numBuffers; i++) {
+    if (posix_memalign((void **) &writer->slots[i].buffer, Y4M_ASYNC_WRITER_ALIGN, slotLen) != 0) {
+      writer->slots[i].buffer = NULL;
+      return 1;
+    }
+  }
+
+  if (posix_memalign((void **) &writer->carry, Y4M_ASYNC_WRITER_ALIGN, Y4M_ASYNC_WRITER_ALIGN) != 0) {
+    writer->carry = NULL;
+    return 1;
+  }
+
+  pthread_mutex_init(&writer->mutex, NULL);
+  pthread_cond_init(&writer->cond, NULL);
+
+  if (pthread_create(&writer->thread, NULL, y4m_async_writer_thread, writer) != 0) {
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    return 1;
+  }
+  writer->threadStarted = 1;
+
+  writer->openTime = y4m_async_writer_now();
+
+  return 0;
+}
+
+// Emit the stream header, must be called once before the first frame.
+
+static inline
+int y4m_async_writer_write_header(Y4MAsyncWriter *writer, Y4MHeaderStruct *hsPtr) {
+#if defined(DEBUG)
+  assert(writer->streamOffset == 0);
+#endif // DEBUG
+
+  // The header is small, so it becomes the carry of the first frame
+
+  FILE *memFile = fmemopen(writer->carry, Y4M_ASYNC_WRITER_ALIGN, "wb");
+  if (memFile == NULL) {
+    return 2;
+  }
+
+  int result = y4m_write_header(memFile, hsPtr);
+  long headerLen = ftell(memFile);
+  fclose(memFile);
+
+  if (result != 0) {
+    return result;
+  }
+
+  writer->carryLen = (int) headerLen;
+  writer->streamOffset = headerLen;
+
+  if (writer->align == 1) {
+    // Not aligned, so just write it now
+    if (y4m_async_writer_write_all(writer->fd, writer->carry, headerLen) != 0) {
+      return 2;
+    }
+    writer->bytesWritten += headerLen;
+    writer->carryLen = 0;
+  }
+
+  return 0;
+}
+
+// Get plane pointers for the next frame, the caller converts
+// pixels directly into these planes and then calls submit.
+// Blocks when all buffers are waiting to be written.
+// Returns 0 on success, 2 when a previous write failed.
+
+static inline
+int y4m_async_writer_acquire(Y4MAsyncWriter *writer, Y4MFrameStruct *fsPtr) {
+  pthread_mutex_lock(&writer->mutex);
+
+#if defined(DEBUG)
+  assert(writer->isAcquired == 0);
+#endif // DEBUG
+
+  if (writer->numInFlight == writer->numBuffers && writer->error == 0) {
+    // Conversion is ahead of the disk, wait for a buffer
+    double startTime = y4m_async_writer_now();
+    writer->numStalls += 1;
+    while (writer->numInFlight == writer->numBuffers && writer->error == 0) {
+      pthread_cond_wait(&writer->cond, &writer->mutex);
+    }
+    writer->stallSeconds += y4m_async_writer_now() - startTime;
+  }
+
+  int error = writer->error;
+
+  if (error == 0) {
+    writer->numInFlight += 1;
+    writer->isAcquired = 1;
+  }
+
+  pthread_mutex_unlock(&writer->mutex);
+
+  if (error != 0) {
+    return error;
+  }
+
+  Y4MAsyncWriterSlot *slot = &writer->slots[writer->nextAcquire];
+
+  // Frame record starts at the stream offset within a block, the
+  // carried over bytes of the previous block are copied in front.
+
+  slot->dataOffset = (int) (writer->streamOffset % writer->align);
+
+  uint8_t *ptr = slot->buffer + slot->dataOffset;
+  memcpy(ptr, "FRAME\n", 6);
+  ptr += 6;
+
+  int yLen = writer->width * writer->height;
+  int uvLen = (writer->width/2) * (writer->height/2);
+
+  fsPtr->yPtr = ptr;
+  fsPtr->yLen = yLen;
+  fsPtr->uPtr = ptr + yLen;
+  fsPtr->uLen = uvLen;
+  fsPtr->vPtr = ptr + yLen + uvLen;
+  fsPtr->vLen = uvLen;
+
+  return 0;
+}
+
+// Queue the acquired frame to be written by the write thread.
+
+static inline
+int y4m_async_writer_submit(Y4MAsyncWriter *writer) {
+  pthread_mutex_lock(&writer->mutex);
+
+#if defined(DEBUG)
+  assert(writer->isAcquired == 1);
+#endif // DEBUG
+
+  writer->isAcquired = 0;
+  writer->nextAcquire = (writer->nextAcquire + 1) % writer->numBuffers;
+  writer->numQueued += 1;
+  writer->numFrames += 1;
+  writer->streamOffset += writer->frameLen;
+
+  int error = writer->error;
+
+  pthread_cond_broadcast(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+
+  return error;
+}
+
+// Copy planes that were converted elsewhere, same
+// interface as y4m_write_frame().
+
+static inline
+int y4m_async_writer_write_frame(Y4MAsyncWriter *writer, Y4MFrameStruct *fsPtr) {
+  Y4MFrameStruct outFs;
+
+  int result = y4m_async_writer_acquire(writer, &outFs);
+  if (result != 0) {
+    return result;
+  }
+
+  memcpy(outFs.yPtr, fsPtr->yPtr, outFs.yLen);
+  memcpy(outFs.uPtr, fsPtr->uPtr, outFs.uLen);
+  memcpy(outFs.vPtr, fsPtr->vPtr, outFs.vLen);
+
+  return y4m_async_writer_submit(writer);
+}
+
+// Wait for all queued frames, write the final partial block,
+// and release resources. Returns 0 when every write succeeded.
+
+static inline
+int y4m_async_writer_close(Y4MAsyncWriter *writer) {
+  if (writer->threadStarted) {
+    pthread_mutex_lock(&writer->mutex);
+    writer->isDone = 1;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+
+    pthread_join(writer->thread, NULL);
+    writer->threadStarted = 0;
+
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+  }
+
+  int result = writer->error;
+
+  if (writer->fd != -1) {
+    if (result == 0 && writer->carryLen > 0) {
+      // A direct write of the final partial block would fail,
+      // so turn off direct writes for the tail.
+#if defined(O_DIRECT)
+      if (writer->isDirect) {
+        int flags = fcntl(writer->fd, F_GETFL);
+        fcntl(writer->fd, F_SETFL, flags & ~O_DIRECT);
+      }
+#endif // O_DIRECT
+      result = y4m_async_writer_write_all(writer->fd, writer->carry, writer->carryLen);
+      writer->bytesWritten += writer->carryLen;
+      writer->carryLen = 0;
+    }
+
+    if (close(writer->fd) != 0 && result == 0) {
+      result = 2;
+    }
+    writer->fd = -1;
+  }
+
+  for (int i = 0; i < Y4M_ASYNC_WRITER_MAX_BUFFERS; i++) {
+    free(writer->slots[i].buffer);
+    writer->slots[i].buffer = NULL;
+  }
+
+  free(writer->carry);
+  writer->carry = NULL;
+
+  return result;
+}
+
+// Print write throughput and how often conversion had to wait
+// for a free buffer. Frequent stalls mean output is the bottleneck.
+
+static inline
+void y4m_async_writer_print_stats(Y4MAsyncWriter *writer, FILE *outFile) {
+  double elapsed = y4m_async_writer_now() - writer->openTime;
+  double mb = writer->bytesWritten / (1024.0 * 1024.0);
+
+  fprintf(outFile, "async Y4M output : %d frames, %.1f MB, %s\n", writer->numFrames, mb, writer->isDirect ? "direct" : "buffered");
+  fprintf(outFile, "write %.1f MB/s while writing, %.1f MB/s overall\n",
+          (writer->writeSeconds > 0.0) ? (mb / writer->writeSeconds) : 0.0,
+          (elapsed > 0.0) ? (mb / elapsed) : 0.0);
+  fprintf(outFile, "queue stalls %d (%.3f sec waiting for a free buffer)\n", writer->numStalls, writer->stallSeconds);
+}
+
+#endif // _Y4M_ASYNC_WRITER_H
@@ -0,0 +1,182 @@
+//
+//  y4m_journal.h
+//
+//  Header only interface that records the progress of a long
+//  running Y4M encode so that it can be resumed after the process
+//  is killed. After each frame is written the output is flushed
+//  and a small journal file next to the output is replaced with
+//  the number of committed frames and the byte offset of the end
+//  of the last one. On restart the output is truncated to that
+//  offset, which drops any partially written frame, and writing
+//  continues with the next input frame.
+//
+//  The journal is written to a temp file and then renamed over the
+//  previous journal, so a kill at any point leaves either the old
+//  or the new progress record.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_Y4M_JOURNAL_H)
+#define _Y4M_JOURNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "y4m_writer.h"
+
+#define Y4M_JOURNAL_MAGIC "Y4MJOURNAL 1"
+
+#define Y4M_JOURNAL_PATH_MAX 1024
+
+typedef struct {
+  // Output path with ".journal" appended
+  char path[Y4M_JOURNAL_PATH_MAX];
+  char tmpPath[Y4M_JOURNAL_PATH_MAX];
+
+  // Frames written and committed to the output
+  int numFrames;
+
+  // Output length after the last committed frame, 0 when the
+  // header has not been committed yet.
+  off_t offset;
+} Y4MJournal;
+
+// Read the journal for outFilePath. Returns 0 when progress was
+// loaded, 1 when there is no journal, and 2 when it is invalid.
+
+static inline
+int y4m_journal_load(Y4MJournal *journal, const char *outFilePath) {
+  memset(journal, 0, sizeof(Y4MJournal));
+
+  if (snprintf(journal->path, sizeof(journal->path), "%s.journal", outFilePath) >= (int) sizeof(journal->path) ||
+      snprintf(journal->tmpPath, sizeof(journal->tmpPath), "%s.journal.tmp", outFilePath) >= (int) sizeof(journal->tmpPath)) {
+    fprintf(stderr, "output path \"%s\" is too long\n", outFilePath);
+    return 2;
+  }
+
+  FILE *inFile = fopen(journal->path, "rb");
+
+  if (inFile == NULL) {
+    return 1;
+  }
+
+  char magic[32];
+  long long offset = -1;
+  int numFrames = -1;
+
+  int numParsed = fscanf(inFile, "%31[^\n]\nframes %d\noffset %lld\n", magic, &numFrames, &offset);
+
+  fclose(inFile);
+
+  if (numParsed != 3 || strcmp(magic, Y4M_JOURNAL_MAGIC) != 0 || numFrames < 0 || offset < 0) {
+    fprintf(stderr, "invalid progress journal \"%s\"\n", journal->path);
+    return 2;
+  }
+
+  journal->numFrames = numFrames;
+  journal->offset = (off_t) offset;
+
+  return 0;
+}
+
+// Open the output for a resumable encode. Without a journal the
+// output is created as with y4m_open_file(). With a journal the
+// output is truncated to the committed offset and opened for
+// appending. Returns NULL on error.
+
+static inline
+FILE* y4m_journal_open(Y4MJournal *journal, const char *outFilePath) {
+  int load_result = y4m_journal_load(journal, outFilePath);
+
+  if (load_result == 2) {
+    return NULL;
+  }
+
+  if (load_result == 1 || journal->offset == 0) {
+    journal->numFrames = 0;
+    journal->offset = 0;
+    return y4m_open_file(outFilePath);
+  }
+
+  struct stat st;
+
+  if (stat(outFilePath, &st) != 0 || st.st_size < journal->offset) {
+    fprintf(stderr, "output \"%s\" is shorter than the %lld bytes recorded in \"%s\"\n",
+            outFilePath, (long long) journal->offset, journal->path);
+    return NULL;
+  }
+
+  if (st.st_size > journal->offset && truncate(outFilePath, journal->offset) != 0) {
+    fprintf(stderr, "could not truncate output \"%s\"\n", outFilePath);
+    return NULL;
+  }
+
+  FILE *outFile = fopen(outFilePath, "r+b");
+
+  if (outFile == NULL || fseeko(outFile, 0, SEEK_END) != 0) {
+    fprintf(stderr, "could not open output Y4M file \"%s\"\n", outFilePath);
+    if (outFile != NULL) {
+      fclose(outFile);
+    }
+    return NULL;
+  }
+
+  return outFile;
+}
+
+// True when the stream header was committed before the restart, an
+// encode interrupted before the first frame resumes with no frames
+// but must not write the header a second time.
+
+static inline
+int y4m_journal_has_header(const Y4MJournal *journal) {
+  return journal->offset > 0;
+}
+
+// Record that numFrames frames have been written to outFile.
+// Returns 0 on success.
+
+static inline
+int y4m_journal_commit(Y4MJournal *journal, FILE *outFile, int numFrames) {
+  if (fflush(outFile) != 0) {
+    return 2;
+  }
+
+  off_t offset = ftello(outFile);
+
+  if (offset < 0) {
+    return 2;
+  }
+
+  FILE *tmpFile = fopen(journal->tmpPath, "wb");
+
+  if (tmpFile == NULL) {
+    fprintf(stderr, "could not write progress journal \"%s\"\n", journal->tmpPath);
+    return 2;
+  }
+
+  int result = fprintf(tmpFile, "%s\nframes %d\noffset %lld\n", Y4M_JOURNAL_MAGIC, numFrames, (long long) offset);
+
+  if (fclose(tmpFile) != 0 || result < 0 || rename(journal->tmpPath, journal->path) != 0) {
+    return 2;
+  }
+
+  journal->numFrames = numFrames;
+  journal->offset = offset;
+
+  return 0;
+}
+
+// Remove the journal once the output is complete
+
+static inline
+void y4m_journal_remove(Y4MJournal *journal) {
+  unlink(journal->path);
+}
+
+#endif // _Y4M_JOURNAL_H
@@ -0,0 +1,229 @@
+//
+//  y4m_reader.h
+//
+//  Header only interface that reads a Y4M file that
+//  contains 8 bit YUV frames in 4:2:0 format, the
+//  reverse of y4m_writer.h. The input path "-" reads
+//  the stream from stdin.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_Y4M_READER_H)
+#define _Y4M_READER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "y4m_writer.h"
+
+typedef struct {
+  FILE *inFile;
+
+  int width;
+  int height;
+
+  // Frame rate as a fraction, for example 30000:1001
+  int fpsNum;
+  int fpsDen;
+
+  // Header lines including the trailing newline
+  char header[256];
+  int headerLen;
+
+  // Planes of the most recently read frame
+  uint8_t *yPtr;
+  uint8_t *uPtr;
+  uint8_t *vPtr;
+  int yLen;
+  int uvLen;
+
+  int frameNum;
+} Y4MReader;
+
+// Map a frame rate fraction back to the enum used when writing,
+// returns -1 when the rate is not one of the supported values.
+
+static inline
+int y4m_reader_fps_enum(int fpsNum, int fpsDen) {
+  if (fpsDen == 1001 && fpsNum == 30000) {
+    return Y4MHeaderFPS_29_97;
+  }
+  if (fpsDen != 1) {
+    return -1;
+  }
+  switch (fpsNum) {
+    case 1: return Y4MHeaderFPS_1;
+    case 15: return Y4MHeaderFPS_15;
+    case 24: return Y4MHeaderFPS_24;
+    case 25: return Y4MHeaderFPS_25;
+    case 30: return Y4MHeaderFPS_30;
+    case 60: return Y4MHeaderFPS_60;
+    default: return -1;
+  }
+}
+
+// Open Y4M input and parse the stream header. Returns 0 on success.
+
+static inline
+int y4m_reader_open(Y4MReader *reader, const char *inFilePath) {
+  memset(reader, 0, sizeof(Y4MReader));
+
+  if (strcmp(inFilePath, "-") == 0) {
+    reader->inFile = stdin;
+  } else {
+    reader->inFile = fopen(inFilePath, "rb");
+  }
+
+  if (reader->inFile == NULL) {
+    fprintf(stderr, "could not open input Y4M file \"%s\"\n", inFilePath);
+    return 1;
+  }
+
+  // Header is a line of space separated tags. y4m_write_header()
+  // emits the XYSCSS comment on a second line, so lines that begin
+  // with 'X' before the first frame are kept as part of the header.
+
+  int len = 0;
+  int c;
+
+  while ((c = getc(reader->inFile)) != EOF) {
+    if (len == (sizeof(reader->header) - 1)) {
+      fprintf(stderr, "Y4M header is too long in \"%s\"\n", inFilePath);
+      return 1;
+    }
+    reader->header[len++] = (char) c;
+    if (c == '\n') {
+      c = getc(reader->inFile);
+      if (c != EOF) {
+        ungetc(c, reader->inFile);
+      }
+      if (c != 'X') {
+        break;
+      }
+    }
+  }
+  reader->header[len] = '\0';
+  reader->headerLen = len;
+
+  if (strncmp(reader->header, "YUV4MPEG2 ", 10) != 0 || reader->header[len-1] != '\n') {
+    fprintf(stderr, "input \"%s\" is not a Y4M file\n", inFilePath);
+    return 1;
+  }
+
+  reader->fpsNum = 30;
+  reader->fpsDen = 1;
+
+  char *tag = reader->header + 10;
+
+  while (*tag != '\0' && *tag != '\n') {
+    switch (tag[0]) {
+      case 'W': {
+        reader->width = atoi(tag + 1);
+        break;
+      }
+      case 'H': {
+        reader->height = atoi(tag + 1);
+        break;
+      }
+      case 'F': {
+        sscanf(tag + 1, "%d:%d", &reader->fpsNum, &reader->fpsDen);
+        break;
+      }
+      case 'C': {
+        const char *chroma = tag + 4;
+        int is420 = (strncmp(tag, "C420", 4) == 0) &&
+          (*chroma == ' ' || *chroma == '\n' ||
+           strncmp(chroma, "jpeg", 4) == 0 ||
+           strncmp(chroma, "paldv", 5) == 0 ||
+           strncmp(chroma, "mpeg2", 5) == 0);
+        if (!is420) {
+          fprintf(stderr, "only 8 bit 4:2:0 Y4M input is supported\n");
+          return 1;
+        }
+        break;
+      }
+      default: {
+        break;
+      }
+    }
+
+    while (*tag != ' ' && *tag != '\n' && *tag != '\0') {
+      tag++;
+    }
+    while (*tag == ' ') {
+      tag++;
+    }
+  }
+
+  if (reader->width <= 0 || reader->height <= 0 || (reader->width % 2) != 0 || (reader->height % 2) != 0) {
+    fprintf(stderr, "Y4M dimensions must be even but got %d x %d\n", reader->width, reader->height);
+    return 1;
+  }
+
+  reader->yLen = reader->width * reader->height;
+  reader->uvLen = (reader->width / 2) * (reader->height / 2);
+
+  reader->yPtr = (uint8_t *) malloc(reader->yLen + 2 * reader->uvLen);
+  if (reader->yPtr == NULL) {
+    return 1;
+  }
+  reader->uPtr = reader->yPtr + reader->yLen;
+  reader->vPtr = reader->uPtr + reader->uvLen;
+
+  return 0;
+}
+
+// Read the next frame into yPtr, uPtr, and vPtr. Returns 0 on
+// success, 1 at the end of the stream, and 2 on a read error.
+
+static inline
+int y4m_reader_next(Y4MReader *reader) {
+  // "FRAME" followed by optional parameters and a newline
+
+  char marker[6];
+
+  size_t numRead = fread(marker, 1, 5, reader->inFile);
+
+  if (numRead == 0 && feof(reader->inFile)) {
+    return 1;
+  }
+
+  if (numRead != 5 || memcmp(marker, "FRAME", 5) != 0) {
+    fprintf(stderr, "Y4M frame %d does not begin with FRAME\n", reader->frameNum);
+    return 2;
+  }
+
+  int c;
+  while ((c = getc(reader->inFile)) != '\n') {
+    if (c == EOF) {
+      return 2;
+    }
+  }
+
+  size_t frameLen = reader->yLen + 2 * reader->uvLen;
+
+  if (fread(reader->yPtr, 1, frameLen, reader->inFile) != frameLen) {
+    fprintf(stderr, "Y4M input truncated in frame %d\n", reader->frameNum);
+    return 2;
+  }
+
+  reader->frameNum += 1;
+
+  return 0;
+}
+
+static inline
+void y4m_reader_close(Y4MReader *reader) {
+  if (reader->inFile != NULL && reader->inFile != stdin) {
+    fclose(reader->inFile);
+  }
+  reader->inFile = NULL;
+  free(reader->yPtr);
+  reader->yPtr = NULL;
+  reader->uPtr = NULL;
+  reader->vPtr = NULL;
+}
+
+#endif // _Y4M_READER_H
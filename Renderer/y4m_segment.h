@@ -0,0 +1,260 @@
+//
+//  y4m_segment.h
+//
+//  Header only interface for Y4M segment files. A segment holds
+//  a contiguous range of frames from a longer sequence so that
+//  separate processes or machines can each encode one range.
+//  In place of the YUV4MPEG2 stream header a segment begins with
+//  a single fixed length line:
+//
+//  Y4MSEG W1920 H1080 F30:1 S0000000000 N0000000000
+//
+//  S is the index of the first frame in the full sequence and N
+//  is the number of frames, N is rewritten when the segment is
+//  finished. The rest of the file is FRAME records exactly as
+//  written by y4m_write_frame(), so segments that pass the checks
+//  are merged by copying the records after the segment line.
+//  On Linux the copy uses copy_file_range() when the including
+//  file defines _GNU_SOURCE and sendfile() otherwise.
+//
+//  Licensed under BSD terms.
+
+#if !defined(_Y4M_SEGMENT_H)
+#define _Y4M_SEGMENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+#include "y4m_writer.h"
+#include "y4m_reader.h"
+
+#define Y4M_SEGMENT_MAGIC "Y4MSEG "
+
+// Width of the S and N fields, N is rewritten in place
+
+#define Y4M_SEGMENT_COUNT_DIGITS 10
+
+typedef struct {
+  int width;
+  int height;
+  int fpsNum;
+  int fpsDen;
+
+  // Index of the first frame in the full sequence
+  int start;
+  int numFrames;
+
+  // Byte length of the segment line, FRAME records follow
+  int headerLen;
+
+  // Byte length of one FRAME record including the marker
+  off_t frameLen;
+} Y4MSegmentInfo;
+
+// Frame rate fraction written in the Y4M header for an fps value
+
+static inline
+int y4m_segment_fps_fraction(Y4MHeaderFPS fps, int *fpsNumPtr, int *fpsDenPtr) {
+  *fpsDenPtr = 1;
+  switch (fps) {
+    case Y4MHeaderFPS_1: *fpsNumPtr = 1; break;
+    case Y4MHeaderFPS_15: *fpsNumPtr = 15; break;
+    case Y4MHeaderFPS_24: *fpsNumPtr = 24; break;
+    case Y4MHeaderFPS_25: *fpsNumPtr = 25; break;
+    case Y4MHeaderFPS_29_97: *fpsNumPtr = 30000; *fpsDenPtr = 1001; break;
+    case Y4MHeaderFPS_30: *fpsNumPtr = 30; break;
+    case Y4MHeaderFPS_60: *fpsNumPtr = 60; break;
+    default: return 1;
+  }
+  return 0;
+}
+
+// Emit the segment line for numFrames frames
+
+static inline
+int y4m_segment_write_line(FILE *outFile, Y4MHeaderStruct *hsPtr, int start, int numFrames) {
+  int fpsNum, fpsDen;
+
+  if (y4m_segment_fps_fraction(hsPtr->fps, &fpsNum, &fpsDen) != 0) {
+    return 3;
+  }
+
+  if (fprintf(outFile, "%sW%d H%d F%d:%d S%0*d N%0*d\n",
+              Y4M_SEGMENT_MAGIC, hsPtr->width, hsPtr->height, fpsNum, fpsDen,
+              Y4M_SEGMENT_COUNT_DIGITS, start,
+              Y4M_SEGMENT_COUNT_DIGITS, numFrames) < 0) {
+    return 2;
+  }
+
+  return 0;
+}
+
+// Emit the segment line in place of y4m_write_header(), the frame
+// count is written as zero until y4m_segment_finish() is invoked.
+
+static inline
+int y4m_segment_write_header(FILE *outFile, Y4MHeaderStruct *hsPtr, int start) {
+  return y4m_segment_write_line(outFile, hsPtr, start, 0);
+}
+
+// Rewrite the segment line with the final frame count once every
+// frame has been written, the fields are fixed width so the line
+// length does not change. The output must be a regular file.
+// Returns 0 on success.
+
+static inline
+int y4m_segment_finish(FILE *outFile, Y4MHeaderStruct *hsPtr, int start, int numFrames) {
+  if (fflush(outFile) != 0 || fseeko(outFile, 0, SEEK_SET) != 0) {
+    return 2;
+  }
+
+  int result = y4m_segment_write_line(outFile, hsPtr, start, numFrames);
+  if (result != 0) {
+    return result;
+  }
+
+  if (fflush(outFile) != 0 || fseeko(outFile, 0, SEEK_END) != 0) {
+    return 2;
+  }
+
+  return 0;
+}
+
+// Parse the segment line at the start of inFile and check that the
+// file size matches the frame count. Returns 0 on success.
+
+static inline
+int y4m_segment_read_header(FILE *inFile, const char *inFilePath, Y4MSegmentInfo *info) {
+  char line[128];
+
+  memset(info, 0, sizeof(Y4MSegmentInfo));
+
+  if (fgets(line, sizeof(line), inFile) == NULL ||
+      strncmp(line, Y4M_SEGMENT_MAGIC, strlen(Y4M_SEGMENT_MAGIC)) != 0) {
+    fprintf(stderr, "input \"%s\" is not a Y4M segment\n", inFilePath);
+    return 1;
+  }
+
+  if (sscanf(line + strlen(Y4M_SEGMENT_MAGIC), "W%d H%d F%d:%d S%d N%d",
+             &info->width, &info->height, &info->fpsNum, &info->fpsDen,
+             &info->start, &info->numFrames) != 6 ||
+      info->width <= 0 || info->height <= 0 ||
+      (info->width % 2) != 0 || (info->height % 2) != 0 ||
+      info->start < 0 || info->numFrames < 0) {
+    fprintf(stderr, "invalid segment line in \"%s\"\n", inFilePath);
+    return 1;
+  }
+
+  info->headerLen = (int) strlen(line);
+
+  off_t yLen = (off_t) info->width * info->height;
+  off_t uvLen = (off_t) (info->width / 2) * (info->height / 2);
+  info->frameLen = 6 + yLen + (2 * uvLen);
+
+  struct stat st;
+
+  if (fstat(fileno(inFile), &st) != 0) {
+    return 2;
+  }
+
+  off_t expectedLen = info->headerLen + (info->frameLen * info->numFrames);
+
+  if (st.st_size != expectedLen) {
+    fprintf(stderr, "segment \"%s\" is %lld bytes but %d frames need %lld bytes\n",
+            inFilePath, (long long) st.st_size, info->numFrames, (long long) expectedLen);
+    return 1;
+  }
+
+  return 0;
+}
+
+// Copy len bytes starting at inOffset in inFd to the current position
+// of outFd. The copy is done in the kernel with copy_file_range() when
+// both are files on Linux, then sendfile() which also handles a pipe
+// as output, and finally a read and write loop. Returns 0 on success.
+
+static inline
+int y4m_segment_splice(int outFd, int inFd, off_t inOffset, off_t len) {
+#if defined(__linux__)
+  // 0 = copy_file_range(), 1 = sendfile(), 2 = read and write
+
+#if defined(_GNU_SOURCE)
+  int mode = 0;
+#else
+  int mode = 1;
+#endif // _GNU_SOURCE
+
+  while (len > 0 && mode < 2) {
+    ssize_t numCopied;
+
+#if defined(_GNU_SOURCE)
+    if (mode == 0) {
+      loff_t offset = inOffset;
+      numCopied = copy_file_range(inFd, &offset, outFd, NULL, (size_t) len, 0);
+    } else
+#endif // _GNU_SOURCE
+    {
+      off_t offset = inOffset;
+      numCopied = sendfile(outFd, inFd, &offset, (size_t) len);
+    }
+
+    if (numCopied > 0) {
+      inOffset += numCopied;
+      len -= numCopied;
+    } else if (numCopied == -1 && errno == EINTR) {
+      continue;
+    } else if (mode == 0 && (numCopied == 0 || errno == EXDEV || errno == EINVAL ||
+                             errno == ENOSYS || errno == EOPNOTSUPP || errno == EBADF)) {
+      mode = 1;
+    } else if (mode == 1 && numCopied == -1 && (errno == EINVAL || errno == ENOSYS)) {
+      mode = 2;
+    } else {
+      return 2;
+    }
+  }
+#endif // __linux__
+
+  uint8_t buffer[64 * 1024];
+
+  while (len > 0) {
+    size_t chunk = (len < (off_t) sizeof(buffer)) ? (size_t) len : sizeof(buffer);
+    ssize_t numRead = pread(inFd, buffer, chunk, inOffset);
+
+    if (numRead == -1 && errno == EINTR) {
+      continue;
+    }
+    if (numRead <= 0) {
+      return 2;
+    }
+
+    ssize_t numWritten = 0;
+
+    while (numWritten < numRead) {
+      ssize_t result = write(outFd, buffer + numWritten, numRead - numWritten);
+      if (result == -1 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0) {
+        return 2;
+      }
+      numWritten += result;
+    }
+
+    inOffset += numRead;
+    len -= numRead;
+  }
+
+  return 0;
+}
+
+#endif // _Y4M_SEGMENT_H
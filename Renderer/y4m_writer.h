@@ -7,12 +7,20 @@
 //  a Y4M file that contains tagged YUV bytes
 //  in 4:2:0 format.
 //
+//  The output path "-" streams to stdout so that the
+//  output can be piped directly into an encoder.
+//
 //  Licensed under BSD terms.
 
 #if !defined(_Y4M_WRITER_H)
 #define _Y4M_WRITER_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 typedef enum {
   Y4MHeaderFPS_1,
@@ -43,11 +51,39 @@ typedef struct {
   int vLen;
 } Y4MFrameStruct;
 
-// Open output Y4M file descriptor with binary setting
+// Point the stdout descriptor at stderr so that status messages
+// printed with printf() cannot be mixed into a Y4M stream written
+// to "-". This changes the whole process, so it is left to main()
+// and must be called after the output is opened, since the output
+// keeps its own descriptor for the original stdout.
+// Returns 0 on success.
+
+static inline
+int y4m_redirect_stdout() {
+  fflush(stdout);
+  if (dup2(STDERR_FILENO, STDOUT_FILENO) == -1) {
+    return 1;
+  }
+  return 0;
+}
+
+// Open output Y4M file descriptor with binary setting.
+// When outFilePath is "-" the Y4M data is written to a new
+// descriptor for stdout, stdout itself is not changed.
 
 static inline
 FILE* y4m_open_file(const char *outFilePath) {
-  FILE *outFile = fopen(outFilePath, "wb");
+  FILE *outFile;
+  
+  if (strcmp(outFilePath, "-") == 0) {
+    int outFd = dup(STDOUT_FILENO);
+    outFile = (outFd == -1) ? NULL : fdopen(outFd, "wb");
+    if (outFile == NULL && outFd != -1) {
+      close(outFd);
+    }
+  } else {
+    outFile = fopen(outFilePath, "wb");
+  }
   
   if (outFile == NULL) {
     fprintf(stderr, "could not open output Y4M file \"%s\"\n", outFilePath);
@@ -56,10 +92,22 @@ FILE* y4m_open_file(const char *outFilePath) {
   return outFile;
 }
 
-// Emit header given the options indicated in header
+// Non-zero when the output is a pipe or socket
 
 static inline
-int y4m_write_header(FILE *outFile, Y4MHeaderStruct *hsPtr) {
+int y4m_is_pipe(FILE *outFile) {
+  struct stat st;
+  if (fstat(fileno(outFile), &st) != 0) {
+    return 0;
+  }
+  return S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode);
+}
+
+// Emit header given the options indicated in header, the
+// colour space and comment segments end with a newline.
+
+static inline
+int y4m_write_header_colorspace(FILE *outFile, Y4MHeaderStruct *hsPtr, const char *colorspace, const char *comment) {
   {
     char *segment = "YUV4MPEG2 ";
     int segmentLen = (int) strlen(segment);
@@ -70,9 +118,8 @@ int y4m_write_header(FILE *outFile, Y4MHeaderStruct *hsPtr) {
   }
   
   {
-    int width = hsPtr->width;
-    NSString *formatted = [NSString stringWithFormat:@"W%d ", width];
-    char *segment = (char*) [formatted UTF8String];
+    char segment[32];
+    snprintf(segment, sizeof(segment), "W%d ", hsPtr->width);
     int segmentLen = (int) strlen(segment);
     int numWritten = (int) fwrite(segment, segmentLen, 1, outFile);
     if (numWritten != 1) {
@@ -81,9 +128,8 @@ int y4m_write_header(FILE *outFile, Y4MHeaderStruct *hsPtr) {
   }
   
   {
-    int height = hsPtr->height;
-    NSString *formatted = [NSString stringWithFormat:@"H%d ", height];
-    char *segment = (char*) [formatted UTF8String];
+    char segment[32];
+    snprintf(segment, sizeof(segment), "H%d ", hsPtr->height);
     int segmentLen = (int) strlen(segment);
     int numWritten = (int) fwrite(segment, segmentLen, 1, outFile);
     if (numWritten != 1) {
@@ -169,7 +215,7 @@ int y4m_write_header(FILE *outFile, Y4MHeaderStruct *hsPtr) {
   // Colour space = 4:2:0 subsampling
   
   {
-    char *segment = "C420jpeg\n";
+    const char *segment = colorspace;
     int segmentLen = (int) strlen(segment);
     int numWritten = (int) fwrite(segment, segmentLen, 1, outFile);
     if (numWritten != 1) {
@@ -180,7 +226,7 @@ int y4m_write_header(FILE *outFile, Y4MHeaderStruct *hsPtr) {
   // Comment
   
   {
-    char *segment = "XYSCSS=420JPEG\n";
+    const char *segment = comment;
     int segmentLen = (int) strlen(segment);
     int numWritten = (int) fwrite(segment, segmentLen, 1, outFile);
     if (numWritten != 1) {
@@ -191,6 +237,21 @@ int y4m_write_header(FILE *outFile, Y4MHeaderStruct *hsPtr) {
   return 0;
 }
 
+// 8 bit 4:2:0
+
+static inline
+int y4m_write_header(FILE *outFile, Y4MHeaderStruct *hsPtr) {
+  return y4m_write_header_colorspace(outFile, hsPtr, "C420jpeg\n", "XYSCSS=420JPEG\n");
+}
+
+// 10 bit 4:2:0, each sample is a little endian 16 bit value
+// in the range [0, 1023]. The frame lengths are in bytes.
+
+static inline
+int y4m_write_header_10(FILE *outFile, Y4MHeaderStruct *hsPtr) {
+  return y4m_write_header_colorspace(outFile, hsPtr, "C420p10\n", "XYSCSS=420P10\n");
+}
+
 static inline
 int y4m_write_frame(FILE *outFile, Y4MFrameStruct *fsPtr) {
   // FRAME marker
@@ -237,6 +298,15 @@ int y4m_write_frame(FILE *outFile, Y4MFrameStruct *fsPtr) {
     }
   }
   
+  // When writing to a pipe, flush at the end of each frame so that
+  // the reader sees complete frames as soon as they are ready. When
+  // the reader falls behind the write blocks, which in turn holds
+  // back conversion of the next frame. Files keep the stdio buffer.
+  
+  if (y4m_is_pipe(outFile) && fflush(outFile) != 0) {
+    return 2;
+  }
+  
   return 0;
 }
 
@@ -0,0 +1,1454 @@
+//
+//  bt709_fuzz.c
+//
+//  Differential fuzzer for the portable conversion code. Each input
+//  is turned into a small frame, with odd row strides and optional
+//  edge colors, that is converted by every C implementation. The
+//  outputs are compared against a scalar reference and against each
+//  other, so an optimized path can not silently change results.
+//
+//  Encode:
+//    BT709_average_pixel_values()  reference for each 2x2 block
+//    bt709_frame_encode()          lookup tables
+//    bt709_context_encode()        parked worker threads
+//    bt709_alpha_encode_premultiplied() with opaque alpha
+//    bt709_frame10_encode()        10 bit output rounded to 8 bits
+//    bt709_cube_lut_encode()       identity 3D LUT
+//    bt709_sharp_encode()          refined with bt709_sharp_block_eval_scalar()
+//    bt709_inverse_table_encode()  bt709_inverse_search_pixel() for each pixel
+//    bt709_pyramid_encode()        proxy levels averaged from the whole frame
+//
+//  Packing:
+//    bt709_planes_interleave() and bt709_planes_deinterleave()
+//    bt709_planes_copy()
+//    bt709_frame10_pack_p010()
+//    bt709_alpha_premultiply_row() and bt709_alpha_unpremultiply_row()
+//
+//  Decode:
+//    double precision reference for each pixel
+//    bt709_decode_region()         full frame and an odd sub region
+//    bt709_decode_region_float()   linear light
+//    bt709_decode_region_half()    linear light half floats
+//    bt709_decode_region_over()    opaque and transparent alpha
+//
+//  Metal and vImage can not run here, those are covered by the
+//  XCTest cases. Allowed differences are set at compile time with
+//  the BT709_FUZZ_TOLERANCE_* defines.
+//
+//  Build with -DBT709_FUZZ_LIBFUZZER and -fsanitize=fuzzer to use
+//  libFuzzer, a mismatch calls abort(). Otherwise main() runs
+//  inputs from files or stdin (afl-fuzz ... -- bt709_fuzz @@), or
+//  generates random inputs and writes a minimized copy of the
+//  first one that fails.
+//
+//  usage: bt709_fuzz FILE...
+//         bt709_fuzz -random N [-seed S] [-out FILE]
+//         bt709_fuzz -minimize FILE OUT
+//
+//  Licensed under BSD terms.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "BT709.h"
+#include "bt709_frame.h"
+#include "bt709_frame10.h"
+#include "bt709_context.h"
+#include "bt709_alpha.h"
+#include "bt709_cube_lut.h"
+#include "bt709_decode.h"
+#include "bt709_sharp_yuv.h"
+#include "bt709_inverse_table.h"
+#include "bt709_pyramid.h"
+#include "bt709_planes.h"
+
+// Max difference in 8 bit code values between the lookup table
+// encoder and BT709_average_pixel_values().
+
+#if !defined(BT709_FUZZ_TOLERANCE_ENCODE)
+#define BT709_FUZZ_TOLERANCE_ENCODE 0
+#endif
+
+// Max difference between 10 bit output rounded to 8 bits and the
+// 8 bit encoder, the 8 bit path rounds the gamma encoded value
+// before the matrix.
+
+#if !defined(BT709_FUZZ_TOLERANCE_ENCODE10)
+#define BT709_FUZZ_TOLERANCE_ENCODE10 1
+#endif
+
+// Max difference in sRGB bytes between the CPU decoder and the
+// double precision reference, the decoder uses a sampled curve.
+
+#if !defined(BT709_FUZZ_TOLERANCE_DECODE)
+#define BT709_FUZZ_TOLERANCE_DECODE 1
+#endif
+
+// Max difference in normalized linear values between the float
+// decoder and the double precision reference.
+
+#if !defined(BT709_FUZZ_TOLERANCE_LINEAR)
+#define BT709_FUZZ_TOLERANCE_LINEAR 0.0005
+#endif
+
+// Max difference in Y between bt709_sharp_encode() and the same
+// refinement done with bt709_sharp_block_eval_scalar(). A fused
+// multiply add in the NEON eval can flip a step that the scalar
+// path keeps.
+
+#if !defined(BT709_FUZZ_TOLERANCE_SHARP)
+#define BT709_FUZZ_TOLERANCE_SHARP 0
+#endif
+
+#define BT709_FUZZ_MAX_DIM 64
+
+// The inverse table search is slow, only the top left corner of
+// the frame is encoded with it.
+
+#define BT709_FUZZ_INVERSE_MAX_DIM 16
+
+// Offset of the first pixel byte in an input, the bytes before
+// it select the frame size, layout, gamma, and so on.
+
+#define BT709_FUZZ_HEADER_SIZE 8
+
+// Colors on either side of each clamp and rounding edge
+
+static const uint8_t edgeValues[] = { 0, 1, 2, 15, 16, 17, 127, 128, 129, 234, 235, 236, 239, 240, 241, 253, 254, 255 };
+
+static const BT709Gamma gammas[] = { BT709GammaSrgb, BT709GammaApple, BT709GammaLinear };
+
+static const char *gammaNames[] = { "srgb", "apple", "linear" };
+
+typedef struct {
+  int width;
+  int height;
+  int layoutIndex;
+  int gammaIndex;
+  int padding;
+  int edgeMode;
+  int regionSeed;
+  int numThreads;
+  int numLevels;
+  const uint8_t *data;
+  size_t dataSize;
+} FuzzInput;
+
+// Every mismatch is reported with the implementation names and
+// the first location that differs.
+
+static int verbose = 1;
+
+static
+int report(const FuzzInput *in, const char *name, int plane, int x, int y, double v, double expected) {
+  if (verbose) {
+    printf("MISMATCH %s : %dx%d layout %d gamma %s pad %d : plane %d (%d, %d) %.6f != %.6f\n",
+           name, in->width, in->height, in->layoutIndex, gammaNames[in->gammaIndex], in->padding,
+           plane, x, y, v, expected);
+  }
+  return 1;
+}
+
+static
+uint8_t header_byte(const uint8_t *data, size_t size, int i) {
+  return ((size_t) i < size) ? data[i] : 0;
+}
+
+static
+void parse_input(FuzzInput *in, const uint8_t *data, size_t size) {
+  in->width = 2 + (2 * (header_byte(data, size, 0) % (BT709_FUZZ_MAX_DIM / 2)));
+  in->height = 2 + (2 * (header_byte(data, size, 1) % (BT709_FUZZ_MAX_DIM / 2)));
+  in->layoutIndex = header_byte(data, size, 2) % 3;
+  in->gammaIndex = (header_byte(data, size, 2) / 3) % 3;
+  in->padding = header_byte(data, size, 3) % 16;
+  in->edgeMode = (header_byte(data, size, 3) / 16) % 3;
+  in->regionSeed = header_byte(data, size, 4) | (header_byte(data, size, 5) << 8);
+  in->numThreads = 1 + (header_byte(data, size, 6) % 4);
+  in->numLevels = 1 + (header_byte(data, size, 7) % BT709_PYRAMID_MAX_LEVELS);
+
+  if (size > BT709_FUZZ_HEADER_SIZE) {
+    in->data = data + BT709_FUZZ_HEADER_SIZE;
+    in->dataSize = size - BT709_FUZZ_HEADER_SIZE;
+  } else {
+    in->data = NULL;
+    in->dataSize = 0;
+  }
+}
+
+// Byte i of the frame contents, the data repeats when it is shorter
+// than the frame. Edge mode 1 maps every byte to an edge color and
+// mode 2 maps odd bytes only.
+
+static
+uint8_t content_byte(const FuzzInput *in, size_t i) {
+  if (in->dataSize == 0) {
+    return 0;
+  }
+  uint8_t b = in->data[i % in->dataSize];
+  if (in->edgeMode == 1 || (in->edgeMode == 2 && (b & 1))) {
+    b = edgeValues[b % sizeof(edgeValues)];
+  }
+  return b;
+}
+
+static
+BT709PixelLayout layout_for_index(int i) {
+  if (i == 0) {
+    return bt709_pixel_layout_bgra();
+  } else if (i == 1) {
+    return bt709_pixel_layout_rgb();
+  } else {
+    return bt709_pixel_layout_rgba();
+  }
+}
+
+// Tables depend only on the gamma, init each one on first use
+
+static BT709FrameTables *frameTables[3];
+static BT709Frame10Tables *frame10Tables[3];
+static BT709DecodeTables *decodeTables[3];
+static BT709SharpTables *sharpTables[3];
+static BT709AlphaTables *alphaTables;
+static BT709CubeLUT identityLUT;
+
+// Inverse table entries are searched the first time a color is
+// used, an entry with Y = 0 has not been searched yet.
+
+static BT709InverseSearch *inverseSearch;
+static uint8_t *inverseEntries;
+static BT709InverseTable inverseTable;
+
+static
+void init_tables(int gammaIndex) {
+  if (frameTables[gammaIndex] == NULL) {
+    frameTables[gammaIndex] = malloc(sizeof(BT709FrameTables));
+    bt709_frame_tables_init(frameTables[gammaIndex], BT709GammaSrgb, gammas[gammaIndex]);
+
+    frame10Tables[gammaIndex] = malloc(sizeof(BT709Frame10Tables));
+    bt709_frame10_tables_init(frame10Tables[gammaIndex], BT709GammaSrgb, gammas[gammaIndex]);
+
+    decodeTables[gammaIndex] = malloc(sizeof(BT709DecodeTables));
+    bt709_decode_tables_init(decodeTables[gammaIndex], gammas[gammaIndex]);
+
+    sharpTables[gammaIndex] = malloc(sizeof(BT709SharpTables));
+    bt709_sharp_tables_init(sharpTables[gammaIndex], BT709GammaSrgb, gammas[gammaIndex], 2);
+  }
+
+  if (alphaTables == NULL) {
+    alphaTables = malloc(sizeof(BT709AlphaTables));
+    bt709_alpha_tables_init(alphaTables, BT709GammaSrgb);
+
+    // A 2 point lattice at the corners of the cube is the identity
+
+    identityLUT.size = 2;
+    identityLUT.table = malloc(2 * 2 * 2 * 4 * sizeof(float));
+    for (int i = 0; i < 8; i++) {
+      identityLUT.table[(i * 4)] = (float) (i & 1);
+      identityLUT.table[(i * 4) + 1] = (float) ((i >> 1) & 1);
+      identityLUT.table[(i * 4) + 2] = (float) ((i >> 2) & 1);
+      identityLUT.table[(i * 4) + 3] = 0.0f;
+    }
+    for (int c = 0; c < 3; c++) {
+      identityLUT.domainMin[c] = 0.0f;
+      identityLUT.domainMax[c] = 1.0f;
+    }
+    bt709_cube_lut_init_index(&identityLUT);
+
+    inverseSearch = malloc(sizeof(BT709InverseSearch));
+    bt709_inverse_search_init(inverseSearch, 2);
+    inverseEntries = calloc(1, BT709_INVERSE_TABLE_DATA_LEN);
+    bt709_inverse_table_init(&inverseTable, inverseEntries);
+  }
+}
+
+// Y Cb Cr planes with a row stride that is not the width
+
+typedef struct {
+  uint8_t *buffer;
+  size_t bufferSize;
+  BT709PlanesStruct planes;
+} FuzzPlanes;
+
+static
+void planes_alloc(FuzzPlanes *p, int width, int height, int padding) {
+  const int yBytesPerRow = width + padding;
+  const int cBytesPerRow = (width / 2) + padding;
+  const size_t yLen = (size_t) yBytesPerRow * height;
+  const size_t cLen = (size_t) cBytesPerRow * (height / 2);
+
+  p->bufferSize = yLen + (2 * cLen);
+  p->buffer = malloc(p->bufferSize);
+  memset(p->buffer, 0xAB, p->bufferSize);
+
+  p->planes.yPtr = p->buffer;
+  p->planes.yBytesPerRow = yBytesPerRow;
+  p->planes.cbPtr = p->buffer + yLen;
+  p->planes.cbBytesPerRow = cBytesPerRow;
+  p->planes.crPtr = p->buffer + yLen + cLen;
+  p->planes.crBytesPerRow = cBytesPerRow;
+}
+
+// Fill with a value an encoder would have to write over
+
+static
+void planes_clear(FuzzPlanes *p) {
+  memset(p->buffer, 0xAB, p->bufferSize);
+}
+
+// Compare two sets of planes, returns 1 on the first difference
+// larger than tolerance.
+
+static
+int compare_planes(const FuzzInput *in, const char *name,
+                   const BT709PlanesStruct *a, const BT709PlanesStruct *b, int tolerance)
+{
+  for (int plane = 0; plane < 3; plane++) {
+    const int w = (plane == 0) ? in->width : (in->width / 2);
+    const int h = (plane == 0) ? in->height : (in->height / 2);
+    const uint8_t *aPtr = (plane == 0) ? a->yPtr : ((plane == 1) ? a->cbPtr : a->crPtr);
+    const uint8_t *bPtr = (plane == 0) ? b->yPtr : ((plane == 1) ? b->cbPtr : b->crPtr);
+    const int aBytesPerRow = (plane == 0) ? a->yBytesPerRow : ((plane == 1) ? a->cbBytesPerRow : a->crBytesPerRow);
+    const int bBytesPerRow = (plane == 0) ? b->yBytesPerRow : ((plane == 1) ? b->cbBytesPerRow : b->crBytesPerRow);
+
+    for (int row = 0; row < h; row++) {
+      for (int col = 0; col < w; col++) {
+        int v = aPtr[(row * aBytesPerRow) + col];
+        int expected = bPtr[(row * bBytesPerRow) + col];
+        if (abs(v - expected) > tolerance) {
+          return report(in, name, plane, col, row, v, expected);
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Encode references, each 2x2 block with BT709_average_pixel_values()
+
+static
+void reference_encode(const FuzzInput *in, const BT709PixelLayout *layout,
+                      const uint8_t *pixels, int inBytesPerRow, const BT709PlanesStruct *planes)
+{
+  const int bpp = layout->bytesPerPixel;
+
+  for (int row = 0; row < in->height; row += 2) {
+    for (int col = 0; col < in->width; col += 2) {
+      const uint8_t *p[4];
+      p[0] = pixels + (row * inBytesPerRow) + (col * bpp);
+      p[1] = p[0] + bpp;
+      p[2] = p[0] + inBytesPerRow;
+      p[3] = p[2] + bpp;
+
+      int Y[4], Cb, Cr;
+
+      BT709_average_pixel_values(p[0][layout->rOffset], p[0][layout->gOffset], p[0][layout->bOffset],
+                                 p[1][layout->rOffset], p[1][layout->gOffset], p[1][layout->bOffset],
+                                 p[2][layout->rOffset], p[2][layout->gOffset], p[2][layout->bOffset],
+                                 p[3][layout->rOffset], p[3][layout->gOffset], p[3][layout->bOffset],
+                                 &Y[0], &Y[1], &Y[2], &Y[3], &Cb, &Cr,
+                                 BT709GammaSrgb, gammas[in->gammaIndex]);
+
+      uint8_t *yPtr = planes->yPtr + (row * planes->yBytesPerRow) + col;
+      yPtr[0] = Y[0];
+      yPtr[1] = Y[1];
+      yPtr[planes->yBytesPerRow] = Y[2];
+      yPtr[planes->yBytesPerRow + 1] = Y[3];
+      planes->cbPtr[((row / 2) * planes->cbBytesPerRow) + (col / 2)] = Cb;
+      planes->crPtr[((row / 2) * planes->crBytesPerRow) + (col / 2)] = Cr;
+    }
+  }
+}
+
+// Fill a frame with the input contents. When opaque is zero and
+// the layout has alpha, each run of 4 pixels is transparent, opaque
+// or has the alpha from the contents, so that SIMD paths that skip
+// whole runs are covered.
+
+static
+uint8_t* make_pixels(const FuzzInput *in, const BT709PixelLayout *layout, int inBytesPerRow, int opaque) {
+  uint8_t *pixels = malloc((size_t) inBytesPerRow * in->height);
+  for (int i = 0; i < (inBytesPerRow * in->height); i++) {
+    pixels[i] = content_byte(in, i);
+  }
+  if (layout->aOffset >= 0) {
+    for (int row = 0; row < in->height; row++) {
+      for (int col = 0; col < in->width; col++) {
+        uint8_t *A = &pixels[(row * inBytesPerRow) + (col * layout->bytesPerPixel) + layout->aOffset];
+        const int mode = opaque ? 1 : (content_byte(in, (row * in->width) + (col / 4) + 3) % 3);
+        if (mode == 0) {
+          *A = 0;
+        } else if (mode == 1) {
+          *A = 0xFF;
+        }
+      }
+    }
+  }
+  return pixels;
+}
+
+static
+int fuzz_encode(const FuzzInput *in) {
+  const int width = in->width;
+  const int height = in->height;
+  const BT709PixelLayout layout = layout_for_index(in->layoutIndex);
+  const int inBytesPerRow = (width * layout.bytesPerPixel) + in->padding;
+  const BT709FrameTables *tables = frameTables[in->gammaIndex];
+
+  int failed = 0;
+
+  // Alpha is opaque so that premultiply does not change the color
+
+  uint8_t *pixels = make_pixels(in, &layout, inBytesPerRow, 1);
+
+  FuzzPlanes expected, frame, actual;
+  planes_alloc(&expected, width, height, in->padding);
+  planes_alloc(&frame, width, height, in->padding + 1);
+  planes_alloc(&actual, width, height, in->padding + 2);
+
+  reference_encode(in, &layout, pixels, inBytesPerRow, &expected.planes);
+
+  bt709_frame_encode(tables, &layout, pixels, inBytesPerRow, width, height, &frame.planes);
+  failed |= compare_planes(in, "bt709_frame_encode", &frame.planes, &expected.planes, BT709_FUZZ_TOLERANCE_ENCODE);
+
+  // Every other implementation must match bt709_frame_encode()
+
+  BT709Context *context = malloc(sizeof(BT709Context));
+  if (bt709_context_init(context, BT709GammaSrgb, gammas[in->gammaIndex], &layout, width, height, in->numThreads, 0) == 0) {
+    planes_clear(&actual);
+    bt709_context_encode(context, pixels, inBytesPerRow, &actual.planes);
+    failed |= compare_planes(in, "bt709_context_encode", &actual.planes, &frame.planes, 0);
+    bt709_context_destroy(context);
+  }
+  free(context);
+
+  if (layout.aOffset >= 0) {
+    uint8_t *scratch = malloc(2 * width * 4);
+    planes_clear(&actual);
+    bt709_alpha_encode_premultiplied(tables, alphaTables, BT709AlphaPremultiply, &layout,
+                                     pixels, inBytesPerRow, width, height, &actual.planes, scratch);
+    failed |= compare_planes(in, "bt709_alpha_encode_premultiplied", &actual.planes, &frame.planes, 0);
+    free(scratch);
+  }
+
+  planes_clear(&actual);
+  bt709_cube_lut_encode(&identityLUT, tables, NULL, &layout, pixels, inBytesPerRow, width, height, &actual.planes, in->numThreads);
+  failed |= compare_planes(in, "bt709_cube_lut_encode", &actual.planes, &frame.planes, 0);
+
+  {
+    const int yBytesPerRow = (width + in->padding) * 2;
+    const int cBytesPerRow = ((width / 2) + in->padding) * 2;
+    uint16_t *buffer16 = malloc(((size_t) yBytesPerRow * height) + (2 * (size_t) cBytesPerRow * (height / 2)));
+
+    BT709Planes16Struct planes16;
+    planes16.yPtr = buffer16;
+    planes16.yBytesPerRow = yBytesPerRow;
+    planes16.cbPtr = buffer16 + ((yBytesPerRow / 2) * height);
+    planes16.cbBytesPerRow = cBytesPerRow;
+    planes16.crPtr = planes16.cbPtr + ((cBytesPerRow / 2) * (height / 2));
+    planes16.crBytesPerRow = cBytesPerRow;
+
+    bt709_frame10_encode(frame10Tables[in->gammaIndex], &layout, pixels, inBytesPerRow, width, height, &planes16);
+
+    for (int plane = 0; plane < 3 && !failed; plane++) {
+      const int w = (plane == 0) ? width : (width / 2);
+      const int h = (plane == 0) ? height : (height / 2);
+      const uint16_t *p16 = (plane == 0) ? planes16.yPtr : ((plane == 1) ? planes16.cbPtr : planes16.crPtr);
+      const int stride16 = ((plane == 0) ? planes16.yBytesPerRow : planes16.cbBytesPerRow) / 2;
+      const uint8_t *p8 = (plane == 0) ? frame.planes.yPtr : ((plane == 1) ? frame.planes.cbPtr : frame.planes.crPtr);
+      const int stride8 = (plane == 0) ? frame.planes.yBytesPerRow : frame.planes.cbBytesPerRow;
+
+      for (int row = 0; row < h && !failed; row++) {
+        for (int col = 0; col < w; col++) {
+          int v = (p16[(row * stride16) + col] + 2) >> 2;
+          int expected8 = p8[(row * stride8) + col];
+          if (abs(v - expected8) > BT709_FUZZ_TOLERANCE_ENCODE10) {
+            failed |= report(in, "bt709_frame10_encode", plane, col, row, v, expected8);
+            break;
+          }
+        }
+      }
+    }
+
+    free(buffer16);
+  }
+
+  free(actual.buffer);
+  free(expected.buffer);
+  free(frame.buffer);
+  free(pixels);
+
+  return failed;
+}
+
+// Same steps as bt709_sharp_refine_block() with the scalar eval
+
+static
+void reference_sharp_refine(const BT709SharpTables *tables, int Y[4], int Cb, int Cr, const float orig[3][4]) {
+  const float chroma[3] = {
+    tables->crR[Cr],
+    tables->crG[Cr] + tables->cbG[Cb],
+    tables->cbB[Cb]
+  };
+
+  float err[4];
+  int next[4];
+  bt709_sharp_block_eval_scalar(tables, Y, chroma, orig, err, next);
+
+  for (int it = 0; it < tables->iterations; it++) {
+    if (next[0] == Y[0] && next[1] == Y[1] && next[2] == Y[2] && next[3] == Y[3]) {
+      break;
+    }
+
+    float nextErr[4];
+    int nextNext[4];
+    bt709_sharp_block_eval_scalar(tables, next, chroma, orig, nextErr, nextNext);
+
+    for (int i = 0; i < 4; i++) {
+      if (nextErr[i] < err[i]) {
+        Y[i] = next[i];
+        err[i] = nextErr[i];
+        next[i] = nextNext[i];
+      } else {
+        next[i] = Y[i];
+      }
+    }
+  }
+}
+
+// The SIMD refinement must match the scalar refinement of the plain
+// encode, and Cb Cr are not changed.
+
+static
+int fuzz_sharp(const FuzzInput *in) {
+  const int width = in->width;
+  const int height = in->height;
+  const BT709PixelLayout layout = layout_for_index(in->layoutIndex);
+  const int bpp = layout.bytesPerPixel;
+  const int inBytesPerRow = (width * bpp) + in->padding;
+  const BT709SharpTables *tables = sharpTables[in->gammaIndex];
+
+  uint8_t *pixels = make_pixels(in, &layout, inBytesPerRow, 1);
+
+  FuzzPlanes expected, actual;
+  planes_alloc(&expected, width, height, in->padding);
+  planes_alloc(&actual, width, height, in->padding + 1);
+
+  bt709_frame_encode(&tables->frame, &layout, pixels, inBytesPerRow, width, height, &expected.planes);
+
+  const int offsets[3] = { layout.rOffset, layout.gOffset, layout.bOffset };
+  const BT709PlanesStruct *planes = &expected.planes;
+
+  for (int row = 0; row < height; row += 2) {
+    for (int col = 0; col < width; col += 2) {
+      uint8_t *yPtr = planes->yPtr + (row * planes->yBytesPerRow) + col;
+      uint8_t *corners[4] = { yPtr, yPtr + 1, yPtr + planes->yBytesPerRow, yPtr + planes->yBytesPerRow + 1 };
+      const uint8_t *p = pixels + (row * inBytesPerRow) + (col * bpp);
+      const uint8_t *inCorners[4] = { p, p + bpp, p + inBytesPerRow, p + inBytesPerRow + bpp };
+
+      float orig[3][4];
+      int Y[4];
+      for (int i = 0; i < 4; i++) {
+        for (int c = 0; c < 3; c++) {
+          orig[c][i] = tables->frame.toLinear[inCorners[i][offsets[c]]];
+        }
+        Y[i] = *corners[i];
+      }
+
+      reference_sharp_refine(tables, Y,
+                             planes->cbPtr[((row / 2) * planes->cbBytesPerRow) + (col / 2)],
+                             planes->crPtr[((row / 2) * planes->crBytesPerRow) + (col / 2)],
+                             orig);
+
+      for (int i = 0; i < 4; i++) {
+        *corners[i] = (uint8_t) Y[i];
+      }
+    }
+  }
+
+  bt709_sharp_encode(tables, &layout, pixels, inBytesPerRow, width, height, &actual.planes);
+  int failed = compare_planes(in, "bt709_sharp_encode", &actual.planes, &expected.planes, BT709_FUZZ_TOLERANCE_SHARP);
+
+  free(actual.buffer);
+  free(expected.buffer);
+  free(pixels);
+
+  return failed;
+}
+
+// Search the inverse table entry for a color if it is not filled in
+
+static
+const uint8_t* inverse_entry(int R, int G, int B) {
+  uint8_t *entry = inverseEntries + (((R << 16) | (G << 8) | B) * 3);
+  if (entry[0] == 0) {
+    bt709_inverse_search_pixel(inverseSearch, R, G, B, entry);
+  }
+  return entry;
+}
+
+static
+int inverse_round_trip_error(int R, int G, int B, int Y, int Cb, int Cr) {
+  int decR, decG, decB;
+  Apple196_to_sRGB_convertYCbCrToRGB(Y, Cb, Cr, &decR, &decG, &decB, 1);
+  return ((decR - R) * (decR - R)) + ((decG - G) * (decG - G)) + ((decB - B) * (decB - B));
+}
+
+// Each Y is the searched entry for its pixel and each Cb Cr is the
+// entry for the linear average of the block. A searched entry never
+// decodes further from the input than the forward matrix result.
+
+static
+int fuzz_inverse(const FuzzInput *in) {
+  FuzzInput crop = *in;
+  crop.width = (in->width < BT709_FUZZ_INVERSE_MAX_DIM) ? in->width : BT709_FUZZ_INVERSE_MAX_DIM;
+  crop.height = (in->height < BT709_FUZZ_INVERSE_MAX_DIM) ? in->height : BT709_FUZZ_INVERSE_MAX_DIM;
+
+  const int width = crop.width;
+  const int height = crop.height;
+  const BT709PixelLayout layout = layout_for_index(in->layoutIndex);
+  const int bpp = layout.bytesPerPixel;
+  const int inBytesPerRow = (width * bpp) + in->padding;
+  const BT709FrameTables *srgbTables = &inverseTable.srgbTables;
+  const int offsets[3] = { layout.rOffset, layout.gOffset, layout.bOffset };
+
+  int failed = 0;
+
+  uint8_t *pixels = make_pixels(&crop, &layout, inBytesPerRow, 1);
+
+  FuzzPlanes expected, actual;
+  planes_alloc(&expected, width, height, in->padding);
+  planes_alloc(&actual, width, height, in->padding + 1);
+
+  const BT709PlanesStruct *planes = &expected.planes;
+
+  for (int row = 0; row < height && !failed; row += 2) {
+    for (int col = 0; col < width && !failed; col += 2) {
+      const uint8_t *p = pixels + (row * inBytesPerRow) + (col * bpp);
+      const uint8_t *corners[4] = { p, p + bpp, p + inBytesPerRow, p + inBytesPerRow + bpp };
+
+      int ave[3];
+
+      for (int i = 0; i < 4; i++) {
+        const int R = corners[i][layout.rOffset];
+        const int G = corners[i][layout.gOffset];
+        const int B = corners[i][layout.bOffset];
+        const uint8_t *entry = inverse_entry(R, G, B);
+
+        int Y, Cb, Cr;
+        Apple196_from_sRGB_convertRGBToYCbCr(R, G, B, &Y, &Cb, &Cr);
+        const int forwardError = inverse_round_trip_error(R, G, B, Y, Cb, Cr);
+        const int searchError = inverse_round_trip_error(R, G, B, entry[0], entry[1], entry[2]);
+        if (searchError > forwardError) {
+          failed |= report(in, "bt709_inverse_search_pixel", 0, col + (i % 2), row + (i / 2), searchError, forwardError);
+          break;
+        }
+
+        planes->yPtr[((row + (i / 2)) * planes->yBytesPerRow) + col + (i % 2)] = entry[0];
+      }
+
+      for (int c = 0; c < 3; c++) {
+        const float *toLinear = srgbTables->toLinear;
+        float v = BT709_average_cbcr_linear(toLinear[corners[0][offsets[c]]], toLinear[corners[1][offsets[c]]],
+                                            toLinear[corners[2][offsets[c]]], toLinear[corners[3][offsets[c]]]);
+        ave[c] = bt709_frame_from_linear(srgbTables, v);
+      }
+
+      const uint8_t *entry = inverse_entry(ave[0], ave[1], ave[2]);
+      planes->cbPtr[((row / 2) * planes->cbBytesPerRow) + (col / 2)] = entry[1];
+      planes->crPtr[((row / 2) * planes->crBytesPerRow) + (col / 2)] = entry[2];
+    }
+  }
+
+  if (!failed) {
+    bt709_inverse_table_encode(&inverseTable, &layout, pixels, inBytesPerRow, width, height, &actual.planes);
+    failed |= compare_planes(&crop, "bt709_inverse_table_encode", &actual.planes, &expected.planes, 0);
+  }
+
+  free(actual.buffer);
+  free(expected.buffer);
+  free(pixels);
+
+  return failed;
+}
+
+// Encode a linear (R G B) float image the way a proxy level is
+// encoded, one pixel at a time.
+
+static
+void reference_encode_linear(const BT709FrameTables *tables, const float *image, int imageWidth,
+                             int width, int height, const BT709PlanesStruct *planes)
+{
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      const float *p = image + (((row * imageWidth) + col) * 3);
+      int Y, Cb, Cr;
+      BT709_convertNonLinearRGBToYCbCr(byteNorm(bt709_frame_from_linear(tables, p[0])),
+                                       byteNorm(bt709_frame_from_linear(tables, p[1])),
+                                       byteNorm(bt709_frame_from_linear(tables, p[2])),
+                                       &Y, &Cb, &Cr);
+      planes->yPtr[(row * planes->yBytesPerRow) + col] = Y;
+    }
+  }
+
+  for (int row = 0; row < height; row += 2) {
+    for (int col = 0; col < width; col += 2) {
+      const float *p1 = image + (((row * imageWidth) + col) * 3);
+      const float *p3 = p1 + (imageWidth * 3);
+      float ave[3];
+      for (int c = 0; c < 3; c++) {
+        ave[c] = BT709_average_cbcr_linear(p1[c], p1[3 + c], p3[c], p3[3 + c]);
+      }
+      int Y, Cb, Cr;
+      BT709_convertNonLinearRGBToYCbCr(byteNorm(bt709_frame_from_linear(tables, ave[0])),
+                                       byteNorm(bt709_frame_from_linear(tables, ave[1])),
+                                       byteNorm(bt709_frame_from_linear(tables, ave[2])),
+                                       &Y, &Cb, &Cr);
+      planes->cbPtr[((row / 2) * planes->cbBytesPerRow) + (col / 2)] = Cb;
+      planes->crPtr[((row / 2) * planes->crBytesPerRow) + (col / 2)] = Cr;
+    }
+  }
+}
+
+// Proxy levels generated row by row must match levels averaged from
+// the whole frame at once, including levels with an odd size.
+
+static
+int fuzz_pyramid(const FuzzInput *in) {
+  const int width = in->width;
+  const int height = in->height;
+  const BT709PixelLayout layout = layout_for_index(in->layoutIndex);
+  const int bpp = layout.bytesPerPixel;
+  const int inBytesPerRow = (width * bpp) + in->padding;
+  const BT709FrameTables *tables = frameTables[in->gammaIndex];
+
+  // Use as many of the requested levels as the frame size allows
+
+  int numLevels = in->numLevels;
+  while (numLevels > 0 && ((width >> numLevels) < 2 || (height >> numLevels) < 2)) {
+    numLevels--;
+  }
+  if (numLevels == 0) {
+    return 0;
+  }
+
+  int failed = 0;
+
+  uint8_t *pixels = make_pixels(in, &layout, inBytesPerRow, 1);
+
+  BT709Pyramid pyramid;
+  if (bt709_pyramid_init(&pyramid, tables, width, height, numLevels) != 0) {
+    bt709_pyramid_free(&pyramid);
+    free(pixels);
+    return report(in, "bt709_pyramid_init", 0, 0, 0, numLevels, 0);
+  }
+
+  FuzzPlanes expected, actual;
+  planes_alloc(&expected, width, height, in->padding);
+  planes_alloc(&actual, width, height, in->padding + 1);
+
+  bt709_frame_encode(tables, &layout, pixels, inBytesPerRow, width, height, &expected.planes);
+  bt709_pyramid_encode(&pyramid, &layout, pixels, inBytesPerRow, width, height, &actual.planes);
+  failed |= compare_planes(in, "bt709_pyramid_encode", &actual.planes, &expected.planes, 0);
+
+  // Level 0 is the input in linear light, each level below it is
+  // the 2x2 average of the level above.
+
+  int levelWidth = width;
+  int levelHeight = height;
+  float *image = malloc(sizeof(float) * 3 * width * height);
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      const uint8_t *p = pixels + (row * inBytesPerRow) + (col * bpp);
+      float *out = image + (((row * width) + col) * 3);
+      out[0] = tables->toLinear[p[layout.rOffset]];
+      out[1] = tables->toLinear[p[layout.gOffset]];
+      out[2] = tables->toLinear[p[layout.bOffset]];
+    }
+  }
+
+  for (int levelNum = 0; levelNum < numLevels && !failed; levelNum++) {
+    const int nextWidth = levelWidth / 2;
+    const int nextHeight = levelHeight / 2;
+    float *next = malloc(sizeof(float) * 3 * nextWidth * nextHeight);
+
+    for (int row = 0; row < nextHeight; row++) {
+      for (int col = 0; col < nextWidth; col++) {
+        const float *p1 = image + ((((row * 2) * levelWidth) + (col * 2)) * 3);
+        const float *p3 = p1 + (levelWidth * 3);
+        for (int c = 0; c < 3; c++) {
+          next[(((row * nextWidth) + col) * 3) + c] = BT709_average_cbcr_linear(p1[c], p1[3 + c], p3[c], p3[3 + c]);
+        }
+      }
+    }
+
+    free(image);
+    image = next;
+    levelWidth = nextWidth;
+    levelHeight = nextHeight;
+
+    const BT709PyramidLevel *level = &pyramid.levels[levelNum];
+
+    if (level->width != (levelWidth & ~1) || level->height != (levelHeight & ~1)) {
+      failed |= report(in, "bt709_pyramid_init level size", levelNum, level->width, level->height, levelWidth, levelHeight);
+      break;
+    }
+
+    FuzzPlanes levelPlanes;
+    planes_alloc(&levelPlanes, level->width, level->height, 0);
+    reference_encode_linear(tables, image, levelWidth, level->width, level->height, &levelPlanes.planes);
+
+    FuzzInput levelIn = *in;
+    levelIn.width = level->width;
+    levelIn.height = level->height;
+    const char *names[BT709_PYRAMID_MAX_LEVELS] = { "bt709_pyramid_encode 1/2", "bt709_pyramid_encode 1/4", "bt709_pyramid_encode 1/8" };
+    failed |= compare_planes(&levelIn, names[levelNum], &level->planes, &levelPlanes.planes, 0);
+
+    free(levelPlanes.buffer);
+  }
+
+  free(image);
+  bt709_pyramid_free(&pyramid);
+  free(actual.buffer);
+  free(expected.buffer);
+  free(pixels);
+
+  return failed;
+}
+
+// Interleave, deinterleave, strided copy and P010 packing must
+// match a plain loop over every sample.
+
+static
+int fuzz_pack(const FuzzInput *in) {
+  const int width = in->width;
+  const int height = in->height;
+  const int cWidth = width / 2;
+  const int cHeight = height / 2;
+
+  int failed = 0;
+
+  FuzzPlanes src, dst;
+  planes_alloc(&src, width, height, in->padding);
+  planes_alloc(&dst, width, height, in->padding + 3);
+
+  size_t offset = 0;
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      src.planes.yPtr[(row * src.planes.yBytesPerRow) + col] = content_byte(in, offset++);
+    }
+  }
+  for (int row = 0; row < cHeight; row++) {
+    for (int col = 0; col < cWidth; col++) {
+      src.planes.cbPtr[(row * src.planes.cbBytesPerRow) + col] = content_byte(in, offset++);
+      src.planes.crPtr[(row * src.planes.crBytesPerRow) + col] = content_byte(in, offset++);
+    }
+  }
+
+  const int cbcrBytesPerRow = (cWidth * 2) + in->padding;
+  uint8_t *cbcr = malloc((size_t) cbcrBytesPerRow * cHeight);
+
+  bt709_planes_interleave(cbcr, cbcrBytesPerRow,
+                          src.planes.cbPtr, src.planes.cbBytesPerRow,
+                          src.planes.crPtr, src.planes.crBytesPerRow,
+                          cWidth, cHeight);
+
+  for (int row = 0; row < cHeight && !failed; row++) {
+    for (int col = 0; col < cWidth; col++) {
+      const int cb = src.planes.cbPtr[(row * src.planes.cbBytesPerRow) + col];
+      const int cr = src.planes.crPtr[(row * src.planes.crBytesPerRow) + col];
+      const uint8_t *p = cbcr + (row * cbcrBytesPerRow) + (col * 2);
+      if (p[0] != cb || p[1] != cr) {
+        failed |= report(in, "bt709_planes_interleave", (p[0] != cb) ? 1 : 2, col, row, (p[0] != cb) ? p[0] : p[1], (p[0] != cb) ? cb : cr);
+        break;
+      }
+    }
+  }
+
+  if (!failed) {
+    bt709_planes_copy(dst.planes.yPtr, dst.planes.yBytesPerRow, src.planes.yPtr, src.planes.yBytesPerRow, width, height);
+    bt709_planes_deinterleave(dst.planes.cbPtr, dst.planes.cbBytesPerRow,
+                              dst.planes.crPtr, dst.planes.crBytesPerRow,
+                              cbcr, cbcrBytesPerRow,
+                              cWidth, cHeight);
+    failed |= compare_planes(in, "bt709_planes_copy and bt709_planes_deinterleave", &dst.planes, &src.planes, 0);
+  }
+
+  free(cbcr);
+
+  // 10 bit samples from pairs of content bytes
+
+  if (!failed) {
+    const int yBytesPerRow = (width + in->padding) * 2;
+    const int cBytesPerRow = (cWidth + in->padding) * 2;
+    uint16_t *buffer16 = malloc(((size_t) yBytesPerRow * height) + (2 * (size_t) cBytesPerRow * cHeight));
+
+    BT709Planes16Struct planes16;
+    planes16.yPtr = buffer16;
+    planes16.yBytesPerRow = yBytesPerRow;
+    planes16.cbPtr = buffer16 + ((yBytesPerRow / 2) * height);
+    planes16.cbBytesPerRow = cBytesPerRow;
+    planes16.crPtr = planes16.cbPtr + ((cBytesPerRow / 2) * cHeight);
+    planes16.crBytesPerRow = cBytesPerRow;
+
+    for (int i = 0; i < ((yBytesPerRow / 2) * height) + (cBytesPerRow * cHeight); i++) {
+      buffer16[i] = (uint16_t) (((content_byte(in, (i * 2) + 1) << 8) | content_byte(in, i * 2)) & 0x3FF);
+    }
+
+    const int outYBytesPerRow = (width * 2) + (in->padding * 2);
+    const int outCbCrBytesPerRow = (width * 2) + (in->padding * 4);
+    uint16_t *outY = malloc((size_t) outYBytesPerRow * height);
+    uint16_t *outCbCr = malloc((size_t) outCbCrBytesPerRow * cHeight);
+
+    bt709_frame10_pack_p010(&planes16, width, height, outY, outYBytesPerRow, outCbCr, outCbCrBytesPerRow);
+
+    for (int row = 0; row < height && !failed; row++) {
+      for (int col = 0; col < width; col++) {
+        const int v = outY[(row * (outYBytesPerRow / 2)) + col];
+        const int expected = planes16.yPtr[(row * (yBytesPerRow / 2)) + col] << 6;
+        if (v != expected) {
+          failed |= report(in, "bt709_frame10_pack_p010", 0, col, row, v, expected);
+          break;
+        }
+      }
+    }
+
+    for (int row = 0; row < cHeight && !failed; row++) {
+      for (int col = 0; col < (cWidth * 2); col++) {
+        const uint16_t *inPtr = ((col % 2) == 0) ? planes16.cbPtr : planes16.crPtr;
+        const int v = outCbCr[(row * (outCbCrBytesPerRow / 2)) + col];
+        const int expected = inPtr[(row * (cBytesPerRow / 2)) + (col / 2)] << 6;
+        if (v != expected) {
+          failed |= report(in, "bt709_frame10_pack_p010", 1 + (col % 2), col / 2, row, v, expected);
+          break;
+        }
+      }
+    }
+
+    free(outCbCr);
+    free(outY);
+    free(buffer16);
+  }
+
+  free(dst.buffer);
+  free(src.buffer);
+
+  return failed;
+}
+
+// Premultiply and unpremultiply rows, in place and to another
+// buffer, must match the exact integer formulas for every pixel.
+
+static
+int fuzz_alpha(const FuzzInput *in) {
+  const BT709PixelLayout layout = layout_for_index(in->layoutIndex);
+  if (layout.aOffset < 0) {
+    return 0;
+  }
+
+  const int width = in->width;
+  const int height = in->height;
+  const int inBytesPerRow = (width * 4) + in->padding;
+  const int offsets[4] = { layout.rOffset, layout.gOffset, layout.bOffset, layout.aOffset };
+
+  int failed = 0;
+
+  uint8_t *pixels = make_pixels(in, &layout, inBytesPerRow, 0);
+  uint8_t *out = malloc((size_t) inBytesPerRow * height);
+  uint8_t *inPlace = malloc((size_t) inBytesPerRow * height);
+
+  for (int op = 0; op < 2 && !failed; op++) {
+    const char *name = (op == 0) ? "bt709_alpha_premultiply_row" : "bt709_alpha_unpremultiply_row";
+
+    memcpy(inPlace, pixels, (size_t) inBytesPerRow * height);
+
+    for (int row = 0; row < height; row++) {
+      const uint8_t *inRow = pixels + (row * inBytesPerRow);
+      uint8_t *outRow = out + (row * inBytesPerRow);
+      uint8_t *inPlaceRow = inPlace + (row * inBytesPerRow);
+      if (op == 0) {
+        bt709_alpha_premultiply_row(&layout, outRow, inRow, width);
+        bt709_alpha_premultiply_row(&layout, inPlaceRow, inPlaceRow, width);
+      } else {
+        bt709_alpha_unpremultiply_row(alphaTables, &layout, outRow, inRow, width);
+        bt709_alpha_unpremultiply_row(alphaTables, &layout, inPlaceRow, inPlaceRow, width);
+      }
+    }
+
+    for (int row = 0; row < height && !failed; row++) {
+      for (int col = 0; col < width && !failed; col++) {
+        const uint8_t *p = pixels + (row * inBytesPerRow) + (col * 4);
+        const uint8_t *q = out + (row * inBytesPerRow) + (col * 4);
+        const uint8_t *r = inPlace + (row * inBytesPerRow) + (col * 4);
+        const int A = p[layout.aOffset];
+
+        for (int c = 0; c < 4; c++) {
+          const int C = p[offsets[c]];
+          int expected;
+          if (c == 3) {
+            expected = A;
+          } else if (op == 0) {
+            expected = (int) floor((C * A / 255.0) + 0.5);
+          } else if (A == 0) {
+            expected = 0;
+          } else {
+            expected = ((C * 255) + (A / 2)) / A;
+            expected = (expected > 255) ? 255 : expected;
+          }
+
+          if (q[offsets[c]] != expected) {
+            failed |= report(in, name, c, col, row, q[offsets[c]], expected);
+            break;
+          }
+          if (r[offsets[c]] != expected) {
+            failed |= report(in, (op == 0) ? "bt709_alpha_premultiply_row in place" : "bt709_alpha_unpremultiply_row in place",
+                             c, col, row, r[offsets[c]], expected);
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  free(inPlace);
+  free(out);
+  free(pixels);
+
+  return failed;
+}
+
+// Reference decode of one Y Cb Cr to normalized linear RGB
+
+static
+void reference_decode_linear(int gammaIndex, int Y, int Cb, int Cr, double *linear) {
+  const double Kr = 0.2126;
+  const double Kb = 0.0722;
+  const double Kg = 1.0 - Kr - Kb;
+
+  const double Yn = (Y - 16) / 219.0;
+  const double Cbn = (Cb - 128) / 224.0;
+  const double Crn = (Cr - 128) / 224.0;
+
+  double rgb[3];
+  rgb[0] = Yn + (2.0 * (1.0 - Kr) * Crn);
+  rgb[2] = Yn + (2.0 * (1.0 - Kb) * Cbn);
+  rgb[1] = (Yn - (Kr * rgb[0]) - (Kb * rgb[2])) / Kg;
+
+  for (int c = 0; c < 3; c++) {
+    double v = rgb[c];
+    v = (v < 0.0) ? 0.0 : ((v > 1.0) ? 1.0 : v);
+    if (gammas[gammaIndex] == BT709GammaSrgb) {
+      v = (v <= 0.04045) ? (v / 12.92) : pow((v + 0.055) / 1.055, 2.4);
+    } else if (gammas[gammaIndex] == BT709GammaApple) {
+      v = (v < 0.05583828) ? (v / 16.0) : pow(v, APPLE_GAMMA_196);
+    }
+    linear[c] = v;
+  }
+}
+
+static
+int reference_decode_byte(double linear) {
+  double v = (linear <= 0.0031308) ? (linear * 12.92) : ((1.055 * pow(linear, 1.0 / 2.4)) - 0.055);
+  return (int) round(v * 255.0);
+}
+
+static
+float half_to_float(uint16_t h) {
+  const int sign = (h >> 15) & 1;
+  const int exponent = (h >> 10) & 0x1F;
+  const int mantissa = h & 0x3FF;
+  float v;
+  if (exponent == 0) {
+    v = ldexpf((float) mantissa, -24);
+  } else {
+    v = ldexpf((float) (mantissa | 0x400), exponent - 25);
+  }
+  return sign ? -v : v;
+}
+
+static
+int fuzz_decode(const FuzzInput *in) {
+  const int width = in->width;
+  const int height = in->height;
+  const BT709PixelLayout layout = layout_for_index(in->layoutIndex);
+  const int bpp = layout.bytesPerPixel;
+  const int outBytesPerRow = (width * bpp) + in->padding;
+  const BT709DecodeTables *tables = decodeTables[in->gammaIndex];
+
+  int failed = 0;
+
+  // Planes are filled directly from the input so that values
+  // outside the video range are decoded too.
+
+  FuzzPlanes src;
+  planes_alloc(&src, width, height, in->padding);
+
+  size_t offset = 0;
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      src.planes.yPtr[(row * src.planes.yBytesPerRow) + col] = content_byte(in, offset++);
+    }
+  }
+  for (int row = 0; row < (height / 2); row++) {
+    for (int col = 0; col < (width / 2); col++) {
+      src.planes.cbPtr[(row * src.planes.cbBytesPerRow) + col] = content_byte(in, offset++);
+      src.planes.crPtr[(row * src.planes.crBytesPerRow) + col] = content_byte(in, offset++);
+    }
+  }
+
+  uint8_t *decoded = malloc((size_t) outBytesPerRow * height);
+  memset(decoded, 0, (size_t) outBytesPerRow * height);
+  bt709_decode_region(tables, &src.planes, 1, width, height, 0, 0, width, height, &layout, decoded, outBytesPerRow);
+
+  float *linear = malloc(3 * sizeof(float) * width * height);
+  BT709FloatPlanesStruct floatPlanes = {
+    linear, width * (int) sizeof(float),
+    linear + (width * height), width * (int) sizeof(float),
+    linear + (2 * width * height), width * (int) sizeof(float)
+  };
+  bt709_decode_region_float(tables, &src.planes, 1, width, height, 0, 0, width, height, &floatPlanes);
+
+  uint16_t *half = malloc(sizeof(uint16_t) * 4 * width * height);
+  bt709_decode_region_half(tables, &src.planes, 1, width, height, 0, 0, width, height, half, width * 8);
+
+  for (int row = 0; row < height && !failed; row++) {
+    for (int col = 0; col < width && !failed; col++) {
+      const int Y = src.planes.yPtr[(row * src.planes.yBytesPerRow) + col];
+      const int Cb = src.planes.cbPtr[((row / 2) * src.planes.cbBytesPerRow) + (col / 2)];
+      const int Cr = src.planes.crPtr[((row / 2) * src.planes.crBytesPerRow) + (col / 2)];
+
+      double expected[3];
+      reference_decode_linear(in->gammaIndex, Y, Cb, Cr, expected);
+
+      const uint8_t *p = decoded + (row * outBytesPerRow) + (col * bpp);
+      const int offsets[3] = { layout.rOffset, layout.gOffset, layout.bOffset };
+
+      for (int c = 0; c < 3; c++) {
+        const int expectedByte = reference_decode_byte(expected[c]);
+        if (abs(p[offsets[c]] - expectedByte) > BT709_FUZZ_TOLERANCE_DECODE) {
+          failed |= report(in, "bt709_decode_region", c, col, row, p[offsets[c]], expectedByte);
+          break;
+        }
+
+        const float f = linear[(c * width * height) + (row * width) + col];
+        if (fabs(f - expected[c]) > BT709_FUZZ_TOLERANCE_LINEAR) {
+          failed |= report(in, "bt709_decode_region_float", c, col, row, f, expected[c]);
+          break;
+        }
+
+        // The half float must be the nearest half to the float
+
+        const float h = half_to_float(half[(((row * width) + col) * 4) + c]);
+        if (fabsf(h - f) > (ldexpf(fmaxf(f, ldexpf(1.0f, -14)), -11) * 1.0001f)) {
+          failed |= report(in, "bt709_decode_region_half", c, col, row, h, f);
+          break;
+        }
+      }
+
+      if (!failed && layout.aOffset >= 0 && p[layout.aOffset] != 0xFF) {
+        failed |= report(in, "bt709_decode_region alpha", 3, col, row, p[layout.aOffset], 0xFF);
+      }
+    }
+  }
+
+  // A region that starts at an odd offset must match the same
+  // pixels of the full frame decode.
+
+  if (!failed) {
+    const int x = in->regionSeed % width;
+    const int y = (in->regionSeed / BT709_FUZZ_MAX_DIM) % height;
+    const int rw = 1 + ((in->regionSeed >> 3) % (width - x));
+    const int rh = 1 + ((in->regionSeed >> 7) % (height - y));
+    const int regionBytesPerRow = (rw * bpp) + 3;
+
+    uint8_t *region = malloc((size_t) regionBytesPerRow * rh);
+    bt709_decode_region(tables, &src.planes, 1, width, height, x, y, rw, rh, &layout, region, regionBytesPerRow);
+
+    for (int row = 0; row < rh && !failed; row++) {
+      const uint8_t *a = region + (row * regionBytesPerRow);
+      const uint8_t *b = decoded + ((y + row) * outBytesPerRow) + (x * bpp);
+      for (int i = 0; i < (rw * bpp); i++) {
+        if (a[i] != b[i]) {
+          failed |= report(in, "bt709_decode_region sub region", i % bpp, x + (i / bpp), y + row, a[i], b[i]);
+          break;
+        }
+      }
+    }
+
+    free(region);
+  }
+
+  // Compositing with opaque alpha is a plain decode and with
+  // transparent alpha leaves the background as is.
+
+  if (!failed) {
+    const int alphaBytesPerRow = width + in->padding;
+    uint8_t *alpha = malloc((size_t) alphaBytesPerRow * height);
+    uint8_t *over = malloc((size_t) outBytesPerRow * height);
+
+    for (int pass = 0; pass < 2 && !failed; pass++) {
+      memset(alpha, (pass == 0) ? 235 : 16, (size_t) alphaBytesPerRow * height);
+      for (int i = 0; i < (outBytesPerRow * height); i++) {
+        over[i] = content_byte(in, i + 7);
+      }
+      if (layout.aOffset >= 0) {
+        for (int row = 0; row < height; row++) {
+          for (int col = 0; col < width; col++) {
+            over[(row * outBytesPerRow) + (col * bpp) + layout.aOffset] = 0xFF;
+          }
+        }
+      }
+
+      uint8_t *background = malloc((size_t) outBytesPerRow * height);
+      memcpy(background, over, (size_t) outBytesPerRow * height);
+
+      bt709_decode_region_over(tables, &src.planes, 1, alpha, alphaBytesPerRow, width, height, 0, 0, width, height,
+                               &layout, over, outBytesPerRow, over, outBytesPerRow);
+
+      const uint8_t *expectedPixels = (pass == 0) ? decoded : background;
+
+      for (int row = 0; row < height && !failed; row++) {
+        for (int i = 0; i < (width * bpp); i++) {
+          const int v = over[(row * outBytesPerRow) + i];
+          const int expectedByte = expectedPixels[(row * outBytesPerRow) + i];
+          if (v != expectedByte) {
+            failed |= report(in, (pass == 0) ? "bt709_decode_region_over opaque" : "bt709_decode_region_over transparent",
+                             i % bpp, i / bpp, row, v, expectedByte);
+            break;
+          }
+        }
+      }
+
+      free(background);
+    }
+
+    free(alpha);
+    free(over);
+  }
+
+  free(half);
+  free(linear);
+  free(decoded);
+  free(src.buffer);
+
+  return failed;
+}
+
+// Run every implementation on one input, returns 1 on a mismatch
+
+static
+int fuzz_one_input(const uint8_t *data, size_t size) {
+  FuzzInput in;
+  parse_input(&in, data, size);
+  init_tables(in.gammaIndex);
+
+  int (*const funcs[])(const FuzzInput *in) = {
+    fuzz_encode, fuzz_sharp, fuzz_inverse, fuzz_pyramid, fuzz_pack, fuzz_alpha, fuzz_decode
+  };
+
+  int failed = 0;
+  for (int i = 0; i < (int) (sizeof(funcs) / sizeof(funcs[0])) && !failed; i++) {
+    failed = funcs[i](&in);
+  }
+  return failed;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (fuzz_one_input(data, size)) {
+    fflush(stdout);
+    abort();
+  }
+  return 0;
+}
+
+#if !defined(BT709_FUZZ_LIBFUZZER)
+
+// Shrink a failing input: drop chunks of bytes, then zero single
+// bytes, keeping each change that still fails. A zero header byte
+// selects the smallest frame and the first layout and gamma.
+
+static
+size_t minimize_input(uint8_t *data, size_t size) {
+  verbose = 0;
+
+  for (size_t chunk = size / 2; chunk >= 1; chunk /= 2) {
+    size_t offset = BT709_FUZZ_HEADER_SIZE;
+    while (offset + chunk <= size) {
+      uint8_t *copy = malloc(size);
+      memcpy(copy, data, size);
+      memmove(copy + offset, copy + offset + chunk, size - offset - chunk);
+
+      if (fuzz_one_input(copy, size - chunk)) {
+        memcpy(data, copy, size - chunk);
+        size -= chunk;
+      } else {
+        offset += chunk;
+      }
+      free(copy);
+    }
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    if (data[i] == 0) {
+      continue;
+    }
+    uint8_t saved = data[i];
+    data[i] = 0;
+    if (!fuzz_one_input(data, size)) {
+      data[i] = saved;
+    }
+  }
+
+  verbose = 1;
+  return size;
+}
+
+static
+int write_input(const char *path, const uint8_t *data, size_t size) {
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) {
+    printf("can't open output file \"%s\"\n", path);
+    return 1;
+  }
+  fwrite(data, 1, size, fp);
+  fclose(fp);
+  return 0;
+}
+
+static
+uint8_t* read_input(const char *path, size_t *sizePtr) {
+  FILE *fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+  if (fp == NULL) {
+    printf("can't open input file \"%s\"\n", path);
+    return NULL;
+  }
+
+  size_t size = 0;
+  size_t capacity = 4096;
+  uint8_t *data = malloc(capacity);
+  size_t n;
+  while ((n = fread(data + size, 1, capacity - size, fp)) > 0) {
+    size += n;
+    if (size == capacity) {
+      capacity *= 2;
+      data = realloc(data, capacity);
+    }
+  }
+
+  if (fp != stdin) {
+    fclose(fp);
+  }
+
+  *sizePtr = size;
+  return data;
+}
+
+// xorshift so that a seed gives the same inputs on every platform
+
+static
+uint32_t next_random(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+static
+int run_random(int numInputs, uint32_t seed, const char *outPath) {
+  uint32_t state = (seed == 0) ? 1 : seed;
+  uint8_t data[BT709_FUZZ_HEADER_SIZE + 512];
+
+  for (int i = 0; i < numInputs; i++) {
+    const size_t size = next_random(&state) % sizeof(data);
+    for (size_t j = 0; j < size; j++) {
+      data[j] = (uint8_t) next_random(&state);
+    }
+
+    if (fuzz_one_input(data, size)) {
+      printf("input %d of %d failed, minimizing\n", i, numInputs);
+      size_t minSize = minimize_input(data, size);
+      fuzz_one_input(data, minSize);
+      write_input(outPath, data, minSize);
+      printf("wrote %d byte input to %s\n", (int) minSize, outPath);
+      return 1;
+    }
+  }
+
+  printf("%d random inputs passed (seed %u)\n", numInputs, seed);
+  return 0;
+}
+
+int main(int argc, const char * argv[]) {
+  if (argc < 2) {
+    printf("usage: bt709_fuzz FILE...\n");
+    printf("       bt709_fuzz -random N [-seed S] [-out FILE]\n");
+    printf("       bt709_fuzz -minimize FILE OUT\n");
+    return 2;
+  }
+
+  if (strcmp(argv[1], "-random") == 0) {
+    int numInputs = (argc > 2) ? atoi(argv[2]) : 1000;
+    uint32_t seed = 1;
+    const char *outPath = "bt709_fuzz_failed.bin";
+
+    for (int i = 3; i + 1 < argc; i += 2) {
+      if (strcmp(argv[i], "-seed") == 0) {
+        seed = (uint32_t) strtoul(argv[i + 1], NULL, 10);
+      } else if (strcmp(argv[i], "-out") == 0) {
+        outPath = argv[i + 1];
+      } else {
+        printf("unknown option \"%s\"\n", argv[i]);
+        return 2;
+      }
+    }
+
+    return run_random(numInputs, seed, outPath);
+  }
+
+  if (strcmp(argv[1], "-minimize") == 0) {
+    if (argc != 4) {
+      printf("usage: bt709_fuzz -minimize FILE OUT\n");
+      return 2;
+    }
+
+    size_t size;
+    uint8_t *data = read_input(argv[2], &size);
+    if (data == NULL) {
+      return 2;
+    }
+    if (!fuzz_one_input(data, size)) {
+      printf("input does not fail\n");
+      free(data);
+      return 1;
+    }
+    size = minimize_input(data, size);
+    int retcode = write_input(argv[3], data, size);
+    printf("wrote %d byte input to %s\n", (int) size, argv[3]);
+    free(data);
+    return retcode;
+  }
+
+  // afl-fuzz only sees a crash as a failure, so a mismatch aborts
+  // after it has been reported.
+
+  for (int i = 1; i < argc; i++) {
+    size_t size;
+    uint8_t *data = read_input(argv[i], &size);
+    if (data == NULL) {
+      return 2;
+    }
+    printf("%s\n", argv[i]);
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+  }
+
+  return 0;
+}
+
+#endif // BT709_FUZZ_LIBFUZZER
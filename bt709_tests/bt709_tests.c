@@ -0,0 +1,1529 @@
+//
+//  bt709_tests.c
+//
+//  Conformance and throughput tests for the portable conversion
+//  core, built with CMake so that the math can be checked on Linux
+//  without Xcode. The expected values are the ones used by the
+//  XCTest cases named next to each group.
+//
+//  Each group also measures throughput and fails when it is below
+//  a floor given in megapixels per second, pass 0 to only report.
+//
+//  usage: bt709_tests GROUP [MIN_MPPS]
+//
+//  Licensed under BSD terms.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "BT709.h"
+#include "bt709_frame.h"
+#include "bt709_decode.h"
+#include "bt709_alpha.h"
+#include "bt709_metrics.h"
+#include "y4m_reader.h"
+#include "y4m_async_writer.h"
+#include "bt709_frame_cache.h"
+
+static int numChecks = 0;
+static int numFailed = 0;
+
+#define CHECK_EQ(v, expected, label) \
+  do { \
+    int _v = (v); \
+    int _e = (expected); \
+    numChecks += 1; \
+    if (_v != _e) { \
+      numFailed += 1; \
+      printf("FAIL %s:%d %s : %d != %d\n", __FILE__, __LINE__, (label), _v, _e); \
+    } \
+  } while (0)
+
+static
+double now_seconds() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+// Call func until at least minSeconds have elapsed and return the
+// number of megapixels per second, pixelsPerCall is the number of
+// pixels one call processes.
+
+typedef void (*ThroughputFunc)(void *ctx);
+
+static
+double measure_mpps(ThroughputFunc func, void *ctx, double pixelsPerCall) {
+  const double minSeconds = 0.25;
+  int numCalls = 0;
+
+  func(ctx);
+
+  double startTime = now_seconds();
+  double elapsed;
+
+  do {
+    func(ctx);
+    numCalls += 1;
+    elapsed = now_seconds() - startTime;
+  } while (elapsed < minSeconds);
+
+  return (pixelsPerCall * numCalls) / elapsed / 1000000.0;
+}
+
+static
+void check_throughput(const char *group, double mpps, double minMpps) {
+  printf("%s throughput %.2f MP/s (floor %.2f)\n", group, mpps, minMpps);
+  numChecks += 1;
+  if (mpps < minMpps) {
+    numFailed += 1;
+    printf("FAIL %s throughput %.2f MP/s is below the floor %.2f MP/s\n", group, mpps, minMpps);
+  }
+}
+
+// Encode a 2x2 frame of one sRGB color with the frame encoder
+
+static
+void frame_encode_color(const BT709FrameTables *tables, int R, int G, int B, int *YPtr, int *CbPtr, int *CrPtr) {
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  uint8_t pixels[2 * 2 * 3];
+  for (int i = 0; i < 4; i++) {
+    pixels[(i * 3)] = R;
+    pixels[(i * 3) + 1] = G;
+    pixels[(i * 3) + 2] = B;
+  }
+
+  uint8_t Y[4], Cb, Cr;
+  BT709PlanesStruct planes = { Y, 2, &Cb, 1, &Cr, 1 };
+  bt709_frame_encode(tables, &layout, pixels, 2 * 3, 2, 2, &planes);
+
+  *YPtr = Y[0];
+  *CbPtr = Cb;
+  *CrPtr = Cr;
+}
+
+// Decode one (Y Cb Cr) with the CPU decoder, the same math as the
+// Metal decode shader.
+
+static
+void frame_decode_color(const BT709DecodeTables *tables, int Y, int Cb, int Cr, int *RPtr, int *GPtr, int *BPtr) {
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  uint8_t Yp[4] = { Y, Y, Y, Y };
+  uint8_t Cbp = Cb;
+  uint8_t Crp = Cr;
+  BT709PlanesStruct planes = { Yp, 2, &Cbp, 1, &Crp, 1 };
+
+  uint8_t out[2 * 2 * 3];
+  bt709_decode_region(tables, &planes, 1, 2, 2, 0, 0, 2, 2, &layout, out, 2 * 3);
+
+  *RPtr = out[0];
+  *GPtr = out[1];
+  *BPtr = out[2];
+}
+
+// Frame of vertical color bars for the throughput measurement
+
+typedef struct {
+  const BT709FrameTables *encodeTables;
+  const BT709DecodeTables *decodeTables;
+  int width;
+  int height;
+  uint8_t *pixels;
+  uint8_t *decoded;
+  uint8_t *Y;
+  uint8_t *Cb;
+  uint8_t *Cr;
+} BarsFrame;
+
+static
+void bars_frame_init(BarsFrame *frame, const int (*colors)[3], int numColors) {
+  frame->width = 1920;
+  frame->height = 1080;
+
+  const int width = frame->width;
+  const int height = frame->height;
+
+  frame->pixels = malloc(width * height * 4);
+  frame->decoded = malloc(width * height * 4);
+  frame->Y = malloc(width * height);
+  frame->Cb = malloc((width / 2) * (height / 2));
+  frame->Cr = malloc((width / 2) * (height / 2));
+
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      const int *c = colors[(col * numColors) / width];
+      uint8_t *p = frame->pixels + (((row * width) + col) * 4);
+      p[0] = c[2];
+      p[1] = c[1];
+      p[2] = c[0];
+      p[3] = 0xFF;
+    }
+  }
+}
+
+static
+void bars_frame_free(BarsFrame *frame) {
+  free(frame->pixels);
+  free(frame->decoded);
+  free(frame->Y);
+  free(frame->Cb);
+  free(frame->Cr);
+}
+
+// Encode and then decode the whole frame
+
+static
+void bars_frame_round_trip(void *ctx) {
+  BarsFrame *frame = (BarsFrame *) ctx;
+  const int width = frame->width;
+  const int height = frame->height;
+
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+  BT709PlanesStruct planes = { frame->Y, width, frame->Cb, width / 2, frame->Cr, width / 2 };
+
+  bt709_frame_encode(frame->encodeTables, &layout, frame->pixels, width * 4, width, height, &planes);
+  bt709_decode_region(frame->decodeTables, &planes, 1, width, height, 0, 0, width, height, &layout, frame->decoded, width * 4);
+}
+
+static
+double bars_frame_mpps(const BT709FrameTables *encodeTables,
+                       const BT709DecodeTables *decodeTables,
+                       const int (*colors)[3],
+                       int numColors)
+{
+  BarsFrame frame;
+  bars_frame_init(&frame, colors, numColors);
+  frame.encodeTables = encodeTables;
+  frame.decodeTables = decodeTables;
+
+  double mpps = measure_mpps(bars_frame_round_trip, &frame, (double) frame.width * frame.height);
+
+  bars_frame_free(&frame);
+  return mpps;
+}
+
+// SMPTE gray levels, see testBT709Decoder_SMPTE_Gray_*_software in
+// AppleEncodeDecodeBT709Tests.m and MetalBT709DecoderTests.m.
+
+static
+int test_smpte_gray(double minMpps) {
+  // sRGB gray, software (Y Cb Cr), software decode delta
+
+  static const int software[][5] = {
+    { 225, 205, 128, 128, -1 },
+    { 188, 170, 128, 128,  0 },
+    {  85,  80, 128, 128, -1 },
+    { 137, 124, 128, 128,  0 },
+    {  89,  84, 128, 128,  0 },
+    {  64,  64, 128, 128,  0 },
+    {  32,  41, 128, 128,  0 },
+    {  30,  40, 128, 128,  0 },
+    {  25,  37, 128, 128, +1 },
+    {   8,  25, 128, 128,  0 },
+    {   5,  21, 128, 128,  0 },
+    {   2,  18, 128, 128,  0 },
+    {   1,  17, 128, 128,  0 },
+    {   0,  16, 128, 128,  0 },
+  };
+
+  for (int i = 0; i < (int) (sizeof(software) / sizeof(software[0])); i++) {
+    const int *t = software[i];
+    char label[64];
+    snprintf(label, sizeof(label), "software gray %d", t[0]);
+
+    int Y, Cb, Cr, R, G, B;
+    CHECK_EQ(Apple196_from_sRGB_convertRGBToYCbCr(t[0], t[0], t[0], &Y, &Cb, &Cr), 0, label);
+    CHECK_EQ(Y, t[1], label);
+    CHECK_EQ(Cb, t[2], label);
+    CHECK_EQ(Cr, t[3], label);
+
+    CHECK_EQ(Apple196_to_sRGB_convertYCbCrToRGB(Y, Cb, Cr, &R, &G, &B, 1), 0, label);
+    CHECK_EQ(R, t[0] + t[4], label);
+    CHECK_EQ(G, t[0] + t[4], label);
+    CHECK_EQ(B, t[0] + t[4], label);
+  }
+
+  // sRGB gray, vImage encoded Y, Metal decode delta. The frame
+  // encoder and CPU decoder must produce the same values.
+
+  static const int metal[][3] = {
+    { 225, 206, +1 },
+    { 188, 171, +1 },
+    { 137, 124,  0 },
+    {  89,  84,  0 },
+    {  64,  64,  0 },
+    {  32,  41,  0 },
+    {  30,  40,  0 },
+    {  25,  37, +1 },
+    {   8,  25,  0 },
+    {   5,  21,  0 },
+    {   2,  18,  0 },
+  };
+
+  BT709FrameTables *encodeTables = malloc(sizeof(BT709FrameTables));
+  bt709_frame_tables_init(encodeTables, BT709GammaSrgb, BT709GammaApple);
+
+  BT709DecodeTables *decodeTables = malloc(sizeof(BT709DecodeTables));
+  bt709_decode_tables_init(decodeTables, BT709GammaApple);
+
+  int colors[sizeof(metal) / sizeof(metal[0])][3];
+
+  for (int i = 0; i < (int) (sizeof(metal) / sizeof(metal[0])); i++) {
+    const int *t = metal[i];
+    char label[64];
+    snprintf(label, sizeof(label), "metal gray %d", t[0]);
+
+    int Y, Cb, Cr, R, G, B;
+    frame_encode_color(encodeTables, t[0], t[0], t[0], &Y, &Cb, &Cr);
+    CHECK_EQ(Y, t[1], label);
+    CHECK_EQ(Cb, 128, label);
+    CHECK_EQ(Cr, 128, label);
+
+    frame_decode_color(decodeTables, t[1], 128, 128, &R, &G, &B);
+    CHECK_EQ(R, t[0] + t[2], label);
+    CHECK_EQ(G, t[0] + t[2], label);
+    CHECK_EQ(B, t[0] + t[2], label);
+
+    colors[i][0] = t[0];
+    colors[i][1] = t[0];
+    colors[i][2] = t[0];
+  }
+
+  check_throughput("smpte_gray", bars_frame_mpps(encodeTables, decodeTables, colors, sizeof(metal) / sizeof(metal[0])), minMpps);
+
+  free(encodeTables);
+  free(decodeTables);
+
+  return 0;
+}
+
+// Primary and secondary colors at 100%, 67% and 33% intensity, see
+// testMetalBT709Decoder_0x* in MetalBT709DecoderTests.m. Expected
+// (Y Cb Cr) are from the vImage encoder and the decode deltas are
+// from the Metal decoder.
+
+static
+int test_primaries(double minMpps) {
+  // sRGB (R G B), (Y Cb Cr), decode delta (R G B)
+
+  static const int primaries[][9] = {
+    { 255, 255, 255, 235, 128, 128,  0,  0,  0 },
+    { 170, 170, 170, 153, 128, 128, -1, -1, -1 },
+    { 128, 128, 128, 117, 128, 128, +1, +1, +1 },
+    {  85,  85,  85,  80, 128, 128, -1, -1, -1 },
+    {   0,   0,   0,  16, 128, 128,  0,  0,  0 },
+    {   0,   0, 255,  32, 240, 118, +1,  0,  0 },
+    {   0,   0, 170,  26, 198, 122, +1,  0, -1 },
+    {   0, 255, 255, 188, 154,  16,  0, -1,  0 },
+    {   0,  85,  85,  67, 136,  95,  0,  0, +1 },
+    {   0, 255,   0, 173,  42,  27, +1,  0, +1 },
+    {   0, 170,   0, 114,  74,  64,  0,  0,  0 },
+    { 255, 255,   0, 219,  16, 138, -1,  0,  0 },
+    {  85,  85,   0,  76,  95, 131,  0,  0,  0 },
+    { 255,   0,   0,  63, 102, 240,  0,  0,  0 },
+    { 170,   0,   0,  45, 112, 198, -1,  0,  0 },
+    { 255,   0, 255,  78, 214, 230,  0,  0, -1 },
+    {  85,   0,  85,  34, 153, 158,  0,  0, -1 },
+  };
+
+  const int numPrimaries = sizeof(primaries) / sizeof(primaries[0]);
+
+  BT709FrameTables *encodeTables = malloc(sizeof(BT709FrameTables));
+  bt709_frame_tables_init(encodeTables, BT709GammaSrgb, BT709GammaApple);
+
+  BT709DecodeTables *decodeTables = malloc(sizeof(BT709DecodeTables));
+  bt709_decode_tables_init(decodeTables, BT709GammaApple);
+
+  int colors[sizeof(primaries) / sizeof(primaries[0])][3];
+
+  for (int i = 0; i < numPrimaries; i++) {
+    const int *t = primaries[i];
+    char label[64];
+    snprintf(label, sizeof(label), "primary (%d %d %d)", t[0], t[1], t[2]);
+
+    // The C encoder differs from vImage by one in two places, 50%
+    // gray rounds Y down to 116 and green rounds Cr down to 26, the
+    // same as the software encoder.
+
+    int expectedY = t[3];
+    int expectedCr = t[5];
+
+    if (t[0] == 128) {
+      expectedY = 116;
+    } else if (t[0] == 0 && t[1] == 255 && t[2] == 0) {
+      expectedCr = 26;
+    }
+
+    int Y, Cb, Cr, R, G, B;
+    frame_encode_color(encodeTables, t[0], t[1], t[2], &Y, &Cb, &Cr);
+    CHECK_EQ(Y, expectedY, label);
+    CHECK_EQ(Cb, t[4], label);
+    CHECK_EQ(Cr, expectedCr, label);
+
+    frame_decode_color(decodeTables, t[3], t[4], t[5], &R, &G, &B);
+    CHECK_EQ(R, t[0] + t[6], label);
+    CHECK_EQ(G, t[1] + t[7], label);
+    CHECK_EQ(B, t[2] + t[8], label);
+
+    colors[i][0] = t[0];
+    colors[i][1] = t[1];
+    colors[i][2] = t[2];
+  }
+
+  check_throughput("primaries", bars_frame_mpps(encodeTables, decodeTables, colors, numPrimaries), minMpps);
+
+  free(encodeTables);
+  free(decodeTables);
+
+  return 0;
+}
+
+// One corner of a 2x2 block with the BT.709 gamma curve, see
+// testConvertsSRGBToYCbCr_ResampleUpper* in CoreImageMetalFilterTests.m.
+
+static const int resampleUpper[][9] = {
+  // sRGB (R G B), (Y Cb Cr), decode delta (R G B)
+  {  40, 201,  53, 142,  76,  59, -1,  0,  0 },
+  {  52, 195,  59, 141,  80,  67,  0,  0, +1 },
+  { 214,  53, 201,  89, 180, 197,  0,  0,  0 },
+  { 202,  58, 197,  90, 178, 189,  0, +1, +1 },
+};
+
+static
+void resample_upper_pixels(void *ctx) {
+  int *sum = (int *) ctx;
+
+  for (int i = 0; i < 65536; i++) {
+    const int *t = resampleUpper[i % 4];
+    int Y, Cb, Cr, R, G, B;
+    BT709_from_sRGB_convertRGBToYCbCr(t[0], t[1], (t[2] + i) & 0xFF, &Y, &Cb, &Cr, 1);
+    BT709_to_sRGB_convertYCbCrToRGB(Y, Cb, Cr, &R, &G, &B, 1);
+    *sum += R + G + B;
+  }
+}
+
+static
+int test_resample_upper(double minMpps) {
+  for (int i = 0; i < 4; i++) {
+    const int *t = resampleUpper[i];
+    char label[64];
+    snprintf(label, sizeof(label), "resample (%d %d %d)", t[0], t[1], t[2]);
+
+    int Y, Cb, Cr, R, G, B;
+    CHECK_EQ(BT709_from_sRGB_convertRGBToYCbCr(t[0], t[1], t[2], &Y, &Cb, &Cr, 1), 0, label);
+    CHECK_EQ(Y, t[3], label);
+    CHECK_EQ(Cb, t[4], label);
+    CHECK_EQ(Cr, t[5], label);
+
+    CHECK_EQ(BT709_to_sRGB_convertYCbCrToRGB(Y, Cb, Cr, &R, &G, &B, 1), 0, label);
+    CHECK_EQ(R, t[0] + t[6], label);
+    CHECK_EQ(G, t[1] + t[7], label);
+    CHECK_EQ(B, t[2] + t[8], label);
+  }
+
+  int sum = 0;
+  check_throughput("resample_upper", measure_mpps(resample_upper_pixels, &sum, 65536), minMpps);
+
+  return 0;
+}
+
+// Gamma correct average of a 2x2 block, see
+// testConvertsSRGBToYCbCr_AverageOf4_* in CoreImageMetalFilterTests.m.
+
+typedef struct {
+  int pixels[4][3];
+  BT709Gamma outputGamma;
+  int expected[6]; // Y1 Y2 Y3 Y4 Cb Cr
+} AverageOf4Case;
+
+static const AverageOf4Case averageOf4[] = {
+  { { { 40, 201, 53 }, { 52, 195, 59 }, { 214, 53, 201 }, { 202, 58, 197 } }, BT709GammaSrgb, { 150, 149, 100, 101, 128, 131 } },
+  { { { 40, 201, 53 }, { 52, 195, 59 }, { 214, 53, 201 }, { 202, 58, 197 } }, BT709GammaApple, { 145, 142, 95, 95, 128, 131 } },
+  { { { 40, 201, 53 }, { 52, 195, 59 }, { 214, 53, 201 }, { 202, 58, 197 } }, BT709GammaLinear, { 109, 104, 62, 59, 128, 131 } },
+  { { { 8, 210, 54 }, { 6, 214, 51 }, { 247, 45, 201 }, { 248, 40, 203 } }, BT709GammaSrgb, { 150, 152, 101, 98, 123, 139 } },
+  { { { 10, 204, 66 }, { 14, 201, 70 }, { 244, 51, 186 }, { 240, 54, 183 } }, BT709GammaSrgb, { 147, 146, 103, 104, 121, 140 } },
+};
+
+static
+void average_of_4_blocks(void *ctx) {
+  int *sum = (int *) ctx;
+
+  for (int i = 0; i < 16384; i++) {
+    const AverageOf4Case *t = &averageOf4[i % 5];
+    int Y1, Y2, Y3, Y4, Cb, Cr;
+    BT709_average_pixel_values(t->pixels[0][0], t->pixels[0][1], t->pixels[0][2],
+                               t->pixels[1][0], t->pixels[1][1], t->pixels[1][2],
+                               t->pixels[2][0], t->pixels[2][1], t->pixels[2][2],
+                               t->pixels[3][0], t->pixels[3][1], (t->pixels[3][2] + i) & 0xFF,
+                               &Y1, &Y2, &Y3, &Y4, &Cb, &Cr,
+                               BT709GammaSrgb, t->outputGamma);
+    *sum += Y1 + Cb + Cr;
+  }
+}
+
+static
+int test_average_of_4(double minMpps) {
+  // The frame encoder must give the same result for a 2x2 frame
+
+  BT709FrameTables *tables = malloc(sizeof(BT709FrameTables));
+  BT709PixelLayout layout = bt709_pixel_layout_rgb();
+
+  for (int i = 0; i < (int) (sizeof(averageOf4) / sizeof(averageOf4[0])); i++) {
+    const AverageOf4Case *t = &averageOf4[i];
+    char label[64];
+    snprintf(label, sizeof(label), "average of 4 case %d", i);
+
+    int out[6];
+    BT709_average_pixel_values(t->pixels[0][0], t->pixels[0][1], t->pixels[0][2],
+                               t->pixels[1][0], t->pixels[1][1], t->pixels[1][2],
+                               t->pixels[2][0], t->pixels[2][1], t->pixels[2][2],
+                               t->pixels[3][0], t->pixels[3][1], t->pixels[3][2],
+                               &out[0], &out[1], &out[2], &out[3], &out[4], &out[5],
+                               BT709GammaSrgb, t->outputGamma);
+
+    for (int j = 0; j < 6; j++) {
+      CHECK_EQ(out[j], t->expected[j], label);
+    }
+
+    bt709_frame_tables_init(tables, BT709GammaSrgb, t->outputGamma);
+
+    uint8_t pixels[2 * 2 * 3];
+    for (int p = 0; p < 4; p++) {
+      for (int c = 0; c < 3; c++) {
+        pixels[(p * 3) + c] = t->pixels[p][c];
+      }
+    }
+
+    uint8_t Y[4], Cb, Cr;
+    BT709PlanesStruct planes = { Y, 2, &Cb, 1, &Cr, 1 };
+    bt709_frame_encode(tables, &layout, pixels, 2 * 3, 2, 2, &planes);
+
+    for (int j = 0; j < 4; j++) {
+      CHECK_EQ(Y[j], t->expected[j], label);
+    }
+    CHECK_EQ(Cb, t->expected[4], label);
+    CHECK_EQ(Cr, t->expected[5], label);
+  }
+
+  free(tables);
+
+  int sum = 0;
+  check_throughput("average_of_4", measure_mpps(average_of_4_blocks, &sum, 16384 * 4), minMpps);
+
+  return 0;
+}
+
+// Scalar SSIM reference, each 8x8 window is summed directly
+
+static
+void ssim_reference(const uint8_t *a, int aBytesPerRow,
+                    const uint8_t *b, int bBytesPerRow,
+                    int width, int height,
+                    double *ssimSumPtr, uint64_t *ssimCountPtr)
+{
+  const double C1 = (0.01 * 255) * (0.01 * 255);
+  const double C2 = (0.03 * 255) * (0.03 * 255);
+
+  for (int row = 0; row <= (height - 8); row += 4) {
+    for (int col = 0; col <= (width - 8); col += 4) {
+      uint32_t sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+
+      for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+          uint32_t va = a[((row + y) * aBytesPerRow) + col + x];
+          uint32_t vb = b[((row + y) * bBytesPerRow) + col + x];
+          sa += va;
+          sb += vb;
+          saa += va * va;
+          sbb += vb * vb;
+          sab += va * vb;
+        }
+      }
+
+      const double n = 64.0;
+      double muA = sa / n;
+      double muB = sb / n;
+      double varA = (saa / n) - (muA * muA);
+      double varB = (sbb / n) - (muB * muB);
+      double cov = (sab / n) - (muA * muB);
+
+      *ssimSumPtr += ((2.0 * muA * muB + C1) * (2.0 * cov + C2)) /
+                     (((muA * muA) + (muB * muB) + C1) * (varA + varB + C2));
+      *ssimCountPtr += 1;
+    }
+  }
+}
+
+typedef struct {
+  const BT709MetricsTables *tables;
+  BT709MetricsFrame refFrame;
+  BT709MetricsFrame frame;
+  int width;
+  int height;
+} MetricsContext;
+
+static
+void metrics_score_frame(void *ctx) {
+  MetricsContext *mc = (MetricsContext *) ctx;
+  BT709MetricsResult result;
+  bt709_metrics_frame(mc->tables, &mc->refFrame, &mc->frame, mc->width, mc->height, 1, &result);
+}
+
+static
+void metrics_frame_planes(BT709MetricsFrame *frame, uint8_t *ptr, int width, int height) {
+  memset(frame, 0, sizeof(BT709MetricsFrame));
+  frame->planes.yPtr = ptr;
+  frame->planes.yBytesPerRow = width;
+  frame->planes.cbPtr = ptr + (width * height);
+  frame->planes.cbBytesPerRow = width / 2;
+  frame->planes.crPtr = ptr + (width * height) + ((width / 2) * (height / 2));
+  frame->planes.crBytesPerRow = width / 2;
+}
+
+// SIMD SSIM window sums and SSE against the scalar reference on
+// noise with odd sizes and strides, then whole frame scores for an
+// identical pair and for each thread count.
+
+static
+int test_metrics(double minMpps) {
+  uint32_t seed = 17;
+
+  static const int sizes[][3] = {
+    { 8, 8, 8 }, { 9, 8, 11 }, { 37, 21, 40 }, { 101, 67, 103 }, { 640, 36, 648 },
+  };
+
+  for (int i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++) {
+    const int width = sizes[i][0];
+    const int height = sizes[i][1];
+    const int bytesPerRow = sizes[i][2];
+
+    uint8_t *a = malloc(bytesPerRow * height);
+    uint8_t *b = malloc(bytesPerRow * height);
+
+    for (int j = 0; j < (bytesPerRow * height); j++) {
+      seed = (seed * 1103515245) + 12345;
+      a[j] = (uint8_t) (seed >> 16);
+      // b is a plus noise in [-8, 7] so that windows are correlated
+      int v = a[j] + (int) ((seed >> 8) & 0xF) - 8;
+      b[j] = (uint8_t) ((v < 0) ? 0 : ((v > 255) ? 255 : v));
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "metrics %d x %d", width, height);
+
+    double refSum = 0.0;
+    uint64_t refCount = 0;
+    ssim_reference(a, bytesPerRow, b, bytesPerRow, width, height, &refSum, &refCount);
+
+    double ssimSum = 0.0;
+    uint64_t ssimCount = 0;
+    CHECK_EQ(bt709_metrics_plane_ssim(a, bytesPerRow, b, bytesPerRow, width, 0, bt709_metrics_ssim_window_rows(height), &ssimSum, &ssimCount), 0, label);
+    CHECK_EQ((int) ssimCount, (int) refCount, label);
+    CHECK_EQ(ssimSum == refSum, 1, label);
+
+    uint64_t refSse = 0;
+    for (int row = 0; row < height; row++) {
+      for (int col = 0; col < width; col++) {
+        int d = a[(row * bytesPerRow) + col] - b[(row * bytesPerRow) + col];
+        refSse += d * d;
+      }
+    }
+    CHECK_EQ(bt709_metrics_plane_sse(a, bytesPerRow, b, bytesPerRow, width, 0, height) == refSse, 1, label);
+
+    free(a);
+    free(b);
+  }
+
+  // Whole frames
+
+  const int width = 1920;
+  const int height = 1080;
+  const int frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+
+  uint8_t *ref = malloc(frameLen);
+  uint8_t *decoded = malloc(frameLen);
+
+  for (int j = 0; j < frameLen; j++) {
+    seed = (seed * 1103515245) + 12345;
+    ref[j] = (uint8_t) (16 + ((seed >> 16) % 220));
+  }
+
+  BT709MetricsTables *tables = malloc(sizeof(BT709MetricsTables));
+  bt709_metrics_tables_init(tables, BT709GammaApple, BT709GammaSrgb);
+
+  MetricsContext mc;
+  mc.tables = tables;
+  mc.width = width;
+  mc.height = height;
+  metrics_frame_planes(&mc.refFrame, ref, width, height);
+  metrics_frame_planes(&mc.frame, ref, width, height);
+
+  BT709MetricsResult result;
+  CHECK_EQ(bt709_metrics_frame(tables, &mc.refFrame, &mc.frame, width, height, 2, &result), 0, "metrics identical");
+
+  for (int pi = 0; pi < 3; pi++) {
+    CHECK_EQ(bt709_metrics_result_psnr(&result, pi) == BT709_METRICS_PSNR_MAX, 1, "metrics identical PSNR");
+    CHECK_EQ(bt709_metrics_result_ssim(&result, pi) == 1.0, 1, "metrics identical SSIM");
+  }
+  CHECK_EQ(result.deltaEMax == 0.0, 1, "metrics identical delta E");
+
+  // Every thread count splits the frame into bands with the same total
+
+  for (int j = 0; j < frameLen; j++) {
+    decoded[j] = (uint8_t) (ref[j] + ((j % 5) - 2));
+  }
+  metrics_frame_planes(&mc.frame, decoded, width, height);
+
+  BT709MetricsResult single;
+  bt709_metrics_frame(tables, &mc.refFrame, &mc.frame, width, height, 1, &single);
+
+  CHECK_EQ(bt709_metrics_result_psnr(&single, 0) < 50.0, 1, "metrics changed PSNR");
+  CHECK_EQ(bt709_metrics_result_ssim(&single, 0) < 1.0, 1, "metrics changed SSIM");
+  CHECK_EQ(single.deltaEMax > 0.0, 1, "metrics changed delta E");
+
+  for (int numThreads = 2; numThreads <= 3; numThreads++) {
+    char label[64];
+    snprintf(label, sizeof(label), "metrics %d threads", numThreads);
+
+    bt709_metrics_frame(tables, &mc.refFrame, &mc.frame, width, height, numThreads, &result);
+
+    for (int pi = 0; pi < 3; pi++) {
+      CHECK_EQ(result.sse[pi] == single.sse[pi], 1, label);
+      CHECK_EQ(result.ssimCount[pi] == single.ssimCount[pi], 1, label);
+      CHECK_EQ(fabs(result.ssimSum[pi] - single.ssimSum[pi]) < 1e-6, 1, label);
+    }
+    CHECK_EQ(result.deltaEMax == single.deltaEMax, 1, label);
+    CHECK_EQ(fabs(result.deltaESum - single.deltaESum) < 1e-3 * single.numPixels, 1, label);
+  }
+
+  check_throughput("metrics", measure_mpps(metrics_score_frame, &mc, (double) width * height), minMpps);
+
+  free(tables);
+  free(ref);
+  free(decoded);
+
+  return 0;
+}
+
+// Write a Y4M file with y4m_writer.h and read it back
+
+static
+int write_y4m_file(const char *path, int width, int height, Y4MHeaderFPS fps, int numFrames) {
+  FILE *outFile = y4m_open_file(path);
+  if (outFile == NULL) {
+    return 1;
+  }
+
+  Y4MHeaderStruct header;
+  header.width = width;
+  header.height = height;
+  header.fps = fps;
+
+  int retcode = y4m_write_header(outFile, &header);
+
+  const int yLen = width * height;
+  const int uvLen = (width / 2) * (height / 2);
+  uint8_t *frame = malloc(yLen + (2 * uvLen));
+
+  for (int frameIndex = 0; frameIndex < numFrames && retcode == 0; frameIndex++) {
+    for (int j = 0; j < (yLen + (2 * uvLen)); j++) {
+      frame[j] = (uint8_t) (j + (frameIndex * 7));
+    }
+
+    Y4MFrameStruct fs = { frame, yLen, frame + yLen, uvLen, frame + yLen + uvLen, uvLen };
+    retcode = y4m_write_frame(outFile, &fs);
+  }
+
+  free(frame);
+  fclose(outFile);
+  return retcode;
+}
+
+static
+void y4m_reader_read_all(void *ctx) {
+  const char *path = (const char *) ctx;
+  Y4MReader reader;
+  if (y4m_reader_open(&reader, path) == 0) {
+    while (y4m_reader_next(&reader) == 0) {
+    }
+  }
+  y4m_reader_close(&reader);
+}
+
+// Header parsing, frame data, end of stream and truncated input
+
+static
+int test_y4m_reader(double minMpps) {
+  const char *tmpDir = getenv("TMPDIR");
+  char path[512];
+  snprintf(path, sizeof(path), "%s/bt709_tests_%d.y4m", (tmpDir != NULL) ? tmpDir : "/tmp", (int) getpid());
+
+  static const int rates[][3] = {
+    { Y4MHeaderFPS_24, 24, 1 },
+    { Y4MHeaderFPS_29_97, 30000, 1001 },
+    { Y4MHeaderFPS_60, 60, 1 },
+  };
+
+  for (int i = 0; i < (int) (sizeof(rates) / sizeof(rates[0])); i++) {
+    const int width = 6 + (2 * i);
+    const int height = 4;
+    const int numFrames = 3;
+
+    char label[64];
+    snprintf(label, sizeof(label), "y4m_reader F%d:%d", rates[i][1], rates[i][2]);
+
+    CHECK_EQ(write_y4m_file(path, width, height, (Y4MHeaderFPS) rates[i][0], numFrames), 0, label);
+
+    Y4MReader reader;
+    CHECK_EQ(y4m_reader_open(&reader, path), 0, label);
+    CHECK_EQ(reader.width, width, label);
+    CHECK_EQ(reader.height, height, label);
+    CHECK_EQ(reader.fpsNum, rates[i][1], label);
+    CHECK_EQ(reader.fpsDen, rates[i][2], label);
+    CHECK_EQ(y4m_reader_fps_enum(reader.fpsNum, reader.fpsDen), rates[i][0], label);
+
+    for (int frameIndex = 0; frameIndex < numFrames; frameIndex++) {
+      CHECK_EQ(y4m_reader_next(&reader), 0, label);
+      CHECK_EQ(reader.yPtr[0], (uint8_t) (frameIndex * 7), label);
+      CHECK_EQ(reader.uPtr[0], (uint8_t) ((width * height) + (frameIndex * 7)), label);
+      CHECK_EQ(reader.vPtr[reader.uvLen - 1], (uint8_t) ((width * height) + (2 * reader.uvLen) - 1 + (frameIndex * 7)), label);
+    }
+
+    CHECK_EQ(reader.frameNum, numFrames, label);
+    CHECK_EQ(y4m_reader_next(&reader), 1, label);
+    y4m_reader_close(&reader);
+  }
+
+  CHECK_EQ(y4m_reader_fps_enum(30000, 1000), -1, "y4m_reader unsupported rate");
+
+  // Drop the last byte of the final frame
+
+  FILE *file = fopen(path, "r+b");
+  fseek(file, 0, SEEK_END);
+  long fileLen = ftell(file);
+  fclose(file);
+  CHECK_EQ(truncate(path, fileLen - 1), 0, "y4m_reader truncate");
+
+  Y4MReader reader;
+  CHECK_EQ(y4m_reader_open(&reader, path), 0, "y4m_reader truncated");
+  CHECK_EQ(y4m_reader_next(&reader), 0, "y4m_reader truncated");
+  CHECK_EQ(y4m_reader_next(&reader), 0, "y4m_reader truncated");
+  CHECK_EQ(y4m_reader_next(&reader), 2, "y4m_reader truncated");
+  y4m_reader_close(&reader);
+
+  // Headers that are not 8 bit 4:2:0 with even dimensions are rejected
+
+  static const char *badHeaders[] = {
+    "YUV4MPEG W6 H4 F30:1\n",
+    "YUV4MPEG2 W7 H4 F30:1\n",
+    "YUV4MPEG2 W6 H0 F30:1\n",
+    "YUV4MPEG2 W6 H4 F30:1 C444\n",
+    "YUV4MPEG2 W6 H4 F30:1 C420p10\n",
+    "YUV4MPEG2 W6 H4 F30:1",
+  };
+
+  for (int i = 0; i < (int) (sizeof(badHeaders) / sizeof(badHeaders[0])); i++) {
+    file = fopen(path, "wb");
+    fputs(badHeaders[i], file);
+    fclose(file);
+
+    CHECK_EQ(y4m_reader_open(&reader, path), 1, badHeaders[i]);
+    y4m_reader_close(&reader);
+  }
+
+  // A 1080p clip read back to back
+
+  CHECK_EQ(write_y4m_file(path, 1920, 1080, Y4MHeaderFPS_30, 4), 0, "y4m_reader 1080p");
+  check_throughput("y4m_reader", measure_mpps(y4m_reader_read_all, path, 1920.0 * 1080 * 4), minMpps);
+
+  unlink(path);
+
+  return 0;
+}
+
+// Write a header and one frame of 6x4 to an open output
+
+static
+int write_y4m_frames(FILE *outFile) {
+  uint8_t frame[6 * 4 + 2 * 3 * 2];
+  memset(frame, 128, sizeof(frame));
+
+  Y4MHeaderStruct header;
+  header.width = 6;
+  header.height = 4;
+  header.fps = Y4MHeaderFPS_30;
+
+  Y4MFrameStruct fs = { frame, 24, frame + 24, 6, frame + 30, 6 };
+
+  if (y4m_write_header(outFile, &header) != 0) {
+    return 2;
+  }
+  return y4m_write_frame(outFile, &fs);
+}
+
+static
+void y4m_writer_write_all(void *ctx) {
+  const char *path = (const char *) ctx;
+  write_y4m_file(path, 1920, 1080, Y4MHeaderFPS_30, 4);
+}
+
+// Frames are flushed to a pipe but stay buffered for a file, and
+// opening "-" does not change the stdout descriptor.
+
+static
+int test_y4m_writer(double minMpps) {
+  const char *tmpDir = getenv("TMPDIR");
+  char path[512];
+  snprintf(path, sizeof(path), "%s/bt709_tests_%d.y4m", (tmpDir != NULL) ? tmpDir : "/tmp", (int) getpid());
+
+  // A small frame to a file is still in the stdio buffer
+
+  FILE *outFile = y4m_open_file(path);
+  CHECK_EQ(outFile != NULL, 1, "y4m_writer file");
+  CHECK_EQ(y4m_is_pipe(outFile), 0, "y4m_writer file");
+  CHECK_EQ(write_y4m_frames(outFile), 0, "y4m_writer file");
+  CHECK_EQ((int) lseek(fileno(outFile), 0, SEEK_CUR), 0, "y4m_writer file buffered");
+  CHECK_EQ(fclose(outFile), 0, "y4m_writer file");
+
+  struct stat st;
+  CHECK_EQ(stat(path, &st), 0, "y4m_writer file");
+  CHECK_EQ(st.st_size > (6 + 36), 1, "y4m_writer file length");
+  const long expectedLen = (long) st.st_size;
+
+  // The whole frame can be read from a pipe before the writer closes
+
+  int fds[2];
+  CHECK_EQ(pipe(fds), 0, "y4m_writer pipe");
+  outFile = fdopen(fds[1], "wb");
+  CHECK_EQ(y4m_is_pipe(outFile), 1, "y4m_writer pipe");
+  CHECK_EQ(write_y4m_frames(outFile), 0, "y4m_writer pipe");
+
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  char buffer[256];
+  long numRead = 0;
+  ssize_t result;
+  while ((result = read(fds[0], buffer, sizeof(buffer))) > 0) {
+    numRead += result;
+  }
+  CHECK_EQ((int) numRead, (int) expectedLen, "y4m_writer pipe flushed");
+
+  fclose(outFile);
+  close(fds[0]);
+
+  // With stdout pointed at a file, "-" writes the stream there and
+  // stdout still points at the same file afterwards.
+
+  fflush(stdout);
+  int savedFd = dup(STDOUT_FILENO);
+  int fileFd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  dup2(fileFd, STDOUT_FILENO);
+
+  outFile = y4m_open_file("-");
+  CHECK_EQ(outFile != NULL, 1, "y4m_writer stdout");
+  if (outFile != NULL) {
+    CHECK_EQ(write_y4m_frames(outFile), 0, "y4m_writer stdout");
+    fclose(outFile);
+  }
+
+  struct stat fileSt, outSt;
+  fstat(fileFd, &fileSt);
+  fstat(STDOUT_FILENO, &outSt);
+  int isSame = (fileSt.st_dev == outSt.st_dev && fileSt.st_ino == outSt.st_ino);
+
+  // y4m_redirect_stdout() is what points stdout at stderr
+
+  struct stat errSt;
+  y4m_redirect_stdout();
+  fstat(STDOUT_FILENO, &outSt);
+  fstat(STDERR_FILENO, &errSt);
+  int isRedirected = (errSt.st_dev == outSt.st_dev && errSt.st_ino == outSt.st_ino);
+
+  dup2(savedFd, STDOUT_FILENO);
+  close(savedFd);
+  close(fileFd);
+
+  CHECK_EQ(isSame, 1, "y4m_writer stdout not redirected");
+  CHECK_EQ(isRedirected, 1, "y4m_redirect_stdout");
+  CHECK_EQ(stat(path, &st), 0, "y4m_writer stdout");
+  CHECK_EQ((int) st.st_size, (int) expectedLen, "y4m_writer stdout length");
+
+  // A 1080p clip written to a file
+
+  check_throughput("y4m_writer", measure_mpps(y4m_writer_write_all, path, 1920.0 * 1080 * 4), minMpps);
+
+  unlink(path);
+
+  return 0;
+}
+
+// Read a whole file into a new buffer, returns NULL on failure
+
+static
+uint8_t* read_whole_file(const char *path, long *lenPtr) {
+  FILE *inFile = fopen(path, "rb");
+  if (inFile == NULL) {
+    return NULL;
+  }
+  fseek(inFile, 0, SEEK_END);
+  long len = ftell(inFile);
+  fseek(inFile, 0, SEEK_SET);
+  uint8_t *buffer = malloc(len + 1);
+  if (buffer != NULL && fread(buffer, 1, len, inFile) != (size_t) len) {
+    free(buffer);
+    buffer = NULL;
+  }
+  fclose(inFile);
+  *lenPtr = len;
+  return buffer;
+}
+
+// Write numFrames frames with the async writer, frames are filled
+// in place between acquire and submit like srgb_to_bt709 -async.
+
+static
+int write_y4m_async_file(const char *path, int width, int height, int numBuffers, int numFrames, int *isDirectPtr) {
+  Y4MAsyncWriter writer;
+  if (y4m_async_writer_open(&writer, path, width, height, numBuffers, 1) != 0) {
+    y4m_async_writer_close(&writer);
+    return 1;
+  }
+  *isDirectPtr = writer.isDirect;
+
+  Y4MHeaderStruct header;
+  header.width = width;
+  header.height = height;
+  header.fps = Y4MHeaderFPS_30;
+
+  int retcode = y4m_async_writer_write_header(&writer, &header);
+
+  const int frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+
+  for (int frameIndex = 0; frameIndex < numFrames && retcode == 0; frameIndex++) {
+    Y4MFrameStruct fs;
+    retcode = y4m_async_writer_acquire(&writer, &fs);
+    if (retcode != 0) {
+      break;
+    }
+    // Same bytes as write_y4m_file(), the planes are contiguous
+    for (int j = 0; j < frameLen; j++) {
+      fs.yPtr[j] = (uint8_t) (j + (frameIndex * 7));
+    }
+    retcode = y4m_async_writer_submit(&writer);
+  }
+
+  int closeResult = y4m_async_writer_close(&writer);
+  return (retcode != 0) ? retcode : closeResult;
+}
+
+static
+void y4m_async_writer_write_clip(void *ctx) {
+  const char *path = (const char *) ctx;
+  int isDirect;
+  write_y4m_async_file(path, 1920, 1080, 3, 4, &isDirect);
+}
+
+// Direct and buffered async output is byte for byte the same as
+// y4m_write_frame(), for frames that are smaller than a block and
+// frames that end part way into a block.
+
+static
+int test_y4m_async_writer(double minMpps) {
+  const char *tmpDir = getenv("TMPDIR");
+  char path[512];
+  char refPath[512];
+  snprintf(path, sizeof(path), "%s/bt709_tests_%d.y4m", (tmpDir != NULL) ? tmpDir : "/tmp", (int) getpid());
+  snprintf(refPath, sizeof(refPath), "%s/bt709_tests_%d_ref.y4m", (tmpDir != NULL) ? tmpDir : "/tmp", (int) getpid());
+
+#if defined(__linux__)
+  // The build defines _GNU_SOURCE so that glibc declares O_DIRECT
+# if defined(O_DIRECT)
+  CHECK_EQ(1, 1, "y4m_async_writer O_DIRECT");
+# else
+  CHECK_EQ(0, 1, "y4m_async_writer O_DIRECT");
+# endif // O_DIRECT
+#endif // __linux__
+
+  static const int sizes[][3] = {
+    { 6, 4, 300 },
+    { 96, 66, 7 },
+    { 1920, 1080, 3 },
+  };
+
+  int numDirect = 0;
+
+  for (int i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++) {
+    const int width = sizes[i][0];
+    const int height = sizes[i][1];
+    const int numFrames = sizes[i][2];
+
+    CHECK_EQ(write_y4m_file(refPath, width, height, Y4MHeaderFPS_30, numFrames), 0, "y4m_async_writer reference");
+
+    long refLen = 0;
+    uint8_t *ref = read_whole_file(refPath, &refLen);
+
+    for (int numBuffers = 2; numBuffers <= Y4M_ASYNC_WRITER_MAX_BUFFERS; numBuffers++) {
+      char label[128];
+      snprintf(label, sizeof(label), "y4m_async_writer %dx%d buffers %d", width, height, numBuffers);
+
+      int isDirect = 0;
+      CHECK_EQ(write_y4m_async_file(path, width, height, numBuffers, numFrames, &isDirect), 0, label);
+      numDirect += isDirect;
+
+      long outLen = 0;
+      uint8_t *out = read_whole_file(path, &outLen);
+      CHECK_EQ((int) outLen, (int) refLen, label);
+      CHECK_EQ(out != NULL && ref != NULL && outLen == refLen && memcmp(out, ref, refLen) == 0, 1, label);
+      free(out);
+    }
+
+    free(ref);
+  }
+
+#if defined(O_DIRECT)
+  if (numDirect == 0) {
+    printf("y4m_async_writer : O_DIRECT is not supported in \"%s\", only buffered output was checked\n", path);
+  }
+#endif // O_DIRECT
+
+  // Only 2 or 3 buffers are supported
+
+  Y4MAsyncWriter writer;
+  CHECK_EQ(y4m_async_writer_open(&writer, path, 2, 2, 4, 1), 1, "y4m_async_writer 4 buffers");
+  y4m_async_writer_close(&writer);
+
+  check_throughput("y4m_async_writer", measure_mpps(y4m_async_writer_write_clip, path, 1920.0 * 1080 * 4), minMpps);
+
+  unlink(path);
+  unlink(refPath);
+
+  return 0;
+}
+
+// Fill a frame cache test frame, the content kind depends on the
+// frame and version so that some frames compress and some do not.
+
+static
+void frame_cache_fill(uint8_t *frame, int width, int height, int frameIndex, int version) {
+  const int frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+  const int kind = (frameIndex + version) % 3;
+  uint32_t state = (uint32_t) ((frameIndex * 7919) + (version * 104729) + 1);
+
+  for (int i = 0; i < frameLen; i++) {
+    if (kind == 0) {
+      // Smooth gradient
+      frame[i] = (uint8_t) ((i % width) + (i / width) + version);
+    } else if (kind == 1) {
+      // Noise
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      frame[i] = (uint8_t) state;
+    } else {
+      frame[i] = (uint8_t) (frameIndex + version);
+    }
+  }
+}
+
+// Sum of held bytes and the recently used list must agree with the
+// entries, returns the number of problems found.
+
+static
+int frame_cache_check_entries(const BT709FrameCache *cache) {
+  int numBad = 0;
+  size_t rawBytes = 0;
+  size_t compressedBytes = 0;
+  int numHeld = 0;
+
+  for (int i = 0; i < cache->numFrames; i++) {
+    const BT709FrameCacheEntry *entry = &cache->entries[i];
+    if (entry->state == BT709FrameCacheRaw) {
+      rawBytes += entry->len;
+      numHeld += 1;
+    } else if (entry->state == BT709FrameCacheCompressed) {
+      compressedBytes += entry->len;
+      numHeld += 1;
+    }
+  }
+
+  numBad += (rawBytes != cache->rawBytes);
+  numBad += (compressedBytes != cache->compressedBytes);
+
+  int numLinked = 0;
+  int prev = -1;
+  for (int i = cache->head; i != -1 && numLinked <= cache->numFrames; i = cache->entries[i].next) {
+    numBad += (cache->entries[i].prev != prev);
+    numBad += (cache->entries[i].state == BT709FrameCacheEmpty);
+    prev = i;
+    numLinked += 1;
+  }
+  numBad += (prev != cache->tail);
+  numBad += (numLinked != numHeld);
+
+  // Over budget only when every frame left is pinned
+
+  if (bt709_frame_cache_bytes(cache) > cache->budget) {
+    for (int i = cache->head; i != -1 && numLinked-- > 0; i = cache->entries[i].next) {
+      numBad += (cache->entries[i].stamp < cache->pinnedStamp);
+    }
+  }
+
+  return numBad;
+}
+
+typedef struct {
+  BT709FrameCache cache;
+  uint8_t *frame;
+  int numFrames;
+} FrameCachePlayback;
+
+static
+void frame_cache_play(void *ctx) {
+  FrameCachePlayback *playback = (FrameCachePlayback *) ctx;
+  BT709FrameCache *cache = &playback->cache;
+
+  for (int i = 0; i < playback->numFrames; i++) {
+    BT709PlanesStruct planes;
+    if (bt709_frame_cache_get(cache, i, &planes) != 0) {
+      bt709_frame_cache_planes(cache, playback->frame, &planes);
+      bt709_frame_cache_put(cache, i, &planes);
+    }
+    bt709_frame_cache_prefetch(cache, i + 1, 2);
+  }
+}
+
+// Random put, get and prefetch calls against caches with budgets
+// from zero to more than every frame. A get must return the last
+// frame put or a miss, and the frame from the last get must stay
+// in place across a prefetch.
+
+static
+int test_frame_cache(double minMpps) {
+  const int width = 32;
+  const int height = 16;
+  const int numFrames = 24;
+  const int frameLen = (width * height) + (2 * (width / 2) * (height / 2));
+
+  const size_t budgets[] = {
+    0,
+    frameLen / 2,
+    frameLen * 3,
+    frameLen * 10,
+    (size_t) frameLen * numFrames * 2
+  };
+
+  uint8_t *frame = NULL;
+  uint8_t *expected = NULL;
+  uint32_t state = 50;
+
+  for (int bi = 0; bi < (int) (sizeof(budgets) / sizeof(budgets[0])); bi++) {
+    char label[64];
+    snprintf(label, sizeof(label), "frame_cache budget %d", (int) budgets[bi]);
+
+    BT709FrameCache cache;
+    CHECK_EQ(bt709_frame_cache_init(&cache, width, height, numFrames, budgets[bi]), 0, label);
+
+    if (frame == NULL) {
+      frame = malloc(cache.frameLen);
+      expected = malloc(cache.frameLen);
+    }
+
+    int versions[numFrames];
+    for (int i = 0; i < numFrames; i++) {
+      versions[i] = -1;
+    }
+
+    int numBad = 0;
+    int numHits = 0;
+    int lastGet = -1;
+    BT709PlanesStruct lastPlanes;
+
+    for (int op = 0; op < 20000; op++) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+
+      const int frameIndex = (int) ((state >> 8) % numFrames);
+      const int kind = (int) (state % 8);
+
+      if (kind < 3) {
+        versions[frameIndex] += 1;
+        frame_cache_fill(frame, width, height, frameIndex, versions[frameIndex]);
+
+        BT709PlanesStruct planes;
+        bt709_frame_cache_planes(&cache, frame, &planes);
+        numBad += (bt709_frame_cache_put(&cache, frameIndex, &planes) != 0);
+        lastGet = -1;
+      } else if (kind < 6) {
+        BT709PlanesStruct planes;
+        int result = bt709_frame_cache_get(&cache, frameIndex, &planes);
+
+        if (result == 0) {
+          numHits += 1;
+          numBad += (versions[frameIndex] < 0);
+          if (versions[frameIndex] >= 0) {
+            frame_cache_fill(expected, width, height, frameIndex, versions[frameIndex]);
+            numBad += (memcmp(planes.yPtr, expected, frameLen) != 0);
+          }
+          // The frame returned is pinned, even with a zero budget
+          numBad += (cache.entries[frameIndex].state != BT709FrameCacheRaw);
+          lastGet = frameIndex;
+          lastPlanes = planes;
+        } else {
+          numBad += (result != 1);
+          lastGet = -1;
+        }
+      } else {
+        const int count = 1 + (int) ((state >> 4) % 6);
+        int numRaw = bt709_frame_cache_prefetch(&cache, frameIndex, count);
+        numBad += (numRaw < 0 || numRaw > count);
+
+        if (lastGet >= 0) {
+          numBad += (cache.entries[lastGet].state != BT709FrameCacheRaw || cache.entries[lastGet].ptr != lastPlanes.yPtr);
+          frame_cache_fill(expected, width, height, lastGet, versions[lastGet]);
+          numBad += (memcmp(lastPlanes.yPtr, expected, frameLen) != 0);
+        }
+      }
+
+      numBad += frame_cache_check_entries(&cache);
+    }
+
+    CHECK_EQ(numBad, 0, label);
+
+    // Every frame fits in the largest budget, so gets must hit
+
+    if (budgets[bi] >= (size_t) frameLen * numFrames) {
+      CHECK_EQ(numHits > 0, 1, label);
+      CHECK_EQ((int) cache.stats.numDropped, 0, label);
+    }
+
+    bt709_frame_cache_free(&cache);
+  }
+
+  // Sequential playback of frames that do not all fit raw
+
+  FrameCachePlayback playback;
+  playback.numFrames = 32;
+  CHECK_EQ(bt709_frame_cache_init(&playback.cache, 256, 128, playback.numFrames, (size_t) 256 * 128 * 3 / 2 * 8), 0, "frame_cache playback");
+  playback.frame = malloc(playback.cache.frameLen);
+  frame_cache_fill(playback.frame, 256, 128, 0, 0);
+
+  check_throughput("frame_cache", measure_mpps(frame_cache_play, &playback, 256.0 * 128 * playback.numFrames), minMpps);
+
+  bt709_frame_cache_free(&playback.cache);
+  free(playback.frame);
+  free(expected);
+  free(frame);
+
+  return 0;
+}
+
+// Color and alpha planes composited over a solid color for the
+// throughput measurement
+
+typedef struct {
+  const BT709DecodeTables *tables;
+  int width;
+  int height;
+  BT709PlanesStruct planes;
+  uint8_t *alpha;
+  uint8_t *out;
+} DecodeOverFrame;
+
+static
+void decode_over_frame(void *ctx) {
+  DecodeOverFrame *frame = (DecodeOverFrame *) ctx;
+  BT709PixelLayout layout = bt709_pixel_layout_bgra();
+
+  bt709_decode_region_over_color(frame->tables, &frame->planes, 1, frame->alpha, frame->width,
+                                 frame->width, frame->height, 0, 0, frame->width, frame->height,
+                                 &layout, 40, 80, 120, frame->out, frame->width * 4);
+}
+
+// Encode a half transparent white pixel with the premultiplied
+// encode that srgb_to_bt709 -alpha uses and composite it over
+// solid backgrounds. Over black the result must be the premultiplied
+// color, about 50% gray, not alpha applied a second time. Decoding
+// the pixel with its alpha also returns the premultiplied color.
+
+static
+int test_decode_over(double minMpps) {
+  const int width = 2;
+  const int height = 2;
+  const int A = 128;
+
+  BT709FrameTables *frameTables = malloc(sizeof(BT709FrameTables));
+  bt709_frame_tables_init(frameTables, BT709GammaSrgb, BT709GammaSrgb);
+
+  BT709AlphaTables *alphaTables = malloc(sizeof(BT709AlphaTables));
+  bt709_alpha_tables_init(alphaTables, BT709GammaSrgb);
+
+  BT709DecodeTables *decodeTables = malloc(sizeof(BT709DecodeTables));
+  bt709_decode_tables_init(decodeTables, BT709GammaSrgb);
+
+  BT709PixelLayout rgbaLayout = bt709_pixel_layout_rgba();
+  BT709PixelLayout rgbLayout = bt709_pixel_layout_rgb();
+
+  uint8_t pixels[width * height * 4];
+  for (int i = 0; i < (width * height); i++) {
+    pixels[(i * 4)] = 255;
+    pixels[(i * 4) + 1] = 255;
+    pixels[(i * 4) + 2] = 255;
+    pixels[(i * 4) + 3] = A;
+  }
+
+  uint8_t Y[width * height], Cb, Cr;
+  BT709PlanesStruct planes = { Y, width, &Cb, 1, &Cr, 1 };
+  uint8_t scratch[2 * width * 4];
+
+  CHECK_EQ(bt709_alpha_encode_premultiplied(frameTables, alphaTables, BT709AlphaPremultiply, &rgbaLayout,
+                                            pixels, width * 4, width, height, &planes, scratch), 0, "decode_over encode");
+
+  // The alpha frame holds linear alpha in Y
+
+  uint8_t alphaY[width * height];
+  memset(alphaY, 16 + (int) round(A * 219.0 / 255.0), sizeof(alphaY));
+
+  const float An = decodeTables->alpha[alphaY[0]];
+
+  float Rn, Gn, Bn;
+  bt709_decode_linear_rgb(decodeTables, Y[0], Cb, Cr, &Rn, &Gn, &Bn);
+
+  static const int backgrounds[][3] = {
+    { 0, 0, 0 }, { 128, 128, 128 }, { 255, 0, 64 },
+  };
+
+  for (int bi = 0; bi < (int) (sizeof(backgrounds) / sizeof(backgrounds[0])); bi++) {
+    const int *bg = backgrounds[bi];
+
+    char label[64];
+    snprintf(label, sizeof(label), "decode_over background (%d %d %d)", bg[0], bg[1], bg[2]);
+
+    uint8_t out[width * height * 3];
+    CHECK_EQ(bt709_decode_region_over_color(decodeTables, &planes, 1, alphaY, width, width, height, 0, 0, width, height,
+                                            &rgbLayout, bg[0], bg[1], bg[2], out, width * 3), 0, label);
+
+    const float rgb[3] = { Rn, Gn, Bn };
+
+    for (int c = 0; c < 3; c++) {
+      float bgLinear = frameTables->toLinear[bg[c]];
+      int expected = (int) round(sRGB_linearNormToNonLinear(rgb[c] + (bgLinear * (1.0f - An))) * 255.0f);
+      CHECK_EQ(abs(out[c] - expected) <= 1, 1, label);
+    }
+
+    if (bi == 0) {
+      for (int c = 0; c < 3; c++) {
+        CHECK_EQ(abs(out[c] - A) <= 1, 1, "decode_over 50% white over black");
+      }
+    }
+  }
+
+  // A packed frame decodes to the premultiplied color with its alpha,
+  // unpremultiply gives back straight white
+
+  uint8_t packedY[width * height * 2];
+  uint8_t packedCb[2] = { Cb, 128 };
+  uint8_t packedCr[2] = { Cr, 128 };
+  memcpy(packedY, Y, sizeof(Y));
+  memcpy(packedY + (width * height), alphaY, sizeof(alphaY));
+
+  BT709PlanesStruct packed = { packedY, width, packedCb, 1, packedCr, 1 };
+  uint8_t withAlpha[width * height * 4];
+  CHECK_EQ(bt709_decode_region_alpha(decodeTables, &packed, 1, bt709_decode_packed_alpha_ptr(&packed, height), width,
+                                     width, height, 0, 0, width, height, &rgbaLayout, withAlpha, width * 4), 0, "decode_over packed");
+
+  CHECK_EQ(abs(withAlpha[0] - A) <= 1, 1, "decode_over packed premultiplied color");
+  CHECK_EQ(abs(withAlpha[3] - A) <= 1, 1, "decode_over packed alpha");
+
+  bt709_alpha_unpremultiply_row(alphaTables, &rgbaLayout, withAlpha, withAlpha, width * height);
+  CHECK_EQ(withAlpha[0] >= 253, 1, "decode_over packed unpremultiplied color");
+
+  // Throughput
+
+  DecodeOverFrame frame;
+  frame.tables = decodeTables;
+  frame.width = 1920;
+  frame.height = 1080;
+
+  uint8_t *yPlane = malloc(frame.width * frame.height);
+  uint8_t *cbPlane = malloc((frame.width / 2) * (frame.height / 2));
+  uint8_t *crPlane = malloc((frame.width / 2) * (frame.height / 2));
+  frame.alpha = malloc(frame.width * frame.height);
+  frame.out = malloc(frame.width * frame.height * 4);
+
+  for (int i = 0; i < (frame.width * frame.height); i++) {
+    yPlane[i] = (uint8_t) (16 + (i % 220));
+    frame.alpha[i] = (uint8_t) (16 + ((i / 7) % 220));
+  }
+  memset(cbPlane, 128, (frame.width / 2) * (frame.height / 2));
+  memset(crPlane, 128, (frame.width / 2) * (frame.height / 2));
+
+  BT709PlanesStruct framePlanes = { yPlane, frame.width, cbPlane, frame.width / 2, crPlane, frame.width / 2 };
+  frame.planes = framePlanes;
+
+  check_throughput("decode_over", measure_mpps(decode_over_frame, &frame, (double) frame.width * frame.height), minMpps);
+
+  free(yPlane);
+  free(cbPlane);
+  free(crPlane);
+  free(frame.alpha);
+  free(frame.out);
+  free(decodeTables);
+  free(alphaTables);
+  free(frameTables);
+
+  return 0;
+}
+
+typedef struct {
+  const char *name;
+  int (*func)(double minMpps);
+} TestGroup;
+
+static const TestGroup groups[] = {
+  { "smpte_gray", test_smpte_gray },
+  { "primaries", test_primaries },
+  { "resample_upper", test_resample_upper },
+  { "average_of_4", test_average_of_4 },
+  { "metrics", test_metrics },
+  { "y4m_reader", test_y4m_reader },
+  { "y4m_writer", test_y4m_writer },
+  { "y4m_async_writer", test_y4m_async_writer },
+  { "frame_cache", test_frame_cache },
+  { "decode_over", test_decode_over },
+};
+
+int main(int argc, const char * argv[]) {
+  if (argc < 2) {
+    printf("usage: bt709_tests GROUP [MIN_MPPS]\n");
+    printf("GROUP is one of:");
+    for (int i = 0; i < (int) (sizeof(groups) / sizeof(groups[0])); i++) {
+      printf(" %s", groups[i].name);
+    }
+    printf("\n");
+    return 2;
+  }
+
+  const char *groupName = argv[1];
+  double minMpps = (argc > 2) ? atof(argv[2]) : 0.0;
+
+  for (int i = 0; i < (int) (sizeof(groups) / sizeof(groups[0])); i++) {
+    if (strcmp(groups[i].name, groupName) == 0) {
+      groups[i].func(minMpps);
+      printf("%s : %d checks, %d failed\n", groupName, numChecks, numFailed);
+      return (numFailed == 0) ? 0 : 1;
+    }
+  }
+
+  printf("unknown test group \"%s\"\n", groupName);
+  return 2;
+}
@@ -0,0 +1,247 @@
+//
+//  bt709_trace_tests.c
+//
+//  Tests for the event storage in bt709_trace.c, built with
+//  BT709_TRACE defined. Events are recorded from several threads
+//  at once and the Chrome trace JSON is parsed back, both before
+//  any event is recorded and after, to check that every record is
+//  written and that the output is valid JSON.
+//
+//  usage: bt709_trace_tests [NUM_EVENTS]
+//
+//  Licensed under BSD terms.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include "bt709_trace.h"
+
+#if !defined(BT709_TRACE)
+#error "bt709_trace_tests must be built with BT709_TRACE defined"
+#endif
+
+static int numChecks = 0;
+static int numFailed = 0;
+
+#define CHECK_EQ(v, expected, label) \
+  do { \
+    int _v = (v); \
+    int _e = (expected); \
+    numChecks += 1; \
+    if (_v != _e) { \
+      numFailed += 1; \
+      printf("FAIL %s:%d %s : %d != %d\n", __FILE__, __LINE__, (label), _v, _e); \
+    } \
+  } while (0)
+
+// Minimal JSON parser that only validates, the number of elements in
+// arrays nested one level down (the traceEvents array) is counted.
+
+typedef struct {
+  const char *p;
+  const char *end;
+  int numElements;
+} JSONParser;
+
+static int json_value(JSONParser *parser, int depth);
+
+static
+void json_space(JSONParser *parser) {
+  while (parser->p < parser->end && (*parser->p == ' ' || *parser->p == '\n' || *parser->p == '\r' || *parser->p == '\t')) {
+    parser->p++;
+  }
+}
+
+static
+int json_string(JSONParser *parser) {
+  if (parser->p == parser->end || *parser->p != '"') {
+    return 1;
+  }
+  parser->p++;
+  while (parser->p < parser->end && *parser->p != '"') {
+    if (*parser->p == '\\') {
+      parser->p++;
+    }
+    parser->p++;
+  }
+  if (parser->p >= parser->end) {
+    return 1;
+  }
+  parser->p++;
+  return 0;
+}
+
+static
+int json_number(JSONParser *parser) {
+  char *numEnd;
+  strtod(parser->p, &numEnd);
+  if (numEnd == parser->p || numEnd > parser->end) {
+    return 1;
+  }
+  parser->p = numEnd;
+  return 0;
+}
+
+// Parse the elements of an array or the members of an object,
+// close is ']' or '}'
+
+static
+int json_list(JSONParser *parser, int depth, char close) {
+  parser->p++;
+  json_space(parser);
+
+  if (parser->p < parser->end && *parser->p == close) {
+    parser->p++;
+    return 0;
+  }
+
+  while (1) {
+    if (close == '}') {
+      if (json_string(parser) != 0) {
+        return 1;
+      }
+      json_space(parser);
+      if (parser->p == parser->end || *parser->p != ':') {
+        return 1;
+      }
+      parser->p++;
+    } else if (depth == 1) {
+      parser->numElements += 1;
+    }
+
+    if (json_value(parser, depth + 1) != 0) {
+      return 1;
+    }
+
+    json_space(parser);
+    if (parser->p == parser->end) {
+      return 1;
+    }
+    if (*parser->p == close) {
+      parser->p++;
+      return 0;
+    }
+    if (*parser->p != ',') {
+      return 1;
+    }
+    parser->p++;
+    json_space(parser);
+  }
+}
+
+static
+int json_value(JSONParser *parser, int depth) {
+  json_space(parser);
+
+  if (parser->p == parser->end) {
+    return 1;
+  }
+
+  switch (*parser->p) {
+    case '{': return json_list(parser, depth, '}');
+    case '[': return json_list(parser, depth, ']');
+    case '"': return json_string(parser);
+    default: return json_number(parser);
+  }
+}
+
+// Write the trace to a temp file and parse it. Returns the number of
+// trace records or -1 when the output is not valid JSON.
+
+static
+int parse_trace(const char *path) {
+  if (bt709_trace_write_json(path) != 0) {
+    return -1;
+  }
+
+  FILE *inFile = fopen(path, "rb");
+  if (inFile == NULL) {
+    return -1;
+  }
+  fseek(inFile, 0, SEEK_END);
+  long len = ftell(inFile);
+  fseek(inFile, 0, SEEK_SET);
+
+  char *json = (char *) malloc(len + 1);
+  size_t numRead = fread(json, 1, len, inFile);
+  fclose(inFile);
+  json[numRead] = '\0';
+
+  JSONParser parser;
+  parser.p = json;
+  parser.end = json + numRead;
+  parser.numElements = 0;
+
+  int result = json_value(&parser, 0);
+  json_space(&parser);
+  if (parser.p != parser.end) {
+    result = 1;
+  }
+
+  free(json);
+
+  return (result == 0) ? parser.numElements : -1;
+}
+
+typedef struct {
+  int numEvents;
+} WorkerArgs;
+
+static
+void* record_events(void *arg) {
+  WorkerArgs *args = (WorkerArgs *) arg;
+
+  for (int i = 0; i < args->numEvents; i++) {
+    BT709_TRACE_SCOPE("worker_event");
+  }
+  BT709_TRACE_COUNTER("worker_counter", args->numEvents);
+
+  return NULL;
+}
+
+int main(int argc, const char * argv[]) {
+  const int numWorkers = 3;
+  // More than one chunk of events for each thread
+  const int numEvents = (argc > 1) ? atoi(argv[1]) : 10000;
+
+  const char *tmpDir = getenv("TMPDIR");
+  char path[512];
+  snprintf(path, sizeof(path), "%s/bt709_trace_tests_%d.json", (tmpDir != NULL) ? tmpDir : "/tmp", (int) getpid());
+
+  BT709_TRACE_START();
+
+  // Only the thread_name record of the main thread
+
+  CHECK_EQ(parse_trace(path), 1, "trace with 0 events");
+
+  pthread_t threads[numWorkers];
+  WorkerArgs args = { numEvents };
+
+  for (int i = 0; i < numWorkers; i++) {
+    CHECK_EQ(pthread_create(&threads[i], NULL, record_events, &args), 0, "pthread_create");
+  }
+
+  // The main thread records and writes while the workers are running
+
+  record_events(&args);
+  CHECK_EQ(parse_trace(path) > 0, 1, "trace while recording");
+
+  for (int i = 0; i < numWorkers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // thread_name for each thread, then each event and counter
+
+  const int numThreads = numWorkers + 1;
+  CHECK_EQ(parse_trace(path), numThreads + (numThreads * (numEvents + 1)), "trace with N events");
+
+  unlink(path);
+
+  printf("trace : %d checks, %d failed\n", numChecks, numFailed);
+  return (numFailed == 0) ? 0 : 1;
+}
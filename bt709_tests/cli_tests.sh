@@ -0,0 +1,166 @@
+#!/bin/sh
+#
+#  cli_tests.sh
+#
+#  Round trip tests for the portable command line tools, run by
+#  ctest with the build directory that holds the tools.
+#
+#  usage: cli_tests.sh GROUP BIN_DIR
+#
+#  Licensed under BSD terms.
+
+set -e
+
+group="$1"
+bin="$2"
+
+if [ -z "$group" ] || [ ! -d "$bin" ]; then
+  echo "usage: cli_tests.sh GROUP BIN_DIR"
+  exit 2
+fi
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+fail() {
+  echo "FAIL $group: $*"
+  exit 1
+}
+
+# Extract a field from a y4m_metrics total line, for example "PSNR Y"
+
+metrics_field() {
+  grep '^total' "$1" | sed -e "s/.* $2 \([^ ]*\).*/\1/"
+}
+
+# Write frames [START, START+COUNT) of a 96x64 Y4M file as a segment
+# file in the format srgb_to_bt709 -range writes.
+
+make_segment() {
+  # The stream header is the YUV4MPEG2 line and the XYSCSS line
+  headerLen=$(head -n 2 "$1" | wc -c)
+  frameLen=$((6 + (96 * 64 * 3 / 2)))
+  {
+    printf 'Y4MSEG W96 H64 F30:1 S%010d N%010d\n' "$2" "$3"
+    tail -c +$((headerLen + ($2 * frameLen) + 1)) "$1" | head -c $(($3 * frameLen))
+  } > "$4"
+}
+
+case "$group" in
+  metrics)
+    # A file scored against itself is identical on every plane
+
+    "$bin/pattern_write" -pattern zoneplate -size 96x64 -frames 3 "$tmp/ref.y4m"
+    "$bin/y4m_metrics" -quiet "$tmp/ref.y4m" "$tmp/ref.y4m" > "$tmp/same.txt"
+    cat "$tmp/same.txt"
+
+    grep -q 'PSNR Y 100.000 Cb 100.000 Cr 100.000 SSIM Y 1.00000 Cb 1.00000 Cr 1.00000' "$tmp/same.txt" ||
+      fail "identical Y4M files do not score PSNR 100 and SSIM 1"
+    [ "$(metrics_field "$tmp/same.txt" "max")" = "0.0000" ] || fail "identical Y4M files have a delta E"
+
+    # Source BGRA frames are encoded with the same tables that
+    # pattern_write uses for bars, so Y Cb Cr match exactly.
+
+    "$bin/pattern_write" -pattern bars -size 96x64 -frames 2 -format bgra "$tmp/src.bgra"
+    "$bin/pattern_write" -pattern bars -size 96x64 -frames 2 "$tmp/bars.y4m"
+    "$bin/y4m_metrics" -quiet -size 96x64 "$tmp/src.bgra" "$tmp/bars.y4m" > "$tmp/source.txt"
+    cat "$tmp/source.txt"
+
+    grep -q 'PSNR Y 100.000 Cb 100.000 Cr 100.000 SSIM Y 1.00000 Cb 1.00000 Cr 1.00000' "$tmp/source.txt" ||
+      fail "source frames do not match their own encode"
+
+    # A changed frame is caught by the PSNR floor
+
+    "$bin/pattern_write" -pattern bars -size 96x64 -frames 2 -gamma srgb "$tmp/srgb.y4m"
+    if "$bin/y4m_metrics" -quiet -min-psnr 60 "$tmp/bars.y4m" "$tmp/srgb.y4m" > "$tmp/diff.txt"; then
+      fail "different gamma passed -min-psnr 60"
+    fi
+    ;;
+  raw)
+    # BGRA frames read from a file and from a pipe encode the same
+    # as the planar output of pattern_write.
+
+    "$bin/pattern_write" -pattern bars -size 96x64 -frames 3 -format bgra "$tmp/src.bgra"
+    "$bin/pattern_write" -pattern bars -size 96x64 -frames 3 "$tmp/expected.y4m"
+
+    "$bin/raw_to_bt709" -size 96x64 "$tmp/src.bgra" "$tmp/file.y4m"
+    cmp "$tmp/file.y4m" "$tmp/expected.y4m" || fail "mapped BGRA input does not match"
+
+    cat "$tmp/src.bgra" | "$bin/raw_to_bt709" -size 96x64 -threads 3 - - > "$tmp/pipe.y4m"
+    cmp "$tmp/pipe.y4m" "$tmp/expected.y4m" || fail "piped BGRA input does not match"
+
+    # A zone plate changes on every row and its gray values go through
+    # the same encode tables, so -gamma changes the planar output.
+
+    "$bin/pattern_write" -pattern zoneplate -size 96x64 -frames 2 -format bgra "$tmp/zone.bgra"
+    "$bin/pattern_write" -pattern zoneplate -size 96x64 -frames 2 "$tmp/zone.y4m"
+    "$bin/raw_to_bt709" -size 96x64 "$tmp/zone.bgra" "$tmp/zone_raw.y4m"
+    cmp "$tmp/zone_raw.y4m" "$tmp/zone.y4m" || fail "zone plate input does not match"
+
+    "$bin/pattern_write" -pattern zoneplate -size 96x64 -frames 2 -gamma linear "$tmp/zone_linear.y4m"
+    if cmp -s "$tmp/zone_linear.y4m" "$tmp/zone.y4m"; then
+      fail "zone plate ignores -gamma linear"
+    fi
+
+    # A PPM frame followed by a PAM frame with alpha, both 2x2 red,
+    # encode to the same (Y Cb Cr) = (63 102 240).
+
+    {
+      printf 'P6\n2 2\n255\n\377\000\000\377\000\000\377\000\000\377\000\000'
+      printf 'P7\nWIDTH 2\nHEIGHT 2\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n'
+      printf '\377\000\000\377\377\000\000\377\377\000\000\377\377\000\000\377'
+    } | "$bin/raw_to_bt709" - "$tmp/mixed.y4m"
+
+    # Each frame is "FRAME\n" then 4 Y, 1 Cb and 1 Cr
+
+    frames=$(tail -c 24 "$tmp/mixed.y4m" | od -An -tu1 | tr -s ' \n' ' ')
+    [ "$frames" = " 70 82 65 77 69 10 63 63 63 63 102 240 70 82 65 77 69 10 63 63 63 63 102 240 " ] ||
+      fail "mixed PPM and PAM frames encode to$frames"
+
+    # Odd dimensions are rejected
+
+    if "$bin/raw_to_bt709" -size 3x2 "$tmp/src.bgra" "$tmp/odd.y4m" 2> /dev/null; then
+      fail "odd BGRA dimensions were accepted"
+    fi
+    ;;
+  merge)
+    # Segments given out of order merge back into the whole file
+
+    "$bin/pattern_write" -pattern zoneplate -size 96x64 -frames 5 "$tmp/ref.y4m"
+    make_segment "$tmp/ref.y4m" 0 2 "$tmp/a.y4mseg"
+    make_segment "$tmp/ref.y4m" 2 3 "$tmp/b.y4mseg"
+
+    "$bin/y4m_merge" "$tmp/merged.y4m" "$tmp/b.y4mseg" "$tmp/a.y4mseg"
+    cmp "$tmp/merged.y4m" "$tmp/ref.y4m" || fail "merged segments do not match"
+
+    "$bin/y4m_merge" - "$tmp/a.y4mseg" "$tmp/b.y4mseg" > "$tmp/pipe.y4m"
+    cmp "$tmp/pipe.y4m" "$tmp/ref.y4m" || fail "merged segments written to stdout do not match"
+
+    # A set that does not start at frame 0, a gap, an overlap and
+    # a truncated segment are rejected
+
+    make_segment "$tmp/ref.y4m" 3 2 "$tmp/c.y4mseg"
+    make_segment "$tmp/ref.y4m" 1 2 "$tmp/d.y4mseg"
+
+    if "$bin/y4m_merge" "$tmp/late.y4m" "$tmp/b.y4mseg" 2> /dev/null; then
+      fail "segments that start at frame 2 were merged"
+    fi
+    if "$bin/y4m_merge" "$tmp/gap.y4m" "$tmp/a.y4mseg" "$tmp/c.y4mseg" 2> /dev/null; then
+      fail "segments with a gap were merged"
+    fi
+    if "$bin/y4m_merge" "$tmp/overlap.y4m" "$tmp/a.y4mseg" "$tmp/d.y4mseg" 2> /dev/null; then
+      fail "overlapping segments were merged"
+    fi
+
+    head -c 1000 "$tmp/b.y4mseg" > "$tmp/short.y4mseg"
+    if "$bin/y4m_merge" "$tmp/short.y4m" "$tmp/a.y4mseg" "$tmp/short.y4mseg" 2> /dev/null; then
+      fail "a truncated segment was merged"
+    fi
+    ;;
+  *)
+    echo "unknown test group \"$group\""
+    exit 2
+    ;;
+esac
+
+echo "$group : passed"
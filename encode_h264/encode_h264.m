@@ -23,6 +23,8 @@
 
 #import "BT709.h"
 
+#import "bt709_trace.h"
+
 typedef struct {
   int fps;
 } ConfigurationStruct;
@@ -137,6 +139,8 @@ void usage() {
                                                  bpp:(int)bpp
                                  convertToColorspace:(CGColorSpaceRef)convertToColorspace
 {
+  BT709_TRACE_SCOPE("colorspace_convert");
+  
   int width = (int) CGImageGetWidth(inImage);
   int height = (int) CGImageGetHeight(inImage);
 
@@ -163,6 +167,8 @@ void usage() {
 + (CGFrameBuffer*) convertFromColorspaceToColorspace:(CGFrameBuffer*)inFB
                                  convertToColorspace:(CGColorSpaceRef)convertToColorspace
 {
+  BT709_TRACE_SCOPE("colorspace_convert");
+  
   int width = (int) inFB.width;
   int height = (int) inFB.height;
   
@@ -187,6 +193,8 @@ void usage() {
 
 CGImageRef makeImageFromFile(NSString *filenameStr)
 {
+  BT709_TRACE_SCOPE("image_decode");
+  
   CGImageSourceRef sourceRef;
   CGImageRef imageRef;
   
@@ -247,6 +255,8 @@ float appleAVFoundationYRangeNormalize(int Y)
 
 static inline
 void exportVideo(CGImageRef inCGImage, NSString *outPath) {
+  BT709_TRACE_SCOPE("h264_encode");
+  
   // Allocate a H264Encoder instance and declare a util
   // object that feeds CoreGraphics images to the encoder
   // and take care of reporting an error condition.
@@ -607,10 +617,12 @@ int process(NSString *inPNGStr, NSString *outM4vStr, ConfigurationStruct *config
     // Load Y Cb Cr values from movie that was just written by reading
     // values into a pixel buffer.
     
+    BT709_TRACE_BEGIN(decode, "h264_decode");
     NSArray *cvPixelBuffers = [BGDecodeEncode recompressKeyframesOnBackgroundThread:outPath
                                                                       frameDuration:1.0/30
                                                                          renderSize:CGSizeMake(width, height)
                                                                          aveBitrate:0];
+    BT709_TRACE_END(decode);
     NSLog(@"returned %d YCbCr textures", (int)cvPixelBuffers.count);
     
     // Grab just the first texture, return retained ref
@@ -821,6 +833,8 @@ int process(NSString *inPNGStr, NSString *outM4vStr, ConfigurationStruct *config
 int main(int argc, const char * argv[]) {
   int retcode = 0;
   
+  BT709_TRACE_START();
+  
   @autoreleasepool {
     char *inPNG = NULL;
     char *outY4m = NULL;
@@ -0,0 +1,228 @@
+//
+//  pattern_write.c
+//
+//  Command line utility that writes generated test patterns as
+//  a Y4M file, headerless I420 frames, or headerless BGRA frames
+//  that can be read with srgb_to_bt709 -raw. The output path "-"
+//  writes to stdout.
+//
+//  This utility depends only on the C library.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "sRGB.h"
+#include "BT709.h"
+
+#include "bt709_frame.h"
+#include "bt709_pattern.h"
+#include "y4m_writer.h"
+
+typedef enum {
+  PatternFormatY4M = 0,
+  PatternFormatI420,
+  PatternFormatBGRA
+} PatternFormat;
+
+static
+void usage() {
+  printf("pattern_write ?OPTIONS? OUTPUT\n");
+  printf("OPTIONS:\n");
+  printf("-pattern bars|ramp|linear-ramp|sweep|zoneplate|noise|alphafade (default is bars)\n");
+  printf("-size WxH (default is 1920x1080)\n");
+  printf("-frames N (default is 1)\n");
+  printf("-seed S (seed for the noise pattern, default is 1)\n");
+  printf("-format y4m|yuv|bgra (yuv is headerless I420, default is y4m)\n");
+  printf("-gamma apple|srgb|linear (gamma of y4m and yuv output, default is apple)\n");
+  printf("-fps 1|15|24|25|2997|30|60 (default is 30)\n");
+}
+
+int main(int argc, const char * argv[]) {
+  int pattern = BT709PatternBars;
+  int width = 1920;
+  int height = 1080;
+  int numFrames = 1;
+  uint32_t seed = 1;
+  PatternFormat format = PatternFormatY4M;
+  BT709Gamma gamma = BT709GammaApple;
+  Y4MHeaderFPS fps = Y4MHeaderFPS_30;
+  const char *outPath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+
+    if (arg[0] == '-' && arg[1] != '\0') {
+      if ((i + 1) >= argc) {
+        usage();
+        exit(3);
+      }
+
+      const char *value = argv[++i];
+
+      if (strcmp(arg, "-pattern") == 0) {
+        pattern = bt709_pattern_from_name(value);
+        if (pattern < 0) {
+          printf("option -pattern unknown value \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-size") == 0) {
+        if (sscanf(value, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+          printf("option -size must be WxH but got \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-frames") == 0) {
+        numFrames = atoi(value);
+        if (numFrames < 1) {
+          printf("option -frames must be 1 or more but got \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-seed") == 0) {
+        seed = (uint32_t) strtoul(value, NULL, 10);
+      } else if (strcmp(arg, "-format") == 0) {
+        if (strcmp(value, "y4m") == 0) {
+          format = PatternFormatY4M;
+        } else if (strcmp(value, "yuv") == 0) {
+          format = PatternFormatI420;
+        } else if (strcmp(value, "bgra") == 0) {
+          format = PatternFormatBGRA;
+        } else {
+          printf("option -format unknown value \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-gamma") == 0) {
+        if (strcmp(value, "apple") == 0) {
+          gamma = BT709GammaApple;
+        } else if (strcmp(value, "srgb") == 0) {
+          gamma = BT709GammaSrgb;
+        } else if (strcmp(value, "linear") == 0) {
+          gamma = BT709GammaLinear;
+        } else {
+          printf("option -gamma unknown value \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-fps") == 0) {
+        if (strcmp(value, "1") == 0) {
+          fps = Y4MHeaderFPS_1;
+        } else if (strcmp(value, "15") == 0) {
+          fps = Y4MHeaderFPS_15;
+        } else if (strcmp(value, "24") == 0) {
+          fps = Y4MHeaderFPS_24;
+        } else if (strcmp(value, "25") == 0) {
+          fps = Y4MHeaderFPS_25;
+        } else if (strcmp(value, "2997") == 0) {
+          fps = Y4MHeaderFPS_29_97;
+        } else if (strcmp(value, "30") == 0) {
+          fps = Y4MHeaderFPS_30;
+        } else if (strcmp(value, "60") == 0) {
+          fps = Y4MHeaderFPS_60;
+        } else {
+          printf("option -fps unknown value \"%s\"\n", value);
+          exit(3);
+        }
+      } else {
+        printf("unknown option \"%s\"\n", arg);
+        exit(3);
+      }
+    } else if (outPath == NULL) {
+      outPath = arg;
+    } else {
+      usage();
+      exit(3);
+    }
+  }
+
+  if (outPath == NULL) {
+    usage();
+    exit(3);
+  }
+
+  if (format != PatternFormatBGRA && ((width % 2) != 0 || (height % 2) != 0)) {
+    printf("y4m and yuv output must have an even width and height\n");
+    exit(3);
+  }
+
+  FILE *outFile = (strcmp(outPath, "-") == 0) ? stdout : fopen(outPath, "wb");
+  if (outFile == NULL) {
+    fprintf(stderr, "could not open output file \"%s\"\n", outPath);
+    return 1;
+  }
+
+  const size_t yLen = (size_t) width * height;
+  const size_t uvLen = (size_t) (width / 2) * (height / 2);
+  const size_t frameLen = (format == PatternFormatBGRA) ? (yLen * 4) : (yLen + (2 * uvLen));
+
+  uint8_t *frame = (uint8_t *) malloc(frameLen);
+  BT709FrameTables *tables = (BT709FrameTables *) malloc(sizeof(BT709FrameTables));
+
+  if (frame == NULL || tables == NULL) {
+    fprintf(stderr, "could not allocate a %d x %d frame\n", width, height);
+    return 2;
+  }
+
+  bt709_frame_tables_init(tables, BT709GammaSrgb, gamma);
+
+  BT709PlanesStruct planes;
+  planes.yPtr = frame;
+  planes.yBytesPerRow = width;
+  planes.cbPtr = frame + yLen;
+  planes.cbBytesPerRow = width / 2;
+  planes.crPtr = frame + yLen + uvLen;
+  planes.crBytesPerRow = width / 2;
+
+  int retcode = 0;
+
+  if (format == PatternFormatY4M) {
+    Y4MHeaderStruct header;
+    header.width = width;
+    header.height = height;
+    header.fps = fps;
+    if (y4m_write_header(outFile, &header) != 0) {
+      retcode = 2;
+    }
+  }
+
+  for (int frameIndex = 0; frameIndex < numFrames && retcode == 0; frameIndex++) {
+    if (format == PatternFormatBGRA) {
+      retcode = bt709_pattern_bgra(pattern, frameIndex, numFrames, seed, width, height, frame, width * 4);
+    } else {
+      retcode = bt709_pattern_planes(tables, pattern, frameIndex, numFrames, seed, width, height, &planes);
+    }
+
+    if (retcode != 0) {
+      fprintf(stderr, "could not generate frame %d\n", frameIndex);
+      break;
+    }
+
+    if (format == PatternFormatY4M) {
+      Y4MFrameStruct fs;
+      fs.yPtr = planes.yPtr;
+      fs.yLen = (int) yLen;
+      fs.uPtr = planes.cbPtr;
+      fs.uLen = (int) uvLen;
+      fs.vPtr = planes.crPtr;
+      fs.vLen = (int) uvLen;
+      retcode = y4m_write_frame(outFile, &fs);
+    } else if (fwrite(frame, 1, frameLen, outFile) != frameLen) {
+      retcode = 2;
+    }
+
+    if (retcode != 0) {
+      fprintf(stderr, "could not write frame %d\n", frameIndex);
+    }
+  }
+
+  if (outFile != stdout) {
+    fclose(outFile);
+  } else {
+    fflush(outFile);
+  }
+
+  free(frame);
+  free(tables);
+
+  return retcode;
+}
@@ -0,0 +1,233 @@
+//
+//  raw_to_bt709.c
+//
+//  Command line utility that converts a stream of PAM (P7) or
+//  binary PPM (P6) frames, or headerless BGRA frames, into a BT.709
+//  Y4M file. This is the portable subset of srgb_to_bt709 -raw, so
+//  renderer output can be piped straight into the encoder on Linux:
+//
+//  render | raw_to_bt709 -size 1920x1080 - OUT.y4m
+//
+//  Frames are converted with bt709_context.h, which keeps its worker
+//  threads parked between frames. The input "-" reads stdin and the
+//  output "-" writes the Y4M stream to stdout.
+//
+//  This utility depends only on the C library.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "sRGB.h"
+#include "BT709.h"
+
+#include "bt709_context.h"
+#include "raw_frame_reader.h"
+#include "y4m_writer.h"
+
+static
+void usage() {
+  printf("raw_to_bt709 ?OPTIONS? IN.pam|IN.bgra|- OUTPUT.y4m|-\n");
+  printf("OPTIONS:\n");
+  printf("-size WxH (dimensions of headerless BGRA frames, otherwise input is PAM or PPM)\n");
+  printf("-gamma apple|srgb|linear (default is apple)\n");
+  printf("-fps 1|15|24|25|2997|30|60 (default is 30)\n");
+  printf("-threads N (default is the number of CPUs)\n");
+}
+
+int main(int argc, const char * argv[]) {
+  RawFrameFormat format = RawFrameFormatNetpbm;
+  int width = 0;
+  int height = 0;
+  BT709Gamma inputGamma = BT709GammaSrgb;
+  BT709Gamma outputGamma = BT709GammaApple;
+  Y4MHeaderFPS fps = Y4MHeaderFPS_30;
+  int numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  const char *inPath = NULL;
+  const char *outPath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+
+    if (arg[0] == '-' && arg[1] != '\0') {
+      if ((i + 1) >= argc) {
+        usage();
+        exit(3);
+      }
+
+      const char *value = argv[++i];
+
+      if (strcmp(arg, "-size") == 0) {
+        if (sscanf(value, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+          printf("option -size must be WxH but got \"%s\"\n", value);
+          exit(3);
+        }
+        format = RawFrameFormatBGRA;
+      } else if (strcmp(arg, "-gamma") == 0) {
+        if (strcmp(value, "apple") == 0) {
+          inputGamma = BT709GammaSrgb;
+          outputGamma = BT709GammaApple;
+        } else if (strcmp(value, "srgb") == 0) {
+          inputGamma = BT709GammaSrgb;
+          outputGamma = BT709GammaSrgb;
+        } else if (strcmp(value, "linear") == 0) {
+          inputGamma = BT709GammaLinear;
+          outputGamma = BT709GammaLinear;
+        } else {
+          printf("option -gamma unknown value \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-fps") == 0) {
+        if (strcmp(value, "1") == 0) {
+          fps = Y4MHeaderFPS_1;
+        } else if (strcmp(value, "15") == 0) {
+          fps = Y4MHeaderFPS_15;
+        } else if (strcmp(value, "24") == 0) {
+          fps = Y4MHeaderFPS_24;
+        } else if (strcmp(value, "25") == 0) {
+          fps = Y4MHeaderFPS_25;
+        } else if (strcmp(value, "2997") == 0) {
+          fps = Y4MHeaderFPS_29_97;
+        } else if (strcmp(value, "30") == 0) {
+          fps = Y4MHeaderFPS_30;
+        } else if (strcmp(value, "60") == 0) {
+          fps = Y4MHeaderFPS_60;
+        } else {
+          printf("option -fps unknown value \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-threads") == 0) {
+        numThreads = atoi(value);
+        if (numThreads < 1) {
+          printf("option -threads must be 1 or more but got \"%s\"\n", value);
+          exit(3);
+        }
+      } else {
+        printf("unknown option \"%s\"\n", arg);
+        exit(3);
+      }
+    } else if (inPath == NULL) {
+      inPath = arg;
+    } else if (outPath == NULL) {
+      outPath = arg;
+    } else {
+      usage();
+      exit(3);
+    }
+  }
+
+  if (inPath == NULL || outPath == NULL) {
+    usage();
+    exit(3);
+  }
+
+  RawFrameReader reader;
+
+  if (raw_frame_reader_open(&reader, inPath, format, width, height) != 0) {
+    return 1;
+  }
+
+  FILE *outFile = y4m_open_file(outPath);
+
+  if (outFile == NULL) {
+    raw_frame_reader_close(&reader);
+    return 1;
+  }
+
+  // Status messages go to stderr once the Y4M stream owns stdout
+
+  if (strcmp(outPath, "-") == 0) {
+    y4m_redirect_stdout();
+  }
+
+  BT709Context *context = NULL;
+  int retcode = 0;
+
+  while (1) {
+    const uint8_t *framePtr = NULL;
+
+    int result = raw_frame_reader_next(&reader, &framePtr);
+
+    if (result == 1) {
+      break;
+    } else if (result != 0) {
+      retcode = 1;
+      break;
+    }
+
+    width = reader.width;
+    height = reader.height;
+
+    if (context == NULL) {
+      if ((width % 2) != 0 || (height % 2) != 0) {
+        fprintf(stderr, "width and height must both be even but got dimensions %d x %d\n", width, height);
+        retcode = 1;
+        break;
+      }
+
+      context = (BT709Context *) malloc(sizeof(BT709Context));
+
+      if (context == NULL || bt709_context_init(context, inputGamma, outputGamma, &reader.layout, width, height, numThreads, 1) != 0) {
+        fprintf(stderr, "could not create a converter for %d x %d frames\n", width, height);
+        free(context);
+        context = NULL;
+        retcode = 1;
+        break;
+      }
+
+      Y4MHeaderStruct header;
+      header.width = width;
+      header.height = height;
+      header.fps = fps;
+
+      retcode = y4m_write_header(outFile, &header);
+      if (retcode != 0) {
+        break;
+      }
+    }
+
+    // A stream can mix PPM and PAM frames, each frame is converted
+    // with the layout read from its own header.
+
+    bt709_context_set_layout(context, &reader.layout);
+
+    BT709PlanesStruct planes;
+    bt709_context_convert(context, framePtr, width * reader.layout.bytesPerPixel, &planes);
+
+    Y4MFrameStruct fs;
+    fs.yPtr = planes.yPtr;
+    fs.yLen = width * height;
+    fs.uPtr = planes.cbPtr;
+    fs.uLen = (width / 2) * (height / 2);
+    fs.vPtr = planes.crPtr;
+    fs.vLen = (width / 2) * (height / 2);
+
+    retcode = y4m_write_frame(outFile, &fs);
+    if (retcode != 0) {
+      fprintf(stderr, "could not write frame %d\n", reader.frameNum - 1);
+      break;
+    }
+  }
+
+  if (retcode == 0 && context == NULL) {
+    fprintf(stderr, "no frames in input \"%s\"\n", inPath);
+    retcode = 1;
+  }
+
+  if (fclose(outFile) != 0 && retcode == 0) {
+    retcode = 2;
+  }
+
+  if (context != NULL) {
+    bt709_context_destroy(context);
+    free(context);
+  }
+
+  raw_frame_reader_close(&reader);
+
+  return retcode;
+}
@@ -18,6 +18,21 @@
 
 #import "y4m_writer.h"
 
+#import "bt709_frame.h"
+#import "bt709_frame10.h"
+#import "raw_frame_reader.h"
+#import "y4m_async_writer.h"
+#import "y4m_segment.h"
+#import "y4m_journal.h"
+#import "bt709_inverse_table.h"
+#import "bt709_sharp_yuv.h"
+#import "bt709_cube_lut.h"
+#import "bt709_pyramid.h"
+#import "bt709_alpha.h"
+#import "bt709_context.h"
+
+#import "bt709_trace.h"
+
 // Emit an array of float data as a CSV file, the
 // labels should be NSString, these define
 // the emitted labels in column 0.
@@ -72,12 +87,25 @@ BOOL writeTableToCSV(NSString *filename, NSArray* labelsArr, NSArray* valuesArr)
 }
 
 void usage() {
-  printf("srgb_to_bt709 ?OPTIONS? OUTPUT.y4m\n");
+  printf("srgb_to_bt709 ?OPTIONS? OUTPUT.y4m|-\n");
   printf("OPTIONS:\n");
   printf("-frame F.png (input is a single frame)\n");
   printf("-frames F0001.png (first frame of N input frames)\n");
   printf("-gamma apple|srgb|linear (default is apple)\n");
+  printf("-alpha 0|1|packed (1 also writes alpha to OUTPUT_alpha.y4m, packed stacks alpha below color in one double height frame)\n");
   printf("-fps 1|15|24|25|2997|30|60 (default to 30 with -frames)\n");
+  printf("-raw IN.pam|IN.bgra|- (stream of PAM/PPM frames or headerless BGRA frames, - reads stdin)\n");
+  printf("-size WxH (dimensions of headerless BGRA frames read with -raw)\n");
+  printf("-async 2|3 (with -raw, write from a background thread with 2 or 3 frame buffers)\n");
+  printf("-sharp N (with -raw, refine Y against the subsampled Cb Cr with up to N iterations)\n");
+  printf("-lut GRADE.cube (with -raw, apply a 3D LUT to input pixels as part of the encode)\n");
+  printf("-inverse TABLE.bin (with -raw and -gamma apple, encode with an inverse search table, built and saved when missing)\n");
+  printf("-bits 8|10 (with -raw, 10 writes C420p10 Y4M with 16 bit samples, default is 8)\n");
+  printf("-range START:END (encode frames START up to but not including END as a segment for y4m_merge)\n");
+  printf("-resume (with -frames, keep a progress journal and continue after the last complete frame on restart)\n");
+  printf("-proxies 1|2|3 (with -raw, also write 1/2, 1/4, and 1/8 size OUTPUT_half.y4m, OUTPUT_quarter.y4m, OUTPUT_eighth.y4m)\n");
+  printf("-premultiply gamma|linear (with -raw RGBA or BGRA input, multiply by straight alpha as part of the encode)\n");
+  printf("OUTPUT - writes the Y4M stream to stdout, status messages go to stderr\n");
   fflush(stdout);
 }
 
@@ -660,12 +688,14 @@ int parse_filenames_from_first_file(NSString *firstFilename,
   return 0;
 }
 
-// Read from source frame, convert to YCbCr and populate CoreVideo buffer
+// Read from source frame, convert to YCbCr and populate CoreVideo buffer.
+// The input colorspace is checked and reported when isFirstFrame is set,
+// which is the first frame this run encodes and not always input frame 0.
 
 static inline
 CVPixelBufferRef loadFrameIntoCVPixelBuffer(
           NSString *inputImageStr,
-                                            int frameNum,
+                                            BOOL isFirstFrame,
                                             BOOL isLinearGamma,
                                             BOOL isSRGBGamma,
                                             BOOL isAlpha,
@@ -674,11 +704,15 @@ CVPixelBufferRef loadFrameIntoCVPixelBuffer(
                                             NSMutableData *Cb,
                                             NSMutableData *Cr)
 {
-  if (1 || frameNum == 1) {
+  BT709_TRACE_SCOPE("loadFrameIntoCVPixelBuffer");
+  
+  if (1 || isFirstFrame) {
     printf("loading %s\n", [inputImageStr UTF8String]);
   }
   
+  BT709_TRACE_BEGIN(decode, "image_decode");
   CGImageRef inImage = makeImageFromFile(inputImageStr);
+  BT709_TRACE_END(decode);
   if (inImage == NULL) {
     return NULL;
   }
@@ -705,6 +739,8 @@ CVPixelBufferRef loadFrameIntoCVPixelBuffer(
     return NULL;
   }
   
+  BT709_TRACE_BEGIN(detect, "colorspace_detect");
+  
   BOOL inputIsRGBColorspace = FALSE;
   BOOL inputIsSRGBColorspace = FALSE;
   BOOL inputIsSRGBLinearColorspace = FALSE;
@@ -783,7 +819,9 @@ CVPixelBufferRef loadFrameIntoCVPixelBuffer(
     CGColorSpaceRelease(colorspace);
   }
   
-  if (frameNum == 1) {
+  BT709_TRACE_END(detect);
+  
+  if (isFirstFrame) {
     if (inputIsRGBColorspace) {
       printf("untagged RGB colorspace is not supported as input\n");
       exit(4);
@@ -843,6 +881,8 @@ CVPixelBufferRef loadFrameIntoCVPixelBuffer(
     // Writing the alpha channel values means just extract the linear
     // values from the alpha channel and write as simple linear data
     
+    BT709_TRACE_SCOPE("alpha_extract");
+    
     CGFrameBuffer *inputFB = [CGFrameBuffer cGFrameBufferWithBppDimensions:32 width:width height:height];
     
     // FIXME: If original input is not in sRGB then it needs to be converted!
@@ -958,6 +998,8 @@ CVPixelBufferRef loadFrameIntoCVPixelBuffer(
     
     // ffmpeg -i in.y4m -c:v libx264 -color_primaries bt709 -colorspace bt709 -color_trc linear out.m4v
     
+    BT709_TRACE_SCOPE("linear_convert");
+    
     CGFrameBuffer *inputFB = [CGFrameBuffer cGFrameBufferWithBppDimensions:24 width:width height:height];
     
     inputFB.colorspace = CGImageGetColorSpace(inImage);
@@ -991,7 +1033,9 @@ CVPixelBufferRef loadFrameIntoCVPixelBuffer(
                                                                        isLinear:isLinearGamma
                                                                     asSRGBGamma:isSRGBGamma];
   
+  BT709_TRACE_BEGIN(meta, "dump_image_meta");
   int dumpResult = dump_image_meta(inImage, cvPixelBuffer, Y, Cb, Cr);
+  BT709_TRACE_END(meta);
   
   CGImageRelease(inImage);
   
@@ -1002,7 +1046,575 @@ CVPixelBufferRef loadFrameIntoCVPixelBuffer(
   return cvPixelBuffer;
 }
 
+// Convert a stream of raw frames without decoding PNG images. Each frame
+// is converted in place from the mapped or read buffer and then written
+// to the output Y4M file.
+
+// Write the current frame of each proxy level to its own file
+
+static inline
+int write_proxy_frames(const BT709Pyramid *pyramid, FILE **proxyFiles) {
+  for (int i = 0; i < pyramid->numLevels; i++) {
+    Y4MFrameStruct fs;
+    bt709_pyramid_level_frame(pyramid, i, &fs);
+    
+    BT709_TRACE_BEGIN(write, "y4m_write_frame");
+    int write_frame_result = y4m_write_frame(proxyFiles[i], &fs);
+    BT709_TRACE_END(write);
+    if (write_frame_result != 0) {
+      return write_frame_result;
+    }
+  }
+  
+  return 0;
+}
+
+int process_raw(NSDictionary *inDict) {
+  NSString *rawInputStr = inDict[@"-raw"];
+  NSString *outY4mStr = inDict[@"output"];
+  NSString *gamma = inDict[@"-gamma"];
+  NSNumber *fpsNum = inDict[@"-fps"];
+  Y4MHeaderFPS fps = [fpsNum intValue];
+  
+  RawFrameFormat format = RawFrameFormatNetpbm;
+  int width = 0;
+  int height = 0;
+  
+  if (inDict[@"-size"] != nil) {
+    format = RawFrameFormatBGRA;
+    width = [inDict[@"-width"] intValue];
+    height = [inDict[@"-height"] intValue];
+  }
+  
+  BT709Gamma inputGamma;
+  BT709Gamma outputGamma;
+  
+  if ([gamma isEqualToString:@"linear"]) {
+    inputGamma = BT709GammaLinear;
+    outputGamma = BT709GammaLinear;
+  } else if ([gamma isEqualToString:@"srgb"]) {
+    inputGamma = BT709GammaSrgb;
+    outputGamma = BT709GammaSrgb;
+  } else {
+    inputGamma = BT709GammaSrgb;
+    outputGamma = BT709GammaApple;
+  }
+  
+  BT709FrameTables tables;
+  bt709_frame_tables_init(&tables, inputGamma, outputGamma);
+  
+  // With -bits 10 gamma encoded values keep full precision and
+  // are quantized to 10 bit samples.
+  
+  BT709Frame10Tables *tables10 = NULL;
+  
+  if ([inDict[@"-bits"] intValue] == 10) {
+    tables10 = (BT709Frame10Tables *) malloc(sizeof(BT709Frame10Tables));
+    
+    if (tables10 == NULL) {
+      fprintf(stderr, "could not allocate -bits 10 tables\n");
+      return 1;
+    }
+    
+    bt709_frame10_tables_init(tables10, inputGamma, outputGamma);
+  }
+  
+  // With -inverse each pixel is encoded with a lookup into a
+  // precomputed table, the table is built once and then mapped.
+  
+  NSString *inverseStr = inDict[@"-inverse"];
+  BT709InverseTable inverseTable;
+  
+  if (inverseStr != nil) {
+    const char *inversePath = [inverseStr UTF8String];
+    int map_result = bt709_inverse_table_map(&inverseTable, inversePath);
+    
+    if (map_result == 1) {
+      int numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+      fprintf(stderr, "building inverse table %s with %d threads\n", inversePath, numThreads);
+      
+      uint8_t *entries = (uint8_t *) malloc(BT709_INVERSE_TABLE_DATA_LEN);
+      
+      BT709_TRACE_BEGIN(build, "bt709_inverse_table_build");
+      if (entries == NULL || bt709_inverse_table_build(entries, 2, numThreads) != 0) {
+        map_result = 2;
+      } else if (bt709_inverse_table_write(inversePath, entries, 2) != 0) {
+        map_result = 2;
+      } else {
+        map_result = bt709_inverse_table_map(&inverseTable, inversePath);
+      }
+      BT709_TRACE_END(build);
+      
+      free(entries);
+    }
+    
+    if (map_result != 0) {
+      free(tables10);
+      return 1;
+    }
+  }
+  
+  RawFrameReader reader;
+  
+  if (raw_frame_reader_open(&reader, [rawInputStr UTF8String], format, width, height) != 0) {
+    if (inverseStr != nil) {
+      bt709_inverse_table_close(&inverseTable);
+    }
+    free(tables10);
+    return 1;
+  }
+  
+  const char *outFilename = [outY4mStr UTF8String];
+  
+  // With -async the output is opened once the frame size is known
+  
+  int numAsyncBuffers = [inDict[@"-async"] intValue];
+  Y4MAsyncWriter asyncWriter;
+  BOOL isAsyncOpen = FALSE;
+  
+  FILE *outFile = NULL;
+  
+  if (numAsyncBuffers == 0) {
+    outFile = y4m_open_file(outFilename);
+    
+    if (outFile == NULL) {
+      raw_frame_reader_close(&reader);
+      if (inverseStr != nil) {
+        bt709_inverse_table_close(&inverseTable);
+      }
+      free(tables10);
+      return 1;
+    }
+    
+    // Status messages go to stderr once the Y4M stream owns stdout
+    
+    if (strcmp(outFilename, "-") == 0) {
+      y4m_redirect_stdout();
+    }
+  }
+  
+  // A setup failure below sets retcode, no frames are read and
+  // everything allocated so far is released at the end.
+  
+  int retcode = 0;
+  
+  // With -sharp each Y is refined after Cb and Cr are averaged
+  
+  BT709SharpTables *sharpTables = NULL;
+  
+  if (inDict[@"-sharp"] != nil) {
+    sharpTables = (BT709SharpTables *) malloc(sizeof(BT709SharpTables));
+    
+    if (sharpTables == NULL) {
+      fprintf(stderr, "could not allocate -sharp tables\n");
+      retcode = 1;
+    } else {
+      bt709_sharp_tables_init(sharpTables, inputGamma, outputGamma, [inDict[@"-sharp"] intValue]);
+    }
+  }
+  
+  // With -lut input pixels are graded one pair of rows at a time
+  // right before conversion, split into bands over all CPUs. The
+  // band threads are started once and stay parked between frames.
+  
+  BT709CubeLUT *cubeLut = NULL;
+  BT709CubeLUTPool *lutPool = NULL;
+  int numLutThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  
+  if (retcode == 0 && inDict[@"-lut"] != nil) {
+    cubeLut = (BT709CubeLUT *) malloc(sizeof(BT709CubeLUT));
+    lutPool = (BT709CubeLUTPool *) malloc(sizeof(BT709CubeLUTPool));
+    
+    if (cubeLut == NULL || lutPool == NULL) {
+      fprintf(stderr, "could not allocate -lut tables\n");
+      retcode = 1;
+    } else if (bt709_cube_lut_load(cubeLut, [inDict[@"-lut"] UTF8String]) != 0) {
+      retcode = 1;
+    } else {
+      bt709_cube_lut_pool_init(lutPool, numLutThreads);
+    }
+    
+    if (retcode != 0) {
+      free(cubeLut);
+      free(lutPool);
+      cubeLut = NULL;
+      lutPool = NULL;
+    }
+  }
+  
+  // With -proxies reduced size levels are generated in the same
+  // pass as the full size encode, each level is written to its
+  // own Y4M file named after the output file.
+  
+  int numProxies = [inDict[@"-proxies"] intValue];
+  BT709Pyramid pyramid;
+  FILE *proxyFiles[BT709_PYRAMID_MAX_LEVELS] = { NULL, NULL, NULL };
+  static const char *proxySuffixes[BT709_PYRAMID_MAX_LEVELS] = { "_half", "_quarter", "_eighth" };
+  
+  memset(&pyramid, 0, sizeof(pyramid));
+  
+  // With -range frames before START are read and dropped and the
+  // output is a segment that ends at END or at the end of input.
+  
+  BOOL isSegment = (inDict[@"-range"] != nil);
+  int rangeStart = isSegment ? [inDict[@"-rangeStart"] intValue] : 0;
+  int rangeEnd = isSegment ? [inDict[@"-rangeEnd"] intValue] : INT_MAX;
+  Y4MHeaderStruct segmentHeader;
+  
+  // With -premultiply each pair of input rows is multiplied by
+  // alpha into a small scratch buffer right before conversion.
+  
+  BT709AlphaTables *alphaTables = NULL;
+  BT709AlphaOp alphaOp = BT709AlphaPremultiply;
+  NSMutableData *alphaScratch = [NSMutableData data];
+  
+  if (retcode == 0 && inDict[@"-premultiply"] != nil) {
+    alphaTables = (BT709AlphaTables *) malloc(sizeof(BT709AlphaTables));
+    
+    if (alphaTables == NULL) {
+      fprintf(stderr, "could not allocate -premultiply tables\n");
+      retcode = 1;
+    } else {
+      bt709_alpha_tables_init(alphaTables, inputGamma);
+    }
+    
+    if ([inDict[@"-premultiply"] isEqualToString:@"linear"]) {
+      alphaOp = BT709AlphaPremultiplyLinear;
+    }
+  }
+  
+  // Plain conversion runs through a context that keeps its worker
+  // threads between frames, created once the frame size is known.
+  
+  BT709Context *context = NULL;
+  
+  NSMutableData *Y = [NSMutableData data];
+  NSMutableData *Cb = [NSMutableData data];
+  NSMutableData *Cr = [NSMutableData data];
+  
+  while (retcode == 0 && reader.frameNum < rangeEnd) @autoreleasepool {
+    const uint8_t *framePtr = NULL;
+    
+    BT709_TRACE_BEGIN(read, "raw_frame_reader_next");
+    int result = raw_frame_reader_next(&reader, &framePtr);
+    BT709_TRACE_END(read);
+    
+    if (result == 1) {
+      break;
+    } else if (result != 0) {
+      retcode = 1;
+      break;
+    }
+    
+    if (reader.frameNum <= rangeStart) {
+      continue;
+    }
+    
+    width = reader.width;
+    height = reader.height;
+    
+    // Every frame is checked since a stream can switch from PAM
+    // with alpha to PPM after the first frame.
+    
+    if (alphaTables != NULL && (reader.layout.bytesPerPixel != 4 || reader.layout.aOffset < 0)) {
+      printf("-premultiply requires input pixels with an alpha channel but frame %d has none\n", reader.frameNum - 1);
+      retcode = 1;
+      break;
+    }
+    
+    if (reader.frameNum == (rangeStart + 1)) {
+      if ((width % 2) != 0 || (height % 2) != 0) {
+        printf("width and height must both be even but got dimensions %d x %d\n", width, height);
+        retcode = 1;
+        break;
+      }
+      
+      if (alphaTables != NULL) {
+        [alphaScratch setLength:2*width*4];
+      }
+      
+      if (tables10 == NULL && cubeLut == NULL && inverseStr == nil && sharpTables == NULL && numProxies == 0 && alphaTables == NULL) {
+        context = (BT709Context *) malloc(sizeof(BT709Context));
+        
+        if (context == NULL || bt709_context_init(context, inputGamma, outputGamma, &reader.layout, width, height, numLutThreads, 0) != 0) {
+          free(context);
+          context = NULL;
+          retcode = 1;
+          break;
+        }
+      }
+      
+      Y4MHeaderStruct header;
+      
+      header.width = width;
+      header.height = height;
+      header.fps = fps;
+      
+      int header_result;
+      
+      if (numAsyncBuffers > 0) {
+        if (y4m_async_writer_open(&asyncWriter, outFilename, width, height, numAsyncBuffers, 1) != 0) {
+          y4m_async_writer_close(&asyncWriter);
+          retcode = 1;
+          break;
+        }
+        isAsyncOpen = TRUE;
+        if (strcmp(outFilename, "-") == 0) {
+          y4m_redirect_stdout();
+        }
+        header_result = y4m_async_writer_write_header(&asyncWriter, &header);
+      } else {
+        const int bytesPerSample = (tables10 != NULL) ? 2 : 1;
+        
+        [Y setLength:width*height*bytesPerSample];
+        [Cb setLength:(width/2)*(height/2)*bytesPerSample];
+        [Cr setLength:(width/2)*(height/2)*bytesPerSample];
+        
+        if (tables10 != NULL) {
+          header_result = y4m_write_header_10(outFile, &header);
+        } else if (isSegment) {
+          segmentHeader = header;
+          header_result = y4m_segment_write_header(outFile, &header, rangeStart);
+        } else {
+          header_result = y4m_write_header(outFile, &header);
+        }
+      }
+      
+      if (header_result != 0) {
+        retcode = header_result;
+        break;
+      }
+      
+      if (numProxies > 0) {
+        if (bt709_pyramid_init(&pyramid, &tables, width, height, numProxies) != 0) {
+          printf("dimensions %d x %d are too small for %d proxy levels\n", width, height, numProxies);
+          retcode = 1;
+          break;
+        }
+        
+        NSString *basePath = [outY4mStr stringByDeletingPathExtension];
+        
+        for (int i = 0; i < numProxies; i++) {
+          NSString *proxyPath = [NSString stringWithFormat:@"%@%s.y4m", basePath, proxySuffixes[i]];
+          proxyFiles[i] = y4m_open_file([proxyPath UTF8String]);
+          
+          if (proxyFiles[i] == NULL) {
+            retcode = 1;
+            break;
+          }
+          
+          Y4MHeaderStruct proxyHeader;
+          
+          proxyHeader.width = pyramid.levels[i].width;
+          proxyHeader.height = pyramid.levels[i].height;
+          proxyHeader.fps = fps;
+          
+          header_result = y4m_write_header(proxyFiles[i], &proxyHeader);
+          if (header_result != 0) {
+            retcode = header_result;
+            break;
+          }
+        }
+        
+        if (retcode != 0) {
+          break;
+        }
+      }
+    }
+    
+    // A stream can mix PPM and PAM frames, so the context converts
+    // each frame with the layout read from its own header.
+    
+    if (context != NULL) {
+      bt709_context_set_layout(context, &reader.layout);
+    }
+    
+    const int inBytesPerRow = width * reader.layout.bytesPerPixel;
+    
+    BT709PlanesStruct planes;
+    
+    if (numAsyncBuffers > 0) {
+      // Convert directly into the next free output buffer, this
+      // blocks when every buffer is still waiting to be written.
+      
+      Y4MFrameStruct fs;
+      
+      BT709_TRACE_BEGIN(acquire, "y4m_async_writer_acquire");
+      int acquire_result = y4m_async_writer_acquire(&asyncWriter, &fs);
+      BT709_TRACE_END(acquire);
+      if (acquire_result != 0) {
+        retcode = acquire_result;
+        break;
+      }
+      
+      planes.yPtr = fs.yPtr;
+      planes.yBytesPerRow = width;
+      planes.cbPtr = fs.uPtr;
+      planes.cbBytesPerRow = width / 2;
+      planes.crPtr = fs.vPtr;
+      planes.crBytesPerRow = width / 2;
+      
+      BT709_TRACE_BEGIN(encode, "bt709_frame_encode");
+      if (cubeLut != NULL) {
+        bt709_cube_lut_pool_encode(lutPool, cubeLut, &tables, sharpTables, &reader.layout, framePtr, inBytesPerRow, width, height, &planes);
+      } else if (inverseStr != nil) {
+        bt709_inverse_table_encode(&inverseTable, &reader.layout, framePtr, inBytesPerRow, width, height, &planes);
+      } else if (sharpTables != NULL) {
+        bt709_sharp_encode(sharpTables, &reader.layout, framePtr, inBytesPerRow, width, height, &planes);
+      } else if (numProxies > 0) {
+        bt709_pyramid_encode(&pyramid, &reader.layout, framePtr, inBytesPerRow, width, height, &planes);
+      } else if (alphaTables != NULL) {
+        bt709_alpha_encode_premultiplied(&tables, alphaTables, alphaOp, &reader.layout, framePtr, inBytesPerRow, width, height, &planes, (uint8_t *) alphaScratch.mutableBytes);
+      } else {
+        bt709_context_encode(context, framePtr, inBytesPerRow, &planes);
+      }
+      BT709_TRACE_END(encode);
+      
+      if (numProxies > 0) {
+        retcode = write_proxy_frames(&pyramid, proxyFiles);
+        if (retcode != 0) {
+          break;
+        }
+      }
+      
+      int submit_result = y4m_async_writer_submit(&asyncWriter);
+      if (submit_result != 0) {
+        retcode = submit_result;
+        break;
+      }
+      
+      continue;
+    }
+    
+    planes.yPtr = (uint8_t *) Y.mutableBytes;
+    planes.yBytesPerRow = width;
+    planes.cbPtr = (uint8_t *) Cb.mutableBytes;
+    planes.cbBytesPerRow = width / 2;
+    planes.crPtr = (uint8_t *) Cr.mutableBytes;
+    planes.crBytesPerRow = width / 2;
+    
+    BT709_TRACE_BEGIN(encode, "bt709_frame_encode");
+    if (tables10 != NULL) {
+      BT709Planes16Struct planes16;
+      
+      planes16.yPtr = (uint16_t *) Y.mutableBytes;
+      planes16.yBytesPerRow = width * 2;
+      planes16.cbPtr = (uint16_t *) Cb.mutableBytes;
+      planes16.cbBytesPerRow = width;
+      planes16.crPtr = (uint16_t *) Cr.mutableBytes;
+      planes16.crBytesPerRow = width;
+      
+      bt709_frame10_encode(tables10, &reader.layout, framePtr, inBytesPerRow, width, height, &planes16);
+    } else if (cubeLut != NULL) {
+      bt709_cube_lut_pool_encode(lutPool, cubeLut, &tables, sharpTables, &reader.layout, framePtr, inBytesPerRow, width, height, &planes);
+    } else if (inverseStr != nil) {
+      bt709_inverse_table_encode(&inverseTable, &reader.layout, framePtr, inBytesPerRow, width, height, &planes);
+    } else if (sharpTables != NULL) {
+      bt709_sharp_encode(sharpTables, &reader.layout, framePtr, inBytesPerRow, width, height, &planes);
+    } else if (numProxies > 0) {
+      bt709_pyramid_encode(&pyramid, &reader.layout, framePtr, inBytesPerRow, width, height, &planes);
+    } else if (alphaTables != NULL) {
+      bt709_alpha_encode_premultiplied(&tables, alphaTables, alphaOp, &reader.layout, framePtr, inBytesPerRow, width, height, &planes, (uint8_t *) alphaScratch.mutableBytes);
+    } else {
+      bt709_context_encode(context, framePtr, inBytesPerRow, &planes);
+    }
+    BT709_TRACE_END(encode);
+    
+    if (numProxies > 0) {
+      retcode = write_proxy_frames(&pyramid, proxyFiles);
+      if (retcode != 0) {
+        break;
+      }
+    }
+    
+    Y4MFrameStruct fs;
+    
+    fs.yPtr = (uint8_t*) Y.bytes;
+    fs.yLen = (int) Y.length;
+    
+    fs.uPtr = (uint8_t*) Cb.bytes;
+    fs.uLen = (int) Cb.length;
+    
+    fs.vPtr = (uint8_t*) Cr.bytes;
+    fs.vLen = (int) Cr.length;
+    
+    BT709_TRACE_BEGIN(write, "y4m_write_frame");
+    int write_frame_result = y4m_write_frame(outFile, &fs);
+    BT709_TRACE_END(write);
+    if (write_frame_result != 0) {
+      retcode = write_frame_result;
+      break;
+    }
+  }
+  
+  int numFrames = (reader.frameNum > rangeStart) ? (reader.frameNum - rangeStart) : 0;
+  
+  raw_frame_reader_close(&reader);
+  
+  if (inverseStr != nil) {
+    bt709_inverse_table_close(&inverseTable);
+  }
+  
+  free(sharpTables);
+  free(tables10);
+  free(alphaTables);
+  
+  if (context != NULL) {
+    bt709_context_destroy(context);
+    free(context);
+  }
+  
+  if (cubeLut != NULL) {
+    bt709_cube_lut_pool_destroy(lutPool);
+    free(lutPool);
+    bt709_cube_lut_free(cubeLut);
+    free(cubeLut);
+  }
+  
+  for (int i = 0; i < BT709_PYRAMID_MAX_LEVELS; i++) {
+    if (proxyFiles[i] != NULL) {
+      fclose(proxyFiles[i]);
+    }
+  }
+  
+  bt709_pyramid_free(&pyramid);
+  
+  if (isSegment && retcode == 0 && numFrames > 0) {
+    retcode = y4m_segment_finish(outFile, &segmentHeader, rangeStart, numFrames);
+  }
+  
+  if (outFile != NULL) {
+    fclose(outFile);
+  }
+  
+  if (isAsyncOpen) {
+    int close_result = y4m_async_writer_close(&asyncWriter);
+    if (retcode == 0) {
+      retcode = close_result;
+    }
+  }
+  
+  if (retcode == 0) {
+    if (numFrames == 0) {
+      fprintf(stderr, "no frames found in raw input\n");
+      return 1;
+    }
+    
+    fprintf(stdout, "wrote %s (%d frames)\n", outFilename, numFrames);
+    
+    if (isAsyncOpen) {
+      y4m_async_writer_print_stats(&asyncWriter, stdout);
+    }
+  }
+  
+  return retcode;
+}
+
 int process(NSDictionary *inDict) {
+  if (inDict[@"-raw"] != nil) {
+    return process_raw(inDict);
+  }
+  
   // Read PNG
   
   NSString *inputImageStr = inDict[@"input"];
@@ -1010,6 +1622,7 @@ int process(NSDictionary *inDict) {
   NSString *gamma = inDict[@"-gamma"];
   
   BOOL isAlpha = [inDict[@"-alpha"] boolValue];
+  BOOL isAlphaPacked = [inDict[@"-alphaPacked"] boolValue];
 
   NSNumber *inputIsFramesPatternNum = inDict[@"inputIsFramesPattern"];
   BOOL inputIsFramesPattern = [inputIsFramesPatternNum boolValue];
@@ -1026,7 +1639,26 @@ int process(NSDictionary *inDict) {
   
   NSNumber *fpsNum = inDict[@"-fps"];
   Y4MHeaderFPS fps = [fpsNum intValue];
-  int frameNum = 1;
+  
+  // With -range only input frames [START, END) are encoded and
+  // the output is a segment that y4m_merge joins with the others.
+  
+  BOOL isSegment = (inDict[@"-range"] != nil);
+  int rangeStart = 0;
+  Y4MHeaderStruct segmentHeader;
+  
+  if (isSegment) {
+    int numInputFrames = (int) [inputFramesFilenames count];
+    rangeStart = [inDict[@"-rangeStart"] intValue];
+    int rangeEnd = MIN([inDict[@"-rangeEnd"] intValue], numInputFrames);
+    
+    if (rangeStart >= numInputFrames) {
+      fprintf(stderr, "-range start %d is past the last input frame %d\n", rangeStart, numInputFrames - 1);
+      return 1;
+    }
+    
+    inputFramesFilenames = [NSMutableArray arrayWithArray:[inputFramesFilenames subarrayWithRange:NSMakeRange(rangeStart, rangeEnd - rangeStart)]];
+  }
 
   BOOL isLinearGamma = FALSE;
   BOOL isSRGBGamma = FALSE;
@@ -1042,6 +1674,13 @@ int process(NSDictionary *inDict) {
   NSMutableData *Cb = [NSMutableData data];
   NSMutableData *Cr = [NSMutableData data];
   
+  // With -alpha packed each output frame is double height, alpha
+  // is converted into these buffers and appended below the color.
+  
+  NSMutableData *alphaY = [NSMutableData data];
+  NSMutableData *alphaCb = [NSMutableData data];
+  NSMutableData *alphaCr = [NSMutableData data];
+  
   // Process YCbCr by writing to output YUV frame(s) to y4m file
   
   const char *outFilename = NULL;
@@ -1055,20 +1694,63 @@ int process(NSDictionary *inDict) {
     outFilename = [outY4mStr UTF8String];
   }
   
-  FILE *outFile = y4m_open_file(outFilename);
+  // With -resume progress is recorded in OUTPUT.journal after every
+  // frame, a restart truncates the output to the last complete
+  // frame and continues with the next input file.
+  
+  BOOL isResume = [inDict[@"-resume"] boolValue];
+  Y4MJournal journal;
+  FILE *outFile;
+  
+  if (isResume) {
+    outFile = y4m_journal_open(&journal, outFilename);
+  } else {
+    outFile = y4m_open_file(outFilename);
+  }
   
   if (outFile == NULL) {
     return 1;
   }
   
-  for (int i = 0; i < (int)[inputFramesFilenames count]; i++) @autoreleasepool {
+  // Status messages go to stderr once the Y4M stream owns stdout
+  
+  if (strcmp(outFilename, "-") == 0) {
+    y4m_redirect_stdout();
+  }
+  
+  int firstFrame = 0;
+  
+  if (isResume && y4m_journal_has_header(&journal)) {
+    firstFrame = MIN(journal.numFrames, (int)[inputFramesFilenames count]);
+    hasWrittenHeader = TRUE;
+    fprintf(stdout, "resuming %s after frame %d\n", outFilename, firstFrame);
+  }
+  
+  for (int i = firstFrame; i < (int)[inputFramesFilenames count]; i++) @autoreleasepool {
     inputImageStr = inputFramesFilenames[i];
 
-    CVPixelBufferRef cvPixelBuffer = loadFrameIntoCVPixelBuffer(inputImageStr, frameNum++, isLinearGamma, isSRGBGamma, isAlpha, FALSE, Y, Cb, Cr);
+    CVPixelBufferRef cvPixelBuffer = loadFrameIntoCVPixelBuffer(inputImageStr, (i == firstFrame), isLinearGamma, isSRGBGamma, isAlpha, FALSE, Y, Cb, Cr);
     
     if (cvPixelBuffer == NULL) {
       return 1;
     }
+    
+    if (isAlphaPacked) {
+      CVPixelBufferRef alphaPixelBuffer = loadFrameIntoCVPixelBuffer(inputImageStr, FALSE, isLinearGamma, isSRGBGamma, isAlpha, TRUE, alphaY, alphaCb, alphaCr);
+      
+      if (alphaPixelBuffer == NULL) {
+        return 1;
+      }
+      
+      CVPixelBufferRelease(alphaPixelBuffer);
+      
+      // Planes are stored row by row, so appending the alpha planes
+      // gives the planes of a frame with alpha rows below the color.
+      
+      [Y appendData:alphaY];
+      [Cb appendData:alphaCb];
+      [Cr appendData:alphaCr];
+    }
   
     if (hasWrittenHeader == FALSE) {
       Y4MHeaderStruct header;
@@ -1077,15 +1759,29 @@ int process(NSDictionary *inDict) {
       int height = (int) CVPixelBufferGetHeight(cvPixelBuffer);
       
       header.width = width;
-      header.height = height;
+      header.height = isAlphaPacked ? (height * 2) : height;
       
       header.fps = fps;
       
-      int header_result = y4m_write_header(outFile, &header);
+      int header_result;
+      
+      if (isSegment) {
+        segmentHeader = header;
+        header_result = y4m_segment_write_header(outFile, &header, rangeStart);
+      } else {
+        header_result = y4m_write_header(outFile, &header);
+      }
       if (header_result != 0) {
         return header_result;
       }
       
+      if (isResume) {
+        int commit_result = y4m_journal_commit(&journal, outFile, 0);
+        if (commit_result != 0) {
+          return commit_result;
+        }
+      }
+      
       hasWrittenHeader = TRUE;
     }
     
@@ -1102,22 +1798,42 @@ int process(NSDictionary *inDict) {
     fs.vPtr = (uint8_t*) Cr.bytes;
     fs.vLen = (int) Cr.length;
     
+    BT709_TRACE_BEGIN(write, "y4m_write_frame");
     int write_frame_result = y4m_write_frame(outFile, &fs);
+    BT709_TRACE_END(write);
     if (write_frame_result != 0) {
       return write_frame_result;
     }
     
+    if (isResume) {
+      int commit_result = y4m_journal_commit(&journal, outFile, i + 1);
+      if (commit_result != 0) {
+        return commit_result;
+      }
+    }
+    
     CVPixelBufferRelease(cvPixelBuffer);
   }
   
+  if (isSegment) {
+    int finish_result = y4m_segment_finish(outFile, &segmentHeader, rangeStart, (int) [inputFramesFilenames count]);
+    if (finish_result != 0) {
+      return finish_result;
+    }
+  }
+  
   fclose(outFile);
   
+  if (isResume) {
+    y4m_journal_remove(&journal);
+  }
+  
   fprintf(stdout, "wrote %s\n", outFilename);
   
   // When emitting alpha, iterate over the input again but emit the alpha
   // channel values. The alpha channel values are always treated as linear.
   
-  if (isAlpha) {
+  if (isAlpha && !isAlphaPacked) {
     hasWrittenHeader = FALSE;
     NSString *pathBeforeExt = [outY4mStr stringByDeletingPathExtension];
     NSString *pathWithExt = [NSString stringWithFormat:@"%@_alpha.y4m", pathBeforeExt];
@@ -1131,7 +1847,7 @@ int process(NSDictionary *inDict) {
     for (int i = 0; i < (int)[inputFramesFilenames count]; i++) @autoreleasepool {
       inputImageStr = inputFramesFilenames[i];
       
-      CVPixelBufferRef cvPixelBuffer = loadFrameIntoCVPixelBuffer(inputImageStr, frameNum++, isLinearGamma, isSRGBGamma, isAlpha, TRUE, Y, Cb, Cr);
+      CVPixelBufferRef cvPixelBuffer = loadFrameIntoCVPixelBuffer(inputImageStr, FALSE, isLinearGamma, isSRGBGamma, isAlpha, TRUE, Y, Cb, Cr);
       
       if (cvPixelBuffer == NULL) {
         return 1;
@@ -1148,7 +1864,14 @@ int process(NSDictionary *inDict) {
         
         header.fps = fps;
         
-        int header_result = y4m_write_header(outFile, &header);
+        int header_result;
+        
+        if (isSegment) {
+          segmentHeader = header;
+          header_result = y4m_segment_write_header(outFile, &header, rangeStart);
+        } else {
+          header_result = y4m_write_header(outFile, &header);
+        }
         if (header_result != 0) {
           return header_result;
         }
@@ -1169,13 +1892,22 @@ int process(NSDictionary *inDict) {
       fs.vPtr = (uint8_t*) Cr.bytes;
       fs.vLen = (int) Cr.length;
       
+      BT709_TRACE_BEGIN(write, "y4m_write_frame");
       int write_frame_result = y4m_write_frame(outFile, &fs);
+      BT709_TRACE_END(write);
       if (write_frame_result != 0) {
         return write_frame_result;
       }
       
       CVPixelBufferRelease(cvPixelBuffer);
     }
+    
+    if (isSegment) {
+      int finish_result = y4m_segment_finish(outFile, &segmentHeader, rangeStart, (int) [inputFramesFilenames count]);
+      if (finish_result != 0) {
+        return finish_result;
+      }
+    }
 
     fclose(outFile);
     
@@ -1188,6 +1920,8 @@ int process(NSDictionary *inDict) {
 int main(int argc, const char * argv[]) {
   int retcode = 0;
   
+  BT709_TRACE_START();
+  
   @autoreleasepool {
     char *inPNG = NULL;
     BOOL inPNGIsFramesPattern = FALSE;
@@ -1219,7 +1953,7 @@ int main(int argc, const char * argv[]) {
       
       //printf("process option \"%s\"\n", arg);
       
-      if (arg[0] == '-') {
+      if (arg[0] == '-' && arg[1] != '\0') {
         if (strcmp(arg, "-alpha") == 0) {
           i++;
           arg = (char *) argv[i];
@@ -1231,10 +1965,14 @@ int main(int argc, const char * argv[]) {
             // with alpha channel data. This is so that different
             // decode paths for Apple vs sRGB gamma are not needed.
             args[@"-gamma"] = @"srgb";
+          } else if (strcmp(arg, "packed") == 0) {
+            args[@"-alpha"] = @TRUE;
+            args[@"-alphaPacked"] = @TRUE;
+            args[@"-gamma"] = @"srgb";
           } else if (strcmp(arg, "0") == 0) {
             args[@"-alpha"] = @FALSE;
           } else {
-            printf("unknown option -alpha value \"%s\", must be 0 or 1", arg);
+            printf("unknown option -alpha value \"%s\", must be 0, 1, or packed", arg);
             exit(3);
           }
         } else if (strcmp(arg, "-gamma") == 0) {
@@ -1290,6 +2028,143 @@ int main(int argc, const char * argv[]) {
           
           // Default to 1 frame displayed for 1 second
           args[@"-fps"] = @(Y4MHeaderFPS_1);
+        } else if (strcmp(arg, "-raw") == 0) {
+          // -raw IN.pam indicates a stream of uncompressed
+          // frames, "-" means read the stream from stdin.
+          
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          if (inPNG != NULL || args[@"-raw"] != nil) {
+            printf("-raw input \"%s\" must appear just once\n", arg);
+            exit(3);
+          }
+          
+          args[@"-raw"] = [NSString stringWithFormat:@"%s", arg];
+        } else if (strcmp(arg, "-async") == 0) {
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          if (strcmp(arg, "2") == 0) {
+            args[@"-async"] = @(2);
+          } else if (strcmp(arg, "3") == 0) {
+            args[@"-async"] = @(3);
+          } else {
+            printf("option -async must be 2 or 3 but got \"%s\"\n", arg);
+            exit(3);
+          }
+        } else if (strcmp(arg, "-sharp") == 0) {
+          // -sharp N enables luma refinement with N iterations
+          
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          int iterations = atoi(arg);
+          
+          if (iterations < 1 || iterations > 16) {
+            printf("option -sharp must be in the range 1 to 16 but got \"%s\"\n", arg);
+            exit(3);
+          }
+          
+          args[@"-sharp"] = @(iterations);
+        } else if (strcmp(arg, "-lut") == 0) {
+          // -lut GRADE.cube names a 3D LUT in .cube format
+          
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          args[@"-lut"] = [NSString stringWithFormat:@"%s", arg];
+        } else if (strcmp(arg, "-inverse") == 0) {
+          // -inverse TABLE.bin names the inverse search table file
+          
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          args[@"-inverse"] = [NSString stringWithFormat:@"%s", arg];
+        } else if (strcmp(arg, "-bits") == 0) {
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          if (strcmp(arg, "8") == 0) {
+            args[@"-bits"] = @(8);
+          } else if (strcmp(arg, "10") == 0) {
+            args[@"-bits"] = @(10);
+          } else {
+            printf("option -bits must be 8 or 10 but got \"%s\"\n", arg);
+            exit(3);
+          }
+        } else if (strcmp(arg, "-premultiply") == 0) {
+          // -premultiply gamma|linear selects the space alpha is applied in
+          
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          if (strcmp(arg, "gamma") == 0 || strcmp(arg, "linear") == 0) {
+            args[@"-premultiply"] = [NSString stringWithFormat:@"%s", arg];
+          } else {
+            printf("option -premultiply must be gamma or linear but got \"%s\"\n", arg);
+            exit(3);
+          }
+        } else if (strcmp(arg, "-resume") == 0) {
+          // -resume continues an interrupted -frames encode
+          
+          i++;
+          
+          args[@"-resume"] = @TRUE;
+        } else if (strcmp(arg, "-range") == 0) {
+          // -range START:END selects a segment of the input frames
+          
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          int rangeStart, rangeEnd;
+          
+          if (sscanf(arg, "%d:%d", &rangeStart, &rangeEnd) != 2 || rangeStart < 0 || rangeEnd <= rangeStart) {
+            printf("option -range must be START:END with START < END but got \"%s\"\n", arg);
+            exit(3);
+          }
+          
+          args[@"-range"] = [NSString stringWithFormat:@"%s", arg];
+          args[@"-rangeStart"] = @(rangeStart);
+          args[@"-rangeEnd"] = @(rangeEnd);
+        } else if (strcmp(arg, "-proxies") == 0) {
+          // -proxies N writes N reduced size levels
+          
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          int numProxies = atoi(arg);
+          
+          if (numProxies < 1 || numProxies > 3) {
+            printf("option -proxies must be 1, 2, or 3 but got \"%s\"\n", arg);
+            exit(3);
+          }
+          
+          args[@"-proxies"] = @(numProxies);
+        } else if (strcmp(arg, "-size") == 0) {
+          i++;
+          arg = (char *) argv[i];
+          i++;
+          
+          int width, height;
+          
+          if (sscanf(arg, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+            printf("option -size must be WxH but got \"%s\"\n", arg);
+            exit(3);
+          }
+          
+          args[@"-size"] = [NSString stringWithFormat:@"%s", arg];
+          args[@"-width"] = @(width);
+          args[@"-height"] = @(height);
         } else if (strcmp(arg, "-frames") == 0) {
           // -frames F0001.png indicates the start
           // of a frame input pattern that can indicate
@@ -1322,49 +2197,207 @@ int main(int argc, const char * argv[]) {
       }
     }
 
-    if (inPNG == NULL) {
-      printf("int filename not found, either -frame or -frames must be used to indicate input image(s)\n");
+    BOOL isRaw = (args[@"-raw"] != nil);
+    
+    if (inPNG == NULL && !isRaw) {
+      printf("int filename not found, either -frame or -frames or -raw must be used to indicate input image(s)\n");
       exit(3);
     }
     
+    if (inPNG != NULL && isRaw) {
+      printf("-raw cannot be combined with -frame or -frames\n");
+      exit(3);
+    }
+    
+    if (args[@"-size"] != nil && !isRaw) {
+      printf("-size can only be used with -raw\n");
+      exit(3);
+    }
+    
+    if (args[@"-async"] != nil && !isRaw) {
+      printf("-async can only be used with -raw\n");
+      exit(3);
+    }
+    
+    if (args[@"-sharp"] != nil) {
+      if (!isRaw) {
+        printf("-sharp can only be used with -raw\n");
+        exit(3);
+      }
+      
+      if (args[@"-inverse"] != nil) {
+        printf("-sharp cannot be combined with -inverse\n");
+        exit(3);
+      }
+    }
+    
+    if (args[@"-lut"] != nil) {
+      if (!isRaw) {
+        printf("-lut can only be used with -raw\n");
+        exit(3);
+      }
+      
+      if (args[@"-inverse"] != nil) {
+        printf("-lut cannot be combined with -inverse\n");
+        exit(3);
+      }
+    }
+    
+    if (args[@"-inverse"] != nil) {
+      if (!isRaw) {
+        printf("-inverse can only be used with -raw\n");
+        exit(3);
+      }
+      
+      // The table inverts the Apple 1.96 gamma decoder only
+      
+      if (![args[@"-gamma"] isEqualToString:@"apple"]) {
+        printf("-inverse can only be used with -gamma apple\n");
+        exit(3);
+      }
+    }
+    
     if (outY4m == NULL) {
       printf("output filename not found, must be last argument\n");
       exit(3);
     }
     
-    args[@"input"] = [NSString stringWithFormat:@"%s", inPNG];
-    args[@"output"] = [NSString stringWithFormat:@"%s", outY4m];
+    if ([args[@"-bits"] intValue] == 10) {
+      if (!isRaw) {
+        printf("-bits 10 can only be used with -raw\n");
+        exit(3);
+      }
+      
+      // The other encode modes and writers produce 8 bit samples
+      
+      if (args[@"-async"] != nil || args[@"-sharp"] != nil || args[@"-lut"] != nil ||
+          args[@"-inverse"] != nil || args[@"-proxies"] != nil || args[@"-range"] != nil) {
+        printf("-bits 10 cannot be combined with -async, -sharp, -lut, -inverse, -proxies, or -range\n");
+        exit(3);
+      }
+    }
+    
+    if (args[@"-premultiply"] != nil) {
+      if (!isRaw) {
+        printf("-premultiply can only be used with -raw\n");
+        exit(3);
+      }
+      
+      // Premultiply is fused into the plain encode only
+      
+      if ([args[@"-bits"] intValue] == 10 || args[@"-sharp"] != nil || args[@"-lut"] != nil ||
+          args[@"-inverse"] != nil || args[@"-proxies"] != nil) {
+        printf("-premultiply cannot be combined with -bits 10, -sharp, -lut, -inverse, or -proxies\n");
+        exit(3);
+      }
+    }
+    
+    if (args[@"-resume"] != nil) {
+      // The raw input may be a pipe that cannot be replayed, and
+      // the journal tracks a single output file.
+      
+      if (isRaw || !inPNGIsFramesPattern || strcmp(outY4m, "-") == 0) {
+        printf("-resume can only be used with -frames and an output file\n");
+        exit(3);
+      }
+      
+      if (([args[@"-alpha"] boolValue] && ![args[@"-alphaPacked"] boolValue]) || args[@"-range"] != nil) {
+        printf("-resume cannot be combined with -alpha 1 or -range\n");
+        exit(3);
+      }
+    }
+    
+    if (args[@"-range"] != nil) {
+      // The segment line is rewritten with the frame count at the
+      // end, so the output must be a file written in one piece.
+      
+      if (strcmp(outY4m, "-") == 0) {
+        printf("-range cannot be used when writing to stdout\n");
+        exit(3);
+      }
+      
+      if (args[@"-async"] != nil || args[@"-proxies"] != nil) {
+        printf("-range cannot be combined with -async or -proxies\n");
+        exit(3);
+      }
+    }
     
-    // Input must be .png or .jpg
+    if (args[@"-proxies"] != nil) {
+      if (!isRaw) {
+        printf("-proxies can only be used with -raw\n");
+        exit(3);
+      }
+      
+      // Proxy levels are built from the plain conversion
+      
+      if (args[@"-sharp"] != nil || args[@"-lut"] != nil || args[@"-inverse"] != nil) {
+        printf("-proxies cannot be combined with -sharp, -lut, or -inverse\n");
+        exit(3);
+      }
+      
+      if (strcmp(outY4m, "-") == 0) {
+        printf("-proxies cannot be used when writing to stdout\n");
+        exit(3);
+      }
+    }
+    
+    args[@"output"] = [NSString stringWithFormat:@"%s", outY4m];
     
-    BOOL isPNG = [args[@"input"] hasSuffix:@".png"];
-    BOOL isJPG = [args[@"input"] hasSuffix:@".jpg"] || [args[@"input"] hasSuffix:@".jpeg"];
+    BOOL isAlphaPacked = [args[@"-alphaPacked"] boolValue];
+    const char *alphaMode = isAlphaPacked ? "packed" : "1";
     
-    if (isPNG || isJPG) {
-      // input is good
+    if (isRaw) {
+      // Raw frames are not decoded as images, so alpha values are
+      // not extracted for either alpha mode.
+      
+      if ([args[@"-alpha"] boolValue]) {
+        printf("-alpha %s cannot be used with -raw input\n", alphaMode);
+        exit(3);
+      }
     } else {
-      printf("input filename \"%s\" must be .png or .jpg or .jpeg\n", inPNG);
-      exit(3);
+      args[@"input"] = [NSString stringWithFormat:@"%s", inPNG];
+      
+      // Input must be .png or .jpg
+      
+      BOOL isPNG = [args[@"input"] hasSuffix:@".png"];
+      BOOL isJPG = [args[@"input"] hasSuffix:@".jpg"] || [args[@"input"] hasSuffix:@".jpeg"];
+      
+      if (isPNG || isJPG) {
+        // input is good
+      } else {
+        printf("input filename \"%s\" must be .png or .jpg or .jpeg\n", inPNG);
+        exit(3);
+      }
     }
     
     args[@"inputIsFramesPattern"] = @(inPNGIsFramesPattern);
     
     BOOL isY4m = [args[@"output"] hasSuffix:@".y4m"];
+    BOOL isStdout = [args[@"output"] isEqualToString:@"-"];
     
-    if (isY4m) {
+    if (isY4m || isStdout) {
       // output is good
     } else {
       printf("output filename \"%s\" must have extension .y4m\n", outY4m);
       exit(3);
     }
     
+    // With -alpha 1 alpha is written to a second "_alpha.y4m" file,
+    // which cannot be derived from stdout. Packed alpha is part of
+    // the one output stream.
+    
+    if (isStdout && [args[@"-alpha"] boolValue] && !isAlphaPacked) {
+      printf("-alpha 1 cannot be used when output is stdout\n");
+      exit(3);
+    }
+    
     // if "-alpha" is TRUE then gamma must be sRGB, gamma for alpha
     // channel is assumed to be linear with this configuration.
     
     if ([args[@"-alpha"] boolValue]) {
       BOOL isSRGB = [args[@"-gamma"] isEqualToString:@"srgb"];
       if (!isSRGB) {
-        printf("-alpha 1 can only be used with -gamma srgb\n : got \"%@\"", args[@"-gamma"]);
+        printf("-alpha %s can only be used with -gamma srgb\n : got \"%@\"", alphaMode, args[@"-gamma"]);
         exit(3);
       }
     }
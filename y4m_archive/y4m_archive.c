@@ -0,0 +1,246 @@
+//
+//  y4m_archive.c
+//
+//  Command line utility that packs the frames of a Y4M file into an
+//  indexed archive written with bt709_archive.h, where every plane
+//  is page aligned so that a reader can map frames without a copy,
+//  and unpacks an archive back into a Y4M file. The verify command
+//  checks the checksum of every frame and the info command prints
+//  the header.
+//
+//  This utility depends only on the C library.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bt709_archive.h"
+#include "y4m_writer.h"
+#include "y4m_reader.h"
+
+static
+void usage() {
+  printf("y4m_archive pack IN.y4m OUT.bfa\n");
+  printf("y4m_archive unpack IN.bfa OUT.y4m|-\n");
+  printf("y4m_archive verify IN.bfa\n");
+  printf("y4m_archive info IN.bfa\n");
+}
+
+static
+int pack(const char *inPath, const char *outPath) {
+  Y4MReader reader;
+
+  if (y4m_reader_open(&reader, inPath) != 0) {
+    y4m_reader_close(&reader);
+    return 1;
+  }
+
+  BT709ArchiveWriter writer;
+
+  int retcode = bt709_archive_writer_open(&writer, outPath, reader.width, reader.height, reader.fpsNum, reader.fpsDen);
+
+  if (retcode != 0) {
+    fprintf(stderr, "could not create archive for %d x %d frames\n", reader.width, reader.height);
+    y4m_reader_close(&reader);
+    return retcode;
+  }
+
+  while (1) {
+    int readResult = y4m_reader_next(&reader);
+    if (readResult == 1) {
+      break;
+    } else if (readResult != 0) {
+      retcode = 1;
+      break;
+    }
+
+    BT709PlanesStruct planes;
+    planes.yPtr = reader.yPtr;
+    planes.yBytesPerRow = reader.width;
+    planes.cbPtr = reader.uPtr;
+    planes.cbBytesPerRow = reader.width / 2;
+    planes.crPtr = reader.vPtr;
+    planes.crBytesPerRow = reader.width / 2;
+
+    if (bt709_archive_writer_add_planes(&writer, &planes) != 0) {
+      fprintf(stderr, "could not write frame %d\n", reader.frameNum);
+      retcode = 2;
+      break;
+    }
+  }
+
+  const int numFrames = (int) writer.header.numFrames;
+
+  y4m_reader_close(&reader);
+
+  if (bt709_archive_writer_close(&writer) != 0) {
+    fprintf(stderr, "could not write archive \"%s\"\n", outPath);
+    retcode = 2;
+  }
+
+  if (retcode == 0) {
+    printf("packed %d frames\n", numFrames);
+  }
+
+  return retcode;
+}
+
+static
+int unpack(const BT709ArchiveReader *reader, const char *outPath) {
+  const int width = reader->header.width;
+  const int height = reader->header.height;
+  const int fps = y4m_reader_fps_enum(reader->header.fpsNum, reader->header.fpsDen);
+
+  if (fps == -1) {
+    fprintf(stderr, "unsupported frame rate F%d:%d\n", reader->header.fpsNum, reader->header.fpsDen);
+    return 1;
+  }
+
+  FILE *outFile = y4m_open_file(outPath);
+  if (outFile == NULL) {
+    return 1;
+  }
+
+  // Status messages go to stderr once the Y4M stream owns stdout
+
+  if (strcmp(outPath, "-") == 0) {
+    y4m_redirect_stdout();
+  }
+
+  const size_t yLen = (size_t) width * height;
+  const size_t uvLen = (size_t) (width / 2) * (height / 2);
+  uint8_t *frameBuffer = (uint8_t *) malloc(yLen + (2 * uvLen));
+
+  Y4MHeaderStruct header;
+  header.width = width;
+  header.height = height;
+  header.fps = fps;
+
+  int retcode = (frameBuffer == NULL) ? 2 : y4m_write_header(outFile, &header);
+
+  for (int frameIndex = 0; frameIndex < (int) reader->header.numFrames && retcode == 0; frameIndex++) {
+    BT709ArchiveFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    if (bt709_archive_reader_frame(reader, frameIndex, &frame) != 0) {
+      fprintf(stderr, "could not read frame %d\n", frameIndex);
+      retcode = 2;
+      break;
+    }
+    bt709_archive_reader_prefetch(reader, frameIndex + 1);
+
+    uint8_t *yPtr = frameBuffer;
+    uint8_t *uPtr = frameBuffer + yLen;
+    uint8_t *vPtr = frameBuffer + yLen + uvLen;
+
+    bt709_planes_copy(yPtr, width, frame.yPtr, frame.yBytesPerRow, width, height);
+    bt709_planes_deinterleave(uPtr, width / 2, vPtr, width / 2, frame.cbcrPtr, frame.cbcrBytesPerRow, width / 2, height / 2);
+
+    Y4MFrameStruct fs;
+    fs.yPtr = yPtr;
+    fs.yLen = (int) yLen;
+    fs.uPtr = uPtr;
+    fs.uLen = (int) uvLen;
+    fs.vPtr = vPtr;
+    fs.vLen = (int) uvLen;
+
+    if (y4m_write_frame(outFile, &fs) != 0) {
+      fprintf(stderr, "could not write frame %d\n", frameIndex);
+      retcode = 2;
+    }
+  }
+
+  if (fclose(outFile) != 0 && retcode == 0) {
+    retcode = 2;
+  }
+
+  free(frameBuffer);
+
+  return retcode;
+}
+
+static
+int verify(const BT709ArchiveReader *reader) {
+  int numCorrupt = 0;
+
+  for (int frameIndex = 0; frameIndex < (int) reader->header.numFrames; frameIndex++) {
+    bt709_archive_reader_prefetch(reader, frameIndex + 1);
+
+    if (bt709_archive_reader_verify(reader, frameIndex) != 0) {
+      printf("frame %d checksum mismatch\n", frameIndex);
+      numCorrupt += 1;
+    }
+  }
+
+  if (numCorrupt > 0) {
+    printf("FAIL: %d of %d frames are corrupt\n", numCorrupt, (int) reader->header.numFrames);
+    return 1;
+  }
+
+  printf("verified %d frames\n", (int) reader->header.numFrames);
+  return 0;
+}
+
+static
+void info(const BT709ArchiveReader *reader) {
+  const BT709ArchiveHeader *header = &reader->header;
+
+  printf("size %d x %d\n", header->width, header->height);
+  printf("fps %d:%d\n", header->fpsNum, header->fpsDen);
+  printf("frames %llu\n", (unsigned long long) header->numFrames);
+  printf("bytes per row Y %d CbCr %d\n", header->yBytesPerRow, header->cbcrBytesPerRow);
+  printf("frame length %llu\n", (unsigned long long) header->frameLen);
+}
+
+int main(int argc, const char * argv[]) {
+  if (argc < 3) {
+    usage();
+    exit(3);
+  }
+
+  const char *command = argv[1];
+
+  if (strcmp(command, "pack") == 0) {
+    if (argc != 4) {
+      usage();
+      exit(3);
+    }
+    return pack(argv[2], argv[3]);
+  }
+
+  if (strcmp(command, "unpack") == 0) {
+    if (argc != 4) {
+      usage();
+      exit(3);
+    }
+  } else if (strcmp(command, "verify") == 0 || strcmp(command, "info") == 0) {
+    if (argc != 3) {
+      usage();
+      exit(3);
+    }
+  } else {
+    printf("unknown command \"%s\"\n", command);
+    exit(3);
+  }
+
+  BT709ArchiveReader reader;
+  int retcode = bt709_archive_reader_open(&reader, argv[2]);
+
+  if (retcode == 1) {
+    fprintf(stderr, "could not open archive \"%s\"\n", argv[2]);
+  }
+
+  if (retcode == 0) {
+    if (strcmp(command, "unpack") == 0) {
+      retcode = unpack(&reader, argv[3]);
+    } else if (strcmp(command, "verify") == 0) {
+      retcode = verify(&reader);
+    } else {
+      info(&reader);
+    }
+
+    bt709_archive_reader_close(&reader);
+  }
+
+  return retcode;
+}
@@ -0,0 +1,176 @@
+//
+//  y4m_merge.c
+//
+//  Command line utility that joins Y4M segments written with
+//  srgb_to_bt709 -range into a single Y4M file. Segments may be
+//  given in any order, they are sorted by first frame and must
+//  have the same dimensions and frame rate and must cover a
+//  contiguous range of frames that starts at frame 0 with no gap
+//  or overlap. Frame data is copied in the kernel where the
+//  platform allows.
+//
+//  This utility depends only on the C library.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "y4m_writer.h"
+#include "y4m_reader.h"
+#include "y4m_segment.h"
+
+typedef struct {
+  const char *path;
+  FILE *inFile;
+  Y4MSegmentInfo info;
+} MergeSegment;
+
+static
+void usage() {
+  printf("y4m_merge OUTPUT.y4m|- SEGMENT.y4mseg ...\n");
+  printf("SEGMENT files are written by srgb_to_bt709 -range START:END, in any order\n");
+}
+
+static
+int compare_segments(const void *a, const void *b) {
+  const MergeSegment *s1 = (const MergeSegment *) a;
+  const MergeSegment *s2 = (const MergeSegment *) b;
+  return (s1->info.start > s2->info.start) - (s1->info.start < s2->info.start);
+}
+
+int main(int argc, const char * argv[]) {
+  if (argc < 3) {
+    usage();
+    exit(3);
+  }
+
+  const char *outPath = argv[1];
+  const int numSegments = argc - 2;
+
+  MergeSegment *segments = (MergeSegment *) calloc(numSegments, sizeof(MergeSegment));
+  if (segments == NULL) {
+    return 1;
+  }
+
+  int retcode = 0;
+
+  for (int i = 0; i < numSegments && retcode == 0; i++) {
+    MergeSegment *segment = &segments[i];
+    segment->path = argv[i + 2];
+    segment->inFile = fopen(segment->path, "rb");
+
+    if (segment->inFile == NULL) {
+      fprintf(stderr, "could not open segment \"%s\"\n", segment->path);
+      retcode = 1;
+    } else if (y4m_segment_read_header(segment->inFile, segment->path, &segment->info) != 0) {
+      retcode = 1;
+    }
+  }
+
+  if (retcode == 0) {
+    qsort(segments, numSegments, sizeof(MergeSegment), compare_segments);
+  }
+
+  // The merged file is a whole sequence, so the first segment must
+  // start at frame 0. Every other segment must match the first one
+  // and continue where the previous one ended.
+
+  if (retcode == 0 && segments[0].info.start != 0) {
+    fprintf(stderr, "first segment \"%s\" starts at frame %d but must start at frame 0\n",
+            segments[0].path, segments[0].info.start);
+    retcode = 1;
+  }
+
+  for (int i = 1; i < numSegments && retcode == 0; i++) {
+    const Y4MSegmentInfo *first = &segments[0].info;
+    const Y4MSegmentInfo *prev = &segments[i-1].info;
+    const Y4MSegmentInfo *info = &segments[i].info;
+
+    if (info->width != first->width || info->height != first->height) {
+      fprintf(stderr, "segment \"%s\" is %d x %d but \"%s\" is %d x %d\n",
+              segments[i].path, info->width, info->height,
+              segments[0].path, first->width, first->height);
+      retcode = 1;
+    } else if (info->fpsNum != first->fpsNum || info->fpsDen != first->fpsDen) {
+      fprintf(stderr, "segment \"%s\" is F%d:%d but \"%s\" is F%d:%d\n",
+              segments[i].path, info->fpsNum, info->fpsDen,
+              segments[0].path, first->fpsNum, first->fpsDen);
+      retcode = 1;
+    } else if (info->start != (prev->start + prev->numFrames)) {
+      fprintf(stderr, "segment \"%s\" starts at frame %d but \"%s\" ends at frame %d\n",
+              segments[i].path, info->start,
+              segments[i-1].path, prev->start + prev->numFrames);
+      retcode = 1;
+    }
+  }
+
+  int fps = (retcode == 0) ? y4m_reader_fps_enum(segments[0].info.fpsNum, segments[0].info.fpsDen) : 0;
+
+  if (fps == -1) {
+    fprintf(stderr, "unsupported frame rate F%d:%d\n", segments[0].info.fpsNum, segments[0].info.fpsDen);
+    retcode = 1;
+  }
+
+  FILE *outFile = NULL;
+
+  if (retcode == 0) {
+    outFile = y4m_open_file(outPath);
+    if (outFile == NULL) {
+      retcode = 1;
+    } else if (strcmp(outPath, "-") == 0) {
+      // The summary line goes to stderr once the Y4M stream owns stdout
+      y4m_redirect_stdout();
+    }
+  }
+
+  if (retcode == 0) {
+    Y4MHeaderStruct header;
+
+    header.width = segments[0].info.width;
+    header.height = segments[0].info.height;
+    header.fps = fps;
+
+    retcode = y4m_write_header(outFile, &header);
+
+    if (retcode == 0 && fflush(outFile) != 0) {
+      retcode = 2;
+    }
+  }
+
+  int numFrames = 0;
+
+  for (int i = 0; i < numSegments && retcode == 0; i++) {
+    const MergeSegment *segment = &segments[i];
+    off_t len = segment->info.frameLen * segment->info.numFrames;
+
+    if (y4m_segment_splice(fileno(outFile), fileno(segment->inFile), segment->info.headerLen, len) != 0) {
+      fprintf(stderr, "could not copy frames from \"%s\"\n", segment->path);
+      retcode = 2;
+    }
+
+    numFrames += segment->info.numFrames;
+  }
+
+  for (int i = 0; i < numSegments; i++) {
+    if (segments[i].inFile != NULL) {
+      fclose(segments[i].inFile);
+    }
+  }
+
+  if (outFile != NULL && fclose(outFile) != 0 && retcode == 0) {
+    retcode = 2;
+  }
+
+  if (retcode == 0) {
+    fprintf(stdout, "wrote %s (%d frames from %d segments)\n",
+            outPath, numFrames, numSegments);
+  }
+
+  free(segments);
+
+  return retcode;
+}
@@ -0,0 +1,291 @@
+//
+//  y4m_metrics.c
+//
+//  Command line utility that scores a decoded BT.709 Y4M file
+//  against a reference. The reference is either another Y4M file
+//  or the original sRGB frames as a PAM/PPM stream or headerless
+//  BGRA frames. Per frame and aggregate PSNR, SSIM, and delta E
+//  are written to stdout.
+//
+//  This utility depends only on the C library and pthreads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "sRGB.h"
+#include "BT709.h"
+
+#include "bt709_frame.h"
+#include "bt709_metrics.h"
+#include "raw_frame_reader.h"
+#include "y4m_reader.h"
+
+static
+void usage() {
+  printf("y4m_metrics ?OPTIONS? REFERENCE DECODED.y4m\n");
+  printf("REFERENCE is REF.y4m, or source frames IN.pam|IN.ppm|IN.bgra\n");
+  printf("OPTIONS:\n");
+  printf("-gamma apple|srgb|linear (gamma of the Y4M data, default is apple)\n");
+  printf("-size WxH (dimensions of headerless BGRA source frames)\n");
+  printf("-threads N (default is the number of CPUs)\n");
+  printf("-quiet (print only the aggregate result)\n");
+  printf("-min-psnr DB (exit with status 1 when aggregate Y PSNR is lower)\n");
+  printf("-max-deltae E (exit with status 1 when mean delta E is larger)\n");
+}
+
+static
+int has_suffix(const char *str, const char *suffix) {
+  size_t len = strlen(str);
+  size_t suffixLen = strlen(suffix);
+  return (len >= suffixLen) && (strcmp(str + len - suffixLen, suffix) == 0);
+}
+
+static
+void print_result(const char *label, const BT709MetricsResult *result) {
+  printf("%s PSNR Y %.3f Cb %.3f Cr %.3f SSIM Y %.5f Cb %.5f Cr %.5f dE mean %.4f max %.4f\n",
+         label,
+         bt709_metrics_result_psnr(result, 0),
+         bt709_metrics_result_psnr(result, 1),
+         bt709_metrics_result_psnr(result, 2),
+         bt709_metrics_result_ssim(result, 0),
+         bt709_metrics_result_ssim(result, 1),
+         bt709_metrics_result_ssim(result, 2),
+         bt709_metrics_result_deltae(result),
+         result->deltaEMax);
+}
+
+int main(int argc, const char * argv[]) {
+  BT709Gamma gamma = BT709GammaApple;
+  int numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  int sizeWidth = 0;
+  int sizeHeight = 0;
+  int quiet = 0;
+  double minPsnr = -1.0;
+  double maxDeltaE = -1.0;
+  const char *refPath = NULL;
+  const char *decodedPath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+
+    if (arg[0] == '-' && arg[1] != '\0') {
+      if (strcmp(arg, "-quiet") == 0) {
+        quiet = 1;
+        continue;
+      }
+
+      if ((i + 1) >= argc) {
+        usage();
+        exit(3);
+      }
+
+      const char *value = argv[++i];
+
+      if (strcmp(arg, "-gamma") == 0) {
+        if (strcmp(value, "apple") == 0) {
+          gamma = BT709GammaApple;
+        } else if (strcmp(value, "srgb") == 0) {
+          gamma = BT709GammaSrgb;
+        } else if (strcmp(value, "linear") == 0) {
+          gamma = BT709GammaLinear;
+        } else {
+          printf("option -gamma unknown value \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-size") == 0) {
+        if (sscanf(value, "%dx%d", &sizeWidth, &sizeHeight) != 2 || sizeWidth <= 0 || sizeHeight <= 0) {
+          printf("option -size must be WxH but got \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-threads") == 0) {
+        numThreads = atoi(value);
+        if (numThreads < 1) {
+          printf("option -threads must be 1 or more but got \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-min-psnr") == 0) {
+        minPsnr = atof(value);
+      } else if (strcmp(arg, "-max-deltae") == 0) {
+        maxDeltaE = atof(value);
+      } else {
+        printf("unknown option \"%s\"\n", arg);
+        exit(3);
+      }
+    } else if (refPath == NULL) {
+      refPath = arg;
+    } else if (decodedPath == NULL) {
+      decodedPath = arg;
+    } else {
+      usage();
+      exit(3);
+    }
+  }
+
+  if (refPath == NULL || decodedPath == NULL) {
+    usage();
+    exit(3);
+  }
+
+  const int refIsY4m = has_suffix(refPath, ".y4m");
+
+  // Source frames are sRGB unless the Y4M data is linear, which
+  // matches the srgb_to_bt709 -gamma setting used to encode.
+
+  const BT709Gamma sourceGamma = (gamma == BT709GammaLinear) ? BT709GammaLinear : BT709GammaSrgb;
+
+  BT709MetricsTables tables;
+  bt709_metrics_tables_init(&tables, gamma, sourceGamma);
+
+  Y4MReader decodedReader;
+  Y4MReader refReader;
+  RawFrameReader rawReader;
+
+  memset(&refReader, 0, sizeof(refReader));
+  memset(&rawReader, 0, sizeof(rawReader));
+  rawReader.fd = -1;
+
+  int retcode = 0;
+
+  if (y4m_reader_open(&decodedReader, decodedPath) != 0) {
+    y4m_reader_close(&decodedReader);
+    return 1;
+  }
+
+  const int width = decodedReader.width;
+  const int height = decodedReader.height;
+
+  // Planes for source frames converted with the ideal encoder
+
+  BT709FrameTables encodeTables;
+  uint8_t *refPlanes = NULL;
+
+  if (refIsY4m) {
+    if (y4m_reader_open(&refReader, refPath) != 0) {
+      retcode = 1;
+    } else if (refReader.width != width || refReader.height != height) {
+      fprintf(stderr, "reference is %d x %d but decoded is %d x %d\n", refReader.width, refReader.height, width, height);
+      retcode = 1;
+    }
+  } else {
+    RawFrameFormat format = (sizeWidth > 0) ? RawFrameFormatBGRA : RawFrameFormatNetpbm;
+    if (raw_frame_reader_open(&rawReader, refPath, format, sizeWidth, sizeHeight) != 0) {
+      retcode = 1;
+    }
+    bt709_frame_tables_init(&encodeTables, sourceGamma, gamma);
+    refPlanes = (uint8_t *) malloc(width * height + 2 * ((width/2) * (height/2)));
+  }
+
+  BT709MetricsResult total;
+  memset(&total, 0, sizeof(total));
+
+  while (retcode == 0) {
+    int decodedResult = y4m_reader_next(&decodedReader);
+
+    BT709MetricsFrame refFrame;
+    memset(&refFrame, 0, sizeof(refFrame));
+    refFrame.planes.yBytesPerRow = width;
+    refFrame.planes.cbBytesPerRow = width / 2;
+    refFrame.planes.crBytesPerRow = width / 2;
+
+    int refResult;
+
+    if (refIsY4m) {
+      refResult = y4m_reader_next(&refReader);
+      refFrame.planes.yPtr = refReader.yPtr;
+      refFrame.planes.cbPtr = refReader.uPtr;
+      refFrame.planes.crPtr = refReader.vPtr;
+    } else {
+      const uint8_t *framePtr = NULL;
+      refResult = raw_frame_reader_next(&rawReader, &framePtr);
+
+      if (refResult == 0 && (rawReader.width != width || rawReader.height != height)) {
+        fprintf(stderr, "source is %d x %d but decoded is %d x %d\n", rawReader.width, rawReader.height, width, height);
+        retcode = 1;
+        break;
+      }
+
+      if (refResult == 0) {
+        refFrame.planes.yPtr = refPlanes;
+        refFrame.planes.cbPtr = refPlanes + (width * height);
+        refFrame.planes.crPtr = refFrame.planes.cbPtr + ((width/2) * (height/2));
+
+        refFrame.rgbPixels = framePtr;
+        refFrame.rgbBytesPerRow = width * rawReader.layout.bytesPerPixel;
+        refFrame.layout = rawReader.layout;
+
+        bt709_frame_encode(&encodeTables, &rawReader.layout, framePtr, refFrame.rgbBytesPerRow, width, height, &refFrame.planes);
+      }
+    }
+
+    if (decodedResult == 1 && refResult == 1) {
+      break;
+    }
+
+    if (decodedResult != 0 || refResult != 0) {
+      if (decodedResult == 1 || refResult == 1) {
+        fprintf(stderr, "reference and decoded inputs have a different number of frames\n");
+      }
+      retcode = 1;
+      break;
+    }
+
+    BT709MetricsFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.planes.yPtr = decodedReader.yPtr;
+    frame.planes.yBytesPerRow = width;
+    frame.planes.cbPtr = decodedReader.uPtr;
+    frame.planes.cbBytesPerRow = width / 2;
+    frame.planes.crPtr = decodedReader.vPtr;
+    frame.planes.crBytesPerRow = width / 2;
+
+    BT709MetricsResult result;
+    if (bt709_metrics_frame(&tables, &refFrame, &frame, width, height, numThreads, &result) != 0) {
+      fprintf(stderr, "could not score frame %d\n", decodedReader.frameNum - 1);
+      retcode = 2;
+      break;
+    }
+
+    if (!quiet) {
+      char label[32];
+      snprintf(label, sizeof(label), "frame %d", decodedReader.frameNum - 1);
+      print_result(label, &result);
+    }
+
+    bt709_metrics_accumulate(&total, &result);
+  }
+
+  y4m_reader_close(&decodedReader);
+  y4m_reader_close(&refReader);
+  raw_frame_reader_close(&rawReader);
+  free(refPlanes);
+
+  if (retcode != 0) {
+    return retcode;
+  }
+
+  if (total.numFrames == 0) {
+    fprintf(stderr, "no frames to compare\n");
+    return 1;
+  }
+
+  char label[32];
+  snprintf(label, sizeof(label), "total %d frames", total.numFrames);
+  print_result(label, &total);
+
+  if (minPsnr >= 0.0 && bt709_metrics_result_psnr(&total, 0) < minPsnr) {
+    printf("FAIL: Y PSNR %.3f is below %.3f\n", bt709_metrics_result_psnr(&total, 0), minPsnr);
+    return 1;
+  }
+
+  if (maxDeltaE >= 0.0 && bt709_metrics_result_deltae(&total) > maxDeltaE) {
+    printf("FAIL: mean delta E %.4f is above %.4f\n", bt709_metrics_result_deltae(&total), maxDeltaE);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,248 @@
+//
+//  y4m_stats.c
+//
+//  Command line utility that reports histograms and range
+//  statistics for 8 bit 4:2:0 Y Cb Cr frames, read from a Y4M
+//  file or headerless planar I420 frames. Per frame and aggregate
+//  min, max, mean, out of range codes, and chroma drift are written
+//  to stdout, so a conversion can be checked without printing
+//  values for each pixel.
+//
+//  This utility depends only on the C library and pthreads.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bt709_stats.h"
+#include "y4m_reader.h"
+
+static const char *planeNames[3] = { "Y", "Cb", "Cr" };
+
+static
+void usage() {
+  printf("y4m_stats ?OPTIONS? IN.y4m|IN.yuv\n");
+  printf("OPTIONS:\n");
+  printf("-size WxH (dimensions of headerless I420 frames)\n");
+  printf("-threads N (default is the number of CPUs)\n");
+  printf("-quiet (print only the aggregate result)\n");
+  printf("-histogram (print the aggregate histogram of each plane)\n");
+  printf("-max-out-of-range F (exit with status 1 when the fraction of out of range codes is larger)\n");
+}
+
+static
+void print_result(const char *label, const BT709StatsResult *result) {
+  printf("%s", label);
+
+  for (int pi = 0; pi < 3; pi++) {
+    uint64_t below, above;
+    bt709_stats_result_out_of_range(result, pi, &below, &above);
+
+    printf(" %s min %d max %d mean %.3f below %llu above %llu",
+           planeNames[pi],
+           bt709_stats_result_min(result, pi),
+           bt709_stats_result_max(result, pi),
+           bt709_stats_result_mean(result, pi),
+           (unsigned long long) below,
+           (unsigned long long) above);
+  }
+
+  printf(" drift Cb %.4f Cr %.4f\n",
+         bt709_stats_result_drift(result, 1),
+         bt709_stats_result_drift(result, 2));
+}
+
+static
+void print_histogram(const BT709StatsResult *result) {
+  for (int pi = 0; pi < 3; pi++) {
+    printf("histogram %s\n", planeNames[pi]);
+    for (int v = 0; v < 256; v++) {
+      if (result->histogram[pi][v] != 0) {
+        printf("%3d %llu\n", v, (unsigned long long) result->histogram[pi][v]);
+      }
+    }
+  }
+}
+
+int main(int argc, const char * argv[]) {
+  int numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  int sizeWidth = 0;
+  int sizeHeight = 0;
+  int quiet = 0;
+  int histogram = 0;
+  double maxOutOfRange = -1.0;
+  const char *inPath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+
+    if (arg[0] == '-' && arg[1] != '\0') {
+      if (strcmp(arg, "-quiet") == 0) {
+        quiet = 1;
+        continue;
+      }
+      if (strcmp(arg, "-histogram") == 0) {
+        histogram = 1;
+        continue;
+      }
+
+      if ((i + 1) >= argc) {
+        usage();
+        exit(3);
+      }
+
+      const char *value = argv[++i];
+
+      if (strcmp(arg, "-size") == 0) {
+        if (sscanf(value, "%dx%d", &sizeWidth, &sizeHeight) != 2 || sizeWidth <= 0 || sizeHeight <= 0 ||
+            (sizeWidth % 2) != 0 || (sizeHeight % 2) != 0) {
+          printf("option -size must be WxH with even dimensions but got \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-threads") == 0) {
+        numThreads = atoi(value);
+        if (numThreads < 1) {
+          printf("option -threads must be 1 or more but got \"%s\"\n", value);
+          exit(3);
+        }
+      } else if (strcmp(arg, "-max-out-of-range") == 0) {
+        maxOutOfRange = atof(value);
+      } else {
+        printf("unknown option \"%s\"\n", arg);
+        exit(3);
+      }
+    } else if (inPath == NULL) {
+      inPath = arg;
+    } else {
+      usage();
+      exit(3);
+    }
+  }
+
+  if (inPath == NULL) {
+    usage();
+    exit(3);
+  }
+
+  // Headerless frames are read into the same buffer layout as
+  // the Y4M reader uses, Y then Cb then Cr.
+
+  Y4MReader reader;
+  memset(&reader, 0, sizeof(reader));
+
+  const int isRaw = (sizeWidth > 0);
+
+  if (isRaw) {
+    reader.inFile = (strcmp(inPath, "-") == 0) ? stdin : fopen(inPath, "rb");
+    if (reader.inFile == NULL) {
+      fprintf(stderr, "could not open input file \"%s\"\n", inPath);
+      return 1;
+    }
+    reader.width = sizeWidth;
+    reader.height = sizeHeight;
+    reader.yLen = sizeWidth * sizeHeight;
+    reader.uvLen = (sizeWidth / 2) * (sizeHeight / 2);
+    reader.yPtr = (uint8_t *) malloc(reader.yLen + 2 * reader.uvLen);
+    reader.uPtr = reader.yPtr + reader.yLen;
+    reader.vPtr = reader.uPtr + reader.uvLen;
+  } else if (y4m_reader_open(&reader, inPath) != 0) {
+    y4m_reader_close(&reader);
+    return 1;
+  }
+
+  const int width = reader.width;
+  const int height = reader.height;
+  const size_t frameLen = reader.yLen + 2 * (size_t) reader.uvLen;
+
+  BT709PlanesStruct planes;
+  planes.yPtr = reader.yPtr;
+  planes.yBytesPerRow = width;
+  planes.cbPtr = reader.uPtr;
+  planes.cbBytesPerRow = width / 2;
+  planes.crPtr = reader.vPtr;
+  planes.crBytesPerRow = width / 2;
+
+  BT709StatsResult *total = (BT709StatsResult *) calloc(1, sizeof(BT709StatsResult));
+  BT709StatsResult *result = (BT709StatsResult *) malloc(sizeof(BT709StatsResult));
+
+  int retcode = 0;
+  int frameNum = 0;
+
+  while (1) {
+    if (isRaw) {
+      size_t numRead = fread(reader.yPtr, 1, frameLen, reader.inFile);
+      if (numRead == 0 && feof(reader.inFile)) {
+        break;
+      }
+      if (numRead != frameLen) {
+        fprintf(stderr, "input truncated in frame %d\n", frameNum);
+        retcode = 1;
+        break;
+      }
+    } else {
+      int readResult = y4m_reader_next(&reader);
+      if (readResult == 1) {
+        break;
+      } else if (readResult != 0) {
+        retcode = 1;
+        break;
+      }
+    }
+
+    if (bt709_stats_frame(&planes, width, height, numThreads, result) != 0) {
+      fprintf(stderr, "could not count frame %d\n", frameNum);
+      retcode = 1;
+      break;
+    }
+
+    if (!quiet) {
+      char label[32];
+      snprintf(label, sizeof(label), "frame %d", frameNum);
+      print_result(label, result);
+    }
+
+    bt709_stats_accumulate(total, result);
+    frameNum += 1;
+  }
+
+  y4m_reader_close(&reader);
+
+  if (retcode == 0 && total->numFrames == 0) {
+    fprintf(stderr, "no frames in input\n");
+    retcode = 1;
+  }
+
+  if (retcode == 0) {
+    char label[32];
+    snprintf(label, sizeof(label), "total %d frames", total->numFrames);
+    print_result(label, total);
+
+    if (histogram) {
+      print_histogram(total);
+    }
+
+    if (maxOutOfRange >= 0.0) {
+      uint64_t numOut = 0;
+      uint64_t numSamples = 0;
+      for (int pi = 0; pi < 3; pi++) {
+        uint64_t below, above;
+        bt709_stats_result_out_of_range(total, pi, &below, &above);
+        numOut += below + above;
+        numSamples += total->numSamples[pi];
+      }
+
+      double fraction = (double) numOut / numSamples;
+      if (fraction > maxOutOfRange) {
+        printf("FAIL: out of range fraction %.6f is above %.6f\n", fraction, maxOutOfRange);
+        retcode = 1;
+      }
+    }
+  }
+
+  free(total);
+  free(result);
+
+  return retcode;
+}